@@ -12,6 +12,10 @@
 #include "ScanAddOnProto.h"
 #include <stdlib.h>
 
+/* The optional hooks this add-on implements, see scan_ext_hooks. */
+static status_t scn_acquire_data( void *cookie, const void **rows, int32 *count );
+static status_t scn_release_data( void *cookie, const void *rows );
+
 #define kVersionMajor	0
 #define kVersionMinor	9
 #define kVersionIncr	0
@@ -24,8 +28,13 @@ typedef struct {
 	uint32			total_bytes;
 	uint32			byte_count;
 	uint32			row_bytes;
+	char			*band;			/* transfer buffer lent by scn_acquire_data() */
+	int32			band_size;
 } my_cookie;
 
+/* Size of the band handed out when the app lets the add-on choose. */
+#define kBandSize	( 64 * 1024L )
+
 static const char *my_scanner_name[] = {
 	"application/x-vnd.jbm-myscanner",
 	"ScannerBe Sample Add-on  (Jim Moy v0.9)",
@@ -46,6 +55,21 @@ static scan_hooks my_scanner_hooks = {
 	scn_error_message
 };
 
+/* Optional: lets libscanbe borrow your transfer buffer in scan_data_ex()
+	instead of having you copy into the app's, move all the settings
+	in one call if your scanner can, break out of a long wait when the
+	app cancels, and say how big your data calls like to be. Leave
+	find_scanner_ext() out altogether if you don't need any of these. */
+static scan_ext_hooks my_scanner_ext_hooks = {
+	sizeof( scan_ext_hooks ),
+	scn_acquire_data,
+	scn_release_data,
+	NULL,		/* get_settings, if your scanner can report them all at once */
+	NULL,		/* put_settings */
+	NULL,		/* cancel, to stop waiting for the user or the device */
+	NULL		/* get_transfer_info, if 64K bands don't suit the device */
+};
+
 const char **
 publish_scanners()
 {
@@ -58,6 +82,12 @@ find_scanner(const char *name)
 	return &my_scanner_hooks;
 }
 
+scan_ext_hooks *
+find_scanner_ext(const char *name)
+{
+	return &my_scanner_ext_hooks;
+}
+
 static status_t scn_open( scan_version *version, void  **cookie )
 {
 	status_t status = B_OK;
@@ -68,6 +98,8 @@ static status_t scn_open( scan_version *version, void  **cookie )
 	goodie->first_time_flag = TRUE;
 	goodie->total_bytes = 0;
 	goodie->byte_count = 0;
+	goodie->band = NULL;
+	goodie->band_size = 0;
 	*cookie = goodie;
 	version->major = kVersionMajor;
 	version->minor = kVersionMinor;
@@ -78,6 +110,7 @@ static status_t scn_open( scan_version *version, void  **cookie )
 static status_t scn_close( void *cookie )
 {
 	my_cookie *goodie = (my_cookie *) cookie;
+	free( goodie->band );
 	free( goodie );
 	return B_OK;
 }
@@ -211,6 +244,10 @@ static status_t scn_open_image( void *cookie )
 
 static status_t scn_close_image( void *cookie )
 {
+	my_cookie *goodie = (my_cookie *) cookie;
+	free( goodie->band );
+	goodie->band = NULL;
+	goodie->band_size = 0;
 	return B_OK;
 }
 
@@ -252,6 +289,35 @@ static status_t scn_data( void *cookie , void* buffer, int32* count )
 	return SCAN_ERROR;
 }
 
+static status_t scn_acquire_data( void *cookie, const void **rows, int32 *count )
+{
+	my_cookie *goodie = (my_cookie *) cookie;
+	int32 want = *count > 0 ? *count : kBandSize;
+	status_t status;
+	
+	/* Keep one band around and scan straight into it. If your device
+		DMAs into a buffer of its own, point *rows at that instead. */
+	if( want > goodie->band_size ) {
+		free( goodie->band );
+		goodie->band = (char *) malloc( want );
+		if( ! goodie->band ) {
+			goodie->band_size = 0;
+			return B_NO_MEMORY;
+		}
+		goodie->band_size = want;
+	}
+	*count = want;
+	status = scn_data( cookie, goodie->band, count );
+	*rows = goodie->band;
+	return status;
+}
+
+static status_t scn_release_data( void *cookie, const void *rows )
+{
+	/* The band is reused on the next call, nothing to do. */
+	return B_OK;
+}
+
 bool scn_adf_ready( void *cookie )
 {
 	return false;
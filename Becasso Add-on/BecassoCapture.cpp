@@ -2,34 +2,31 @@
 
 #include "BecassoAddOn.h"
 #include "ScanGlue.h"
+#include "ScanAsync.h"
 #include <Application.h>
 #include <string.h>
 #include <stdio.h>
 
 #pragma export on
 
-const uint32 kTriggerScan = 'trig';
-
 // The interesting part about this add-on is that Becasso wants to be
 // informed of when an image is ready; it doesn't call and wait for
 // an image like is most natural in the ScannerBe interface. To work
 // in this manner, we put the ScannerBe add-on in a perpetual state of
 // readiness, i.e., as soon as an image is delivered by the add-on
-// we immediately call scan_start() again, waiting for the indication
-// that we can get the image. The ClickWatcher class handles this
-// interaction.
-class ClickWatcher : public BLooper {
-public:
-virtual void	MessageReceived( BMessage *msg );
-};
+// we submit another scan_start() request, and it tells Becasso when
+// the user has clicked scan. The request waits for the click on a
+// thread of libscanbe's, and can be cancelled when Becasso is done
+// with us.
 
 static bool				gBeScanOpen = false;
-static bool				gScanStartFailed = false;
 static scan_id			gScanID = 0;
-static ClickWatcher		*gClickWatch = NULL;
+static scan_request		*gStartRequest = NULL;
 static uint32			gIndex;
 
 void do_close();
+static void wait_for_click();
+static void click_done( void *data, status_t status );
 
 int addon_init (uint32 index, becasso_addon_info *info)
 {
@@ -45,9 +42,6 @@ int addon_init (uint32 index, becasso_addon_info *info)
 	info->becasso_release	= 0;
 	info->does_preview		= true;
 	gIndex = index;
-	gScanStartFailed = false;
-	gClickWatch = new ClickWatcher;
-	gClickWatch->Run();
 	return (0);
 }
 
@@ -55,16 +49,13 @@ void do_close()
 {
 	status_t status = B_OK;
 	
-	// Break us out of any pending scan_start() call. If the ScannerBe
-	// add-on decides to quit and return an error from scan_start(), e.g.,
-	// if a cancel button on the UI is clicked, then scan_start() will
-	// have returned an error, and we don't need to cancel it. If we
-	// are still waiting on scan_start() in the ScannerBe add-on, and
-	// want to shutdown the Becasso add-on (when Becasso quits) then
-	// we have to shut it down here to allow it to clean up.
-	if( gBeScanOpen && ( ! gScanStartFailed ) ) {
-		status = scan_close_image( gScanID );
-	}
+	// Break us out of any pending scan_start(). If the ScannerBe add-on
+	// has already returned from it, e.g., if a cancel button on the UI
+	// was clicked, the request is done and cancelling does nothing. An
+	// add-on that can't cancel is broken out by closing the session, so
+	// the request is only waited for after that.
+	if( gStartRequest )
+		scan_request_cancel( gStartRequest );
 	
 	if( gBeScanOpen && ( gScanID != 0 ) ) {
 		status = scan_close( gScanID );
@@ -72,9 +63,9 @@ void do_close()
 		gScanID = 0;
 	}
 	
-	if( gClickWatch ) {
-		gClickWatch->PostMessage( B_QUIT_REQUESTED );
-		gClickWatch = NULL;
+	if( gStartRequest ) {
+		scan_request_delete( gStartRequest );
+		gStartRequest = NULL;
 	}
 }
 
@@ -98,7 +89,8 @@ int addon_open (BWindow *, const char *)
 	if( status != B_OK )
 		return B_ERROR;
 
-	gClickWatch->PostMessage( kTriggerScan );
+	if( ! gStartRequest )
+		wait_for_click();
 		
 	return B_OK;
 }
@@ -114,37 +106,42 @@ BBitmap *bitmap (char *title)
 	strcpy (title, "Scanned Image");
 	status_t status = B_OK;
 	
+	// the start request told Becasso to call us, so it's done
+	if( gStartRequest ) {
+		scan_request_delete( gStartRequest );
+		gStartRequest = NULL;
+	}
+	
 	// get an image from the ScannerBe add-on
 	BBitmap *bitmap = GetNextScannerImage( gScanID, status );
 	
 	// get ready for another scan
-	gClickWatch->PostMessage( kTriggerScan );
+	wait_for_click();
 
 	return bitmap;
 }
 
 #pragma export off
 
-void ClickWatcher::MessageReceived( BMessage *msg )
+static void wait_for_click()
 {
-	if( msg->what != kTriggerScan ) {
-		BLooper::MessageReceived( msg );
-		return;
-	}
-
-	status_t status = B_OK;
-	status = scan_start( gScanID );
-	if( status == B_OK ) {
-		BMessage msg( CAPTURE_READY );
-		status = msg.AddInt32( "index", gIndex );
-		if( status == B_OK )
-			be_app->PostMessage( &msg );
-	} else {
-		// Failed scan_start(), which in this case the UI is
-		// no longer ready to start a scan, so indicate that
-		// to addon_exit() that we don't need to cancel out of
-		// a pending scan_start().
-		gScanStartFailed = true;
-	}
+	scan_request_sink sink;
+	memset( &sink, 0, sizeof( sink ) );
+	sink.done = click_done;
+	sink.port = -1;
+	if( scan_submit( gScanID, SCAN_REQUEST_START, &sink, &gStartRequest ) != B_OK )
+		gStartRequest = NULL;
 }
 
+// Called on the request's thread once scan_start() returns. If it
+// failed, the UI is no longer ready to start a scan, and Becasso just
+// never hears from us.
+static void click_done( void *data, status_t status )
+{
+	if( status != B_OK )
+		return;
+	BMessage msg( CAPTURE_READY );
+	status = msg.AddInt32( "index", gIndex );
+	if( status == B_OK )
+		be_app->PostMessage( &msg );
+}
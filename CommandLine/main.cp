@@ -1,19 +1,15 @@
 /* ScannerBe sample code. Copyright © Jim Moy, 1997, All rights reserved. */
 
 #include "ScannerBe.h"
-#include "Datatypes.h"
+#include "ScanChunk.h"
+#include "ScanWriter.h"
 #include <Application.h>
 #include <Directory.h>
 #include <Errors.h>
-#include <File.h>
 #include <Path.h>
 #include <stdio.h>
 #include <stdlib.h>
 
-// some buffers for image data
-const int32 kBufSize = 16 * 1024L;
-char gScanBuf[ kBufSize ];
-char gRowBuf[ kBufSize ];
 scan_id gScanID;
 
 const char *kSig = "application/x-vnd.jbm-scandemo";
@@ -25,7 +21,6 @@ public:
 					ScanApp() : BApplication( kSig ) { Run(); }
 virtual void		ReadyToRun();
 		void		do_scan();
-		status_t	write_buffer( FILE*, void*, int32, scan_settings&, DATABitmap& );
 };
 
 void main() { ScanApp app; }
@@ -35,11 +30,6 @@ void main() { ScanApp app; }
 
 void ScanApp::ReadyToRun()
 {
-	if( DATAInit( kSig ) != B_OK ) {
-		fprintf( stderr, "Couldn't init Datatypes\n" );
-		return;
-	}
-	
 	// Before doing the scan_open() call, you might want to do some version
 	// checking with scan_get_version(). Also, if you're doing to be
 	// selecting a scanner with no user interaction, you should probably
@@ -50,7 +40,6 @@ void ScanApp::ReadyToRun()
 	printf( "opening scanner: %s\n", scannerName );
 	status_t status = scan_open( scannerName, &gScanID, &version );
 	if( status != B_OK ) {
-		DATAShutdown();
 		fprintf( stderr, "Couldn't open scanner: %s\n", scannerName );
 		return;
 	}
@@ -61,7 +50,6 @@ void ScanApp::ReadyToRun()
 	if( status != B_OK )
 		fprintf( stderr, "Did not complete the scan (0x%X)\n", status );
 	
-	DATAShutdown();
 	PostMessage( B_QUIT_REQUESTED );
 }
 
@@ -74,6 +62,7 @@ void ScanApp::do_scan()
 	// demo, I'm going to ask the scanner for the current settings, then
 	// just modifiy a few before sending it back.
 	scan_settings settings;
+	scan_value value;
 	status = scan_get_settings( gScanID, &settings, NULL, NULL );
 	if( status != B_OK ) {
 		fprintf( stderr, "Couldn't get scanner settings (0x%X)\n", status );
@@ -82,10 +71,15 @@ void ScanApp::do_scan()
 	
 	printf( "putting back modified settings\n" );
 	// For this demo, use the default full-page scan, but make
-	// it low resolution and color.
+	// it low resolution and color. Keep all 16 bits a sample if the
+	// scanner has them, the TIFF writer stores them as they are.
 	settings.resolution = 72;
 	settings.image_type = SCAN_TYPE_RGB;
 	settings.pixel_bits = 24;
+	status = scan_get_one_setting( gScanID, SCAN_SETTING_PIXELBITS,
+							SCAN_SETTING_MAXIMUM, &value );
+	if( status == B_OK && value.u_int >= 48 )
+		settings.pixel_bits = 48;
 	scan_settings_mask mask;
 	status = scan_put_settings( gScanID, &settings, &mask );
 	if( status != B_OK ) {
@@ -102,7 +96,6 @@ void ScanApp::do_scan()
 	// update rate on some indicators while talking to some, uh, low-cost processor
 	// inside a scanner.
 	printf( "querying image size\n" );
-	scan_value value;
 	status = scan_get_one_setting( gScanID, SCAN_SETTING_WIDTH,
 							SCAN_SETTING_CURRENT, &value );
 	settings.pixel_width = value.u_int;
@@ -125,34 +118,35 @@ void ScanApp::do_scan()
 		return;
 	}
 
-	// Set up the Datatypes header.
-	DATABitmap dmap;
-	dmap.magic = DATA_BITMAP;
-	dmap.bounds.Set( 0, 0,
-		settings.pixel_width -1, settings.pixel_height - 1 );
-	dmap.colors = B_RGB_32_BIT;
-	dmap.rowBytes = settings.row_bytes * 4 / 3;
-	int32 width = dmap.bounds.IntegerWidth();
-	dmap.dataSize = ( dmap.bounds.IntegerHeight() + 1 ) * dmap.rowBytes;
-	
-	// We'll write it to a temporary file, then hand it off to the
-	// Datatypes library to convert the image.
-	char tmpPath[256];
-	tmpnam( tmpPath );
-	FILE *fp = fopen( tmpPath, "w+b" );
-	if( ! fp ) {
-		fprintf( stderr, "Couldn't open the temporary file\n", status );
+	// Just drop the file in the app's directory.
+	app_info info;
+	status = be_roster->GetAppInfo( kSig, &info );
+	BEntry entry( &info.ref );
+	BDirectory dir;
+	status_t ioErr = entry.GetParent( &dir );
+	if( ( status != B_OK ) || ( entry.InitCheck() != B_OK ) || ( ioErr != B_OK ) ) {
+		fprintf( stderr, "Couldn't get app directory\n" );
 		return;
 	}
+	bool deep = ( settings.pixel_bits == 48 );
+	BPath path( &dir, deep ? "scanned_image.tif" : "scanned_image.tga" );
 	
-	// Datatypes header.
-	int32 count = fwrite( &dmap, 1, sizeof( DATABitmap ), fp );
-	if( count <= 0 ) {
-		fprintf( stderr, "Couldn't write the DATABitmap header (0x%X)\n", status );
-		fclose( fp );
+	// The writer encodes the file as the rows come in from the
+	// scanner, so the image only goes to disk once.
+	scan_writer *writer;
+	status = scan_writer_open( path.Path(), deep ? SCAN_FORMAT_TIFF : SCAN_FORMAT_TGA,
+							&settings, &writer );
+	if( status != B_OK ) {
+		fprintf( stderr, "Couldn't open %s (0x%X)\n", path.Path(), status );
 		return;
 	}
 
+	// Have libscanbe keep the scanner busy reading the next few buffers
+	// while we're writing this one. It's only an optimization, so if it
+	// can't be done we just scan without it. A band size of 0 lets the
+	// scanner pick.
+	scan_set_readahead( gScanID, 4, 0 );
+
 	printf( "writing image to file\n" );
 	// Since we're doing this "non-interactive," we don't have to call
 	// scan_start() and can just blow by it and proceed directly to scanning.
@@ -160,120 +154,71 @@ void ScanApp::do_scan()
 	status = scan_open_image( gScanID );
 	if( status != B_OK ) {
 		fprintf( stderr, "Couldn't open the image (0x%X)\n", status );
+		scan_writer_abort( writer );
+		return;
+	}
+	
+	// Rather than guess at a buffer size, let the chunk reader find the
+	// one the scanner goes fastest with. It lends us the data, so there's
+	// no buffer of our own at all.
+	scan_chunk_reader *reader;
+	status = scan_chunk_open( gScanID, 0, &reader );
+	if( status != B_OK ) {
+		fprintf( stderr, "Couldn't read the image (0x%X)\n", status );
+		scan_close_image( gScanID );
+		scan_writer_abort( writer );
 		return;
 	}
 	
-	// Main scanning loop. Get a buffer at a time and do the padding
-	// conversion required by Datatypes.
+	// Main scanning loop. Get a chunk at a time and hand it to the writer.
+	const void *rows;
+	int32 count;
 	for( bool notDone = true; notDone; ) {
-		count = kBufSize;
-		
-		// scan data into gScanBuf, get the number of bytes scanned back in count
-		status = scan_data( gScanID, gScanBuf, &count );
+		// get the next chunk, and the number of bytes in it back in count
+		status = scan_chunk_read( reader, &rows, &count );
 		
 		if( status != B_OK ) {
 			// if we've reached the end of the scan, we get back SCANNER_DATA_END
 			if( status == SCAN_DATA_END )
 				status = B_OK;
-			else				
-				scan_close_image( gScanID );			// some other scanner error
 			notDone = false;
 		}
 		
 		if( status == B_OK && count > 0 ) {
 			// As required by scan_data(), this will always come out to
 			// be an integral number of lines.
-			int32 lines = count / settings.row_bytes;
-			// Write a buffer at a time out to the tmp file.
-			if( write_buffer( fp, gScanBuf, lines, settings, dmap ) != B_OK ) {
+			status = scan_writer_write( writer, rows, count );
+			if( status != B_OK ) {
+				fprintf( stderr, "Couldn't write the image (0x%X)\n", status );
 				notDone = false;
-				scan_close_image( gScanID );
 			}
 		}
 		
 		// Do other things in the scan loop, like check for user
 		// cancellation of the scan, etc.
 	}
+	scan_chunk_close( reader );
+	
+	if( status != B_OK ) {
+		scan_close_image( gScanID );
+		scan_writer_abort( writer );
+		return;
+	}
 
 	status = scan_close_image( gScanID );
 	if( status != B_OK ) {
 		fprintf( stderr, "Couldn't close the image (0x%X)\n", status );
+		scan_writer_abort( writer );
 		return;
 	}
 	
 	// We're all done scanning!
-	fclose( fp );
-	
-	// Now do the Datatypes conversion,
-	// just drop the file in the app's directory.
-	BFile inFile( tmpPath, B_READ_ONLY );
-	status_t ioErr = inFile.InitCheck();
-	if( ioErr != B_OK ) {
-		fprintf( stderr, "Couldn't open %s\n", tmpPath );
-		remove( tmpPath );
-		return;
-	}
-	app_info info;
-	status = be_roster->GetAppInfo( kSig, &info );
-	BEntry entry( &info.ref );
-	BDirectory dir;
-	ioErr = entry.GetParent( &dir );
-	if( ( status != B_OK ) || ( entry.InitCheck() != B_OK ) || ( ioErr != B_OK ) ) {
-		fprintf( stderr, "Couldn't get app directory\n" );
-		return;
-	}
-	const char *fileName = "scanned_image.tga";
-	BFile outFile( &dir, fileName, B_READ_WRITE | B_CREATE_FILE | B_ERASE_FILE );
-	ioErr = outFile.InitCheck();
-	if( ioErr != B_OK ) {
-		BPath p( &dir, fileName );
-		fprintf( stderr, "Couldn't open %s\n", p.Path() );
-		remove( tmpPath );
-		return;
-	}
-	printf( "doing Datatypes conversion\n" );
-	status = DATATranslate( inFile, NULL, NULL, outFile, 'TGA ' );
+	status = scan_writer_close( writer );
 	if( status != B_OK )
-		fprintf( stderr, "DATATranslate() failed (0x%X)\n", status );
+		fprintf( stderr, "Couldn't finish writing %s (0x%X)\n", path.Path(), status );
 	
 	// There. Now we have a nice, plain RGB image with linear data from
 	// the scanner at whatever default tonemap it had setup inside it.
-	// Should be able to just open it and RRaster will use the same
-	// translator to show it to you. Clean up the tmp file that had
-	// DATABitmap data in it.
-	remove( tmpPath );
+	// Should be able to just open it and RRaster will show it to you.
 	printf( "done\n" );
 }
-
-// Pad the RGB data so it'll stream into Datatypes.
-
-status_t ScanApp::write_buffer( FILE *fp, void *buf, int32 lines,
-								scan_settings &settings, DATABitmap &dmap )
-{
-	status_t status = B_OK;
-	int32 writeCount = 0;
-	char *rowPtr = (char *) buf;
-	char *ptr = rowPtr;
-	char *dest = NULL;
-	
-	for( int32 i = 0; ( i < lines ) && ( status == B_OK ); i++ ) {
-		dest = gRowBuf;
-		// Datatypes manual disagrees with BGRA format, bit BBitmap doc is right.
-		for( int32 j = 0; j < settings.pixel_width; j++ ) {
-			// (make your processing loop faster than this one...)
-			*dest++ = *(ptr+2);
-			*dest++ = *(ptr+1);
-			*dest++ = *ptr;
-			*dest++ = 0;
-			ptr += 3;
-		}
-		writeCount = fwrite( gRowBuf, 1, dmap.rowBytes, fp );
-		if( writeCount <= 0 )
-			status = B_FILE_ERROR;
-		// next row
-		rowPtr += settings.row_bytes;
-		ptr = rowPtr;
-	}
-	return status;
-}
-
@@ -1,6 +1,8 @@
 /* ScannerBe sample code. Copyright © Jim Moy, 1997, All rights reserved. */
 
 #include "ScannerBe.h"
+#include "ScanConvert.h"
+#include "ScanPreview.h"
 #include <Application.h>
 #include <Bitmap.h>
 #include <Window.h>
@@ -16,8 +18,14 @@ public:
 					ScanView( BRect rect );
 virtual	void		Draw( BRect updateRect );
 virtual void		MouseDown( BPoint where );
+		void		begin_preview( const scan_preview_info *info );
+		void		preview_rows( int32 first_row, const void *rows,
+								int32 row_count );
 
 		BBitmap*	_bitmap;
+		BBitmap*	_preview;			// shown while _bitmap is scanned
+		BBitmap*	_spare;				// the last scan's, for the next if it fits
+		scan_type	_previewType;
 };
 
 class ScanWindow : public BWindow {
@@ -38,6 +46,10 @@ public:
 
 void main() { ScanApp app; app.Run(); }
 
+static status_t preview_begin( void *data, const scan_preview_info *info );
+static status_t preview_rows( void *data, int32 first_row, const void *rows,
+								int32 row_count );
+
 #pragma mark ---- Functions ----
 
 ScanApp::ScanApp() : BApplication( kSig )
@@ -64,8 +76,10 @@ void ScanWindow::scan()
 {
 	status_t status = B_OK;
 	scan_id id;
-	const int32 kBufSize = 16 * 1024L;
-	char *scanBuf = new char[ kBufSize ];
+	int32 bufSize = 0;
+	char *scanBuf = NULL;
+	scan_preview *preview = NULL;
+	char *deepRow = NULL;
 	
 	scan_version version;
 	status = scan_open( NULL, &id, &version );
@@ -102,25 +116,57 @@ void ScanWindow::scan()
 		goto errXit;
 	}
 	
-	// This demo app only handles gray & color images, one byte per sample,
-	// but this is where you'd handle the threshold case and possibly handle
-	// deeper than 24-bit color, etc.
+	// This demo app only handles gray & color images, one or two bytes per
+	// sample, but this is where you'd handle the threshold case, etc.
 	if( ( settings.image_type != SCAN_TYPE_RGB ) &&
 			( settings.image_type != SCAN_TYPE_GRAY ) ) {
 		fprintf( stderr, "Sorry, this app only handles gray or color data.\n" );
 		goto errXit;
 	}
 	
+	// Ask for the data in the size the scanner likes best: a small buffer
+	// on a big page means thousands of trips to the scanner.
+	scan_transfer_info transfer;
+	transfer.size = sizeof( transfer );
+	bufSize = 64 * 1024L;
+	if( scan_get_transfer_info( id, &transfer ) == B_OK )
+		bufSize = transfer.preferred;
+	scanBuf = new char[ bufSize ];
+	
 	// Make the bitmap that we're going to draw.
 	BRect bitmapRect(  0, 0, settings.pixel_width - 1, settings.pixel_height - 1 );
 	color_space space = B_RGB_32_BIT;
-	BBitmap *bitmap = new BBitmap( bitmapRect, space ) ;
+	// Scanning the same page size again is the usual thing, so reuse the
+	// last scan's bitmap rather than allocate and fault in a new one.
+	BBitmap *bitmap = _view->_spare;
+	_view->_spare = NULL;
+	if( ! bitmap || bitmap->Bounds() != bitmapRect ) {
+		delete bitmap;
+		bitmap = new BBitmap( bitmapRect, space ) ;
+	}
 	int32 bitmapSize = bitmap->BitsLength();
 	
+	// A 600 dpi page takes a while, so show it shrunk to the window as it
+	// comes in. libscanbe averages the rows down and hands us a few at a
+	// time; without this the window stays blank until the end.
+	scan_preview_sink sink;
+	sink.begin = preview_begin;
+	sink.rows = preview_rows;
+	sink.data = _view;
+	if( scan_preview_open( &settings, _view->Bounds().IntegerWidth() + 1, 8,
+							&sink, &preview ) != B_OK )
+		preview = NULL;
+	
+	// 16-bit samples are dithered down a row at a time, the bitmap only
+	// holds 8.
+	int32 channels = ( settings.image_type == SCAN_TYPE_RGB ) ? 3 : 1;
+	if( settings.pixel_bits == 16 || settings.pixel_bits == 48 )
+		deepRow = new char[ settings.pixel_width * channels ];
+	
 	// Do the scan loop, filling in the bitmap as we go.
 	int32 offset = 0, count;
 	for( bool notDone = true; notDone; ) {
-		count = kBufSize;
+		count = bufSize;
 		
 		// scan data into scanBuf, get the number of bytes scanned back in count
 		status = scan_data( id, scanBuf, &count );
@@ -135,23 +181,26 @@ void ScanWindow::scan()
 		}
 		
 		if( status == B_OK && count > 0 ) {
-			if( settings.image_type == SCAN_TYPE_RGB ) {
-				bitmap->SetBits( scanBuf, count, offset, space );
-				offset += count * 4 / 3;
-			} else {
-				// scanner only does gray, but BBitmaps only do RGB
-				char *ptr = (char *) scanBuf;
-				char *dest = (char *) bitmap->Bits();
-				dest += offset;
-				for( int32 i = 0; i < count; i++, ptr++ ) {
-					// (do your processing faster than this...)
-					*dest++ = *ptr;		// B
-					*dest++ = *ptr;		// G
-					*dest++ = *ptr;		// R
-					*dest++ = 0;		// A
+			// The scanner's rows and the bitmap's may both be padded, so
+			// go a row at a time, each to its own BytesPerRow().
+			const char *row = scanBuf;
+			for( int32 n = count / settings.row_bytes; n > 0; n-- ) {
+				char *dest = (char *) bitmap->Bits() + offset;
+				const char *src = row;
+				if( deepRow ) {
+					scan_convert_16_to_8_dither( row, deepRow, settings.pixel_width,
+												channels, offset / bitmap->BytesPerRow() );
+					src = deepRow;
 				}
-				offset += count * 4;
+				if( channels == 3 )
+					scan_convert_rgb24_to_bgra32( src, dest, settings.pixel_width, 0 );
+				else	// scanner only does gray, but BBitmaps only do RGB
+					scan_convert_gray8_to_bgra32( src, dest, settings.pixel_width, 0 );
+				row += settings.row_bytes;
+				offset += bitmap->BytesPerRow();
 			}
+			if( preview )
+				scan_preview_write( preview, scanBuf, count );
 		}
 		
 		// Do other things in the scan loop, like check for user
@@ -163,6 +212,9 @@ void ScanWindow::scan()
 		fprintf( stderr, "Did not close the image (0x%X)\n", status );
 
 errXit:
+	if( preview )
+		scan_preview_close( preview );
+	delete[] deepRow;
 	delete[] scanBuf;
 	status = scan_close( id );
 	// At this point we're done using id, it doesn't mean anything any more.
@@ -178,12 +230,16 @@ errXit:
 ScanView::ScanView( BRect frame ) : BView( frame, "", B_FOLLOW_ALL, B_WILL_DRAW )
 {
 	_bitmap = NULL;
+	_preview = NULL;
+	_spare = NULL;
 }
 
 void ScanView::Draw( BRect updateRect )
 {
 	if( _bitmap )
 		DrawBitmap( _bitmap, BPoint( 0, 0 ) );
+	else if( _preview )
+		DrawBitmap( _preview, BPoint( 0, 0 ) );
 	else
 		DrawString( "Click here to scan.", BPoint( 20, 40 ) );
 }
@@ -191,9 +247,56 @@ void ScanView::Draw( BRect updateRect )
 void ScanView::MouseDown( BPoint where )
 {
 	// Every time someone clicks in the window, a new scan is invoked.
-	delete _bitmap;
+	delete _spare;
+	_spare = _bitmap;
 	_bitmap = NULL;
 	((ScanWindow *) Window() )->scan();
+	delete _preview;
+	_preview = NULL;
 	Window()->Activate();
 }
 
+void ScanView::begin_preview( const scan_preview_info *info )
+{
+	delete _preview;
+	BRect rect( 0, 0, info->width - 1, info->height - 1 );
+	_preview = new BBitmap( rect, B_RGB_32_BIT );
+	_previewType = info->image_type;
+	FillRect( Bounds(), B_SOLID_LOW );
+}
+
+// We're called from scan(), on the window's thread, so draw right away
+// rather than waiting for an update that won't come until the scan's done.
+void ScanView::preview_rows( int32 first_row, const void *rows, int32 row_count )
+{
+	int32 width = _preview->Bounds().IntegerWidth() + 1;
+	char *dest = (char *) _preview->Bits() + first_row * _preview->BytesPerRow();
+	const char *src = (const char *) rows;
+	for( int32 i = 0; i < row_count; i++ ) {
+		if( _previewType == SCAN_TYPE_RGB ) {
+			scan_convert_rgb24_to_bgra32( src, dest, width, 0 );
+			src += width * 3;
+		} else {
+			scan_convert_gray8_to_bgra32( src, dest, width, 0 );
+			src += width;
+		}
+		dest += _preview->BytesPerRow();
+	}
+	BRect band( 0, first_row, width - 1, first_row + row_count - 1 );
+	DrawBitmap( _preview, band, band );
+	Flush();
+}
+
+static status_t preview_begin( void *data, const scan_preview_info *info )
+{
+	( (ScanView *) data )->begin_preview( info );
+	return B_OK;
+}
+
+static status_t preview_rows( void *data, int32 first_row, const void *rows,
+								int32 row_count )
+{
+	( (ScanView *) data )->preview_rows( first_row, rows, row_count );
+	return B_OK;
+}
+
@@ -0,0 +1,826 @@
+/*
+	ScanHost -- runs scanner add-ons for libscanbe, in a team of their own.
+	Copyright (c) 1997, Jim Moy, All Rights Reserved
+
+	libscanbe starts one for a session when SCANBE_HOST is set, as
+		ScanHost <add-on path> <scanner name> <request port> <reply port> <cancel port>
+	and it makes the add-on's calls for as long as the session is open.
+
+	Started as
+		ScanHost -server
+	it's a daemon for every app on the machine: it keeps each scanner it's
+	asked for open from the first session on it until it quits, and serves
+	each session on a thread of its own. Sessions take turns with a
+	scanner, a call at a time and an image at a time, and each gets the
+	settings it put back when its turn comes. ScanHost -quit stops it.
+
+	See ScanHost.h for how libscanbe talks to it.
+*/
+
+#include "ScanAddOn.h"
+#include "ScanBeConst.h"
+#include "ScanHost.h"
+
+#include <Autolock.h>
+#include <Directory.h>
+#include <Entry.h>
+#include <Errors.h>
+#include <FindDirectory.h>
+#include <List.h>
+#include <Locker.h>
+#include <OS.h>
+#include <Path.h>
+#include <image.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+const int32 kRingSlots = 4;
+const int32 kMinSlotSize = 256 * 1024L;		// so a slot is worth a switch to the client
+const int32 kDefaultCallSize = 64 * 1024L;
+const bigtime_t kClientPoll = 1000000;		// how often a server checks a session's team
+
+typedef scan_hooks* (*find_proc)( const char *name );
+typedef scan_ext_hooks* (*find_ext_proc)( const char *name );
+
+/*	The settings each session has its own of, in the order they're put
+	back when it gets its turn. */
+static const scan_setting_id kPutFields[] = {
+	SCAN_SETTING_IMAGETYPE, SCAN_SETTING_PIXELBITS, SCAN_SETTING_RESOLUTION,
+	SCAN_SETTING_AREA, SCAN_SETTING_BRIGHTNESS, SCAN_SETTING_CONTRAST,
+	SCAN_SETTING_SCALING
+};
+const int32 kNumPutFields = sizeof( kPutFields ) / sizeof( kPutFields[0] );
+
+struct host_client;
+
+/*	One scanner: an add-on, and its cookie once it's open. */
+struct scan_device {
+	char*			path;
+	char*			name;
+	image_id		image;
+	scan_hooks*		hooks;
+	scan_ext_hooks*	ext;			// NULL if the add-on has none
+	void*			cookie;
+	bool			opened;
+	scan_version	version;		// from opening it, for the later sessions
+	int32			clients;		// sessions open on it
+	BLocker			use_lock;		// a session's turn: a call, or a whole image
+	BLocker			hook_lock;		// one call into the add-on at a time
+	BLocker			cancel_lock;	// around the cancel hook, and changes to
+									// opened and current
+	host_client*	current;		// the one whose settings the scanner has
+	scan_value		defaults[kNumPutFields];	// from opening it, for new sessions
+	scan_value		values[kNumPutFields];		// what it's set to now
+};
+
+/*	One session, served on a thread of its own. */
+struct host_client {
+	scan_device*	device;
+	port_id			request;
+	port_id			reply;
+	port_id			cancel;
+	thread_id		thread;			// serving it, in a server
+	bool			ended;			// and done with it, to be joined
+	bool			opened;
+	scan_value		values[kNumPutFields];	// its settings, see restore_settings()
+		// the open image
+	area_id			area;			// -1 if there's no image open
+	host_ring*		ring;
+	sem_id			full;
+	sem_id			empty;
+	thread_id		filler;
+	int32			row_bytes;
+	int32			call_size;		// bytes per data hook call
+	scan_transfer_info	transfer;	// the add-on's, for the open image
+};
+
+static bool gKeepOpen = false;		// as a server
+static BList gDevices;				// the server's, only the main thread's
+static BList gSessions;				// the server's host_clients, until joined
+static BLocker gSessionLocker;
+static int32 gQuitting = 0;			// the server's sessions should end
+
+/*	Some local function prototypes. */
+static int run_server();
+static int quit_server();
+static bool addon_allowed( const char *path, char *resolved );
+static scan_device* load_device( const char *path, const char *name );
+static void unload_device( scan_device *device );
+static scan_device* find_device( const char *path, const char *name );
+static host_client* new_client( scan_device *device, port_id request,
+						port_id reply, port_id cancel );
+static void run_client( host_client *client );
+static void reap_sessions();
+static void end_sessions();
+static status_t client_thread( void *data );
+static status_t serve( host_client *client, int32 code,
+						const host_request *request, host_reply *reply );
+static status_t open_device( host_client *client, host_reply *reply );
+static status_t close_device( host_client *client );
+static void read_settings( scan_device *device, scan_settings_mask mask,
+						scan_value *values );
+static void record_setting( host_client *client, scan_setting_id setting,
+						const scan_value *value );
+static void restore_settings( host_client *client );
+static void get_field( const scan_settings *settings, scan_setting_id setting,
+						scan_value *value );
+static bool same_value( scan_setting_id setting, const scan_value *a,
+						const scan_value *b );
+static status_t open_image( host_client *client, host_ring_info *info );
+static status_t close_image( host_client *client );
+static status_t start_ring( host_client *client, host_ring_info *info );
+static void stop_ring( host_client *client );
+static status_t fill_thread( void *data );
+static status_t cancel_thread( void *data );
+
+int main( int argc, char **argv )
+{
+	if( argc == 2 && strcmp( argv[1], "-server" ) == 0 )
+		return run_server();
+	if( argc == 2 && strcmp( argv[1], "-quit" ) == 0 )
+		return quit_server();
+	if( argc != 6 ) {
+		fprintf( stderr, "usage: ScanHost <add-on> <scanner> <request port>"
+				" <reply port> <cancel port>\n"
+				"       ScanHost -server | -quit\n" );
+		return 1;
+	}
+
+	scan_device *device = load_device( argv[1], argv[2] );
+	if( ! device )
+		fprintf( stderr, "ScanHost: couldn't load '%s'\n", argv[1] );
+		// without one, it still answers, so the client hears why
+	run_client( new_client( device, atol( argv[3] ), atol( argv[4] ),
+							atol( argv[5] ) ) );
+	if( device )
+		unload_device( device );
+	return 0;
+}
+
+#pragma mark ---- The Server ----
+
+static int run_server()
+{
+	if( find_port( kServerPortName ) >= B_OK ) {
+		fprintf( stderr, "ScanHost: a server is already running\n" );
+		return 1;
+	}
+	port_id port = create_port( 8, kServerPortName );
+	if( port < B_OK ) {
+		fprintf( stderr, "ScanHost: couldn't make the server's port\n" );
+		return 1;
+	}
+	gKeepOpen = true;
+
+	for( ;; ) {
+		int32 code;
+		host_connect_info info;
+		ssize_t size = read_port( port, &code, &info, sizeof( info ) );
+		if( size < B_OK || code == kHostQuit )
+			break;
+		if( code != kHostConnect || size != (ssize_t) sizeof( info ) )
+			continue;
+		info.name[SCAN_STRING_LENGTH - 1] = 0;
+		info.path[kHostPathLength - 1] = 0;
+
+		char path[B_PATH_NAME_LENGTH];
+		scan_device *device = NULL;		// the session says there's no scanner
+		if( ! addon_allowed( info.path, path ) )
+			fprintf( stderr, "ScanHost: '%s' isn't in the add-on directory\n",
+					info.path );
+		else if( ! ( device = find_device( path, info.name ) )
+				&& ( device = load_device( path, info.name ) ) )
+			gDevices.AddItem( device );
+		reap_sessions();
+		host_client *client = new_client( device, info.request, info.reply,
+										info.cancel );
+		BAutolock lock( gSessionLocker );
+		client->thread = spawn_thread( client_thread, "scan server session",
+										B_NORMAL_PRIORITY, client );
+		if( client->thread < B_OK )
+			delete client;
+		else {
+			gSessions.AddItem( client );
+			resume_thread( client->thread );
+		}
+	}
+
+	delete_port( port );
+	end_sessions();
+	for( int32 i = 0; i < gDevices.CountItems(); i++ ) {
+		scan_device *device = (scan_device *) gDevices.ItemAt( i );
+		BAutolock lock( device->use_lock );
+		if( ! device->opened )
+			continue;
+		device->cancel_lock.Lock();
+		device->opened = false;
+		device->cancel_lock.Unlock();
+		device->hooks->close( device->cookie );
+	}
+	return 0;
+}
+
+/* Joins the sessions that have ended. Only the main thread's. */
+static void reap_sessions()
+{
+	BList ended;
+	{
+		BAutolock lock( gSessionLocker );
+		for( int32 i = gSessions.CountItems() - 1; i >= 0; i-- ) {
+			host_client *client = (host_client *) gSessions.ItemAt( i );
+			if( client->ended )
+				ended.AddItem( gSessions.RemoveItem( i ) );
+		}
+	}
+	for( int32 i = 0; i < ended.CountItems(); i++ ) {
+		host_client *client = (host_client *) ended.ItemAt( i );
+		status_t exitValue;
+		wait_for_thread( client->thread, &exitValue );
+		delete client;
+	}
+}
+
+/*	Has the sessions still going stop, cancelling whatever hook they're
+	in, and joins them all; each closes what it had open as usual. */
+static void end_sessions()
+{
+	atomic_set( &gQuitting, 1 );
+	BList sessions;
+	{
+		BAutolock lock( gSessionLocker );
+		sessions.AddList( &gSessions );
+		gSessions.MakeEmpty();
+		for( int32 i = 0; i < sessions.CountItems(); i++ ) {
+			host_client *client = (host_client *) sessions.ItemAt( i );
+			if( ! client->ended )
+				write_port_etc( client->cancel, kHostCancel, NULL, 0,
+								B_RELATIVE_TIMEOUT, 0 );
+		}
+	}
+	for( int32 i = 0; i < sessions.CountItems(); i++ ) {
+		host_client *client = (host_client *) sessions.ItemAt( i );
+		status_t exitValue;
+		wait_for_thread( client->thread, &exitValue );
+		delete client;
+	}
+}
+
+static int quit_server()
+{
+	port_id port = find_port( kServerPortName );
+	if( port < B_OK ) {
+		fprintf( stderr, "ScanHost: no server running\n" );
+		return 1;
+	}
+	return write_port( port, kHostQuit, NULL, 0 ) == B_OK ? 0 : 1;
+}
+
+/*	Anyone can send the server a path, so it only loads files that are
+	in the add-on directory, or linked from it, just as libscanbe would
+	find them. resolved gets the path they're known by. */
+static bool addon_allowed( const char *path, char *resolved )
+{
+	BEntry wanted( path, true );
+	BPath wantedPath;
+	if( wanted.InitCheck() != B_OK || wanted.GetPath( &wantedPath ) != B_OK )
+		return false;
+	BPath dirPath;
+	if( find_directory( B_USER_ADDONS_DIRECTORY, &dirPath ) != B_OK
+			|| dirPath.Append( kDefaultAddonSubdir ) != B_OK )
+		return false;
+
+	BDirectory dir( dirPath.Path() );
+	BEntry entry;
+	while( dir.GetNextEntry( &entry, true ) == B_OK ) {
+		BPath entryPath;
+		if( entry.IsFile() && entry.GetPath( &entryPath ) == B_OK
+				&& strcmp( entryPath.Path(), wantedPath.Path() ) == 0 ) {
+			strcpy( resolved, wantedPath.Path() );
+			return true;
+		}
+	}
+	return false;
+}
+
+static scan_device* load_device( const char *path, const char *name )
+{
+	image_id image = load_add_on( path );
+	if( image < B_OK )
+		return NULL;
+	find_proc func;
+	scan_hooks *hooks = NULL;
+	if( get_image_symbol( image, kFindScannerFunction, B_SYMBOL_TYPE_TEXT,
+							&func ) == B_OK )
+		hooks = func( name );
+	if( ! hooks ) {
+		unload_add_on( image );
+		return NULL;
+	}
+
+	scan_device *device = new scan_device;
+	device->path = strdup( path );
+	device->name = strdup( name );
+	device->image = image;
+	device->hooks = hooks;
+	device->ext = NULL;
+	find_ext_proc extFunc;
+	if( get_image_symbol( image, kFindScannerExtFunction, B_SYMBOL_TYPE_TEXT,
+							&extFunc ) == B_OK )
+		device->ext = extFunc( name );
+	device->cookie = NULL;
+	device->opened = false;
+	device->clients = 0;
+	device->current = NULL;
+	return device;
+}
+
+static void unload_device( scan_device *device )
+{
+	if( device->opened )
+		device->hooks->close( device->cookie );
+	unload_add_on( device->image );
+	free( device->path );
+	free( device->name );
+	delete device;
+}
+
+static scan_device* find_device( const char *path, const char *name )
+{
+	for( int32 i = 0; i < gDevices.CountItems(); i++ ) {
+		scan_device *device = (scan_device *) gDevices.ItemAt( i );
+		if( strcmp( device->path, path ) == 0 && strcmp( device->name, name ) == 0 )
+			return device;
+	}
+	return NULL;
+}
+
+#pragma mark ---- Sessions ----
+
+static host_client* new_client( scan_device *device, port_id request,
+						port_id reply, port_id cancel )
+{
+	host_client *client = new host_client;
+	client->device = device;
+	client->request = request;
+	client->reply = reply;
+	client->cancel = cancel;
+	client->thread = -1;
+	client->ended = false;
+	client->opened = false;
+	client->area = -1;
+	client->ring = NULL;
+	return client;
+}
+
+/*	Serves the session until it's closed, or its ports go, which means
+	its team has; either way whatever it left open is closed. */
+static void run_client( host_client *client )
+{
+	thread_id canceller = spawn_thread( cancel_thread, "scan host cancel",
+										B_NORMAL_PRIORITY, client );
+	resume_thread( canceller );
+
+	host_request request;
+	host_reply reply;
+	port_info info;
+	for( ;; ) {
+		int32 code;
+		memset( &request, 0, sizeof( request ) );
+		ssize_t size = read_port_etc( client->request, &code, &request,
+									sizeof( request ), B_RELATIVE_TIMEOUT, kClientPoll );
+		if( atomic_get( &gQuitting ) )
+			break;
+		if( size == B_TIMED_OUT && get_port_info( client->request, &info ) == B_OK )
+			continue;
+		if( size < B_OK )
+			break;
+		memset( &reply, 0, sizeof( reply ) );
+		reply.status = serve( client, code, &request, &reply );
+		if( write_port( client->reply, code, &reply, sizeof( reply ) ) != B_OK )
+			break;
+		if( code == kHostClose )
+			break;
+	}
+
+	if( client->ring )
+		close_image( client );
+	if( client->opened )
+		close_device( client );
+	write_port_etc( client->cancel, kHostQuit, NULL, 0, B_RELATIVE_TIMEOUT, 0 );
+	status_t exitValue;
+	wait_for_thread( canceller, &exitValue );
+	bool served;
+	{
+		BAutolock lock( gSessionLocker );
+		served = client->thread >= B_OK;
+		client->ended = served;		// the server joins and deletes it
+	}
+	if( ! served )
+		delete client;
+}
+
+static status_t client_thread( void *data )
+{
+	run_client( (host_client *) data );
+	return B_OK;
+}
+
+/* One call from the client, made on the add-on once it's the client's turn. */
+static status_t serve( host_client *client, int32 code,
+						const host_request *request, host_reply *reply )
+{
+	scan_device *device = client->device;
+	if( ! device )
+		return SCAN_NO_SCANNER;
+	if( code == kHostOpen )
+		return open_device( client, reply );
+	if( ! client->opened )
+		return SCAN_BAD_PHASE;
+	if( code == kHostClose )
+		return close_device( client );
+
+	BAutolock useLock( device->use_lock );
+	if( device->current != client )
+		restore_settings( client );
+	if( code == kHostOpenImage )
+		return open_image( client, &reply->ring );
+	if( code == kHostCloseImage ) {
+		if( ! client->ring )
+			return SCAN_BAD_PHASE;
+		return close_image( client );
+	}
+
+	BAutolock lock( device->hook_lock );
+	status_t status;
+	switch( code ) {
+	case kHostGetCapabilities:
+		status = device->hooks->get_capabilities( device->cookie, &reply->mask );
+		reply->mask &= ~kHostLocalSettings;
+		return status;
+	case kHostGetSetting:
+		return device->hooks->get_setting( device->cookie, request->setting,
+										request->kind, &reply->value );
+	case kHostPutSetting:
+		reply->value = request->value;
+		status = device->hooks->put_setting( device->cookie, request->setting,
+										&reply->value, &reply->mask );
+		if( status == B_OK ) {
+			record_setting( client, request->setting, &reply->value );
+				// it may have moved others to suit
+			scan_value values[kNumPutFields];
+			read_settings( device, reply->mask & ~request->setting, values );
+			for( int32 i = 0; i < kNumPutFields; i++ ) {
+				if( reply->mask & ~request->setting & kPutFields[i] )
+					record_setting( client, kPutFields[i], &values[i] );
+			}
+		}
+		return status;
+	case kHostGetSettings:
+		if( ! HAS_EXT_HOOK( device, get_settings ) )
+			return B_ERROR;
+		return device->ext->get_settings( device->cookie,
+							request->want[0] ? &reply->settings[0] : NULL,
+							request->want[1] ? &reply->settings[1] : NULL,
+							request->want[2] ? &reply->settings[2] : NULL );
+	case kHostPutSettings:
+		if( ! HAS_EXT_HOOK( device, put_settings ) )
+			return B_ERROR;
+		reply->settings[0] = request->settings;
+		status = device->ext->put_settings( device->cookie, &reply->settings[0],
+										&reply->mask );
+		if( status == B_OK ) {
+			for( int32 i = 0; i < kNumPutFields; i++ ) {
+				scan_value value;
+				get_field( &reply->settings[0], kPutFields[i], &value );
+				record_setting( client, kPutFields[i], &value );
+			}
+		}
+		return status;
+	case kHostStart:
+		return device->hooks->start( device->cookie );
+	case kHostAdfReady:
+		reply->ready = device->hooks->adf_ready( device->cookie );
+		return B_OK;
+	case kHostErrorMessage:
+		device->hooks->error_message( device->cookie, request->error, reply->message );
+		reply->message[SCAN_STRING_LENGTH - 1] = 0;
+		return B_OK;
+	case kHostGetTransferInfo:
+			// with an image open, the client's calls are on the ring
+		if( client->ring ) {
+			reply->transfer = client->transfer;
+			reply->transfer.preferred = client->ring->slot_size;
+			reply->transfer.maximum = 0;
+			reply->transfer.alignment = 1;
+			return B_OK;
+		}
+		reply->transfer = request->transfer;
+		if( ! HAS_EXT_HOOK( device, get_transfer_info ) )
+			return B_OK;
+		return device->ext->get_transfer_info( device->cookie, &reply->transfer );
+	default:
+		return B_BAD_VALUE;
+	}
+}
+
+/* The first session opens the scanner; the rest share it as it is. */
+static status_t open_device( host_client *client, host_reply *reply )
+{
+	scan_device *device = client->device;
+	if( client->opened )
+		return SCAN_BAD_PHASE;
+	BAutolock useLock( device->use_lock );
+	if( ! device->opened ) {
+		BAutolock lock( device->hook_lock );
+		status_t status = device->hooks->open( &device->version, &device->cookie );
+		if( status != B_OK )
+			return status;
+		BAutolock cancelLock( device->cancel_lock );
+		device->opened = true;
+		device->current = NULL;
+		read_settings( device, ~(scan_settings_mask) 0, device->defaults );
+		memcpy( device->values, device->defaults, sizeof( device->values ) );
+	}
+	memcpy( client->values, device->defaults, sizeof( client->values ) );
+	reply->version = device->version;
+	if( HAS_EXT_HOOK( device, get_settings ) )
+		reply->hooks |= kHostHasGetSettings;
+	if( HAS_EXT_HOOK( device, put_settings ) )
+		reply->hooks |= kHostHasPutSettings;
+	device->clients++;
+	client->opened = true;
+	return B_OK;
+}
+
+/* The last session closes the scanner, unless it's the server's to keep. */
+static status_t close_device( host_client *client )
+{
+	scan_device *device = client->device;
+	BAutolock useLock( device->use_lock );
+	client->opened = false;
+	device->cancel_lock.Lock();
+	if( device->current == client )
+		device->current = NULL;
+	bool last = --device->clients == 0 && ! gKeepOpen;
+	if( last )
+		device->opened = false;		// no cancel gets to the cookie from here
+	device->cancel_lock.Unlock();
+	if( ! last )
+		return B_OK;
+	BAutolock lock( device->hook_lock );
+	return device->hooks->close( device->cookie );
+}
+
+/*	Reads the settings in mask into values, by kPutFields. Ones the add-on
+	won't give are left zero. Hold hook_lock. */
+static void read_settings( scan_device *device, scan_settings_mask mask,
+						scan_value *values )
+{
+	memset( values, 0, kNumPutFields * sizeof( scan_value ) );
+	for( int32 i = 0; i < kNumPutFields; i++ ) {
+		if( mask & kPutFields[i] )
+			device->hooks->get_setting( device->cookie, kPutFields[i],
+									SCAN_SETTING_CURRENT, &values[i] );
+	}
+}
+
+/* What the client's put is what the scanner has now, too. */
+static void record_setting( host_client *client, scan_setting_id setting,
+						const scan_value *value )
+{
+	for( int32 i = 0; i < kNumPutFields; i++ ) {
+		if( kPutFields[i] == setting ) {
+			client->values[i] = *value;
+			client->device->values[i] = *value;
+		}
+	}
+}
+
+/*	Sets the scanner back to the client's settings, now that it's its
+	turn after some other session's, putting only the ones that differ.
+	A session starts with the ones the scanner had when it was opened.
+	Hold use_lock. */
+static void restore_settings( host_client *client )
+{
+	scan_device *device = client->device;
+	BAutolock lock( device->hook_lock );
+	for( int32 i = 0; i < kNumPutFields; i++ ) {
+		if( same_value( kPutFields[i], &client->values[i], &device->values[i] ) )
+			continue;
+		scan_value value = client->values[i];
+		scan_settings_mask changed;
+		if( device->hooks->put_setting( device->cookie, kPutFields[i], &value,
+										&changed ) == B_OK )
+			device->values[i] = value;
+	}
+	BAutolock cancelLock( device->cancel_lock );
+	device->current = client;
+}
+
+static void get_field( const scan_settings *settings, scan_setting_id setting,
+						scan_value *value )
+{
+	switch( setting ) {
+	case SCAN_SETTING_AREA:			value->rect = settings->scan_area; break;
+	case SCAN_SETTING_IMAGETYPE:	value->type = settings->image_type; break;
+	case SCAN_SETTING_PIXELBITS:	value->u_int = settings->pixel_bits; break;
+	case SCAN_SETTING_RESOLUTION:	value->u_int = settings->resolution; break;
+	case SCAN_SETTING_BRIGHTNESS:	value->s_int = settings->brightness; break;
+	case SCAN_SETTING_CONTRAST:		value->s_int = settings->contrast; break;
+	case SCAN_SETTING_SCALING:		value->s_int = settings->scaling; break;
+	}
+}
+
+static bool same_value( scan_setting_id setting, const scan_value *a,
+						const scan_value *b )
+{
+	switch( setting ) {
+	case SCAN_SETTING_AREA:
+		return a->rect.left == b->rect.left && a->rect.top == b->rect.top
+			&& a->rect.right == b->rect.right && a->rect.bottom == b->rect.bottom;
+	case SCAN_SETTING_IMAGETYPE:	return a->type == b->type;
+	case SCAN_SETTING_PIXELBITS:
+	case SCAN_SETTING_RESOLUTION:	return a->u_int == b->u_int;
+	default:						return a->s_int == b->s_int;
+	}
+}
+
+#pragma mark ---- Images ----
+
+/*	Opens the image on the add-on and starts filling a ring from it. The
+	client keeps its turn with the scanner until it closes the image.
+	Hold use_lock. */
+static status_t open_image( host_client *client, host_ring_info *info )
+{
+	scan_device *device = client->device;
+	if( client->ring )
+		return SCAN_BAD_PHASE;
+	status_t status;
+	{
+		BAutolock lock( device->hook_lock );
+		status = device->hooks->open_image( device->cookie );
+	}
+	if( status != B_OK )
+		return status;
+	status = start_ring( client, info );
+	if( status != B_OK ) {
+		BAutolock lock( device->hook_lock );
+		device->hooks->close_image( device->cookie );
+		return status;
+	}
+	device->use_lock.Lock();
+	return B_OK;
+}
+
+/* Hold use_lock. */
+static status_t close_image( host_client *client )
+{
+	scan_device *device = client->device;
+	stop_ring( client );
+	status_t status;
+	{
+		BAutolock lock( device->hook_lock );
+		status = device->hooks->close_image( device->cookie );
+	}
+	device->use_lock.Unlock();
+	return status;
+}
+
+/*	Slots are whole data calls of the size the add-on likes, enough of
+	them to make up kMinSlotSize, so each handoff to the client carries
+	enough rows to be worth the switch. */
+static status_t start_ring( host_client *client, host_ring_info *info )
+{
+	scan_device *device = client->device;
+	scan_value rowBytes;
+	client->transfer.size = sizeof( scan_transfer_info );
+	client->transfer.preferred = 0;
+	client->transfer.maximum = 0;
+	client->transfer.alignment = 1;
+	{
+		BAutolock lock( device->hook_lock );
+		status_t status = device->hooks->get_setting( device->cookie,
+							SCAN_SETTING_ROWBYTES, SCAN_SETTING_CURRENT, &rowBytes );
+		if( status != B_OK )
+			return status;
+		if( HAS_EXT_HOOK( device, get_transfer_info ) )
+			device->ext->get_transfer_info( device->cookie, &client->transfer );
+	}
+	if( rowBytes.u_int == 0 )
+		return SCAN_ADDON_ERROR;
+	client->row_bytes = rowBytes.u_int;
+
+	int32 call = client->transfer.preferred > 0 ? client->transfer.preferred
+												: kDefaultCallSize;
+	if( client->transfer.maximum > 0 && call > client->transfer.maximum )
+		call = client->transfer.maximum;
+	call = call < client->row_bytes ? client->row_bytes : call - call % client->row_bytes;
+	client->call_size = call;
+	int32 slotSize = ( ( kMinSlotSize + call - 1 ) / call ) * call;
+	size_t size = host_ring_header_size() + (size_t) kRingSlots * slotSize;
+	size = ( size + B_PAGE_SIZE - 1 ) & ~( (size_t) B_PAGE_SIZE - 1 );
+
+	void *address;
+	client->area = create_area( "scan host ring", &address, B_ANY_ADDRESS, size,
+							B_FULL_LOCK, B_READ_AREA | B_WRITE_AREA );
+	if( client->area < B_OK )
+		return client->area;
+	client->ring = (host_ring *) address;
+	client->ring->slots = kRingSlots;
+	client->ring->slot_size = slotSize;
+	client->ring->quit = 0;
+	client->full = create_sem( 0, "scan host full" );
+	client->empty = create_sem( kRingSlots, "scan host empty" );
+	client->filler = spawn_thread( fill_thread, "scan host fill",
+								B_NORMAL_PRIORITY, client );
+	if( client->full < B_OK || client->empty < B_OK || client->filler < B_OK ) {
+		stop_ring( client );
+		return B_NO_MORE_SEMS;
+	}
+	resume_thread( client->filler );
+
+	info->area = client->area;
+	info->full = client->full;
+	info->empty = client->empty;
+	info->slots = kRingSlots;
+	info->slot_size = slotSize;
+	info->row_bytes = client->row_bytes;
+	return B_OK;
+}
+
+/*	The filler may be waiting for a slot, or in the add-on; either way it
+	sees quit next time round. Deleting the semaphores wakes a client
+	that's still waiting on full. */
+static void stop_ring( host_client *client )
+{
+	if( ! client->ring )
+		return;
+	atomic_set( &client->ring->quit, 1 );
+	if( client->filler >= B_OK ) {
+		release_sem( client->empty );
+		status_t exitValue;
+		wait_for_thread( client->filler, &exitValue );
+	}
+	delete_sem( client->full );
+	delete_sem( client->empty );
+	delete_area( client->area );
+	client->area = -1;
+	client->ring = NULL;
+}
+
+/*	Fills slots from the add-on's data hook, straight into the shared
+	memory, until the image ends or something goes wrong. A slot's status
+	is that of its last call. */
+static status_t fill_thread( void *data )
+{
+	host_client *client = (host_client *) data;
+	scan_device *device = client->device;
+	host_ring *ring = client->ring;
+	for( int32 slot = 0; ; slot = ( slot + 1 ) % ring->slots ) {
+		if( acquire_sem( client->empty ) != B_OK || atomic_get( &ring->quit ) )
+			break;
+		char *dest = host_slot_data( ring, slot );
+		int32 filled = 0;
+		status_t status = B_OK;
+		while( filled < ring->slot_size && status == B_OK ) {
+			int32 count = ring->slot_size - filled;
+			if( count > client->call_size )
+				count = client->call_size;
+			BAutolock lock( device->hook_lock );
+			status = device->hooks->data( device->cookie, dest + filled, &count );
+			if( status != B_OK && status != SCAN_DATA_END )
+				count = 0;
+			filled += count;
+			if( status == B_OK && count == 0 )
+				break;
+		}
+		ring->slot[slot].count = filled;
+		ring->slot[slot].status = status;
+		release_sem( client->full );
+		if( status != B_OK )
+			break;
+	}
+	return B_OK;
+}
+
+/*	Passes cancels on while the client's thread is in a hook, which is the
+	only time they'd do anything; a session waiting its turn mustn't cancel
+	the one that has it. */
+static status_t cancel_thread( void *data )
+{
+	host_client *client = (host_client *) data;
+	for( ;; ) {
+		int32 code;
+		if( read_port( client->cancel, &code, NULL, 0 ) < B_OK || code == kHostQuit )
+			break;
+		scan_device *device = client->device;
+		if( ! device )
+			continue;
+		BAutolock lock( device->cancel_lock );
+		if( device->opened && device->current == client
+				&& HAS_EXT_HOOK( device, cancel ) )
+			device->ext->cancel( device->cookie );
+	}
+	return B_OK;
+}
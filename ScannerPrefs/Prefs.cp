@@ -2,6 +2,7 @@
 
 #include <Application.h>
 #include <Bitmap.h>
+#include <Messenger.h>
 #include <Window.h>
 #include <stdio.h>
 #include "ScannerBe.h"
@@ -11,6 +12,7 @@
 const char *kSig = "application/x-vnd.jbm-scanpref";
 const char *kNoScannerName = "libscanbe_no_scanner";
 const uint32 kInvokeMsg = 'linv';
+const uint32 kAddonsChangedMsg = 'ladd';
 
 // libscanbe entry points which are not part of the ScannerBe API
 extern "C" bool libscanbe_save_scanner( const char *name );
@@ -22,7 +24,11 @@ class PrefView : public BView {
 public:
 					PrefView( BRect rect );
 static	int32		get_addon_info( const CallbackInfo *info, void *data );
+static	void		addons_changed( scan_addon_change change,
+						const CallbackInfo *info, void *data );
+		void		fill_list();
 virtual	void		AttachedToWindow();
+virtual	void		DetachedFromWindow();
 virtual	void		MessageReceived( BMessage *msg );
 
 		char		_current[SCAN_STRING_LENGTH];
@@ -142,8 +148,16 @@ PrefView::PrefView( BRect frame ) : BView( frame, "", B_FOLLOW_ALL, B_WILL_DRAW
 	AddChild( string );
 										// set up the scanner list
 	libscanbe_get_scanner( _current );
+	fill_list();
+}
+
+/* Lists the scanners, noting which is _current in _init_select. */
+void PrefView::fill_list()
+{
+	for( int32 i = _list->CountItems() - 1; i >= 0; i-- )
+		delete _list->RemoveItem( i );
 	_init_select = -1;
-	status_t status = scan_get_addons( get_addon_info, this );
+	scan_get_addons( get_addon_info, this );
 }
 
 void PrefView::AttachedToWindow()
@@ -154,12 +168,31 @@ void PrefView::AttachedToWindow()
 		
 	_list->SetInvocationMessage( new BMessage( kInvokeMsg ) );
 	_list->SetTarget( this );
+										// keep up with add-ons being
+										// installed and removed
+	scan_watch_addons( addons_changed, this );
+}
+
+void PrefView::DetachedFromWindow()
+{
+	scan_unwatch_addons( addons_changed, this );
 }
 
 void PrefView::MessageReceived( BMessage *msg )
 {
 	BAlert *alert = NULL;
 	switch( msg->what ) {
+	case kAddonsChangedMsg: {
+		int32 sel = _list->CurrentSelection();
+		if( sel >= 0 ) {
+			ScannerItem *item = dynamic_cast<ScannerItem*>( _list->ItemAt( sel ) );
+			strcpy( _current, item->_info );
+		}
+		fill_list();
+		if( _init_select != -1 )
+			_list->Select( _init_select );
+		break;
+	}
 	case kInvokeMsg:
 		int32 sel = _list->CurrentSelection();
 		if( sel >= 0 ) {
@@ -215,6 +248,12 @@ int32 PrefView::get_addon_info( const CallbackInfo *info, void *data )
 	return 0;
 }
 
+/* Called by libscanbe's watch thread, so the list is redone in the window's. */
+void PrefView::addons_changed( scan_addon_change, const CallbackInfo *, void *data )
+{
+	BMessenger( static_cast<PrefView*>( data ) ).SendMessage( kAddonsChangedMsg );
+}
+
 ScannerItem::ScannerItem( const char *text, const char *info, const char *moreInfo )
 	: BStringItem( text )
 {
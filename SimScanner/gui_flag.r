@@ -0,0 +1,6 @@
+resource( 'GUIF', 0, "GUI Flags" )
+{
+	0,	// can run with user interface
+	1	// can run in driver only mode
+}
+
@@ -0,0 +1,4 @@
+resource( 'info', 0, "ScannerBe Info" )
+{
+	"Simulated Scanner, for benchmarks. Version 1.0.0."
+}
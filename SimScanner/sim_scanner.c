@@ -0,0 +1,646 @@
+/*
+	ScannerBe Simulated Scanner -- Copyright (c) 1997, Jim Moy, All Rights Reserved
+
+	A ScannerBe add-on with no hardware behind it, built from the add-on
+	skeleton. It produces a deterministic test pattern at whatever area,
+	resolution, image type and depth it's set to, so libscanbe and the apps
+	on top of it can be timed and checked without a scanner attached.
+
+	The delays a real device would add can be dialed in with environment
+	variables, read when a session is opened:
+
+		SIMSCAN_DATA_LATENCY		microseconds per data call
+		SIMSCAN_SETTING_LATENCY		microseconds per settings call, as
+									a round trip to the device
+		SIMSCAN_EXT					set to 0 to hide the optional hooks,
+									to time the fallback paths
+		SIMSCAN_ADF_PAGES			pages in the document feeder, none
+									if unset
+		SIMSCAN_FEED_LATENCY		microseconds to feed each page
+		SIMSCAN_START_LATENCY		microseconds scan_start() waits, as
+									for the user to click scan
+		SIMSCAN_OPEN_LATENCY		microseconds opening the session
+									takes, as for the lamp to warm up
+
+	The pattern: sample c of pixel x on row y is ( 3x + 5y + 85c ) & 0xff.
+	16-bit samples carry that in their high byte and x & 0xff in the low
+	byte, big-endian. Binary images are an 8x8 checkerboard, black first.
+*/
+
+#pragma export on
+#include "ScanAddOn.h"
+#pragma export off
+#include "ScanAddOnProto.h"
+#include <OS.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The optional hooks this add-on implements, see scan_ext_hooks. */
+static status_t scn_acquire_data( void *cookie, const void **rows, int32 *count );
+static status_t scn_release_data( void *cookie, const void *rows );
+static status_t scn_get_settings( void *cookie, scan_settings *current,
+									scan_settings *minimum, scan_settings *maximum );
+static status_t scn_put_settings( void *cookie, scan_settings *settings,
+									scan_settings_mask *mask );
+static void scn_cancel( void *cookie );
+static status_t scn_get_transfer_info( void *cookie, scan_transfer_info *info );
+
+#define kVersionMajor	1
+#define kVersionMinor	0
+#define kVersionIncr	0
+
+/* The bed, in the 300dpi units of scan_rect: 8.5 x 11.7 inches. */
+#define kBedWidth		2550
+#define kBedHeight		3510
+
+/* The pattern repeats every this many rows, so that many are built
+	once per image and rows are copied (or lent) out of them. */
+#define kPatternRows	256
+
+/* Size of the band handed out when the app lets the add-on choose. */
+#define kBandSize		( 64 * 1024L )
+
+typedef struct {
+	scan_rect		area;
+	scan_type		type;
+	uint32			pixel_bits;
+	uint32			resolution;
+	int32			brightness;
+	int32			contrast;
+	int32			scaling;
+} sim_settings;
+
+typedef struct {
+	sim_settings	settings;
+	bigtime_t		data_latency;
+	bigtime_t		setting_latency;
+	bigtime_t		feed_latency;
+	bigtime_t		start_latency;
+	sem_id			cancel;			/* released by scn_cancel() */
+	int32			adf_pages;		/* in the feeder */
+	int32			adf_fed;		/* of them scanned */
+	uint32			width;			/* of the image being scanned */
+	uint32			height;
+	uint32			row_bytes;
+	uint32			row;			/* next row to deliver */
+	char			*pattern;		/* kPatternRows rows */
+} sim_cookie;
+
+static const char *sim_scanner_name[] = {
+	"application/x-vnd.jbm-simscanner",
+	"Simulated Scanner (ScannerBe v1.0)",
+	NULL
+};
+
+static scan_hooks sim_scanner_hooks = {
+	scn_open,
+	scn_close,
+	scn_get_capabilities,
+	scn_get_setting,
+	scn_put_setting,
+	scn_open_image,
+	scn_close_image,
+	scn_start,
+	scn_data,
+	scn_adf_ready,
+	scn_error_message
+};
+
+static scan_ext_hooks sim_scanner_ext_hooks = {
+	sizeof( scan_ext_hooks ),
+	scn_acquire_data,
+	scn_release_data,
+	scn_get_settings,
+	scn_put_settings,
+	scn_cancel,
+	scn_get_transfer_info
+};
+
+static bigtime_t env_time( const char *name )
+{
+	const char *value = getenv( name );
+	return value ? atoll( value ) : 0;
+}
+
+/* Waits like the device would, but gives up if scn_cancel() is called. */
+static status_t wait_for( sim_cookie *goodie, bigtime_t latency )
+{
+	if( latency <= 0 )
+		return B_OK;
+	if( acquire_sem_etc( goodie->cancel, 1, B_RELATIVE_TIMEOUT, latency ) == B_OK )
+		return SCAN_USER_CANCEL;
+	return B_OK;
+}
+
+static uint32 bits_per_sample( const sim_settings *s )
+{
+	switch( s->type ) {
+	case SCAN_TYPE_BINARY:	return 1;
+	case SCAN_TYPE_GRAY:	return s->pixel_bits;
+	default:				return s->pixel_bits / 3;
+	}
+}
+
+/* Image size for the current settings. */
+static void figure_size( const sim_settings *s, uint32 *width, uint32 *height,
+							uint32 *row_bytes )
+{
+	uint32 dpi = s->resolution * s->scaling / 100;
+	*width = ( s->area.right - s->area.left ) * dpi / 300;
+	*height = ( s->area.bottom - s->area.top ) * dpi / 300;
+	*row_bytes = ( *width * s->pixel_bits + 7 ) / 8;
+}
+
+/* Builds kPatternRows rows of the test pattern for the image. */
+static status_t make_pattern( sim_cookie *goodie )
+{
+	uint32 samples = goodie->settings.type == SCAN_TYPE_RGB ? 3 : 1;
+	uint32 bits = bits_per_sample( &goodie->settings );
+	uint32 x, y, c;
+
+	free( goodie->pattern );
+	goodie->pattern = (char *) malloc( goodie->row_bytes * kPatternRows );
+	if( ! goodie->pattern )
+		return B_NO_MEMORY;
+	memset( goodie->pattern, 0, goodie->row_bytes * kPatternRows );
+
+	for( y = 0; y < kPatternRows; y++ ) {
+		uint8 *row = (uint8 *) goodie->pattern + y * goodie->row_bytes;
+		for( x = 0; x < goodie->width; x++ ) {
+			if( bits == 1 ) {
+				if( ( ( x / 8 ) + ( y / 8 ) ) % 2 == 0 )
+					row[x / 8] |= 0x80 >> ( x % 8 );
+				continue;
+			}
+			for( c = 0; c < samples; c++ ) {
+				uint8 value = ( 3 * x + 5 * y + 85 * c ) & 0xff;
+				if( bits == 16 ) {
+					*row++ = value;
+					*row++ = x & 0xff;
+				} else
+					*row++ = value;
+			}
+		}
+	}
+	return B_OK;
+}
+
+const char **
+publish_scanners()
+{
+	return sim_scanner_name;
+}
+
+scan_hooks *
+find_scanner(const char *name)
+{
+	return &sim_scanner_hooks;
+}
+
+scan_ext_hooks *
+find_scanner_ext(const char *name)
+{
+	const char *ext = getenv( "SIMSCAN_EXT" );
+	if( ext && strcmp( ext, "0" ) == 0 )
+		return NULL;
+	return &sim_scanner_ext_hooks;
+}
+
+static status_t scn_open( scan_version *version, void  **cookie )
+{
+	sim_cookie *goodie = (sim_cookie *) malloc( sizeof( sim_cookie ) );
+	if( ! goodie )
+		return B_NO_MEMORY;
+
+	goodie->settings.area.left = 0;
+	goodie->settings.area.top = 0;
+	goodie->settings.area.right = kBedWidth;
+	goodie->settings.area.bottom = kBedHeight;
+	goodie->settings.type = SCAN_TYPE_RGB;
+	goodie->settings.pixel_bits = 24;
+	goodie->settings.resolution = 100;
+	goodie->settings.brightness = 0;
+	goodie->settings.contrast = 0;
+	goodie->settings.scaling = 100;
+	goodie->data_latency = env_time( "SIMSCAN_DATA_LATENCY" );
+	goodie->setting_latency = env_time( "SIMSCAN_SETTING_LATENCY" );
+	goodie->feed_latency = env_time( "SIMSCAN_FEED_LATENCY" );
+	goodie->start_latency = env_time( "SIMSCAN_START_LATENCY" );
+	goodie->adf_pages = (int32) env_time( "SIMSCAN_ADF_PAGES" );
+	goodie->adf_fed = 0;
+	goodie->pattern = NULL;
+	goodie->row = 0;
+	goodie->cancel = create_sem( 0, "sim scanner cancel" );
+	if( goodie->cancel < B_OK ) {
+		free( goodie );
+		return B_NO_MORE_SEMS;
+	}
+	figure_size( &goodie->settings, &goodie->width, &goodie->height,
+					&goodie->row_bytes );
+	*cookie = goodie;
+	snooze( env_time( "SIMSCAN_OPEN_LATENCY" ) );
+
+	version->major = kVersionMajor;
+	version->minor = kVersionMinor;
+	version->incr = kVersionIncr;
+	return B_OK;
+}
+
+static status_t scn_close( void *cookie )
+{
+	sim_cookie *goodie = (sim_cookie *) cookie;
+	free( goodie->pattern );
+	delete_sem( goodie->cancel );
+	free( goodie );
+	return B_OK;
+}
+
+static status_t scn_get_capabilities( void *cookie, scan_settings_mask *mask )
+{
+	*mask =
+		SCAN_SETTING_AREA			|
+		SCAN_SETTING_IMAGETYPE		|
+		SCAN_SETTING_PIXELBITS		|
+		SCAN_SETTING_RESOLUTION		|
+		SCAN_SETTING_BRIGHTNESS		|
+		SCAN_SETTING_CONTRAST		|
+		SCAN_SETTING_SCALING
+	;
+	return B_OK;
+}
+
+/* One setting, without the simulated round trip. */
+static status_t get_value( sim_cookie *goodie, scan_setting_id setting_id,
+							scan_setting_kind setting_kind, scan_value *value_ptr )
+{
+	const sim_settings *s = &goodie->settings;
+	uint32 width, height, rowBytes;
+
+	if( setting_kind == SCAN_SETTING_CURRENT ) {
+		figure_size( s, &width, &height, &rowBytes );
+		switch( setting_id ) {
+		case SCAN_SETTING_AREA:			value_ptr->rect = s->area; break;
+		case SCAN_SETTING_IMAGETYPE:	value_ptr->type = s->type; break;
+		case SCAN_SETTING_PIXELBITS:	value_ptr->u_int = s->pixel_bits; break;
+		case SCAN_SETTING_RESOLUTION:	value_ptr->u_int = s->resolution; break;
+		case SCAN_SETTING_BRIGHTNESS:	value_ptr->s_int = s->brightness; break;
+		case SCAN_SETTING_CONTRAST:		value_ptr->s_int = s->contrast; break;
+		case SCAN_SETTING_SCALING:		value_ptr->s_int = s->scaling; break;
+		case SCAN_SETTING_WIDTH:		value_ptr->u_int = width; break;
+		case SCAN_SETTING_HEIGHT:		value_ptr->u_int = height; break;
+		case SCAN_SETTING_ROWBYTES:		value_ptr->u_int = rowBytes; break;
+		default:						return SCAN_INVALID_SETTING;
+		}
+		return B_OK;
+	}
+
+	switch( setting_id ) {
+	case SCAN_SETTING_AREA:
+		value_ptr->rect.left = 0;
+		value_ptr->rect.top = 0;
+		value_ptr->rect.right = setting_kind == SCAN_SETTING_MINIMUM ? 1 : kBedWidth;
+		value_ptr->rect.bottom = setting_kind == SCAN_SETTING_MINIMUM ? 1 : kBedHeight;
+		break;
+	case SCAN_SETTING_IMAGETYPE:
+		value_ptr->type = SCAN_TYPE_BINARY | SCAN_TYPE_GRAY | SCAN_TYPE_RGB;
+		break;
+	case SCAN_SETTING_PIXELBITS:
+		value_ptr->u_int = setting_kind == SCAN_SETTING_MINIMUM ? 1 : 48;
+		break;
+	case SCAN_SETTING_RESOLUTION:
+		value_ptr->u_int = setting_kind == SCAN_SETTING_MINIMUM ? 12 : 1200;
+		break;
+	case SCAN_SETTING_BRIGHTNESS:
+	case SCAN_SETTING_CONTRAST:
+		value_ptr->s_int = setting_kind == SCAN_SETTING_MINIMUM ? -127 : 127;
+		break;
+	case SCAN_SETTING_SCALING:
+		value_ptr->s_int = setting_kind == SCAN_SETTING_MINIMUM ? 10 : 400;
+		break;
+	case SCAN_SETTING_WIDTH:
+	case SCAN_SETTING_HEIGHT:
+	case SCAN_SETTING_ROWBYTES:
+		value_ptr->u_int = 0;
+		break;
+	default:
+		return SCAN_INVALID_SETTING;
+	}
+	return B_OK;
+}
+
+/* One setting, without the simulated round trip. */
+static status_t put_value( sim_cookie *goodie, scan_setting_id setting_id,
+							scan_value *value_ptr, scan_settings_mask *settings_mask )
+{
+	sim_settings *s = &goodie->settings;
+	scan_settings_mask derived = SCAN_SETTING_WIDTH | SCAN_SETTING_HEIGHT
+								| SCAN_SETTING_ROWBYTES;
+
+	switch( setting_id ) {
+	case SCAN_SETTING_AREA:
+		if( value_ptr->rect.left < 0 || value_ptr->rect.top < 0
+				|| value_ptr->rect.right > kBedWidth
+				|| value_ptr->rect.bottom > kBedHeight
+				|| value_ptr->rect.right <= value_ptr->rect.left
+				|| value_ptr->rect.bottom <= value_ptr->rect.top )
+			return SCAN_INVALID_SETTING;
+		s->area = value_ptr->rect;
+		*settings_mask |= derived;
+		break;
+
+	case SCAN_SETTING_IMAGETYPE:
+		switch( value_ptr->type ) {
+		case SCAN_TYPE_BINARY:	s->pixel_bits = 1; break;
+		case SCAN_TYPE_GRAY:	s->pixel_bits = 8; break;
+		case SCAN_TYPE_RGB:		s->pixel_bits = 24; break;
+		default:				return SCAN_INVALID_SETTING;
+		}
+		s->type = value_ptr->type;
+		*settings_mask |= derived | SCAN_SETTING_PIXELBITS;
+		break;
+
+	case SCAN_SETTING_PIXELBITS:
+		if( value_ptr->u_int == s->pixel_bits )
+			break;
+		if( ( s->type == SCAN_TYPE_GRAY && value_ptr->u_int != 8
+				&& value_ptr->u_int != 16 )
+			|| ( s->type == SCAN_TYPE_RGB && value_ptr->u_int != 24
+				&& value_ptr->u_int != 48 )
+			|| s->type == SCAN_TYPE_BINARY )
+			return SCAN_INVALID_SETTING;
+		s->pixel_bits = value_ptr->u_int;
+		*settings_mask |= SCAN_SETTING_ROWBYTES;
+		break;
+
+	case SCAN_SETTING_RESOLUTION:
+		if( value_ptr->u_int < 12 || value_ptr->u_int > 1200 )
+			return SCAN_INVALID_SETTING;
+		s->resolution = value_ptr->u_int;
+		*settings_mask |= derived;
+		break;
+
+	case SCAN_SETTING_BRIGHTNESS:
+		s->brightness = value_ptr->s_int;
+		break;
+
+	case SCAN_SETTING_CONTRAST:
+		s->contrast = value_ptr->s_int;
+		break;
+
+	case SCAN_SETTING_SCALING:
+		if( value_ptr->s_int < 10 || value_ptr->s_int > 400 )
+			return SCAN_INVALID_SETTING;
+		s->scaling = value_ptr->s_int;
+		*settings_mask |= derived;
+		break;
+
+	case SCAN_SETTING_WIDTH:
+	case SCAN_SETTING_HEIGHT:
+	case SCAN_SETTING_ROWBYTES:
+	default:
+		return SCAN_INVALID_SETTING;
+	}
+
+	return B_OK;
+}
+
+static status_t scn_get_setting(
+	void						*cookie,
+	const scan_setting_id		setting_id,
+	const scan_setting_kind		setting_kind,
+	scan_value					*value_ptr )
+{
+	sim_cookie *goodie = (sim_cookie *) cookie;
+	if( goodie->setting_latency )
+		snooze( goodie->setting_latency );
+	return get_value( goodie, setting_id, setting_kind, value_ptr );
+}
+
+static status_t scn_put_setting(
+	void					*cookie,
+	const scan_setting_id	setting_id,
+	scan_value				*value_ptr,
+	scan_settings_mask		*settings_mask )
+{
+	sim_cookie *goodie = (sim_cookie *) cookie;
+	if( goodie->setting_latency )
+		snooze( goodie->setting_latency );
+	*settings_mask = 0;
+	return put_value( goodie, setting_id, value_ptr, settings_mask );
+}
+
+static status_t get_all( sim_cookie *goodie, scan_setting_kind kind,
+							scan_settings *settings )
+{
+	scan_value value;
+	if( ! settings )
+		return B_OK;
+	get_value( goodie, SCAN_SETTING_AREA, kind, &value );
+	settings->scan_area = value.rect;
+	get_value( goodie, SCAN_SETTING_IMAGETYPE, kind, &value );
+	settings->image_type = value.type;
+	get_value( goodie, SCAN_SETTING_PIXELBITS, kind, &value );
+	settings->pixel_bits = value.u_int;
+	get_value( goodie, SCAN_SETTING_RESOLUTION, kind, &value );
+	settings->resolution = value.u_int;
+	get_value( goodie, SCAN_SETTING_BRIGHTNESS, kind, &value );
+	settings->brightness = value.s_int;
+	get_value( goodie, SCAN_SETTING_CONTRAST, kind, &value );
+	settings->contrast = value.s_int;
+	get_value( goodie, SCAN_SETTING_SCALING, kind, &value );
+	settings->scaling = value.s_int;
+	get_value( goodie, SCAN_SETTING_WIDTH, kind, &value );
+	settings->pixel_width = value.u_int;
+	get_value( goodie, SCAN_SETTING_HEIGHT, kind, &value );
+	settings->pixel_height = value.u_int;
+	get_value( goodie, SCAN_SETTING_ROWBYTES, kind, &value );
+	settings->row_bytes = value.u_int;
+	return B_OK;
+}
+
+/* The bulk hooks cost one round trip, however much they move. */
+static status_t scn_get_settings( void *cookie, scan_settings *current,
+								scan_settings *minimum, scan_settings *maximum )
+{
+	sim_cookie *goodie = (sim_cookie *) cookie;
+	if( goodie->setting_latency )
+		snooze( goodie->setting_latency );
+	get_all( goodie, SCAN_SETTING_CURRENT, current );
+	get_all( goodie, SCAN_SETTING_MINIMUM, minimum );
+	get_all( goodie, SCAN_SETTING_MAXIMUM, maximum );
+	return B_OK;
+}
+
+static status_t scn_put_settings( void *cookie, scan_settings *settings,
+								scan_settings_mask *mask )
+{
+	sim_cookie *goodie = (sim_cookie *) cookie;
+	sim_settings saved = goodie->settings;
+	scan_value value;
+	status_t status;
+
+	if( goodie->setting_latency )
+		snooze( goodie->setting_latency );
+	*mask = 0;
+
+	/* all or nothing */
+	value.rect = settings->scan_area;
+	status = put_value( goodie, SCAN_SETTING_AREA, &value, mask );
+	if( status == B_OK ) {
+		value.type = settings->image_type;
+		status = put_value( goodie, SCAN_SETTING_IMAGETYPE, &value, mask );
+	}
+	if( status == B_OK ) {
+		value.u_int = settings->pixel_bits;
+		status = put_value( goodie, SCAN_SETTING_PIXELBITS, &value, mask );
+	}
+	if( status == B_OK ) {
+		value.u_int = settings->resolution;
+		status = put_value( goodie, SCAN_SETTING_RESOLUTION, &value, mask );
+	}
+	if( status == B_OK ) {
+		value.s_int = settings->brightness;
+		status = put_value( goodie, SCAN_SETTING_BRIGHTNESS, &value, mask );
+	}
+	if( status == B_OK ) {
+		value.s_int = settings->contrast;
+		status = put_value( goodie, SCAN_SETTING_CONTRAST, &value, mask );
+	}
+	if( status == B_OK ) {
+		value.s_int = settings->scaling;
+		status = put_value( goodie, SCAN_SETTING_SCALING, &value, mask );
+	}
+	if( status != B_OK )
+		goodie->settings = saved;
+	return status;
+}
+
+static status_t scn_open_image( void *cookie )
+{
+	sim_cookie *goodie = (sim_cookie *) cookie;
+
+	figure_size( &goodie->settings, &goodie->width, &goodie->height,
+					&goodie->row_bytes );
+	if( goodie->width == 0 || goodie->height == 0 )
+		return SCAN_INVALID_SETTING;
+	goodie->row = 0;
+	if( goodie->adf_fed < goodie->adf_pages ) {
+		if( goodie->feed_latency )
+			snooze( goodie->feed_latency );
+		goodie->adf_fed++;
+	}
+	return make_pattern( goodie );
+}
+
+static status_t scn_close_image( void *cookie )
+{
+	sim_cookie *goodie = (sim_cookie *) cookie;
+	free( goodie->pattern );
+	goodie->pattern = NULL;
+	return B_OK;
+}
+
+static status_t scn_start( void *cookie )
+{
+	sim_cookie *goodie = (sim_cookie *) cookie;
+	return wait_for( goodie, goodie->start_latency );
+}
+
+/* Points at up to max bytes of whole rows from the pattern, without
+	wrapping past its end. */
+static int32 next_rows( sim_cookie *goodie, int32 max, const char **rows )
+{
+	uint32 first = goodie->row % kPatternRows;
+	uint32 count = max / goodie->row_bytes;
+	if( count > kPatternRows - first )
+		count = kPatternRows - first;
+	if( count > goodie->height - goodie->row )
+		count = goodie->height - goodie->row;
+	*rows = goodie->pattern + first * goodie->row_bytes;
+	goodie->row += count;
+	return count * goodie->row_bytes;
+}
+
+static status_t scn_data( void *cookie , void* buffer, int32* count )
+{
+	sim_cookie *goodie = (sim_cookie *) cookie;
+	char *dest = (char *) buffer;
+	int32 room = *count;
+
+	if( ! goodie->pattern )
+		return SCAN_BAD_PHASE;
+	if( room < (int32) goodie->row_bytes )
+		return SCAN_BAD_PARAM;
+	if( wait_for( goodie, goodie->data_latency ) != B_OK )
+		return SCAN_USER_CANCEL;
+
+	*count = 0;
+	while( goodie->row < goodie->height && room >= (int32) goodie->row_bytes ) {
+		const char *rows;
+		int32 size = next_rows( goodie, room, &rows );
+		memcpy( dest, rows, size );
+		dest += size;
+		room -= size;
+		*count += size;
+	}
+	if( goodie->row < goodie->height )
+		return B_OK;
+	return SCAN_DATA_END;
+}
+
+/* Lends rows straight out of the pattern, which is what a device with
+	its own DMA buffers would do. */
+static status_t scn_acquire_data( void *cookie, const void **rows, int32 *count )
+{
+	sim_cookie *goodie = (sim_cookie *) cookie;
+	int32 want = *count > 0 ? *count : kBandSize;
+	const char *band;
+
+	if( ! goodie->pattern )
+		return SCAN_BAD_PHASE;
+	if( want < (int32) goodie->row_bytes )
+		want = goodie->row_bytes;
+	if( wait_for( goodie, goodie->data_latency ) != B_OK )
+		return SCAN_USER_CANCEL;
+
+	*count = next_rows( goodie, want, &band );
+	*rows = band;
+	if( goodie->row < goodie->height )
+		return B_OK;
+	return SCAN_DATA_END;
+}
+
+static status_t scn_release_data( void *cookie, const void *rows )
+{
+	/* The pattern stays put until the image is closed. */
+	return B_OK;
+}
+
+/* Wakes whichever wait is going on, or the next one. */
+static void scn_cancel( void *cookie )
+{
+	sim_cookie *goodie = (sim_cookie *) cookie;
+	release_sem( goodie->cancel );
+}
+
+/* A band can't run past the end of the pattern, so that's the most one
+	data call gives. SIMSCAN_TRANSFER_SIZE asks for a different start. */
+static status_t scn_get_transfer_info( void *cookie, scan_transfer_info *info )
+{
+	sim_cookie *goodie = (sim_cookie *) cookie;
+	int32 preferred = (int32) env_time( "SIMSCAN_TRANSFER_SIZE" );
+	info->preferred = preferred > 0 ? preferred : kBandSize;
+	info->maximum = kPatternRows * goodie->row_bytes;
+	return B_OK;
+}
+
+bool scn_adf_ready( void *cookie )
+{
+	sim_cookie *goodie = (sim_cookie *) cookie;
+	return goodie->adf_fed < goodie->adf_pages;
+}
+
+void scn_error_message( void *cookie, status_t err, char *msg )
+{
+	msg[0] = 0;
+}
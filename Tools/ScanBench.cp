@@ -0,0 +1,855 @@
+/*
+	ScanBench -- times libscanbe against a scanner add-on.
+	Copyright (c) 1997, Jim Moy, All Rights Reserved
+
+	Meant to be run against the simulated scanner in SimScanner, so the
+	numbers are libscanbe's and not some scanner's, but any add-on will
+	do. Reports add-on enumeration and open/close times, the cost of
+	settings round trips, scan_data() latency percentiles and throughput.
+	With -n it runs that many sessions at once, each on its own thread,
+	which also makes a decent stress test of the per-session locking.
+
+	Builds headless on Linux through Tools/shim, see Tools/Makefile.
+*/
+
+#include "ScannerBe.h"
+#include "ScanConvert.h"
+#include "ScanBatch.h"
+#include "ScanPreview.h"
+#include "ScanTiles.h"
+#include "ScanAsync.h"
+#include "ScanChunk.h"
+#include "ScanPool.h"
+#include <OS.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+const char *kDefaultScanner = "application/x-vnd.jbm-simscanner";
+const uint32 kPreviewResolution = 75;
+
+/* What to run, from the command line. */
+struct bench_options {
+	const char	*scanner;
+	int32		sessions;
+	int32		images;
+	scan_type	type;
+	uint32		pixel_bits;			// 0 for the type's default
+	uint32		resolution;
+	int32		buf_size;
+	int32		readahead;			// depth, 0 for none
+	bool		lend;				// use scan_data_ex()
+	bool		tune;				// read through a scan_chunk_reader
+	bool		into;				// scan_data_into() a B_RGB_32_BIT band
+	int32		pages;				// or whole pages, kept in a pool this big;
+									// 0 for a new page each time, -1 for bands
+	int32		setting_loops;
+	bool		batch;				// feed pages through scan_batch()
+	const char	*file_pattern;		// batch into these files
+	scan_file_format format;		// of them
+	int32		encoders;			// threads in their pool, 0 for one per CPU
+	bigtime_t	work;				// app time per band, simulated
+	float		gamma;				// scan_set_process(), 0 for none
+	int32		threshold;			// and despeckle, 0 for none
+	int32		preview_width;		// time a preview pass this wide, 0 for none
+	int32		tile_size;			// keep the images in tile stores, 0 for none
+	bigtime_t	cancel_after;		// time cancelling a request, -1 for none
+};
+
+/* What one session measured. */
+struct session_result {
+	status_t	status;
+	bigtime_t	open_time;
+	bigtime_t	close_time;
+	bigtime_t	scan_time;			// open_image through close_image
+	int64		bytes;
+	bigtime_t	*latency;			// of each scan_data() call
+	int32		calls;
+	int32		latency_size;
+	scan_stats	stats;				// libscanbe's own count, before closing
+	int32		chunk_size;			// the chunk reader settled on, last image
+};
+
+struct session_args {
+	const bench_options	*options;
+	session_result		result;
+};
+
+/* Some local function prototypes. */
+static void usage();
+static status_t count_addon( const CallbackInfo *info, void *data );
+static void time_enumeration();
+static status_t set_up_session( scan_id id, const bench_options *options,
+								scan_settings *settings );
+static void time_settings( const bench_options *options );
+static void time_preview( const bench_options *options );
+static status_t preview_begin( void *data, const scan_preview_info *info );
+static status_t preview_rows( void *data, int32 first_row, const void *rows,
+								int32 row_count );
+static void time_cancel( const bench_options *options );
+static status_t cancel_rows( void *data, int32 first_row, const void *rows,
+								int32 count );
+static status_t run_session( void *data );
+static status_t run_batch( scan_id id, const bench_options *options,
+								session_result *result );
+static status_t count_begin_page( void *data, int32 page,
+								const scan_settings *settings );
+static status_t count_rows( void *data, const void *rows, int32 count );
+static status_t count_end_page( void *data, int32 page, status_t status );
+static void add_latency( session_result *result, bigtime_t latency );
+static int compare_times( const void *a, const void *b );
+static bigtime_t percentile( const bigtime_t *sorted, int32 count, int32 pct );
+static double mb_per_sec( int64 bytes, bigtime_t time );
+
+int main( int argc, char **argv )
+{
+	bench_options options;
+	options.scanner = kDefaultScanner;
+	options.sessions = 1;
+	options.images = 3;
+	options.type = SCAN_TYPE_RGB;
+	options.pixel_bits = 0;
+	options.resolution = 300;
+	options.buf_size = 64 * 1024L;
+	options.readahead = 0;
+	options.lend = false;
+	options.tune = false;
+	options.into = false;
+	options.pages = -1;
+	options.setting_loops = 1000;
+	options.batch = false;
+	options.file_pattern = NULL;
+	options.format = SCAN_FORMAT_TIFF;
+	options.encoders = 0;
+	options.work = 0;
+	options.gamma = 0;
+	options.threshold = 0;
+	options.preview_width = 0;
+	options.tile_size = 0;
+	options.cancel_after = -1;
+
+	int c;
+	while( ( c = getopt( argc, argv, "s:n:i:t:b:d:c:r:xuvP:q:ao:f:e:w:g:k:p:T:C:h" ) ) != -1 ) {
+		switch( c ) {
+		case 's':	options.scanner = optarg; break;
+		case 'n':	options.sessions = atol( optarg ); break;
+		case 'i':	options.images = atol( optarg ); break;
+		case 'b':	options.pixel_bits = atol( optarg ); break;
+		case 'd':	options.resolution = atol( optarg ); break;
+		case 'c':	options.buf_size = atol( optarg ) * 1024L; break;
+		case 'r':	options.readahead = atol( optarg ); break;
+		case 'x':	options.lend = true; break;
+		case 'u':	options.tune = true; break;
+		case 'v':	options.into = true; break;
+		case 'P':	options.into = true; options.pages = atol( optarg ); break;
+		case 'q':	options.setting_loops = atol( optarg ); break;
+		case 'a':	options.batch = true; break;
+		case 'o':	options.batch = true; options.file_pattern = optarg; break;
+		case 'w':	options.work = atol( optarg ); break;
+		case 'e':	options.encoders = atol( optarg ); break;
+		case 'g':	options.gamma = atof( optarg ); break;
+		case 'k':	options.threshold = atol( optarg ); break;
+		case 'p':	options.preview_width = atol( optarg ); break;
+		case 'T':	options.tile_size = atol( optarg ); break;
+		case 'C':	options.cancel_after = atol( optarg ); break;
+		case 'f':
+			if( strcmp( optarg, "tga" ) == 0 )
+				options.format = SCAN_FORMAT_TGA;
+			else if( strcmp( optarg, "pnm" ) == 0 )
+				options.format = SCAN_FORMAT_PNM;
+			else if( strcmp( optarg, "tiff" ) == 0 )
+				options.format = SCAN_FORMAT_TIFF;
+			else if( strcmp( optarg, "zip" ) == 0 )
+				options.format = SCAN_FORMAT_TIFF_DEFLATE;
+			else if( strcmp( optarg, "png" ) == 0 )
+				options.format = SCAN_FORMAT_PNG;
+			else
+				usage();
+			break;
+		case 't':
+			if( strcmp( optarg, "rgb" ) == 0 )
+				options.type = SCAN_TYPE_RGB;
+			else if( strcmp( optarg, "gray" ) == 0 )
+				options.type = SCAN_TYPE_GRAY;
+			else if( strcmp( optarg, "binary" ) == 0 )
+				options.type = SCAN_TYPE_BINARY;
+			else
+				usage();
+			break;
+		default:
+			usage();
+		}
+	}
+	if( options.sessions < 1 || options.images < 1 || options.buf_size <= 0 )
+		usage();
+
+	// the simulated scanner's feeder holds as many pages as we want images
+	char pages[32];
+	sprintf( pages, "%ld", options.images );
+	if( options.batch )
+		setenv( "SIMSCAN_ADF_PAGES", pages, 0 );
+
+	scan_version version;
+	scan_get_version( &version );
+	printf( "%s, converters: %s\n", version.info, scan_convert_implementation() );
+	printf( "scanner: %s\n\n", options.scanner );
+
+	time_enumeration();
+	time_settings( &options );
+	if( options.preview_width > 0 )
+		time_preview( &options );
+	if( options.cancel_after >= 0 )
+		time_cancel( &options );
+
+	session_args *args = new session_args[ options.sessions ];
+	thread_id *threads = new thread_id[ options.sessions ];
+	bigtime_t start = system_time();
+	for( int32 i = 0; i < options.sessions; i++ ) {
+		args[i].options = &options;
+		threads[i] = spawn_thread( run_session, "bench session",
+									B_NORMAL_PRIORITY, &args[i] );
+		if( threads[i] >= B_OK )
+			resume_thread( threads[i] );
+		else
+			args[i].result.status = threads[i];
+	}
+	status_t status = B_OK;
+	for( int32 i = 0; i < options.sessions; i++ ) {
+		status_t exitValue;
+		if( threads[i] >= B_OK )
+			wait_for_thread( threads[i], &exitValue );
+		if( args[i].result.status != B_OK )
+			status = args[i].result.status;
+	}
+	bigtime_t elapsed = system_time() - start;
+
+	if( status != B_OK ) {
+		fprintf( stderr, "Scanning failed (0x%lX)\n", status );
+		return 1;
+	}
+
+	// all the sessions' scan_data() latencies together
+	int32 calls = 0;
+	int64 bytes = 0;
+	for( int32 i = 0; i < options.sessions; i++ ) {
+		calls += args[i].result.calls;
+		bytes += args[i].result.bytes;
+	}
+	bigtime_t *all = (bigtime_t *) malloc( calls * sizeof( bigtime_t ) + 1 );
+	int32 n = 0;
+	for( int32 i = 0; i < options.sessions; i++ ) {
+		memcpy( all + n, args[i].result.latency,
+				args[i].result.calls * sizeof( bigtime_t ) );
+		n += args[i].result.calls;
+	}
+	qsort( all, calls, sizeof( bigtime_t ), compare_times );
+
+	printf( "scanning, %ld session(s) x %ld image(s), %s%s, %ldK buffer",
+			options.sessions, options.images,
+			options.batch ? "scan_batch" : options.tune ? "scan_chunk_read"
+				: options.into ? "scan_data_into" : options.lend ? "scan_data_ex"
+				: "scan_data",
+			options.readahead ? " + read-ahead" : "",
+			options.buf_size / 1024 );
+	if( options.readahead )
+		printf( ", depth %ld", options.readahead );
+	if( options.gamma > 0 )
+		printf( ", gamma %.2f", options.gamma );
+	if( options.threshold > 0 )
+		printf( ", threshold %ld", options.threshold );
+	if( options.tile_size > 0 )
+		printf( ", %ld pixel tiles", options.tile_size );
+	if( options.pages > 0 )
+		printf( ", pages from a pool of %ld", options.pages );
+	else if( options.pages == 0 )
+		printf( ", a new page each time" );
+	printf( "\n" );
+	for( int32 i = 0; i < options.sessions; i++ ) {
+		const session_result &r = args[i].result;
+		printf( "  session %ld: open %Ld us, close %Ld us, %.1f MB/s\n", i,
+				r.open_time, r.close_time, mb_per_sec( r.bytes, r.scan_time ) );
+		if( r.chunk_size )
+			printf( "    chunks settled at %ldK\n", r.chunk_size / 1024 );
+
+		// where the time went, by libscanbe's count
+		const scan_stats &st = r.stats;
+		bigtime_t addon = st.hooks[SCAN_HOOK_DATA].total_time
+						+ st.hooks[SCAN_HOOK_ACQUIRE_DATA].total_time
+						+ st.hooks[SCAN_HOOK_RELEASE_DATA].total_time;
+		printf( "    add-on %Ld us, in data calls %Ld us, app %Ld us, "
+				"read-ahead wait %Ld us\n", addon, st.data_calls.total_time,
+				st.app_time.total_time, st.readahead_wait );
+	}
+	printf( "  %ld calls, %.1f MB total, %.1f MB/s aggregate\n", calls,
+			bytes / ( 1024.0 * 1024.0 ), mb_per_sec( bytes, elapsed ) );
+	if( calls )
+		printf( "  latency us: p50 %Ld, p90 %Ld, p99 %Ld, max %Ld\n",
+				percentile( all, calls, 50 ), percentile( all, calls, 90 ),
+				percentile( all, calls, 99 ), all[calls - 1] );
+
+	free( all );
+	for( int32 i = 0; i < options.sessions; i++ )
+		free( args[i].result.latency );
+	delete [] threads;
+	delete [] args;
+	return 0;
+}
+
+static void usage()
+{
+	fprintf( stderr,
+		"usage: ScanBench [-s scanner] [-n sessions] [-i images]\n"
+		"                 [-t rgb|gray|binary] [-b pixel bits] [-d dpi]\n"
+		"                 [-c buffer KB] [-r read-ahead depth] [-x] [-u] [-v]\n"
+		"                 [-P pages] [-q loops] [-a] [-o file pattern] [-f format]\n"
+		"                 [-e threads] [-w us] [-g gamma] [-k threshold]\n"
+		"                 [-p preview width] [-T tile size] [-C us]\n"
+		"  -x  use scan_data_ex() instead of scan_data()\n"
+		"  -u  read through a chunk reader, which tunes its own size\n"
+		"  -v  convert with scan_data_into(), a buffer's worth of rows at a time\n"
+		"  -P  same, into whole pages kept in a scan_page_pool this big, or 0\n"
+		"      to allocate each page\n"
+		"  -q  settings round trips to time\n"
+		"  -a  scan the images as feeder pages with scan_batch()\n"
+		"  -o  same, into files named by a printf pattern\n"
+		"  -f  their format: tga, pnm, tiff (the default), zip (deflated TIFF) or png\n"
+		"  -e  threads to compress them with, 0 for one per CPU (the default)\n"
+		"  -w  simulated app work per buffer, in microseconds\n"
+		"  -g  have libscanbe apply a gamma to the rows\n"
+		"  -k  have libscanbe threshold gray rows and despeckle them\n"
+		"  -p  time a preview pass at %ld dpi, reduced to this width\n"
+		"  -T  write the images into tile stores in temporary files\n"
+		"  -C  time cancelling a background scan this long after it's submitted\n",
+		kPreviewResolution );
+	exit( 2 );
+}
+
+#pragma mark ---- Enumeration and Settings ----
+
+static status_t count_addon( const CallbackInfo *info, void *data )
+{
+	( *(int32 *) data )++;
+	return B_OK;
+}
+
+/* The first scan_get_addons() builds the add-on catalog, later ones read it. */
+static void time_enumeration()
+{
+	const int32 kLoops = 100;
+	int32 count = 0;
+	bigtime_t start = system_time();
+	status_t status = scan_get_addons( count_addon, &count );
+	bigtime_t cold = system_time() - start;
+	if( status != B_OK ) {
+		fprintf( stderr, "Couldn't list add-ons (0x%lX)\n", status );
+		return;
+	}
+
+	int32 warmCount = 0;
+	start = system_time();
+	for( int32 i = 0; i < kLoops; i++ )
+		scan_get_addons( count_addon, &warmCount );
+	bigtime_t warm = ( system_time() - start ) / kLoops;
+
+	printf( "scan_get_addons: %ld add-on(s), cold %Ld us, warm %Ld us\n",
+			count, cold, warm );
+}
+
+static status_t set_up_session( scan_id id, const bench_options *options,
+								scan_settings *settings )
+{
+	status_t status = scan_get_settings( id, settings, NULL, NULL );
+	if( status != B_OK )
+		return status;
+
+	settings->image_type = options->type;
+	switch( options->type ) {
+	case SCAN_TYPE_BINARY:	settings->pixel_bits = 1; break;
+	case SCAN_TYPE_GRAY:	settings->pixel_bits = 8; break;
+	default:				settings->pixel_bits = 24; break;
+	}
+	if( options->pixel_bits )
+		settings->pixel_bits = options->pixel_bits;
+	settings->resolution = options->resolution;
+
+	scan_settings_mask mask;
+	status = scan_put_settings( id, settings, &mask );
+	if( status != B_OK )
+		return status;
+	return scan_get_settings( id, settings, NULL, NULL );
+}
+
+/* Times the ways of getting at settings, on a session of its own. */
+static void time_settings( const bench_options *options )
+{
+	scan_id id;
+	scan_version version;
+	status_t status = scan_open( options->scanner, &id, &version );
+	if( status != B_OK ) {
+		fprintf( stderr, "Couldn't open scanner: %s (0x%lX)\n",
+					options->scanner, status );
+		exit( 1 );
+	}
+
+	scan_settings settings, minimum, maximum;
+	scan_settings_mask mask;
+	scan_value value;
+	int32 loops = options->setting_loops > 0 ? options->setting_loops : 1;
+	bigtime_t start;
+
+	start = system_time();
+	status = scan_get_settings( id, &settings, &minimum, &maximum );
+	bigtime_t first = system_time() - start;
+
+	start = system_time();
+	for( int32 i = 0; i < loops; i++ )
+		scan_get_settings( id, &settings, NULL, NULL );
+	double cached = (double) ( system_time() - start ) / loops;
+
+	start = system_time();
+	for( int32 i = 0; i < loops; i++ )
+		scan_get_one_setting( id, SCAN_SETTING_WIDTH, SCAN_SETTING_CURRENT, &value );
+	double getOne = (double) ( system_time() - start ) / loops;
+
+	// a resolution change invalidates the size, so the get has to go
+	// back to the scanner
+	start = system_time();
+	for( int32 i = 0; i < loops; i++ ) {
+		value.u_int = i & 1 ? settings.resolution : settings.resolution / 2;
+		scan_put_one_setting( id, SCAN_SETTING_RESOLUTION, &value, &mask );
+		scan_get_one_setting( id, SCAN_SETTING_WIDTH, SCAN_SETTING_CURRENT, &value );
+	}
+	double putGet = (double) ( system_time() - start ) / loops;
+
+	start = system_time();
+	for( int32 i = 0; i < loops; i++ ) {
+		settings.brightness = i & 1;
+		scan_put_settings( id, &settings, &mask );
+		scan_get_settings( id, &settings, NULL, NULL );
+	}
+	double putGetAll = (double) ( system_time() - start ) / loops;
+
+	scan_close( id );
+
+	if( status != B_OK ) {
+		fprintf( stderr, "Couldn't get scanner settings (0x%lX)\n", status );
+		exit( 1 );
+	}
+	printf( "settings, us per call:\n" );
+	printf( "  scan_get_settings all three, first     %Ld\n", first );
+	printf( "  scan_get_settings, cached              %.2f\n", cached );
+	printf( "  scan_get_one_setting, cached           %.2f\n", getOne );
+	printf( "  put_one_setting + get_one_setting      %.2f\n", putGet );
+	printf( "  scan_put_settings + scan_get_settings  %.2f\n\n", putGetAll );
+}
+
+/* What a preview pass saw. */
+struct preview_result {
+	bigtime_t			start;
+	bigtime_t			first_rows;		// from the start
+	int32				updates;
+	int32				rows;
+	scan_preview_info	info;
+};
+
+/* A preview pass at low resolution, on a session of its own. What counts
+	for an interactive app is how soon the first rows show up. */
+static void time_preview( const bench_options *options )
+{
+	scan_id id;
+	scan_version version;
+	status_t status = scan_open( options->scanner, &id, &version );
+	if( status != B_OK ) {
+		fprintf( stderr, "Couldn't open scanner: %s (0x%lX)\n",
+					options->scanner, status );
+		exit( 1 );
+	}
+
+	preview_result result;
+	memset( &result, 0, sizeof( result ) );
+	scan_settings settings;
+	status = set_up_session( id, options, &settings );
+	if( status == B_OK ) {
+		scan_preview_sink sink;
+		sink.begin = preview_begin;
+		sink.rows = preview_rows;
+		sink.data = &result;
+		result.start = system_time();
+		status = scan_preview_pass( id, kPreviewResolution,
+									options->preview_width, 0, &sink );
+	}
+	bigtime_t elapsed = system_time() - result.start;
+	scan_close( id );
+
+	if( status != B_OK ) {
+		fprintf( stderr, "Preview failed (0x%lX)\n", status );
+		exit( 1 );
+	}
+	printf( "preview at %ld dpi: %ld x %ld, 1/%ld of the scan\n",
+			result.info.settings.resolution, result.info.width,
+			result.info.height, result.info.factor );
+	printf( "  first rows %Ld us, %ld updates, done %Ld us\n\n",
+			result.first_rows, result.updates, elapsed );
+}
+
+/* A background scan, cancelled part way. What counts is how long the
+	request takes to be done once it's told to stop; set SIMSCAN_START_LATENCY
+	or SIMSCAN_DATA_LATENCY to have the simulated scanner be waiting. */
+static void time_cancel( const bench_options *options )
+{
+	scan_id id;
+	scan_version version;
+	status_t status = scan_open( options->scanner, &id, &version );
+	if( status != B_OK ) {
+		fprintf( stderr, "Couldn't open scanner: %s (0x%lX)\n",
+					options->scanner, status );
+		exit( 1 );
+	}
+
+	int64 bytes = 0;
+	status_t result = B_OK;
+	bigtime_t stopped = 0;
+	scan_settings settings;
+	status = set_up_session( id, options, &settings );
+	if( status == B_OK ) {
+		scan_request_sink sink;
+		memset( &sink, 0, sizeof( sink ) );
+		sink.rows = cancel_rows;
+		sink.data = &bytes;
+		sink.port = -1;
+		scan_request *request;
+		status = scan_submit( id, SCAN_REQUEST_START | SCAN_REQUEST_IMAGE,
+								&sink, &request );
+		if( status == B_OK ) {
+			snooze( options->cancel_after );
+			bigtime_t start = system_time();
+			scan_request_cancel( request );
+			scan_request_wait( request, B_INFINITE_TIMEOUT, &result );
+			stopped = system_time() - start;
+			scan_request_delete( request );
+		}
+	}
+	scan_close( id );
+
+	if( status != B_OK ) {
+		fprintf( stderr, "Request failed (0x%lX)\n", status );
+		exit( 1 );
+	}
+	printf( "cancel after %Ld us: done in %Ld us, %s, %Ld KB in\n\n",
+			options->cancel_after, stopped,
+			result == SCAN_USER_CANCEL ? "cancelled" : "finished", bytes / 1024 );
+}
+
+static status_t cancel_rows( void *data, int32 first_row, const void *rows,
+								int32 count )
+{
+	*(int64 *) data += count;
+	return B_OK;
+}
+
+static status_t preview_begin( void *data, const scan_preview_info *info )
+{
+	( (preview_result *) data )->info = *info;
+	return B_OK;
+}
+
+static status_t preview_rows( void *data, int32 first_row, const void *rows,
+								int32 row_count )
+{
+	preview_result *result = (preview_result *) data;
+	if( result->updates++ == 0 )
+		result->first_rows = system_time() - result->start;
+	result->rows += row_count;
+	return B_OK;
+}
+
+#pragma mark ---- Scanning ----
+
+/* One session: open, scan the images, close. Runs on its own thread. */
+static status_t run_session( void *data )
+{
+	session_args *args = (session_args *) data;
+	const bench_options *options = args->options;
+	session_result *result = &args->result;
+	memset( result, 0, sizeof( session_result ) );
+
+	scan_id id;
+	scan_version version;
+	bigtime_t start = system_time();
+	status_t status = scan_open( options->scanner, &id, &version );
+	result->open_time = system_time() - start;
+	if( status != B_OK ) {
+		fprintf( stderr, "Couldn't open scanner: %s (0x%lX)\n",
+					options->scanner, status );
+		result->status = status;
+		return status;
+	}
+
+	scan_settings settings;
+	status = set_up_session( id, options, &settings );
+	if( status != B_OK )
+		fprintf( stderr, "Couldn't set up the scanner (0x%lX)\n", status );
+	if( status == B_OK && options->readahead )
+		scan_set_readahead( id, options->readahead, options->buf_size );
+	if( status == B_OK && ( options->gamma > 0 || options->threshold > 0 ) ) {
+		scan_process process;
+		memset( &process, 0, sizeof( process ) );
+		process.size = sizeof( process );
+		process.white = 255;
+		process.gamma = options->gamma;
+		process.threshold = options->threshold;
+		process.despeckle = options->threshold > 0;
+		status = scan_set_process( id, &process );
+		if( status != B_OK )
+			fprintf( stderr, "Couldn't set the processing (0x%lX)\n", status );
+	}
+
+	// scan_data_into() fills whole B_RGB_32_BIT rows, at least one
+	int32 intoStride = settings.pixel_width * 4;
+	int32 intoRows = options->buf_size / intoStride;
+	if( intoRows < 1 )
+		intoRows = 1;
+	char *buffer = (char *) malloc( options->into ? intoRows * intoStride
+											: options->buf_size );
+	scan_page_pool *pool = NULL;
+	if( status == B_OK && options->pages > 0 )
+		status = scan_page_pool_create( options->pages, &pool );
+	if( status == B_OK && ! buffer )
+		status = B_NO_MEMORY;
+
+	if( status == B_OK && options->batch )
+		status = run_batch( id, options, result );
+
+	for( int32 image = 0; status == B_OK && ! options->batch
+							&& image < options->images; image++ ) {
+		bigtime_t imageStart = system_time();
+		status = scan_open_image( id );
+		if( status != B_OK ) {
+			fprintf( stderr, "Couldn't open the image (0x%lX)\n", status );
+			break;
+		}
+
+		// a whole page to scan into, as an app keeping the image would
+		scan_page *page = NULL;
+		char *pageBits = NULL;
+		int32 pageStride = intoStride;
+		if( pool ) {
+			status = scan_page_pool_get( pool, &settings, SCAN_PIXEL_BGRA32, &page );
+			if( status != B_OK ) {
+				fprintf( stderr, "Couldn't get a page (0x%lX)\n", status );
+				scan_close_image( id );
+				break;
+			}
+			pageBits = (char *) page->bits;
+			pageStride = page->bytes_per_row;
+		} else if( options->pages == 0 )
+			pageBits = (char *) malloc( intoStride * settings.pixel_height );
+
+		scan_tile_store *tiles = NULL;
+		if( options->tile_size > 0 ) {
+			status = scan_tiles_create( NULL, &settings, options->tile_size, &tiles );
+			if( status != B_OK ) {
+				fprintf( stderr, "Couldn't create the tiles (0x%lX)\n", status );
+				scan_close_image( id );
+				break;
+			}
+		}
+
+		scan_chunk_reader *chunks = NULL;
+		if( options->tune ) {
+			status = scan_chunk_open( id, 0, &chunks );
+			if( status != B_OK ) {
+				fprintf( stderr, "Couldn't open a chunk reader (0x%lX)\n", status );
+				scan_close_image( id );
+				if( tiles )
+					scan_tiles_delete( tiles );
+				break;
+			}
+		}
+
+		int64 bytes = 0;
+		int32 intoRow = 0;
+		for( bool notDone = true; notDone; ) {
+			int32 count = options->buf_size;
+			const void *rows;
+			bigtime_t callStart = system_time();
+			if( chunks )
+				status = scan_chunk_read( chunks, &rows, &count );
+			else if( options->into ) {
+				scan_destination dest;
+				dest.size = sizeof( dest );
+				dest.bits = pageBits ? pageBits + intoRow * pageStride : buffer;
+				dest.bytes_per_row = pageStride;
+				dest.format = SCAN_PIXEL_BGRA32;
+				dest.first_row = intoRow;
+				dest.rows = intoRows;
+				dest.alpha = 255;
+				int32 done;
+				status = scan_data_into( id, &dest, &done );
+				intoRow += done;
+				count = done * settings.row_bytes;		// as scanned, to check
+			}
+			else if( options->lend )
+				status = scan_data_ex( id, &rows, &count );
+			else
+				status = scan_data( id, buffer, &count );
+			add_latency( result, system_time() - callStart );
+
+			if( status == SCAN_DATA_END ) {
+				status = B_OK;
+				notDone = false;
+			} else if( status != B_OK ) {
+				fprintf( stderr, "Scanning failed (0x%lX)\n", status );
+				notDone = false;
+			}
+			bytes += count;
+			if( tiles && count > 0 && ! options->into ) {
+				status_t tileStat = scan_tiles_write( tiles,
+										chunks || options->lend ? rows : buffer, count );
+				if( tileStat != B_OK ) {
+					fprintf( stderr, "Couldn't write the tiles (0x%lX)\n", tileStat );
+					status = tileStat;
+					notDone = false;
+				}
+			}
+			if( options->work )
+				snooze( options->work );
+			if( options->lend && ! chunks && count > 0 )
+				scan_release_data( id, rows );
+		}
+		if( chunks ) {
+			result->chunk_size = scan_chunk_size( chunks, NULL );
+			scan_chunk_close( chunks );
+		}
+
+		status_t closeStat = scan_close_image( id );
+		if( status == B_OK )
+			status = closeStat;
+		if( tiles )
+			scan_tiles_delete( tiles );
+		if( page )
+			scan_page_pool_put( pool, page );
+		else
+			free( pageBits );
+		result->scan_time += system_time() - imageStart;
+		result->bytes += bytes;
+
+		if( status == B_OK && bytes
+				!= (int64) settings.row_bytes * settings.pixel_height ) {
+			fprintf( stderr, "Got %Ld bytes, expected %Ld\n", bytes,
+					(int64) settings.row_bytes * settings.pixel_height );
+			status = B_ERROR;
+		}
+	}
+	free( buffer );
+	if( pool )
+		scan_page_pool_delete( pool );
+
+	result->stats.size = sizeof( result->stats );
+	scan_get_stats( id, &result->stats );
+
+	start = system_time();
+	status_t closeStat = scan_close( id );
+	result->close_time = system_time() - start;
+	if( status == B_OK )
+		status = closeStat;
+	result->status = status;
+	return status;
+}
+
+/* The feeder's pages through scan_batch(), with the app's work done on
+	the sink thread. */
+static status_t run_batch( scan_id id, const bench_options *options,
+								session_result *result )
+{
+	bigtime_t start = system_time();
+	int32 pages = 0;
+	status_t status;
+	if( options->file_pattern ) {
+		scan_encoder_pool *pool;
+		status = scan_encoder_pool_create( options->encoders, 0, &pool );
+		if( status == B_OK ) {
+			status = scan_batch_to_files_etc( id, NULL, options->file_pattern,
+											options->format, pool, &pages );
+			scan_encoder_pool_delete( pool );
+		}
+	} else {
+		scan_batch_sink sink;
+		sink.begin_page = count_begin_page;
+		sink.rows = count_rows;
+		sink.end_page = count_end_page;
+		sink.data = (void *) options;
+		status = scan_batch( id, NULL, &sink, 0, options->buf_size, &pages );
+	}
+	result->scan_time = system_time() - start;
+
+	scan_stats stats;
+	stats.size = sizeof( stats );
+	scan_get_stats( id, &stats );
+	result->bytes = stats.bytes;
+
+	if( status != B_OK )
+		fprintf( stderr, "Batch failed after %ld page(s) (0x%lX)\n", pages, status );
+	else if( pages != options->images ) {
+		fprintf( stderr, "Batch got %ld page(s), expected %ld\n", pages,
+				options->images );
+		status = B_ERROR;
+	}
+	return status;
+}
+
+static status_t count_begin_page( void *data, int32 page,
+								const scan_settings *settings )
+{
+	return B_OK;
+}
+
+static status_t count_rows( void *data, const void *rows, int32 count )
+{
+	const bench_options *options = (const bench_options *) data;
+	if( options->work )
+		snooze( options->work );
+	return B_OK;
+}
+
+static status_t count_end_page( void *data, int32 page, status_t status )
+{
+	return B_OK;
+}
+
+static void add_latency( session_result *result, bigtime_t latency )
+{
+	if( result->calls == result->latency_size ) {
+		int32 size = result->latency_size ? result->latency_size * 2 : 1024;
+		bigtime_t *grown = (bigtime_t *) realloc( result->latency,
+										size * sizeof( bigtime_t ) );
+		if( ! grown )
+			return;
+		result->latency = grown;
+		result->latency_size = size;
+	}
+	result->latency[ result->calls++ ] = latency;
+}
+
+static int compare_times( const void *a, const void *b )
+{
+	bigtime_t x = *(const bigtime_t *) a;
+	bigtime_t y = *(const bigtime_t *) b;
+	return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static bigtime_t percentile( const bigtime_t *sorted, int32 count, int32 pct )
+{
+	if( count == 0 )
+		return 0;
+	int32 i = (int32) ( (int64) count * pct / 100 );
+	return sorted[ i < count ? i : count - 1 ];
+}
+
+static double mb_per_sec( int64 bytes, bigtime_t time )
+{
+	if( time <= 0 )
+		return 0;
+	return ( bytes / ( 1024.0 * 1024.0 ) ) / ( time / 1000000.0 );
+}
@@ -0,0 +1,22 @@
+/* ScannerBe headless shim -- BAutolock. */
+
+#ifndef _SHIM_AUTOLOCK_H
+#define _SHIM_AUTOLOCK_H
+
+#include <Locker.h>
+
+class BAutolock {
+public:
+					BAutolock( BLocker *locker ) : fLocker( locker )
+						{ fLocked = fLocker->Lock(); }
+					BAutolock( BLocker &locker ) : fLocker( &locker )
+						{ fLocked = fLocker->Lock(); }
+					~BAutolock() { if( fLocked ) fLocker->Unlock(); }
+		bool		IsLocked() const { return fLocked; }
+
+private:
+		BLocker*	fLocker;
+		bool		fLocked;
+};
+
+#endif /* _SHIM_AUTOLOCK_H */
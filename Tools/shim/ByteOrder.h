@@ -0,0 +1,26 @@
+/* ScannerBe headless shim -- byte order helpers. */
+
+#ifndef _SHIM_BYTE_ORDER_H
+#define _SHIM_BYTE_ORDER_H
+
+#include <SupportDefs.h>
+#include <endian.h>
+
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+#define B_HOST_IS_LENDIAN	1
+#define B_HOST_IS_BENDIAN	0
+#else
+#define B_HOST_IS_LENDIAN	0
+#define B_HOST_IS_BENDIAN	1
+#endif
+
+#define B_HOST_TO_LENDIAN_INT16( x )	( (uint16) htole16( x ) )
+#define B_HOST_TO_LENDIAN_INT32( x )	( (uint32) htole32( x ) )
+#define B_HOST_TO_BENDIAN_INT16( x )	( (uint16) htobe16( x ) )
+#define B_HOST_TO_BENDIAN_INT32( x )	( (uint32) htobe32( x ) )
+#define B_LENDIAN_TO_HOST_INT16( x )	( (uint16) le16toh( x ) )
+#define B_LENDIAN_TO_HOST_INT32( x )	( (uint32) le32toh( x ) )
+#define B_BENDIAN_TO_HOST_INT16( x )	( (uint16) be16toh( x ) )
+#define B_BENDIAN_TO_HOST_INT32( x )	( (uint32) be32toh( x ) )
+
+#endif /* _SHIM_BYTE_ORDER_H */
@@ -0,0 +1,14 @@
+/* ScannerBe headless shim -- debugging macros. */
+
+#ifndef _SHIM_DEBUG_H
+#define _SHIM_DEBUG_H
+
+#include <assert.h>
+
+#if DEBUG
+#define ASSERT( x )		assert( x )
+#else
+#define ASSERT( x )		((void) 0)
+#endif
+
+#endif /* _SHIM_DEBUG_H */
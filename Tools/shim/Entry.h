@@ -0,0 +1,2 @@
+/* ScannerBe headless shim. */
+#include <ShimStorage.h>
@@ -0,0 +1,19 @@
+/* ScannerBe headless shim -- find_directory(). */
+
+#ifndef _SHIM_FIND_DIRECTORY_H
+#define _SHIM_FIND_DIRECTORY_H
+
+#include <ShimStorage.h>
+
+typedef enum {
+	B_USER_DIRECTORY = 3000,
+	B_USER_CONFIG_DIRECTORY,
+	B_USER_ADDONS_DIRECTORY,
+	B_USER_SETTINGS_DIRECTORY,
+	B_USER_LIB_DIRECTORY
+} directory_which;
+
+status_t find_directory( directory_which which, BPath *path,
+						bool createIt = false, void *volume = NULL );
+
+#endif /* _SHIM_FIND_DIRECTORY_H */
@@ -0,0 +1,82 @@
+/* ScannerBe headless shim -- BList. */
+
+#ifndef _SHIM_LIST_H
+#define _SHIM_LIST_H
+
+#include <SupportDefs.h>
+#include <stdlib.h>
+#include <string.h>
+
+class BList {
+public:
+					BList( int32 blockSize = 20 )
+						: fItems( NULL ), fCount( 0 ), fSize( 0 ) {}
+					~BList() { free( fItems ); }
+
+		bool		AddItem( void *item ) { return AddItem( item, fCount ); }
+		bool		AddItem( void *item, int32 index )
+					{
+						if( index < 0 || index > fCount )
+							return false;
+						if( fCount == fSize ) {
+							int32 newSize = fSize ? fSize * 2 : 16;
+							void **items = (void **) realloc( fItems,
+													newSize * sizeof( void * ) );
+							if( ! items )
+								return false;
+							fItems = items;
+							fSize = newSize;
+						}
+						memmove( fItems + index + 1, fItems + index,
+								( fCount - index ) * sizeof( void * ) );
+						fItems[index] = item;
+						fCount++;
+						return true;
+					}
+		bool		RemoveItem( void *item )
+					{
+						int32 index = IndexOf( item );
+						if( index < 0 )
+							return false;
+						RemoveItem( index );
+						return true;
+					}
+		bool		AddList( const BList *list )
+					{
+						for( int32 i = 0; i < list->fCount; i++ )
+							if( ! AddItem( list->fItems[i] ) )
+								return false;
+						return true;
+					}
+		void*		RemoveItem( int32 index )
+					{
+						if( index < 0 || index >= fCount )
+							return NULL;
+						void *item = fItems[index];
+						memmove( fItems + index, fItems + index + 1,
+								( fCount - index - 1 ) * sizeof( void * ) );
+						fCount--;
+						return item;
+					}
+		void*		ItemAt( int32 index ) const
+					{
+						return ( index < 0 || index >= fCount ) ? NULL : fItems[index];
+					}
+		int32		IndexOf( void *item ) const
+					{
+						for( int32 i = 0; i < fCount; i++ )
+							if( fItems[i] == item )
+								return i;
+						return -1;
+					}
+		int32		CountItems() const { return fCount; }
+		bool		IsEmpty() const { return fCount == 0; }
+		void		MakeEmpty() { fCount = 0; }
+
+private:
+		void**		fItems;
+		int32		fCount;
+		int32		fSize;
+};
+
+#endif /* _SHIM_LIST_H */
@@ -0,0 +1,48 @@
+/* ScannerBe headless shim -- BLocker. */
+
+#ifndef _SHIM_LOCKER_H
+#define _SHIM_LOCKER_H
+
+#include <SupportDefs.h>
+#include <pthread.h>
+
+class BLocker {
+public:
+					BLocker( const char *name = NULL )
+					{
+						pthread_mutexattr_t attr;
+						pthread_mutexattr_init( &attr );
+						pthread_mutexattr_settype( &attr, PTHREAD_MUTEX_RECURSIVE );
+						pthread_mutex_init( &fMutex, &attr );
+						pthread_mutexattr_destroy( &attr );
+						fOwner = 0;
+						fCount = 0;
+					}
+					~BLocker() { pthread_mutex_destroy( &fMutex ); }
+
+		status_t	InitCheck() const { return B_OK; }
+		bool		Lock()
+					{
+						pthread_mutex_lock( &fMutex );
+						fOwner = pthread_self();
+						fCount++;
+						return true;
+					}
+		void		Unlock()
+					{
+						if( --fCount == 0 )
+							fOwner = 0;
+						pthread_mutex_unlock( &fMutex );
+					}
+		bool		IsLocked() const
+					{
+						return fCount > 0 && pthread_equal( fOwner, pthread_self() );
+					}
+
+private:
+		pthread_mutex_t	fMutex;
+		pthread_t		fOwner;
+		int32			fCount;
+};
+
+#endif /* _SHIM_LOCKER_H */
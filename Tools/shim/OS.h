@@ -0,0 +1,135 @@
+/* ScannerBe headless shim -- kernel kit: threads, semaphores, areas, ports. */
+
+#ifndef _SHIM_OS_H
+#define _SHIM_OS_H
+
+#include <SupportDefs.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define B_OS_NAME_LENGTH		32
+#define B_PAGE_SIZE				4096
+#define B_INFINITE_TIMEOUT		(9223372036854775807LL)
+
+typedef int32 thread_id;
+typedef int32 sem_id;
+typedef int32 area_id;
+typedef int32 port_id;
+typedef int32 team_id;
+
+/* thread priorities */
+#define B_LOW_PRIORITY				5
+#define B_NORMAL_PRIORITY			10
+#define B_DISPLAY_PRIORITY			15
+#define B_URGENT_DISPLAY_PRIORITY	20
+#define B_REAL_TIME_DISPLAY_PRIORITY	100
+#define B_URGENT_PRIORITY			110
+#define B_REAL_TIME_PRIORITY		120
+
+/* flags for acquire_sem_etc() and friends */
+enum {
+	B_CAN_INTERRUPT			= 0x01,
+	B_CHECK_PERMISSION		= 0x04,
+	B_TIMEOUT				= 0x08,
+	B_RELATIVE_TIMEOUT		= 0x08,
+	B_ABSOLUTE_TIMEOUT		= 0x10,
+	B_DO_NOT_RESCHEDULE		= 0x02
+};
+
+typedef status_t (*thread_func)( void *data );
+#define thread_entry thread_func
+
+thread_id	spawn_thread( thread_func func, const char *name, int32 priority,
+						void *data );
+status_t	resume_thread( thread_id thread );
+status_t	wait_for_thread( thread_id thread, status_t *exitValue );
+thread_id	find_thread( const char *name );
+status_t	snooze( bigtime_t microseconds );
+bigtime_t	system_time( void );
+
+/* system info, just the parts libscanbe looks at */
+typedef struct {
+	int32		cpu_count;
+} system_info;
+
+status_t	get_system_info( system_info *info );
+
+/* teams, enough to start a helper program and watch it; load_image() is
+	in image.h, and a team's id is its main thread's, for resume_thread()
+	and wait_for_thread() */
+typedef struct {
+	team_id		team;
+	int32		thread_count;
+	char		args[64];
+} team_info;
+
+status_t	get_team_info( team_id team, team_info *info );
+status_t	kill_team( team_id team );
+
+sem_id		create_sem( int32 count, const char *name );
+status_t	delete_sem( sem_id sem );
+status_t	acquire_sem( sem_id sem );
+status_t	acquire_sem_etc( sem_id sem, int32 count, uint32 flags,
+						bigtime_t timeout );
+status_t	release_sem( sem_id sem );
+status_t	release_sem_etc( sem_id sem, int32 count, uint32 flags );
+status_t	get_sem_count( sem_id sem, int32 *count );
+
+int32		atomic_add( int32 *value, int32 addValue );
+int32		atomic_and( int32 *value, int32 andValue );
+int32		atomic_or( int32 *value, int32 orValue );
+int32		atomic_get( int32 *value );
+void		atomic_set( int32 *value, int32 newValue );
+int32		atomic_test_and_set( int32 *value, int32 newValue,
+						int32 testAgainst );
+
+/* areas */
+#define B_ANY_ADDRESS			0
+#define B_EXACT_ADDRESS			1
+#define B_CLONE_ADDRESS			3
+#define B_NO_LOCK				0
+#define B_LAZY_LOCK				1
+#define B_FULL_LOCK				2
+#define B_CONTIGUOUS			3
+#define B_READ_AREA				1
+#define B_WRITE_AREA			2
+
+area_id		create_area( const char *name, void **startAddress,
+						uint32 addressSpec, size_t size, uint32 lock,
+						uint32 protection );
+area_id		clone_area( const char *name, void **destAddress,
+						uint32 addressSpec, uint32 protection, area_id source );
+status_t	delete_area( area_id area );
+
+/* ports */
+port_id		create_port( int32 capacity, const char *name );
+port_id		find_port( const char *name );
+status_t	delete_port( port_id port );
+status_t	write_port( port_id port, int32 code, const void *buffer,
+						size_t bufferSize );
+status_t	write_port_etc( port_id port, int32 code, const void *buffer,
+						size_t bufferSize, uint32 flags, bigtime_t timeout );
+ssize_t		read_port( port_id port, int32 *code, void *buffer,
+						size_t bufferSize );
+ssize_t		read_port_etc( port_id port, int32 *code, void *buffer,
+						size_t bufferSize, uint32 flags, bigtime_t timeout );
+ssize_t		port_buffer_size( port_id port );
+
+typedef struct {
+	port_id		port;
+	team_id		team;
+	char		name[B_OS_NAME_LENGTH];
+	int32		capacity;
+	int32		queue_count;
+	int32		total_count;
+} port_info;
+
+status_t	get_port_info( port_id port, port_info *info );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SHIM_OS_H */
@@ -0,0 +1,43 @@
+/*
+	ScannerBe headless shim -- stand-in for Jon Watte's libprefs.
+	Settings live in a flat file per set under $HOME/config/settings.
+*/
+
+#ifndef _SHIM_PREFERENCES_H
+#define _SHIM_PREFERENCES_H
+
+#include <SupportDefs.h>
+
+class Preferences {
+public:
+					Preferences( const char *signature );
+					~Preferences();
+		status_t	InitCheck() const { return fSignature ? B_OK : B_NO_INIT; }
+		const char*	Signature() const { return fSignature; }
+private:
+		char*		fSignature;
+};
+
+class PreferenceSet {
+public:
+					PreferenceSet( Preferences &prefs, const char *name,
+						bool doSave = true );
+					~PreferenceSet();
+		status_t	InitCheck() const { return fStatus; }
+		status_t	GetData( const char *name, void *&data, ssize_t &size,
+						uint32 &type );
+		status_t	SetData( const char *name, const void *data, ssize_t size,
+						uint32 type );
+		status_t	RemoveData( const char *name );
+		status_t	Save();
+
+private:
+		struct item;
+		void		_Load();
+		char		fPath[1024];
+		item*		fItems;
+		status_t	fStatus;
+		bool		fLoaded;
+};
+
+#endif /* _SHIM_PREFERENCES_H */
@@ -0,0 +1,169 @@
+/* ScannerBe headless shim -- the bits of the storage kit libscanbe uses. */
+
+#ifndef _SHIM_STORAGE_H
+#define _SHIM_STORAGE_H
+
+#include <SupportDefs.h>
+#include <limits.h>
+#include <time.h>
+#include <dirent.h>
+
+#define B_FILE_NAME_LENGTH		256
+#define B_PATH_NAME_LENGTH		PATH_MAX
+#define B_ATTR_NAME_LENGTH		256
+
+#define B_STRING_TYPE			'CSTR'
+#define B_RAW_TYPE				'RAWT'
+#define B_INT32_TYPE			'LONG'
+
+enum {
+	B_READ_ONLY				= 0x0000,
+	B_WRITE_ONLY			= 0x0001,
+	B_READ_WRITE			= 0x0002,
+	B_FAIL_IF_EXISTS		= 0x0100,
+	B_CREATE_FILE			= 0x0200,
+	B_ERASE_FILE			= 0x0400,
+	B_OPEN_AT_END			= 0x0800
+};
+
+enum {
+	SEEK_SET_ = 0
+};
+
+struct entry_ref {
+					entry_ref() { path[0] = 0; }
+		char		path[PATH_MAX];
+};
+
+class BPath;
+class BDirectory;
+
+class BStatable {
+public:
+virtual				~BStatable() {}
+		bool		IsFile() const;
+		bool		IsDirectory() const;
+		bool		IsSymLink() const;
+		status_t	GetModificationTime( time_t *mtime ) const;
+		status_t	GetSize( off_t *size ) const;
+protected:
+virtual	const char*	_ShimPath() const = 0;
+};
+
+class BEntry : public BStatable {
+public:
+					BEntry();
+					BEntry( const char *path, bool traverse = false );
+					BEntry( const entry_ref *ref, bool traverse = false );
+					BEntry( const BEntry &entry );
+		BEntry&		operator=( const BEntry &entry );
+
+		status_t	InitCheck() const { return fStatus; }
+		status_t	SetTo( const char *path, bool traverse = false );
+		status_t	SetTo( const entry_ref *ref, bool traverse = false );
+		void		Unset();
+		bool		Exists() const;
+		status_t	GetRef( entry_ref *ref ) const;
+		status_t	GetPath( BPath *path ) const;
+		status_t	GetParent( BDirectory *dir ) const;
+		status_t	GetName( char *buffer ) const;
+
+protected:
+virtual	const char*	_ShimPath() const { return fPath; }
+
+private:
+		char		fPath[PATH_MAX];
+		status_t	fStatus;
+};
+
+class BNode : public BStatable {
+public:
+					BNode();
+					BNode( const BEntry *entry );
+					BNode( const char *path );
+virtual				~BNode() {}
+
+		status_t	InitCheck() const { return fStatus; }
+		status_t	SetTo( const BEntry *entry );
+		status_t	SetTo( const char *path );
+		ssize_t		ReadAttr( const char *name, type_code type, off_t offset,
+						void *buffer, size_t length );
+		ssize_t		WriteAttr( const char *name, type_code type, off_t offset,
+						const void *buffer, size_t length );
+
+protected:
+virtual	const char*	_ShimPath() const { return fPath; }
+		char		fPath[PATH_MAX];
+		status_t	fStatus;
+};
+
+class BDirectory : public BNode {
+public:
+					BDirectory();
+					BDirectory( const char *path );
+virtual				~BDirectory();
+
+		status_t	SetTo( const char *path );
+		status_t	GetEntry( BEntry *entry ) const;
+		status_t	GetNextEntry( BEntry *entry, bool traverse = false );
+		status_t	Rewind();
+
+private:
+		DIR*		fDir;
+};
+
+class BFile : public BNode {
+public:
+					BFile();
+					BFile( const char *path, uint32 openMode );
+					BFile( const BEntry *entry, uint32 openMode );
+					BFile( const BDirectory *dir, const char *path, uint32 openMode );
+virtual				~BFile();
+
+		status_t	SetTo( const char *path, uint32 openMode );
+		status_t	SetTo( const BEntry *entry, uint32 openMode );
+		status_t	SetTo( const BDirectory *dir, const char *path, uint32 openMode );
+		void		Unset();
+		ssize_t		Read( void *buffer, size_t size );
+		ssize_t		Write( const void *buffer, size_t size );
+		ssize_t		ReadAt( off_t pos, void *buffer, size_t size );
+		ssize_t		WriteAt( off_t pos, const void *buffer, size_t size );
+		off_t		Seek( off_t position, uint32 seekMode );
+		off_t		Position() const;
+		status_t	SetSize( off_t size );
+		int			_ShimFD() const { return fFD; }
+
+private:
+		int			fFD;
+};
+
+class BPath {
+public:
+					BPath();
+					BPath( const char *dir, const char *leaf = NULL,
+						bool normalize = false );
+					BPath( const BDirectory *dir, const char *leaf,
+						bool normalize = false );
+					BPath( const BEntry *entry );
+
+		status_t	InitCheck() const { return fStatus; }
+		status_t	SetTo( const char *path, const char *leaf = NULL,
+						bool normalize = false );
+		status_t	Append( const char *path, bool normalize = false );
+		const char*	Path() const { return fStatus == B_OK ? fPath : NULL; }
+		const char*	Leaf() const;
+		status_t	GetParent( BPath *path ) const;
+
+private:
+		char		fPath[PATH_MAX];
+		status_t	fStatus;
+};
+
+class BResources {
+public:
+					BResources() {}
+		status_t	SetTo( BFile *file, bool clobber = false );
+		void*		FindResource( type_code type, int32 id, size_t *size );
+};
+
+#endif /* _SHIM_STORAGE_H */
@@ -0,0 +1,37 @@
+/*
+	ScannerBe headless shim -- just enough of the Be API to build
+	libscanbe and its tools on a POSIX box without a BeOS/Haiku
+	system. Not a general purpose emulation layer.
+*/
+
+#ifndef _SHIM_SUPPORT_DEFS_H
+#define _SHIM_SUPPORT_DEFS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+typedef int8_t				int8;
+typedef uint8_t				uint8;
+typedef int16_t				int16;
+typedef uint16_t			uint16;
+typedef int32_t				int32;
+typedef uint32_t			uint32;
+typedef int64_t				int64;
+typedef uint64_t			uint64;
+typedef unsigned char		uchar;
+
+typedef int32				status_t;
+typedef int64				bigtime_t;
+typedef uint32				type_code;
+typedef uint32				perform_code;
+
+#ifndef TRUE
+#define TRUE	1
+#define FALSE	0
+#endif
+
+#include <Errors.h>
+
+#endif /* _SHIM_SUPPORT_DEFS_H */
@@ -0,0 +1,52 @@
+/* ScannerBe headless shim -- add-on images via dlopen(). */
+
+#ifndef _SHIM_IMAGE_H
+#define _SHIM_IMAGE_H
+
+#include <OS.h>
+#include <limits.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef MAXPATHLEN
+#define MAXPATHLEN		PATH_MAX
+#endif
+
+typedef int32 image_id;
+
+typedef struct {
+	image_id	id;
+	int32		type;
+	char		name[MAXPATHLEN];
+} image_info;
+
+#define B_SYMBOL_TYPE_DATA		0x1
+#define B_SYMBOL_TYPE_TEXT		0x2
+#define B_SYMBOL_TYPE_ANY		0x5
+
+thread_id	load_image( int32 argc, const char **argv, const char **envp );
+image_id	load_add_on( const char *path );
+status_t	unload_add_on( image_id image );
+status_t	get_image_symbol( image_id image, const char *name,
+						int32 symbolType, void **symbolLocation );
+status_t	_get_next_image_info( team_id team, int32 *cookie,
+						image_info *info, size_t size );
+
+#ifdef __cplusplus
+}
+
+/* the Be headers let you pass any pointer-to-pointer here */
+template <class T>
+inline status_t get_image_symbol( image_id image, const char *name,
+						int32 symbolType, T *symbolLocation )
+{
+	return get_image_symbol( image, name, symbolType, (void **) symbolLocation );
+}
+#endif
+
+#define get_next_image_info( team, cookie, info ) \
+	_get_next_image_info( (team), (cookie), (info), sizeof( *(info) ) )
+
+#endif /* _SHIM_IMAGE_H */
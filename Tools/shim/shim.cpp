@@ -0,0 +1,1650 @@
+/*
+	ScannerBe headless shim -- POSIX implementations of the Be calls
+	declared in this directory. Semaphores, areas and ports are backed
+	by POSIX shared memory so they work between processes, like the
+	real ones do.
+*/
+
+#include <OS.h>
+#include <image.h>
+#include <ShimStorage.h>
+#include <FindDirectory.h>
+#include <Preferences.h>
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/xattr.h>
+#include <time.h>
+#include <unistd.h>
+
+#pragma mark ---- Helpers ----
+
+static pthread_mutex_t sShimLock = PTHREAD_MUTEX_INITIALIZER;
+
+static status_t errno_to_status( int err )
+{
+	switch( err ) {
+	case 0:				return B_OK;
+	case ENOMEM:		return B_NO_MEMORY;
+	case EACCES:
+	case EPERM:			return B_PERMISSION_DENIED;
+	case ENOENT:		return B_ENTRY_NOT_FOUND;
+	case EEXIST:		return B_FILE_EXISTS;
+	case ENOTDIR:		return B_NOT_A_DIRECTORY;
+	case EISDIR:		return B_IS_A_DIRECTORY;
+	case ENAMETOOLONG:	return B_NAME_TOO_LONG;
+	case ENOSPC:		return B_DEVICE_FULL;
+	case EINVAL:		return B_BAD_VALUE;
+	case ETIMEDOUT:		return B_TIMED_OUT;
+	case EINTR:			return B_INTERRUPTED;
+	case EAGAIN:		return B_WOULD_BLOCK;
+	default:			return B_IO_ERROR;
+	}
+}
+
+/* Unique ids that stay unique across the processes sharing objects. */
+static int32 next_global_id()
+{
+	static int32 sCounter = 0;
+	int32 n = __sync_add_and_fetch( &sCounter, 1 );
+	return ( ( getpid() & 0x7fff ) << 16 ) | ( n & 0xffff );
+}
+
+static void abs_deadline( bigtime_t timeout, uint32 flags, struct timespec *ts )
+{
+	bigtime_t when;
+	if( flags & B_ABSOLUTE_TIMEOUT )
+		when = timeout;
+	else
+		when = system_time() + timeout;
+		// system_time() is CLOCK_MONOTONIC based
+	ts->tv_sec = when / 1000000;
+	ts->tv_nsec = ( when % 1000000 ) * 1000;
+}
+
+#pragma mark ---- Time ----
+
+bigtime_t system_time( void )
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (bigtime_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+status_t snooze( bigtime_t microseconds )
+{
+	if( microseconds <= 0 )
+		return B_OK;
+	struct timespec ts;
+	ts.tv_sec = microseconds / 1000000;
+	ts.tv_nsec = ( microseconds % 1000000 ) * 1000;
+	while( nanosleep( &ts, &ts ) != 0 && errno == EINTR )
+		;
+	return B_OK;
+}
+
+status_t get_system_info( system_info *info )
+{
+	if( ! info )
+		return B_BAD_VALUE;
+	long cpus = sysconf( _SC_NPROCESSORS_ONLN );
+	info->cpu_count = cpus > 0 ? cpus : 1;
+	return B_OK;
+}
+
+#pragma mark ---- Atomics ----
+
+int32 atomic_add( int32 *value, int32 addValue )
+	{ return __sync_fetch_and_add( value, addValue ); }
+int32 atomic_and( int32 *value, int32 andValue )
+	{ return __sync_fetch_and_and( value, andValue ); }
+int32 atomic_or( int32 *value, int32 orValue )
+	{ return __sync_fetch_and_or( value, orValue ); }
+int32 atomic_get( int32 *value )
+	{ return __atomic_load_n( value, __ATOMIC_SEQ_CST ); }
+void atomic_set( int32 *value, int32 newValue )
+	{ __atomic_store_n( value, newValue, __ATOMIC_SEQ_CST ); }
+int32 atomic_test_and_set( int32 *value, int32 newValue, int32 testAgainst )
+	{ return __sync_val_compare_and_swap( value, testAgainst, newValue ); }
+
+#pragma mark ---- Threads ----
+
+struct shim_thread {
+	thread_id		id;
+	pthread_t		pthread;
+	thread_func		func;
+	void*			data;
+	bool			resumed;
+	bool			joined;
+	pthread_cond_t	cond;
+	shim_thread*	next;
+};
+
+static shim_thread *sThreads = NULL;
+static __thread thread_id sCurrentThread = 0;
+
+	// teams share the thread calls, see below
+static status_t resume_team( thread_id team );
+static status_t wait_for_team( thread_id team, status_t *exitValue );
+
+static shim_thread* lookup_thread( thread_id id )
+{
+	for( shim_thread *t = sThreads; t; t = t->next )
+		if( t->id == id )
+			return t;
+	return NULL;
+}
+
+static void* thread_trampoline( void *arg )
+{
+	shim_thread *t = (shim_thread *) arg;
+	pthread_mutex_lock( &sShimLock );
+	while( ! t->resumed )
+		pthread_cond_wait( &t->cond, &sShimLock );
+	pthread_mutex_unlock( &sShimLock );
+	sCurrentThread = t->id;
+	status_t result = t->func( t->data );
+	return (void *) (intptr_t) result;
+}
+
+thread_id spawn_thread( thread_func func, const char *name, int32 priority,
+						void *data )
+{
+	shim_thread *t = new shim_thread;
+	t->id = next_global_id();
+	t->func = func;
+	t->data = data;
+	t->resumed = false;
+	t->joined = false;
+	pthread_cond_init( &t->cond, NULL );
+	pthread_mutex_lock( &sShimLock );
+	t->next = sThreads;
+	sThreads = t;
+	pthread_mutex_unlock( &sShimLock );
+	if( pthread_create( &t->pthread, NULL, thread_trampoline, t ) != 0 )
+		return B_NO_MORE_THREADS;
+	return t->id;
+}
+
+status_t resume_thread( thread_id thread )
+{
+	pthread_mutex_lock( &sShimLock );
+	shim_thread *t = lookup_thread( thread );
+	if( t ) {
+		t->resumed = true;
+		pthread_cond_broadcast( &t->cond );
+	}
+	pthread_mutex_unlock( &sShimLock );
+	if( ! t )
+		return resume_team( thread );
+	return B_OK;
+}
+
+status_t wait_for_thread( thread_id thread, status_t *exitValue )
+{
+	pthread_mutex_lock( &sShimLock );
+	shim_thread *t = lookup_thread( thread );
+	if( ! t ) {
+		pthread_mutex_unlock( &sShimLock );
+		return wait_for_team( thread, exitValue );
+	}
+	if( t->joined ) {
+		pthread_mutex_unlock( &sShimLock );
+		return B_BAD_THREAD_ID;
+	}
+	t->joined = true;
+	if( ! t->resumed ) {
+		t->resumed = true;
+		pthread_cond_broadcast( &t->cond );
+	}
+	pthread_mutex_unlock( &sShimLock );
+	void *result = NULL;
+	pthread_join( t->pthread, &result );
+	if( exitValue )
+		*exitValue = (status_t) (intptr_t) result;
+	return B_OK;
+}
+
+thread_id find_thread( const char *name )
+{
+	if( name )
+		return B_NAME_NOT_FOUND;
+	if( sCurrentThread == 0 )
+		sCurrentThread = next_global_id();
+	return sCurrentThread;
+}
+
+#pragma mark ---- Teams ----
+
+/*	A team is a child process. Like a BeOS team it's loaded suspended, so
+	nothing runs until resume_thread(); here that's when it's spawned. */
+struct shim_team {
+	team_id			id;
+	pid_t			pid;			// 0 until resumed
+	char**			argv;
+	char**			envp;
+	bool			exited;
+	status_t		exit_value;
+	shim_team*		next;
+};
+
+static shim_team *sTeams = NULL;
+extern char **environ;
+
+static shim_team* lookup_team( team_id id )
+{
+	for( shim_team *t = sTeams; t; t = t->next )
+		if( t->id == id )
+			return t;
+	return NULL;
+}
+
+static char** copy_strings( int32 count, const char **strings )
+{
+	char **copy = new char*[count + 1];
+	for( int32 i = 0; i < count; i++ )
+		copy[i] = strdup( strings[i] );
+	copy[count] = NULL;
+	return copy;
+}
+
+/* Notices a child that has gone; call with sShimLock held. */
+static void poll_team( shim_team *t )
+{
+	if( t->exited || t->pid == 0 )
+		return;
+	int wstatus;
+	if( waitpid( t->pid, &wstatus, WNOHANG ) != t->pid )
+		return;
+	t->exited = true;
+	t->exit_value = WIFEXITED( wstatus ) ? WEXITSTATUS( wstatus ) : B_ERROR;
+}
+
+thread_id load_image( int32 argc, const char **argv, const char **envp )
+{
+	if( argc < 1 || ! argv || ! argv[0] )
+		return B_BAD_VALUE;
+	if( access( argv[0], X_OK ) != 0 )
+		return B_NOT_AN_EXECUTABLE;
+	if( ! envp )
+		envp = (const char **) environ;
+	int32 envCount = 0;
+	while( envp[envCount] )
+		envCount++;
+
+	shim_team *t = new shim_team;
+	t->id = next_global_id();
+	t->pid = 0;
+	t->argv = copy_strings( argc, argv );
+	t->envp = copy_strings( envCount, envp );
+	t->exited = false;
+	t->exit_value = B_OK;
+	pthread_mutex_lock( &sShimLock );
+	t->next = sTeams;
+	sTeams = t;
+	pthread_mutex_unlock( &sShimLock );
+	return t->id;
+}
+
+static status_t resume_team( thread_id team )
+{
+	pthread_mutex_lock( &sShimLock );
+	shim_team *t = lookup_team( team );
+	status_t status = t ? (status_t) B_OK : (status_t) B_BAD_THREAD_ID;
+	if( t && t->pid == 0 && ! t->exited ) {
+		pid_t pid;
+		int err = posix_spawn( &pid, t->argv[0], NULL, NULL, t->argv, t->envp );
+		if( err == 0 )
+			t->pid = pid;
+		else {
+			t->exited = true;
+			t->exit_value = errno_to_status( err );
+			status = t->exit_value;
+		}
+	}
+	pthread_mutex_unlock( &sShimLock );
+	return status;
+}
+
+static status_t wait_for_team( thread_id team, status_t *exitValue )
+{
+	pthread_mutex_lock( &sShimLock );
+	shim_team *t = lookup_team( team );
+	pthread_mutex_unlock( &sShimLock );
+	if( ! t )
+		return B_BAD_THREAD_ID;
+	if( t->pid == 0 )
+		resume_team( team );
+		// waitpid() blocks, so not with the lock held
+	int wstatus;
+	if( ! t->exited && t->pid && waitpid( t->pid, &wstatus, 0 ) == t->pid ) {
+		pthread_mutex_lock( &sShimLock );
+		t->exited = true;
+		t->exit_value = WIFEXITED( wstatus ) ? WEXITSTATUS( wstatus ) : B_ERROR;
+		pthread_mutex_unlock( &sShimLock );
+	}
+	if( exitValue )
+		*exitValue = t->exit_value;
+	return B_OK;
+}
+
+status_t get_team_info( team_id team, team_info *info )
+{
+	pthread_mutex_lock( &sShimLock );
+	shim_team *t = lookup_team( team );
+	if( t )
+		poll_team( t );
+	status_t status = ( t && ! t->exited ) ? (status_t) B_OK : (status_t) B_BAD_TEAM_ID;
+	if( status == B_OK && info ) {
+		info->team = t->id;
+		info->thread_count = 1;
+		strncpy( info->args, t->argv[0], sizeof( info->args ) - 1 );
+		info->args[sizeof( info->args ) - 1] = 0;
+	}
+	pthread_mutex_unlock( &sShimLock );
+	return status;
+}
+
+status_t kill_team( team_id team )
+{
+	pthread_mutex_lock( &sShimLock );
+	shim_team *t = lookup_team( team );
+	status_t status = ( t && ! t->exited ) ? (status_t) B_OK : (status_t) B_BAD_TEAM_ID;
+	if( status == B_OK ) {
+		if( t->pid )
+			kill( t->pid, SIGKILL );
+		else {
+			t->exited = true;
+			t->exit_value = B_ERROR;
+		}
+	}
+	pthread_mutex_unlock( &sShimLock );
+	return status;
+}
+
+#pragma mark ---- Semaphores ----
+
+/*	Every semaphore is a small shared memory object, so another process
+	can acquire/release it by id just like on BeOS. */
+struct shim_sem_data {
+	pthread_mutex_t	lock;
+	pthread_cond_t	cond;
+	int32			count;
+	int32			deleted;
+};
+
+struct shim_sem {
+	sem_id			id;
+	shim_sem_data*	data;
+	shim_sem*		next;
+};
+
+static shim_sem *sSems = NULL;
+
+static void sem_object_name( sem_id id, char *name )
+{
+	sprintf( name, "/scanbe-sem-%ld", (long) id );
+}
+
+static shim_sem_data* map_sem( sem_id id, bool create )
+{
+	pthread_mutex_lock( &sShimLock );
+	for( shim_sem *s = sSems; s; s = s->next ) {
+		if( s->id == id ) {
+			pthread_mutex_unlock( &sShimLock );
+			return s->data;
+		}
+	}
+	char name[64];
+	sem_object_name( id, name );
+	int fd = shm_open( name, create ? ( O_RDWR | O_CREAT | O_EXCL ) : O_RDWR, 0600 );
+	if( fd < 0 ) {
+		pthread_mutex_unlock( &sShimLock );
+		return NULL;
+	}
+	if( create && ftruncate( fd, sizeof( shim_sem_data ) ) != 0 ) {
+		close( fd );
+		shm_unlink( name );
+		pthread_mutex_unlock( &sShimLock );
+		return NULL;
+	}
+	void *addr = mmap( NULL, sizeof( shim_sem_data ), PROT_READ | PROT_WRITE,
+						MAP_SHARED, fd, 0 );
+	close( fd );
+	if( addr == MAP_FAILED ) {
+		pthread_mutex_unlock( &sShimLock );
+		return NULL;
+	}
+	shim_sem *s = new shim_sem;
+	s->id = id;
+	s->data = (shim_sem_data *) addr;
+	s->next = sSems;
+	sSems = s;
+	pthread_mutex_unlock( &sShimLock );
+	return s->data;
+}
+
+sem_id create_sem( int32 count, const char *name )
+{
+	if( count < 0 )
+		return B_BAD_VALUE;
+	sem_id id = next_global_id();
+	shim_sem_data *data = map_sem( id, true );
+	if( ! data )
+		return B_NO_MORE_SEMS;
+	pthread_mutexattr_t mattr;
+	pthread_mutexattr_init( &mattr );
+	pthread_mutexattr_setpshared( &mattr, PTHREAD_PROCESS_SHARED );
+	pthread_mutex_init( &data->lock, &mattr );
+	pthread_mutexattr_destroy( &mattr );
+	pthread_condattr_t cattr;
+	pthread_condattr_init( &cattr );
+	pthread_condattr_setpshared( &cattr, PTHREAD_PROCESS_SHARED );
+	pthread_condattr_setclock( &cattr, CLOCK_MONOTONIC );
+	pthread_cond_init( &data->cond, &cattr );
+	pthread_condattr_destroy( &cattr );
+	data->count = count;
+	data->deleted = 0;
+	return id;
+}
+
+status_t delete_sem( sem_id sem )
+{
+	shim_sem_data *data = map_sem( sem, false );
+	if( ! data )
+		return B_BAD_SEM_ID;
+	pthread_mutex_lock( &data->lock );
+	if( data->deleted ) {
+		pthread_mutex_unlock( &data->lock );
+		return B_BAD_SEM_ID;
+	}
+	data->deleted = 1;
+	pthread_cond_broadcast( &data->cond );
+	pthread_mutex_unlock( &data->lock );
+	char name[64];
+	sem_object_name( sem, name );
+	shm_unlink( name );
+		// the mapping itself is kept, other threads may still be waking up
+	return B_OK;
+}
+
+status_t acquire_sem_etc( sem_id sem, int32 count, uint32 flags,
+						bigtime_t timeout )
+{
+	shim_sem_data *data = map_sem( sem, false );
+	if( ! data )
+		return B_BAD_SEM_ID;
+	struct timespec deadline;
+	bool timed = ( flags & ( B_RELATIVE_TIMEOUT | B_ABSOLUTE_TIMEOUT ) )
+					&& timeout != B_INFINITE_TIMEOUT;
+	if( timed )
+		abs_deadline( timeout, flags, &deadline );
+	status_t status = B_OK;
+	pthread_mutex_lock( &data->lock );
+	while( ! data->deleted && data->count < count ) {
+		if( timed ) {
+			if( timeout == 0 && ! ( flags & B_ABSOLUTE_TIMEOUT ) ) {
+				status = B_WOULD_BLOCK;
+				break;
+			}
+			int err = pthread_cond_timedwait( &data->cond, &data->lock, &deadline );
+			if( err == ETIMEDOUT ) {
+				status = B_TIMED_OUT;
+				break;
+			}
+		} else
+			pthread_cond_wait( &data->cond, &data->lock );
+	}
+	if( data->deleted )
+		status = B_BAD_SEM_ID;
+	else if( status == B_OK )
+		data->count -= count;
+	pthread_mutex_unlock( &data->lock );
+	return status;
+}
+
+status_t acquire_sem( sem_id sem )
+{
+	return acquire_sem_etc( sem, 1, 0, 0 );
+}
+
+status_t release_sem_etc( sem_id sem, int32 count, uint32 flags )
+{
+	shim_sem_data *data = map_sem( sem, false );
+	if( ! data )
+		return B_BAD_SEM_ID;
+	pthread_mutex_lock( &data->lock );
+	status_t status = B_OK;
+	if( data->deleted )
+		status = B_BAD_SEM_ID;
+	else {
+		data->count += count;
+		pthread_cond_broadcast( &data->cond );
+	}
+	pthread_mutex_unlock( &data->lock );
+	return status;
+}
+
+status_t release_sem( sem_id sem )
+{
+	return release_sem_etc( sem, 1, 0 );
+}
+
+status_t get_sem_count( sem_id sem, int32 *count )
+{
+	shim_sem_data *data = map_sem( sem, false );
+	if( ! data )
+		return B_BAD_SEM_ID;
+	pthread_mutex_lock( &data->lock );
+	*count = data->count;
+	pthread_mutex_unlock( &data->lock );
+	return data->deleted ? (status_t) B_BAD_SEM_ID : (status_t) B_OK;
+}
+
+#pragma mark ---- Areas ----
+
+struct shim_area {
+	area_id			id;
+	area_id			source;
+	void*			address;
+	size_t			size;
+	shim_area*		next;
+};
+
+static shim_area *sAreas = NULL;
+
+static void area_object_name( area_id id, char *name )
+{
+	sprintf( name, "/scanbe-area-%ld", (long) id );
+}
+
+static area_id map_area( area_id source, void **address, size_t size,
+						uint32 lock, uint32 protection, bool create )
+{
+	char name[64];
+	area_object_name( source, name );
+	int fd = shm_open( name, create ? ( O_RDWR | O_CREAT | O_EXCL ) : O_RDWR, 0600 );
+	if( fd < 0 )
+		return errno_to_status( errno );
+	if( create ) {
+		if( ftruncate( fd, size ) != 0 ) {
+			close( fd );
+			shm_unlink( name );
+			return B_NO_MEMORY;
+		}
+	} else {
+		struct stat st;
+		fstat( fd, &st );
+		size = st.st_size;
+	}
+	int prot = PROT_READ | ( ( protection & B_WRITE_AREA ) ? PROT_WRITE : 0 );
+	int flags = MAP_SHARED;
+	if( lock == B_FULL_LOCK || lock == B_CONTIGUOUS )
+		flags |= MAP_POPULATE;
+	void *addr = mmap( NULL, size, prot, flags, fd, 0 );
+	close( fd );
+	if( addr == MAP_FAILED ) {
+		if( create )
+			shm_unlink( name );
+		return B_NO_MEMORY;
+	}
+	shim_area *a = new shim_area;
+	a->id = create ? source : next_global_id();
+	a->source = source;
+	a->address = addr;
+	a->size = size;
+	pthread_mutex_lock( &sShimLock );
+	a->next = sAreas;
+	sAreas = a;
+	pthread_mutex_unlock( &sShimLock );
+	*address = addr;
+	return a->id;
+}
+
+area_id create_area( const char *name, void **startAddress,
+						uint32 addressSpec, size_t size, uint32 lock,
+						uint32 protection )
+{
+	if( size == 0 || ( size % B_PAGE_SIZE ) != 0 )
+		return B_BAD_VALUE;
+	return map_area( next_global_id(), startAddress, size, lock, protection, true );
+}
+
+area_id clone_area( const char *name, void **destAddress,
+						uint32 addressSpec, uint32 protection, area_id source )
+{
+	return map_area( source, destAddress, 0, B_NO_LOCK, protection, false );
+}
+
+status_t delete_area( area_id area )
+{
+	pthread_mutex_lock( &sShimLock );
+	shim_area **prev = &sAreas;
+	shim_area *a = sAreas;
+	for( ; a; prev = &a->next, a = a->next )
+		if( a->id == area )
+			break;
+	if( a )
+		*prev = a->next;
+	pthread_mutex_unlock( &sShimLock );
+	if( ! a )
+		return B_BAD_VALUE;
+	munmap( a->address, a->size );
+	if( a->id == a->source ) {
+		char name[64];
+		area_object_name( a->id, name );
+		shm_unlink( name );
+	}
+	delete a;
+	return B_OK;
+}
+
+#pragma mark ---- Ports ----
+
+/*	A port is a ring of fixed-size message slots in shared memory,
+	guarded by a process-shared mutex. Good enough for control traffic. */
+const int32 kShimPortMaxMessage = 4096;
+
+struct shim_port_msg {
+	int32			code;
+	int32			size;
+	char			data[kShimPortMaxMessage];
+};
+
+struct shim_port_data {
+	pthread_mutex_t	lock;
+	pthread_cond_t	cond;
+	int32			capacity;
+	int32			head;
+	int32			count;
+	int32			deleted;
+	pid_t			owner;			// the port goes when this process does
+	char			name[B_OS_NAME_LENGTH];
+	shim_port_msg	msgs[1];
+};
+
+struct shim_port {
+	port_id			id;
+	shim_port_data*	data;
+	size_t			size;
+	shim_port*		next;
+};
+
+static shim_port *sPorts = NULL;
+
+static void port_object_name( port_id id, char *name )
+{
+	sprintf( name, "/scanbe-port-%ld", (long) id );
+}
+
+static void port_registry_name( const char *portName, char *name )
+{
+	sprintf( name, "/scanbe-portname-" );
+	char *dst = name + strlen( name );
+	for( const char *src = portName; *src && dst - name < 200; src++ )
+		*dst++ = ( *src == '/' ) ? '_' : *src;
+	*dst = 0;
+}
+
+static shim_port_data* map_port( port_id id, int32 capacity, bool create )
+{
+	pthread_mutex_lock( &sShimLock );
+	for( shim_port *p = sPorts; p; p = p->next ) {
+		if( p->id == id ) {
+			pthread_mutex_unlock( &sShimLock );
+			return p->data;
+		}
+	}
+	char name[64];
+	port_object_name( id, name );
+	int fd = shm_open( name, create ? ( O_RDWR | O_CREAT | O_EXCL ) : O_RDWR, 0600 );
+	if( fd < 0 ) {
+		pthread_mutex_unlock( &sShimLock );
+		return NULL;
+	}
+	size_t size;
+	if( create ) {
+		size = sizeof( shim_port_data ) + ( capacity - 1 ) * sizeof( shim_port_msg );
+		if( ftruncate( fd, size ) != 0 ) {
+			close( fd );
+			shm_unlink( name );
+			pthread_mutex_unlock( &sShimLock );
+			return NULL;
+		}
+	} else {
+		struct stat st;
+		fstat( fd, &st );
+		size = st.st_size;
+	}
+	void *addr = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+	close( fd );
+	if( addr == MAP_FAILED ) {
+		pthread_mutex_unlock( &sShimLock );
+		return NULL;
+	}
+	shim_port *p = new shim_port;
+	p->id = id;
+	p->data = (shim_port_data *) addr;
+	p->size = size;
+	p->next = sPorts;
+	sPorts = p;
+	pthread_mutex_unlock( &sShimLock );
+	return p->data;
+}
+
+port_id create_port( int32 capacity, const char *name )
+{
+	if( capacity <= 0 )
+		return B_BAD_VALUE;
+	port_id id = next_global_id();
+	shim_port_data *data = map_port( id, capacity, true );
+	if( ! data )
+		return B_NO_MORE_PORTS;
+	pthread_mutexattr_t mattr;
+	pthread_mutexattr_init( &mattr );
+	pthread_mutexattr_setpshared( &mattr, PTHREAD_PROCESS_SHARED );
+	pthread_mutex_init( &data->lock, &mattr );
+	pthread_mutexattr_destroy( &mattr );
+	pthread_condattr_t cattr;
+	pthread_condattr_init( &cattr );
+	pthread_condattr_setpshared( &cattr, PTHREAD_PROCESS_SHARED );
+	pthread_condattr_setclock( &cattr, CLOCK_MONOTONIC );
+	pthread_cond_init( &data->cond, &cattr );
+	pthread_condattr_destroy( &cattr );
+	data->capacity = capacity;
+	data->head = 0;
+	data->count = 0;
+	data->deleted = 0;
+	data->owner = getpid();
+	data->name[0] = 0;
+	if( name ) {
+		strncpy( data->name, name, B_OS_NAME_LENGTH - 1 );
+		data->name[B_OS_NAME_LENGTH - 1] = 0;
+		char regName[256];
+		port_registry_name( name, regName );
+		int fd = shm_open( regName, O_RDWR | O_CREAT | O_TRUNC, 0600 );
+		if( fd >= 0 ) {
+			if( write( fd, &id, sizeof( id ) ) != sizeof( id ) )
+				shm_unlink( regName );
+			close( fd );
+		}
+	}
+	return id;
+}
+
+port_id find_port( const char *name )
+{
+	char regName[256];
+	port_registry_name( name, regName );
+	int fd = shm_open( regName, O_RDONLY, 0600 );
+	if( fd < 0 )
+		return B_NAME_NOT_FOUND;
+	port_id id;
+	ssize_t len = read( fd, &id, sizeof( id ) );
+	close( fd );
+	if( len != sizeof( id ) || get_port_info( id, NULL ) != B_OK )
+		return B_NAME_NOT_FOUND;
+	return id;
+}
+
+/*	A BeOS port is deleted with the team that made it; here one whose
+	process has gone is only treated as deleted. */
+status_t get_port_info( port_id port, port_info *info )
+{
+	shim_port_data *data = map_port( port, 0, false );
+	if( ! data )
+		return B_BAD_PORT_ID;
+	pthread_mutex_lock( &data->lock );
+	bool gone = data->deleted
+				|| ( kill( data->owner, 0 ) != 0 && errno == ESRCH );
+	if( ! gone && info ) {
+		info->port = port;
+		info->team = data->owner;
+		strcpy( info->name, data->name );
+		info->capacity = data->capacity;
+		info->queue_count = data->count;
+		info->total_count = 0;
+	}
+	pthread_mutex_unlock( &data->lock );
+	return gone ? (status_t) B_BAD_PORT_ID : (status_t) B_OK;
+}
+
+status_t delete_port( port_id port )
+{
+	shim_port_data *data = map_port( port, 0, false );
+	if( ! data )
+		return B_BAD_PORT_ID;
+	pthread_mutex_lock( &data->lock );
+	data->deleted = 1;
+	pthread_cond_broadcast( &data->cond );
+	pthread_mutex_unlock( &data->lock );
+	char name[64];
+	port_object_name( port, name );
+	shm_unlink( name );
+	return B_OK;
+}
+
+status_t write_port_etc( port_id port, int32 code, const void *buffer,
+						size_t bufferSize, uint32 flags, bigtime_t timeout )
+{
+	if( bufferSize > (size_t) kShimPortMaxMessage )
+		return B_BAD_VALUE;
+	shim_port_data *data = map_port( port, 0, false );
+	if( ! data )
+		return B_BAD_PORT_ID;
+	struct timespec deadline;
+	bool timed = ( flags & ( B_RELATIVE_TIMEOUT | B_ABSOLUTE_TIMEOUT ) )
+					&& timeout != B_INFINITE_TIMEOUT;
+	if( timed )
+		abs_deadline( timeout, flags, &deadline );
+	status_t status = B_OK;
+	pthread_mutex_lock( &data->lock );
+	while( ! data->deleted && data->count == data->capacity ) {
+		if( timed ) {
+			if( pthread_cond_timedwait( &data->cond, &data->lock, &deadline ) == ETIMEDOUT ) {
+				status = B_TIMED_OUT;
+				break;
+			}
+		} else
+			pthread_cond_wait( &data->cond, &data->lock );
+	}
+	if( data->deleted )
+		status = B_BAD_PORT_ID;
+	if( status == B_OK ) {
+		shim_port_msg *msg = &data->msgs[( data->head + data->count ) % data->capacity];
+		msg->code = code;
+		msg->size = bufferSize;
+		if( bufferSize )
+			memcpy( msg->data, buffer, bufferSize );
+		data->count++;
+		pthread_cond_broadcast( &data->cond );
+	}
+	pthread_mutex_unlock( &data->lock );
+	return status;
+}
+
+status_t write_port( port_id port, int32 code, const void *buffer,
+						size_t bufferSize )
+{
+	return write_port_etc( port, code, buffer, bufferSize, 0, 0 );
+}
+
+ssize_t read_port_etc( port_id port, int32 *code, void *buffer,
+						size_t bufferSize, uint32 flags, bigtime_t timeout )
+{
+	shim_port_data *data = map_port( port, 0, false );
+	if( ! data )
+		return B_BAD_PORT_ID;
+	struct timespec deadline;
+	bool timed = ( flags & ( B_RELATIVE_TIMEOUT | B_ABSOLUTE_TIMEOUT ) )
+					&& timeout != B_INFINITE_TIMEOUT;
+	if( timed )
+		abs_deadline( timeout, flags, &deadline );
+	ssize_t result = B_OK;
+	pthread_mutex_lock( &data->lock );
+	while( ! data->deleted && data->count == 0 ) {
+		if( timed ) {
+			if( pthread_cond_timedwait( &data->cond, &data->lock, &deadline ) == ETIMEDOUT ) {
+				result = B_TIMED_OUT;
+				break;
+			}
+		} else
+			pthread_cond_wait( &data->cond, &data->lock );
+	}
+	if( result == B_OK && data->count == 0 )
+		result = B_BAD_PORT_ID;
+	if( result == B_OK ) {
+		shim_port_msg *msg = &data->msgs[data->head];
+		*code = msg->code;
+		result = msg->size < (int32) bufferSize ? msg->size : bufferSize;
+		if( result > 0 )
+			memcpy( buffer, msg->data, result );
+		data->head = ( data->head + 1 ) % data->capacity;
+		data->count--;
+		pthread_cond_broadcast( &data->cond );
+	}
+	pthread_mutex_unlock( &data->lock );
+	return result;
+}
+
+ssize_t read_port( port_id port, int32 *code, void *buffer, size_t bufferSize )
+{
+	return read_port_etc( port, code, buffer, bufferSize, 0, 0 );
+}
+
+ssize_t port_buffer_size( port_id port )
+{
+	shim_port_data *data = map_port( port, 0, false );
+	if( ! data )
+		return B_BAD_PORT_ID;
+	ssize_t result;
+	pthread_mutex_lock( &data->lock );
+	while( ! data->deleted && data->count == 0 )
+		pthread_cond_wait( &data->cond, &data->lock );
+	result = data->count ? data->msgs[data->head].size : B_BAD_PORT_ID;
+	pthread_mutex_unlock( &data->lock );
+	return result;
+}
+
+#pragma mark ---- Images ----
+
+struct shim_image {
+	image_id		id;
+	void*			handle;
+	char			path[PATH_MAX];
+	shim_image*		next;
+};
+
+static shim_image *sImages = NULL;
+static int32 sNextImage = 100;
+const image_id kAppImage = 1;
+
+image_id load_add_on( const char *path )
+{
+	void *handle = dlopen( path, RTLD_NOW | RTLD_LOCAL );
+	if( ! handle ) {
+		if( getenv( "SCAN_DEBUG" ) )
+			fprintf( stderr, "shim: %s\n", dlerror() );
+		return B_NOT_AN_EXECUTABLE;
+	}
+	shim_image *image = new shim_image;
+	pthread_mutex_lock( &sShimLock );
+	image->id = sNextImage++;
+	image->handle = handle;
+	strncpy( image->path, path, PATH_MAX - 1 );
+	image->path[PATH_MAX - 1] = 0;
+	image->next = sImages;
+	sImages = image;
+	pthread_mutex_unlock( &sShimLock );
+	return image->id;
+}
+
+status_t unload_add_on( image_id id )
+{
+	pthread_mutex_lock( &sShimLock );
+	shim_image **prev = &sImages;
+	shim_image *image = sImages;
+	for( ; image; prev = &image->next, image = image->next )
+		if( image->id == id )
+			break;
+	if( image )
+		*prev = image->next;
+	pthread_mutex_unlock( &sShimLock );
+	if( ! image )
+		return B_BAD_IMAGE_ID;
+	dlclose( image->handle );
+	delete image;
+	return B_OK;
+}
+
+status_t get_image_symbol( image_id id, const char *name,
+						int32 symbolType, void **symbolLocation )
+{
+	void *handle = NULL;
+	if( id == kAppImage )
+		handle = RTLD_DEFAULT;
+	else {
+		pthread_mutex_lock( &sShimLock );
+		for( shim_image *image = sImages; image; image = image->next )
+			if( image->id == id )
+				handle = image->handle;
+		pthread_mutex_unlock( &sShimLock );
+		if( ! handle )
+			return B_BAD_IMAGE_ID;
+	}
+	void *sym = dlsym( handle, name );
+	if( ! sym )
+		return B_MISSING_SYMBOL;
+	*symbolLocation = sym;
+	return B_OK;
+}
+
+/*	Only the application image (which has libscanbe linked into it in
+	the headless build) and the loaded add-ons are visible. */
+status_t _get_next_image_info( team_id team, int32 *cookie,
+						image_info *info, size_t size )
+{
+	memset( info, 0, sizeof( image_info ) );
+	if( *cookie == 0 ) {
+		info->id = kAppImage;
+		ssize_t len = readlink( "/proc/self/exe", info->name, MAXPATHLEN - 1 );
+		if( len < 0 )
+			len = 0;
+		info->name[len] = 0;
+		(*cookie)++;
+		return B_OK;
+	}
+	pthread_mutex_lock( &sShimLock );
+	int32 index = 1;
+	for( shim_image *image = sImages; image; image = image->next, index++ ) {
+		if( index == *cookie ) {
+			info->id = image->id;
+			strcpy( info->name, image->path );
+			(*cookie)++;
+			pthread_mutex_unlock( &sShimLock );
+			return B_OK;
+		}
+	}
+	pthread_mutex_unlock( &sShimLock );
+	return B_BAD_VALUE;
+}
+
+#pragma mark ---- Storage ----
+
+static bool stat_path( const char *path, struct stat *st, bool follow = false )
+{
+	if( ! path || ! *path )
+		return false;
+	return ( follow ? stat( path, st ) : lstat( path, st ) ) == 0;
+}
+
+bool BStatable::IsFile() const
+{
+	struct stat st;
+	return stat_path( _ShimPath(), &st ) && S_ISREG( st.st_mode );
+}
+
+bool BStatable::IsDirectory() const
+{
+	struct stat st;
+	return stat_path( _ShimPath(), &st ) && S_ISDIR( st.st_mode );
+}
+
+bool BStatable::IsSymLink() const
+{
+	struct stat st;
+	return stat_path( _ShimPath(), &st ) && S_ISLNK( st.st_mode );
+}
+
+status_t BStatable::GetModificationTime( time_t *mtime ) const
+{
+	struct stat st;
+	if( ! stat_path( _ShimPath(), &st ) )
+		return errno_to_status( errno );
+	*mtime = st.st_mtime;
+	return B_OK;
+}
+
+status_t BStatable::GetSize( off_t *size ) const
+{
+	struct stat st;
+	if( ! stat_path( _ShimPath(), &st ) )
+		return errno_to_status( errno );
+	*size = st.st_size;
+	return B_OK;
+}
+
+BEntry::BEntry() : fStatus( B_NO_INIT ) { fPath[0] = 0; }
+BEntry::BEntry( const char *path, bool traverse ) { SetTo( path, traverse ); }
+BEntry::BEntry( const entry_ref *ref, bool traverse ) { SetTo( ref, traverse ); }
+BEntry::BEntry( const BEntry &entry ) { *this = entry; }
+
+BEntry& BEntry::operator=( const BEntry &entry )
+{
+	strcpy( fPath, entry.fPath );
+	fStatus = entry.fStatus;
+	return *this;
+}
+
+status_t BEntry::SetTo( const char *path, bool traverse )
+{
+	fPath[0] = 0;
+	if( ! path )
+		return fStatus = B_BAD_VALUE;
+	if( traverse ) {
+		if( ! realpath( path, fPath ) )
+			return fStatus = errno_to_status( errno );
+	} else {
+		if( strlen( path ) >= PATH_MAX )
+			return fStatus = B_NAME_TOO_LONG;
+		strcpy( fPath, path );
+	}
+	return fStatus = B_OK;
+}
+
+status_t BEntry::SetTo( const entry_ref *ref, bool traverse )
+{
+	return SetTo( ref ? ref->path : NULL, traverse );
+}
+
+void BEntry::Unset() { fPath[0] = 0; fStatus = B_NO_INIT; }
+
+bool BEntry::Exists() const
+{
+	struct stat st;
+	return fStatus == B_OK && stat_path( fPath, &st );
+}
+
+status_t BEntry::GetRef( entry_ref *ref ) const
+{
+	if( fStatus != B_OK )
+		return fStatus;
+	strcpy( ref->path, fPath );
+	return B_OK;
+}
+
+status_t BEntry::GetPath( BPath *path ) const
+{
+	if( fStatus != B_OK )
+		return fStatus;
+	return path->SetTo( fPath );
+}
+
+status_t BEntry::GetParent( BDirectory *dir ) const
+{
+	if( fStatus != B_OK )
+		return fStatus;
+	BPath path( fPath );
+	BPath parent;
+	status_t status = path.GetParent( &parent );
+	if( status != B_OK )
+		return status;
+	return dir->SetTo( parent.Path() );
+}
+
+status_t BEntry::GetName( char *buffer ) const
+{
+	if( fStatus != B_OK )
+		return fStatus;
+	const char *leaf = strrchr( fPath, '/' );
+	strcpy( buffer, leaf ? leaf + 1 : fPath );
+	return B_OK;
+}
+
+BNode::BNode() : fStatus( B_NO_INIT ) { fPath[0] = 0; }
+BNode::BNode( const BEntry *entry ) { SetTo( entry ); }
+BNode::BNode( const char *path ) { SetTo( path ); }
+
+status_t BNode::SetTo( const BEntry *entry )
+{
+	BPath path;
+	fStatus = entry->GetPath( &path );
+	if( fStatus != B_OK )
+		return fStatus;
+	return SetTo( path.Path() );
+}
+
+status_t BNode::SetTo( const char *path )
+{
+	struct stat st;
+	fPath[0] = 0;
+	if( ! stat_path( path, &st, true ) )
+		return fStatus = errno_to_status( errno );
+	strcpy( fPath, path );
+	return fStatus = B_OK;
+}
+
+/*	Attributes map onto "user." extended attributes. Since most Linux
+	file systems have nothing stamped on them, a shared object without a
+	BEOS:TYPE attribute is reported as an executable, which is what an
+	add-on looks like to libscanbe. */
+ssize_t BNode::ReadAttr( const char *name, type_code type, off_t offset,
+						void *buffer, size_t length )
+{
+	if( fStatus != B_OK )
+		return fStatus;
+	char attr[B_ATTR_NAME_LENGTH + 8];
+	sprintf( attr, "user.%s", name );
+	ssize_t len = getxattr( fPath, attr, buffer, length );
+	if( len >= 0 )
+		return len;
+	if( strcmp( name, "BEOS:TYPE" ) == 0 ) {
+		unsigned char magic[4];
+		FILE *fp = fopen( fPath, "rb" );
+		if( fp ) {
+			size_t got = fread( magic, 1, 4, fp );
+			fclose( fp );
+			if( got == 4 && magic[0] == 0x7f && magic[1] == 'E'
+					&& magic[2] == 'L' && magic[3] == 'F' ) {
+				const char *mime = "application/x-be-executable";
+				size_t mimeLen = strlen( mime );
+				if( mimeLen > length )
+					mimeLen = length;
+				memcpy( buffer, mime, mimeLen );
+				return mimeLen;
+			}
+		}
+	}
+	return B_ENTRY_NOT_FOUND;
+}
+
+ssize_t BNode::WriteAttr( const char *name, type_code type, off_t offset,
+						const void *buffer, size_t length )
+{
+	if( fStatus != B_OK )
+		return fStatus;
+	char attr[B_ATTR_NAME_LENGTH + 8];
+	sprintf( attr, "user.%s", name );
+	if( setxattr( fPath, attr, buffer, length, 0 ) != 0 )
+		return errno_to_status( errno );
+	return length;
+}
+
+BDirectory::BDirectory() : fDir( NULL ) {}
+BDirectory::BDirectory( const char *path ) : fDir( NULL ) { SetTo( path ); }
+BDirectory::~BDirectory() { if( fDir ) closedir( fDir ); }
+
+status_t BDirectory::SetTo( const char *path )
+{
+	if( fDir ) {
+		closedir( fDir );
+		fDir = NULL;
+	}
+	status_t status = BNode::SetTo( path );
+	if( status != B_OK )
+		return status;
+	fDir = opendir( path );
+	if( ! fDir )
+		return fStatus = errno_to_status( errno );
+	return B_OK;
+}
+
+status_t BDirectory::GetEntry( BEntry *entry ) const
+{
+	if( fStatus != B_OK )
+		return fStatus;
+	return entry->SetTo( fPath );
+}
+
+status_t BDirectory::GetNextEntry( BEntry *entry, bool traverse )
+{
+	if( ! fDir )
+		return B_NO_INIT;
+	struct dirent *de;
+	while( ( de = readdir( fDir ) ) != NULL ) {
+		if( strcmp( de->d_name, "." ) == 0 || strcmp( de->d_name, ".." ) == 0 )
+			continue;
+		BPath path( fPath, de->d_name );
+		return entry->SetTo( path.Path(), traverse );
+	}
+	return B_ENTRY_NOT_FOUND;
+}
+
+status_t BDirectory::Rewind()
+{
+	if( ! fDir )
+		return B_NO_INIT;
+	rewinddir( fDir );
+	return B_OK;
+}
+
+BFile::BFile() : fFD( -1 ) {}
+BFile::BFile( const char *path, uint32 openMode ) : fFD( -1 ) { SetTo( path, openMode ); }
+BFile::BFile( const BEntry *entry, uint32 openMode ) : fFD( -1 ) { SetTo( entry, openMode ); }
+BFile::BFile( const BDirectory *dir, const char *path, uint32 openMode )
+	: fFD( -1 ) { SetTo( dir, path, openMode ); }
+BFile::~BFile() { Unset(); }
+
+status_t BFile::SetTo( const char *path, uint32 openMode )
+{
+	Unset();
+	int flags = 0;
+	switch( openMode & 3 ) {
+	case B_READ_ONLY:	flags = O_RDONLY; break;
+	case B_WRITE_ONLY:	flags = O_WRONLY; break;
+	default:			flags = O_RDWR; break;
+	}
+	if( openMode & B_CREATE_FILE )
+		flags |= O_CREAT;
+	if( openMode & B_FAIL_IF_EXISTS )
+		flags |= O_EXCL;
+	if( openMode & B_ERASE_FILE )
+		flags |= O_TRUNC;
+	if( openMode & B_OPEN_AT_END )
+		flags |= O_APPEND;
+	fFD = open( path, flags, 0644 );
+	if( fFD < 0 )
+		return fStatus = errno_to_status( errno );
+	strncpy( fPath, path, PATH_MAX - 1 );
+	fPath[PATH_MAX - 1] = 0;
+	return fStatus = B_OK;
+}
+
+status_t BFile::SetTo( const BEntry *entry, uint32 openMode )
+{
+	BPath path;
+	status_t status = entry->GetPath( &path );
+	if( status != B_OK )
+		return fStatus = status;
+	return SetTo( path.Path(), openMode );
+}
+
+status_t BFile::SetTo( const BDirectory *dir, const char *path, uint32 openMode )
+{
+	BPath full( dir, path );
+	if( full.InitCheck() != B_OK )
+		return fStatus = full.InitCheck();
+	return SetTo( full.Path(), openMode );
+}
+
+void BFile::Unset()
+{
+	if( fFD >= 0 )
+		close( fFD );
+	fFD = -1;
+	fPath[0] = 0;
+	fStatus = B_NO_INIT;
+}
+
+ssize_t BFile::Read( void *buffer, size_t size )
+{
+	ssize_t len = read( fFD, buffer, size );
+	return len < 0 ? errno_to_status( errno ) : len;
+}
+
+ssize_t BFile::Write( const void *buffer, size_t size )
+{
+	ssize_t len = write( fFD, buffer, size );
+	return len < 0 ? errno_to_status( errno ) : len;
+}
+
+ssize_t BFile::ReadAt( off_t pos, void *buffer, size_t size )
+{
+	ssize_t len = pread( fFD, buffer, size, pos );
+	return len < 0 ? errno_to_status( errno ) : len;
+}
+
+ssize_t BFile::WriteAt( off_t pos, const void *buffer, size_t size )
+{
+	ssize_t len = pwrite( fFD, buffer, size, pos );
+	return len < 0 ? errno_to_status( errno ) : len;
+}
+
+off_t BFile::Seek( off_t position, uint32 seekMode )
+{
+	off_t pos = lseek( fFD, position, seekMode );
+	return pos < 0 ? errno_to_status( errno ) : pos;
+}
+
+off_t BFile::Position() const
+{
+	return lseek( fFD, 0, SEEK_CUR );
+}
+
+status_t BFile::SetSize( off_t size )
+{
+	return ftruncate( fFD, size ) == 0 ? B_OK : errno_to_status( errno );
+}
+
+BPath::BPath() : fStatus( B_NO_INIT ) { fPath[0] = 0; }
+BPath::BPath( const char *dir, const char *leaf, bool normalize )
+	{ SetTo( dir, leaf, normalize ); }
+BPath::BPath( const BDirectory *dir, const char *leaf, bool normalize )
+{
+	BEntry entry;
+	fStatus = dir->GetEntry( &entry );
+	if( fStatus == B_OK ) {
+		BPath dirPath;
+		entry.GetPath( &dirPath );
+		SetTo( dirPath.Path(), leaf, normalize );
+	}
+}
+BPath::BPath( const BEntry *entry )
+{
+	fStatus = entry->GetPath( this );
+}
+
+status_t BPath::SetTo( const char *path, const char *leaf, bool normalize )
+{
+	fPath[0] = 0;
+	if( ! path )
+		return fStatus = B_BAD_VALUE;
+	if( strlen( path ) >= PATH_MAX )
+		return fStatus = B_NAME_TOO_LONG;
+	strcpy( fPath, path );
+	fStatus = B_OK;
+	if( leaf )
+		return Append( leaf, normalize );
+	return B_OK;
+}
+
+status_t BPath::Append( const char *path, bool normalize )
+{
+	if( fStatus != B_OK )
+		return fStatus;
+	size_t len = strlen( fPath );
+	if( len + strlen( path ) + 2 >= PATH_MAX )
+		return B_NAME_TOO_LONG;
+	if( len > 0 && fPath[len - 1] != '/' )
+		strcat( fPath, "/" );
+	strcat( fPath, path );
+	return B_OK;
+}
+
+const char* BPath::Leaf() const
+{
+	if( fStatus != B_OK )
+		return NULL;
+	const char *leaf = strrchr( fPath, '/' );
+	return leaf ? leaf + 1 : fPath;
+}
+
+status_t BPath::GetParent( BPath *path ) const
+{
+	if( fStatus != B_OK )
+		return fStatus;
+	char buf[PATH_MAX];
+	strcpy( buf, fPath );
+	char *slash = strrchr( buf, '/' );
+	if( ! slash )
+		return B_ENTRY_NOT_FOUND;
+	if( slash == buf )
+		slash[1] = 0;
+	else
+		*slash = 0;
+	return path->SetTo( buf );
+}
+
+/* ELF files don't carry Be resources; callers get to use their defaults. */
+status_t BResources::SetTo( BFile *file, bool clobber )
+{
+	return file->InitCheck();
+}
+
+void* BResources::FindResource( type_code type, int32 id, size_t *size )
+{
+	return NULL;
+}
+
+/*	$SCANBE_HOME stands in for the home directory, so a test run can use
+	a private add-on directory and settings. */
+status_t find_directory( directory_which which, BPath *path,
+						bool createIt, void *volume )
+{
+	const char *home = getenv( "SCANBE_HOME" );
+	if( ! home )
+		home = getenv( "HOME" );
+	if( ! home )
+		home = "/tmp";
+	const char *sub = NULL;
+	switch( which ) {
+	case B_USER_DIRECTORY:			sub = NULL; break;
+	case B_USER_CONFIG_DIRECTORY:	sub = "config"; break;
+	case B_USER_ADDONS_DIRECTORY:	sub = "config/add-ons"; break;
+	case B_USER_SETTINGS_DIRECTORY:	sub = "config/settings"; break;
+	case B_USER_LIB_DIRECTORY:		sub = "config/lib"; break;
+	default:						return B_BAD_VALUE;
+	}
+	status_t status = path->SetTo( home, sub );
+	if( status == B_OK && createIt ) {
+		char buf[PATH_MAX];
+		strcpy( buf, path->Path() );
+		for( char *p = buf + 1; *p; p++ ) {
+			if( *p == '/' ) {
+				*p = 0;
+				mkdir( buf, 0755 );
+				*p = '/';
+			}
+		}
+		mkdir( buf, 0755 );
+	}
+	return status;
+}
+
+#pragma mark ---- Preferences ----
+
+struct PreferenceSet::item {
+	char*			name;
+	void*			data;
+	ssize_t			size;
+	uint32			type;
+	item*			next;
+};
+
+Preferences::Preferences( const char *signature )
+{
+	fSignature = strdup( signature );
+}
+
+Preferences::~Preferences()
+{
+	free( fSignature );
+}
+
+PreferenceSet::PreferenceSet( Preferences &prefs, const char *name, bool doSave )
+	: fItems( NULL ), fStatus( B_OK ), fLoaded( false )
+{
+	BPath path;
+	fStatus = find_directory( B_USER_SETTINGS_DIRECTORY, &path, true );
+	if( fStatus == B_OK )
+		snprintf( fPath, sizeof( fPath ), "%s/%s-%s", path.Path(),
+					prefs.Signature(), name );
+}
+
+PreferenceSet::~PreferenceSet()
+{
+	while( fItems ) {
+		item *next = fItems->next;
+		free( fItems->name );
+		free( fItems->data );
+		delete fItems;
+		fItems = next;
+	}
+}
+
+void PreferenceSet::_Load()
+{
+	if( fLoaded )
+		return;
+	fLoaded = true;
+	FILE *fp = fopen( fPath, "rb" );
+	if( ! fp )
+		return;
+	for( ;; ) {
+		uint32 nameLen, type;
+		int32 size;
+		if( fread( &nameLen, 4, 1, fp ) != 1 || nameLen > 1024 )
+			break;
+		char *name = (char *) malloc( nameLen + 1 );
+		bool ok = fread( name, 1, nameLen, fp ) == nameLen
+					&& fread( &type, 4, 1, fp ) == 1
+					&& fread( &size, 4, 1, fp ) == 1 && size >= 0;
+		void *data = ok ? malloc( size ? size : 1 ) : NULL;
+		if( ok )
+			ok = (ssize_t) fread( data, 1, size, fp ) == size;
+		if( ! ok ) {
+			free( name );
+			free( data );
+			break;
+		}
+		name[nameLen] = 0;
+		item *it = new item;
+		it->name = name;
+		it->data = data;
+		it->size = size;
+		it->type = type;
+		it->next = fItems;
+		fItems = it;
+	}
+	fclose( fp );
+}
+
+status_t PreferenceSet::GetData( const char *name, void *&data, ssize_t &size,
+						uint32 &type )
+{
+	if( fStatus != B_OK )
+		return fStatus;
+	_Load();
+	for( item *it = fItems; it; it = it->next ) {
+		if( strcmp( it->name, name ) == 0 ) {
+			data = it->data;
+			size = it->size;
+			type = it->type;
+			return B_OK;
+		}
+	}
+	return B_NAME_NOT_FOUND;
+}
+
+status_t PreferenceSet::SetData( const char *name, const void *data, ssize_t size,
+						uint32 type )
+{
+	if( fStatus != B_OK )
+		return fStatus;
+	_Load();
+	RemoveData( name );
+	item *it = new item;
+	it->name = strdup( name );
+	it->data = malloc( size ? size : 1 );
+	memcpy( it->data, data, size );
+	it->size = size;
+	it->type = type;
+	it->next = fItems;
+	fItems = it;
+	return B_OK;
+}
+
+status_t PreferenceSet::RemoveData( const char *name )
+{
+	_Load();
+	for( item **prev = &fItems; *prev; prev = &(*prev)->next ) {
+		if( strcmp( (*prev)->name, name ) == 0 ) {
+			item *it = *prev;
+			*prev = it->next;
+			free( it->name );
+			free( it->data );
+			delete it;
+			return B_OK;
+		}
+	}
+	return B_NAME_NOT_FOUND;
+}
+
+status_t PreferenceSet::Save()
+{
+	if( fStatus != B_OK )
+		return fStatus;
+	_Load();
+	char tmpPath[1100];
+	snprintf( tmpPath, sizeof( tmpPath ), "%s.%d", fPath, (int) getpid() );
+	FILE *fp = fopen( tmpPath, "wb" );
+	if( ! fp )
+		return errno_to_status( errno );
+	bool ok = true;
+	for( item *it = fItems; it && ok; it = it->next ) {
+		uint32 nameLen = strlen( it->name );
+		int32 size = it->size;
+		ok = fwrite( &nameLen, 4, 1, fp ) == 1
+			&& fwrite( it->name, 1, nameLen, fp ) == nameLen
+			&& fwrite( &it->type, 4, 1, fp ) == 1
+			&& fwrite( &size, 4, 1, fp ) == 1
+			&& (ssize_t) fwrite( it->data, 1, it->size, fp ) == it->size;
+	}
+	if( fclose( fp ) != 0 )
+		ok = false;
+	if( ! ok || rename( tmpPath, fPath ) != 0 ) {
+		unlink( tmpPath );
+		return B_IO_ERROR;
+	}
+	return B_OK;
+}
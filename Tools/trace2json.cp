@@ -0,0 +1,116 @@
+/*
+	trace2json -- converts a libscanbe trace to Chrome trace JSON.
+	Copyright (c) 1997, Jim Moy, All Rights Reserved
+
+	usage: trace2json trace-file [json-file]
+
+	The trace comes from scan_trace_save(), or from setting SCAN_TRACE.
+	Load the output in chrome://tracing or Perfetto. Each thread gets its
+	own track; public calls and add-on hooks show as nested spans, and
+	session state changes as instant events.
+*/
+
+#include "ScannerBe.h"
+#include "ScanTrace.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Some local function prototypes. */
+static const char *event_name( const trace_event *e, char *buf );
+
+int main( int argc, char **argv )
+{
+	if( argc < 2 || argc > 3 ) {
+		fprintf( stderr, "usage: trace2json trace-file [json-file]\n" );
+		return 2;
+	}
+
+	FILE *in = fopen( argv[1], "rb" );
+	if( ! in ) {
+		fprintf( stderr, "Couldn't open %s\n", argv[1] );
+		return 1;
+	}
+	trace_file_header header;
+	if( fread( &header, sizeof( header ), 1, in ) != 1
+			|| header.magic != kTraceMagic || header.version != kTraceVersion
+			|| header.event_size != (int32) sizeof( trace_event )
+			|| header.count < 0 ) {
+		fprintf( stderr, "%s isn't a libscanbe trace from this kind of machine\n",
+				argv[1] );
+		return 1;
+	}
+
+	FILE *out = argc == 3 ? fopen( argv[2], "w" ) : stdout;
+	if( ! out ) {
+		fprintf( stderr, "Couldn't create %s\n", argv[2] );
+		return 1;
+	}
+
+	// Times are shown relative to the first event.
+	fprintf( out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" );
+	bigtime_t base = 0;
+	int32 written = 0;
+	for( int32 i = 0; i < header.count; i++ ) {
+		trace_event e;
+		if( fread( &e, sizeof( e ), 1, in ) != 1 ) {
+			fprintf( stderr, "%s is cut short\n", argv[1] );
+			break;
+		}
+		if( i == 0 )
+			base = e.start;
+
+		char buf[64];
+		const char *name = event_name( &e, buf );
+		fprintf( out, "%s{\"name\":\"%s\",\"pid\":1,\"tid\":%ld,\"ts\":%Ld,",
+				written ? ",\n" : "", name, (long) e.thread,
+				(long long) ( e.start - base ) );
+		switch( e.kind ) {
+		case kTraceApi:
+			fprintf( out, "\"ph\":\"X\",\"dur\":%ld,\"cat\":\"api\","
+					"\"args\":{\"session\":%ld}}", (long) e.duration,
+					(long) e.session );
+			break;
+		case kTraceHook:
+			fprintf( out, "\"ph\":\"X\",\"dur\":%ld,\"cat\":\"hook\","
+					"\"args\":{\"session\":%ld,\"result\":%ld}}",
+					(long) e.duration, (long) e.session, (long) e.arg );
+			break;
+		default:
+			fprintf( out, "\"ph\":\"i\",\"s\":\"t\",\"cat\":\"state\","
+					"\"args\":{\"session\":%ld}}", (long) e.session );
+			break;
+		}
+		written++;
+	}
+	fprintf( out, "\n]}\n" );
+
+	fclose( in );
+	if( out != stdout && fclose( out ) != 0 ) {
+		fprintf( stderr, "Couldn't write %s\n", argv[2] );
+		return 1;
+	}
+	return 0;
+}
+
+static const char *event_name( const trace_event *e, char *buf )
+{
+	switch( e->kind ) {
+	case kTraceApi:
+		if( e->what >= 0 && e->what < kTraceApiCount )
+			return kTraceApiNames[e->what];
+		break;
+	case kTraceHook:
+		if( e->what >= 0 && e->what < SCAN_HOOK_COUNT )
+			return kTraceHookNames[e->what];
+		break;
+	case kTraceState:
+		if( e->what >= 0 && e->what < (int16) ( sizeof( kTraceStateNames )
+											/ sizeof( kTraceStateNames[0] ) ) ) {
+			sprintf( buf, "state: %s", kTraceStateNames[e->what] );
+			return buf;
+		}
+		break;
+	}
+	sprintf( buf, "unknown %d.%d", e->kind, e->what );
+	return buf;
+}
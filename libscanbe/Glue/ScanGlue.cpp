@@ -37,27 +37,57 @@
 		have an interface (for example, if you're just batch scanning
 		with an ADF) you can pull scan_start() out of the loop, or
 		remove it altogether, depending on your purpose.
+
+		For a stack of pages in an ADF, scan_batch() in ScanBatch.h
+		runs this loop for you, and keeps the scanner going while
+		the pages already scanned are being saved.
+
+	GetNextScannerPage()
+
+		Like GetNextScannerImage(), but for a feeder full of pages: the
+		image goes into a page from a scan_page_pool instead of a new
+		BBitmap, and when you put the page back the next one scanned
+		reuses its memory. Pass the format you want the pixels in.
+
+			scan_page_pool *pool;
+			scan_page_pool_create( 0, &pool );
+			while( scan_adf_ready( scanID ) ) {
+				scan_page *page = GetNextScannerPage( scanID, pool,
+										SCAN_PIXEL_BGRA32, status );
+				app_process_page( page );
+				scan_page_pool_put( pool, page );
+			}
+			scan_page_pool_delete( pool );
+
+	GetNextScannerTiles()
+
+		Like GetNextScannerImage(), but for big scans: a 1200 dpi bed
+		scan won't fit in a BBitmap, so the rows go into a tile store
+		in a file instead, as they come off the scanner. Draw or
+		process it a tile at a time with scan_tiles_lock(), and
+		scan_tiles_delete() it when you're done.
 */
 
 #include "ScanGlue.h"
 #include <Bitmap.h>
 
-static scan_id gScanID = 0;
-
 BBitmap* GetScannerImage( status_t &status )
 {
+	scan_id scanID;
 	scan_version version;
-	status = scan_open( NULL, &gScanID, &version );
+	status = scan_open( NULL, &scanID, &version );
 	if( status != B_OK )
 		return NULL;
 	
-	status = scan_start( gScanID );
-	if( status != B_OK )
+	status = scan_start( scanID );
+	if( status != B_OK ) {
+		scan_close( scanID );
 		return NULL;
+	}
 	
-	BBitmap *bitmap = GetNextScannerImage( gScanID, status );
+	BBitmap *bitmap = GetNextScannerImage( scanID, status );
 	
-	status_t closeStatus = scan_close( gScanID );
+	status_t closeStatus = scan_close( scanID );
 	
 	if( status != B_OK )
 		return NULL;
@@ -69,14 +99,11 @@ BBitmap* GetScannerImage( status_t &status )
 		return NULL;
 	}
 	
-	gScanID = 0;
 	return bitmap;
 }
 
 BBitmap* GetNextScannerImage( scan_id id, status_t &status  )
 {
-	const int32 kBufSize = 32 * 1024L;
-	char *scanBuf = new char[ kBufSize ];
 	BBitmap *bitmap = NULL;
 	
 	status = scan_open_image( id );
@@ -93,11 +120,14 @@ BBitmap* GetNextScannerImage( scan_id id, status_t &status  )
 	if( status != B_OK )
 		goto errXit;
 	
-	// This demo app only handles gray & color images, one byte per sample,
-	// but this is where you'd handle the threshold case and possibly handle
-	// deeper than 24-bit color, etc.
+	// This demo app handles gray & color images, one or two bytes per
+	// sample, and thresholded ones, one bit per pixel. 16-bit samples are
+	// dithered down to 8, since that's all a BBitmap holds. Scanners that
+	// only do gray can have libscanbe threshold for them instead, see
+	// scan_set_process().
 	if( ( settings.image_type != SCAN_TYPE_RGB ) &&
-			( settings.image_type != SCAN_TYPE_RGB ) ) {
+			( settings.image_type != SCAN_TYPE_GRAY ) &&
+			( settings.image_type != SCAN_TYPE_BINARY ) ) {
 		goto errXit;
 	}
 	
@@ -106,52 +136,27 @@ BBitmap* GetNextScannerImage( scan_id id, status_t &status  )
 			settings.pixel_width - 1, settings.pixel_height - 1 );
 	color_space space = B_RGB_32_BIT;
 	bitmap = new BBitmap( bitmapRect, space ) ;
-	int32 bitmapSize = bitmap->BitsLength();
-	
-	// Do the scan loop, filling in the bitmap as we go.
-	int32 offset = 0, count;
-	for( bool notDone = true; notDone; ) {
-		count = kBufSize;
-		
-		// scan data into scanBuf, get the number of bytes scanned back in count
-		status = scan_data( id, scanBuf, &count );
-		
-		if( status != B_OK ) {
-			// if we've reached the end of the scan, we get back B_SCANNER_DATA_END
-			if( status == SCAN_DATA_END )
-				status = B_OK;
-			else				
-				scan_close_image( id );			// some other scanner error
-			notDone = false;
-		}
-		
-		if( status == B_OK && count > 0 ) {
-			if( settings.image_type == SCAN_TYPE_RGB ) {
-				bitmap->SetBits( scanBuf, count, offset, space );
-				offset += count * 4 / 3;
-			} else {
-				// scanner only does gray, but BBitmaps only do RGB
-				char *ptr = (char *) scanBuf;
-				char *dest = (char *) bitmap->Bits();
-				dest += offset;
-				for( int32 i = 0; i < count; i++, ptr++ ) {
-					*dest++ = *ptr;		// B
-					*dest++ = *ptr;		// G
-					*dest++ = *ptr;		// R
-					*dest++ = 0;		// A
-				}
-				offset += count * 4;
-			}
-			// still gotta do thresholded data
-		}
-		
-		// You might take this code and do other things in the scan loop,
-		// like check for user cancellation, etc.
-	}
+	
+	// Have libscanbe scan the whole image straight into the bitmap. It
+	// converts each row to B_RGB_32_BIT as it goes, and lines them up with
+	// the bitmap's rows however either side pads them.
+	scan_destination dest;
+	dest.size = sizeof( dest );
+	dest.bits = bitmap->Bits();
+	dest.bytes_per_row = bitmap->BytesPerRow();
+	dest.format = SCAN_PIXEL_BGRA32;
+	dest.first_row = 0;
+	dest.rows = 0;
+	dest.alpha = 0;
+	int32 rows;
+	status = scan_data_into( id, &dest, &rows );
+	
+	// if we've reached the end of the scan, we get back SCAN_DATA_END
+	if( status == SCAN_DATA_END )
+		status = B_OK;
 	
 errXit:
 	status_t closeStatus = scan_close_image( id );
-	delete[] scanBuf;
 	if( ( closeStatus != B_OK ) || ( status != B_OK ) ) {
 		if( bitmap )
 			delete bitmap;
@@ -160,3 +165,82 @@ errXit:
 	return bitmap;
 }
 
+scan_page* GetNextScannerPage( scan_id id, scan_page_pool *pool,
+							scan_pixel_format format, status_t &status )
+{
+	scan_page *page = NULL;
+	
+	status = scan_open_image( id );
+	if( status != B_OK )
+		return NULL;
+	
+	// As above, the size is only final once the image is open.
+	scan_settings settings;
+	status = scan_get_settings( id, &settings, NULL, NULL );
+	if( status == B_OK )
+		status = scan_page_pool_get( pool, &settings, format, &page );
+	
+	if( status == B_OK ) {
+		scan_destination dest;
+		dest.size = sizeof( dest );
+		dest.bits = page->bits;
+		dest.bytes_per_row = page->bytes_per_row;
+		dest.format = format;
+		dest.first_row = 0;
+		dest.rows = 0;
+		dest.alpha = 0;
+		int32 rows;
+		status = scan_data_into( id, &dest, &rows );
+		if( status == SCAN_DATA_END )
+			status = B_OK;
+	}
+	
+	status_t closeStatus = scan_close_image( id );
+	if( status == B_OK )
+		status = closeStatus;
+	if( status != B_OK && page ) {
+		scan_page_pool_put( pool, page );
+		page = NULL;
+	}
+	return page;
+}
+
+scan_tile_store* GetNextScannerTiles( scan_id id, const char *path,
+									status_t &status )
+{
+	scan_tile_store *store = NULL;
+	
+	status = scan_open_image( id );
+	if( status != B_OK )
+		return NULL;
+	
+	// As above, the size is only final once the image is open.
+	scan_settings settings;
+	status = scan_get_settings( id, &settings, NULL, NULL );
+	if( status == B_OK )
+		status = scan_tiles_create( path, &settings, 0, &store );
+	
+	// The store takes the bands as they are, so there's nothing to convert.
+	while( status == B_OK ) {
+		const void *scanBuf;
+		int32 count = 0;
+		status = scan_data_ex( id, &scanBuf, &count );
+		if( ( status == B_OK || status == SCAN_DATA_END ) && scanBuf ) {
+			status_t writeStatus = scan_tiles_write( store, scanBuf, count );
+			scan_release_data( id, scanBuf );
+			if( writeStatus != B_OK )
+				status = writeStatus;
+		}
+	}
+	if( status == SCAN_DATA_END )
+		status = B_OK;
+	
+	status_t closeStatus = scan_close_image( id );
+	if( status == B_OK )
+		status = closeStatus;
+	if( status != B_OK && store ) {
+		scan_tiles_delete( store );
+		store = NULL;
+	}
+	return store;
+}
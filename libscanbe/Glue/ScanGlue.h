@@ -6,6 +6,8 @@
 
 #include <SupportDefs.h>
 #include "ScannerBe.h"
+#include "ScanTiles.h"
+#include "ScanPool.h"
 class BBitmap;
 
 // This is the one-function "just scan me an image" routine.
@@ -13,3 +15,14 @@ BBitmap* GetScannerImage( status_t &status );
 
 // This gives you a bit more flexibility. See the .cpp file.
 BBitmap* GetNextScannerImage( scan_id id, status_t &status  );
+
+// The same for a stack of pages: each image goes into a page from pool,
+// in format, so pages the same size reuse the memory. Put it back in the
+// pool when you're done with it.
+scan_page* GetNextScannerPage( scan_id id, scan_page_pool *pool,
+							scan_pixel_format format, status_t &status );
+
+// The same for images too big to hold in memory: the image goes into a
+// tile store, kept in the file at path (or a temporary one if NULL).
+scan_tile_store* GetNextScannerTiles( scan_id id, const char *path,
+									status_t &status );
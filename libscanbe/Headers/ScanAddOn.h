@@ -7,6 +7,7 @@
 #define _SCANNERADDON_H
 
 #include <SupportDefs.h>
+#include <stddef.h>
 #include "ScannerBe.h"
 
 #ifdef __cplusplus
@@ -26,6 +27,9 @@ typedef status_t (*scan_put_setting_hook)( void *cookie, const scan_setting_id i
 typedef status_t (*scan_open_image_hook)( void *cookie );
 typedef status_t (*scan_close_image_hook)( void *cookie );
 typedef status_t (*scan_start_hook)( void *cookie );
+/* rows go out as described with scan_settings in ScannerBe.h: 16-bit
+	samples big-endian on every CPU, and scaled up to the whole range if
+	the scanner has fewer bits, so swap them on little-endian machines */
 typedef status_t (*scan_data_hook)( void *cookie, void *buffer, int32 *count );
 typedef bool (*scan_adf_ready_hook)( void *cookie );
 typedef void (*scan_error_message_hook)( void *cookie, status_t err, char *msg );
@@ -47,8 +51,67 @@ typedef struct {
 } scan_hooks;
 
 
+/* Optional hooks. An add-on that implements any of these exports
+	find_scanner_ext() alongside find_scanner(). The size field must be
+	set to sizeof( scan_ext_hooks ) as the add-on was compiled, so hooks
+	appended here later are only called on add-ons that know about them.
+	Unimplemented hooks may be left NULL. */
+
+/* Lends the caller a read-only band of whole rows owned by the add-on,
+	instead of copying into a caller buffer. On entry count is the most
+	the caller wants (0 for whatever suits the add-on), on return the
+	size of the band. Same SCAN_DATA_END convention as the data hook.
+	Only one band is out at a time; it stays valid until release_data. */
+typedef status_t (*scan_acquire_data_hook)( void *cookie, const void **rows,
+								int32 *count );
+typedef status_t (*scan_release_data_hook)( void *cookie, const void *rows );
+
+/* Bulk versions of get_setting and put_setting, moving a whole
+	scan_settings in one call. get_settings fills in whichever of current,
+	minimum and maximum aren't NULL. put_settings sets the writable fields
+	and returns in mask every setting affected by any of them. Without
+	these, libscanbe makes one get_setting or put_setting call per field. */
+typedef status_t (*scan_get_settings_hook)( void *cookie, scan_settings *current,
+								scan_settings *minimum, scan_settings *maximum );
+typedef status_t (*scan_put_settings_hook)( void *cookie, scan_settings *settings,
+								scan_settings_mask *mask );
+
+/* Asks whatever hook is running on cookie to give up as soon as it can
+	and return SCAN_USER_CANCEL: the start hook waiting for the user, or a
+	data hook waiting for the device. It's called from another thread while
+	that hook is still running, so it must only set a flag or release a
+	semaphore, and must not wait. Calls made after it may go back to normal;
+	libscanbe stops making them until the image is closed. */
+typedef void (*scan_cancel_hook)( void *cookie );
+
+/* Fills in the data call sizes that suit the device, see scan_transfer_info
+	in ScannerBe.h; it arrives holding the defaults, so leave alone what
+	doesn't matter. Called when an image is opened, so the sizes can depend
+	on its settings. libscanbe rounds them to whole rows. */
+typedef status_t (*scan_get_transfer_info_hook)( void *cookie,
+								scan_transfer_info *info );
+
+typedef struct {
+	size_t						size;
+	scan_acquire_data_hook		acquire_data;
+	scan_release_data_hook		release_data;
+	scan_get_settings_hook		get_settings;
+	scan_put_settings_hook		put_settings;
+	scan_cancel_hook			cancel;
+	scan_get_transfer_info_hook	get_transfer_info;
+} scan_ext_hooks;
+
+/* Is an optional hook both known to the add-on's version of scan_ext_hooks
+	and filled in? owner is whatever holds the pointer find_scanner_ext()
+	returned, in a member named ext, which may be NULL. */
+#define HAS_EXT_HOOK( owner, hook ) \
+	( (owner)->ext && (owner)->ext->size >= offsetof( scan_ext_hooks, hook ) \
+		+ sizeof( (owner)->ext->hook ) && (owner)->ext->hook )
+
+
 extern const char	**publish_scanners();
 extern scan_hooks	*find_scanner( const char *name );
+extern scan_ext_hooks	*find_scanner_ext( const char *name );
 
 #ifdef __cplusplus
 }
@@ -34,6 +34,9 @@ static bool scn_adf_ready( void *cookie );
 
 static void scn_error_message( void *cookie, status_t err, char *msg );
 
+/*	The optional scan_ext_hooks are left out: an add-on declares the
+	ones it implements, so a static prototype is never left unused. */
+
 #ifdef __cplusplus
 }
 #endif
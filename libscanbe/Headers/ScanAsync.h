@@ -0,0 +1,85 @@
+/*
+	ScannerBe -- scanning in the background, with cancellation.
+	Copyright (c) 1997, Jim Moy, All Rights Reserved
+*/
+
+#ifndef _SCANASYNC_H
+#define _SCANASYNC_H
+
+#include <OS.h>
+#include <SupportDefs.h>
+#include "ScannerBe.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* scan_start() can wait as long as the user likes, and scan_data() as
+	long as the scanner does, so an app driving them directly needs a
+	thread per scanner parked in those calls. A request does that waiting
+	on a thread of libscanbe's instead: submit it and go back to your
+	event loop, and it calls the sink as the image comes in and when it's
+	over. One thread can look after any number of scanners this way.
+
+	The sink's functions run on the request's thread. begin() is called
+	once the image is open, with its final settings, rows() with each band
+	of whole rows, numbered from 0, as scan_data() delivers them, and
+	done() last of all, with B_OK or whatever ended the request. Any of
+	them may be NULL. If begin() or rows() return an error, the image is
+	closed and that's the request's result. Once done() has been called,
+	a message with code SCAN_REQUEST_DONE and a scan_request_event is also
+	written to port, unless it's negative, so the end of a request can be
+	waited for along with other things. */
+
+typedef struct scan_request scan_request;
+
+/* What a request does, in this order. */
+typedef uint32 scan_request_flags;
+const scan_request_flags	SCAN_REQUEST_START	= 1;	/* scan_start(), for the add-on's interface */
+const scan_request_flags	SCAN_REQUEST_IMAGE	= 2;	/* open, read and close an image */
+
+typedef struct {
+	status_t	(*begin)( void *data, const scan_settings *settings );
+	status_t	(*rows)( void *data, int32 first_row, const void *rows,
+						int32 count );
+	void		(*done)( void *data, status_t status );
+	void		*data;
+	port_id		port;
+} scan_request_sink;
+
+const int32 SCAN_REQUEST_DONE = 'SCrd';
+
+typedef struct {
+	scan_request	*request;
+	status_t		status;
+	void			*data;			/* the sink's */
+} scan_request_event;
+
+/* Starts a request on a session open with scan_open(). Make no other
+	calls on the session until it's done, except scan_cancel() and
+	scan_get_stats(). */
+status_t	scan_submit( const scan_id id, scan_request_flags flags,
+						const scan_request_sink *sink, scan_request **request );
+
+/* Stops the request as soon as it can, without waiting for it: it's
+	done with SCAN_USER_CANCEL, after closing the image if it had one
+	open. A start or data call that's waiting on the add-on is woken if
+	the add-on has a cancel hook, see scan_cancel(); otherwise the request
+	stops when it returns, which for a scan_start() may take closing the
+	session. Too late to stop, it finishes as it would have. */
+status_t	scan_request_cancel( scan_request *request );
+
+/* Waits up to timeout for the request to be done, and if it is, sets
+	result to what it ended with. A timeout of 0 just polls, returning
+	B_WOULD_BLOCK if it's still going, B_INFINITE_TIMEOUT waits for good. */
+status_t	scan_request_wait( scan_request *request, bigtime_t timeout,
+						status_t *result );
+
+/* Waits for the request to be done, and frees it. Not from the sink. */
+status_t	scan_request_delete( scan_request *request );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SCANASYNC_H */
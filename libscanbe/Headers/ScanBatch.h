@@ -0,0 +1,64 @@
+/*
+	ScannerBe -- multi-page scanning from a document feeder.
+	Copyright (c) 1997, Jim Moy, All Rights Reserved
+*/
+
+#ifndef _SCANBATCH_H
+#define _SCANBATCH_H
+
+#include <SupportDefs.h>
+#include "ScannerBe.h"
+#include "ScanWriter.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Scans pages for as long as scan_adf_ready() says the feeder has them,
+	handing each page's rows to a sink. The sink runs on a thread of its
+	own, so while it's still encoding and writing one page the scanner is
+	already reading the next; the two are decoupled by depth buffers of
+	band_size bytes (0 for defaults, 32 of 64K). When they're all waiting
+	on the sink, the scanner is paused.
+
+	The sink's functions are called in order for each page: begin_page()
+	once the page is open, with its final settings, rows() with whole rows
+	as scan_data() delivers them, and end_page() with B_OK or the error
+	that ended the page. If any of them returns an error, the batch stops
+	after the page and returns it; SCAN_USER_CANCEL is the polite way to
+	stop early. */
+
+typedef struct {
+	status_t	(*begin_page)( void *data, int32 page, const scan_settings *settings );
+	status_t	(*rows)( void *data, const void *rows, int32 count );
+	status_t	(*end_page)( void *data, int32 page, status_t status );
+	void		*data;
+} scan_batch_sink;
+
+/* Call between scan_open() (or scan_start()) and scan_close(). profile
+	is put with scan_put_settings() first, unless it's NULL. pages is set
+	to the number of pages the sink saw through, even on error. */
+status_t	scan_batch( const scan_id id, scan_settings *profile,
+						const scan_batch_sink *sink, int32 depth,
+						int32 band_size, int32 *pages );
+
+/* scan_batch() into one file per page. name_pattern is a printf format
+	for the page number, starting at 1, such as "/boot/home/page%03ld.tif".
+	The compressed formats are encoded by a scan_encoder_pool with a thread
+	for each CPU, so pages are compressed side by side while the feeder
+	goes on; the call returns once they're all written. */
+status_t	scan_batch_to_files( const scan_id id, scan_settings *profile,
+						const char *name_pattern, scan_file_format format,
+						int32 *pages );
+
+/* The same, with the pages encoded by pool, which is waited for before
+	returning. NULL pool is the same as scan_batch_to_files(). */
+status_t	scan_batch_to_files_etc( const scan_id id, scan_settings *profile,
+						const char *name_pattern, scan_file_format format,
+						scan_encoder_pool *pool, int32 *pages );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SCANBATCH_H */
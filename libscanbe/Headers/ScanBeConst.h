@@ -1,6 +1,8 @@
 #pragma once
 
-typedef char** (*publish_proc)();
+typedef const char** (*publish_proc)();
 
 #define	kPublishNamesFunction		"publish_scanners"
 #define	kFindScannerFunction		"find_scanner"
+#define	kFindScannerExtFunction		"find_scanner_ext"
+#define	kDefaultAddonSubdir			"Scanner"	// in the user add-ons, as in strings.r
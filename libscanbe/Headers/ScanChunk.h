@@ -0,0 +1,51 @@
+/*
+	ScannerBe -- self-tuning data call sizes.
+	Copyright (c) 1997, Jim Moy, All Rights Reserved
+*/
+
+#ifndef _SCANCHUNK_H
+#define _SCANCHUNK_H
+
+#include <SupportDefs.h>
+#include "ScannerBe.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Reads an image in chunks sized for the scanner instead of a fixed
+	buffer. A small buffer on a high resolution page means thousands of
+	data calls, each paying the add-on's and the device's overhead; too
+	big a one makes the app wait longer for each. The reader starts at
+	the size scan_get_transfer_info() prefers, then keeps doubling it for
+	as long as that makes the data calls measurably faster, up to the
+	add-on's maximum or max_bytes, and settles on the fastest.
+
+	Chunks are borrowed with scan_data_ex(), so with an add-on that lends
+	its buffers they aren't copied at all. Each one is given back on the
+	next read, or on closing. */
+
+typedef struct scan_chunk_reader scan_chunk_reader;
+
+/* Call once the image is open. max_bytes of 0 leaves the limit to the
+	add-on, or 1MB if it has none. */
+status_t	scan_chunk_open( const scan_id id, int32 max_bytes,
+						scan_chunk_reader **reader );
+
+/* Points rows at the next chunk of whole rows and sets count to its size.
+	Returns what scan_data_ex() did: B_OK, SCAN_DATA_END with the last of
+	the image, or an error. */
+status_t	scan_chunk_read( scan_chunk_reader *reader, const void **rows,
+						int32 *count );
+
+/* The size being asked for now, and whether it's done tuning. */
+int32		scan_chunk_size( scan_chunk_reader *reader, bool *settled );
+
+/* Gives back the last chunk; call it before scan_close_image(). */
+status_t	scan_chunk_close( scan_chunk_reader *reader );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SCANCHUNK_H */
@@ -0,0 +1,71 @@
+/*
+	ScannerBe -- pixel format conversion helpers.
+	Copyright (c) 1997, Jim Moy, All Rights Reserved
+*/
+
+#ifndef _SCANCONVERT_H
+#define _SCANCONVERT_H
+
+#include <SupportDefs.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Row converters between scan_data() formats and what BBitmaps and most
+	file formats want. Each call converts a run of pixels (or samples) and
+	may be handed any length and alignment. The fastest version the CPU
+	supports (SSE2/SSSE3/AVX2/AVX-512 or NEON, with a plain C fallback) is
+	picked the first time libscanbe is loaded; setting the SCAN_CONVERT
+	environment variable to "scalar" forces the C versions. */
+
+/* interleaved RGB, red first -> B_RGB_32_BIT (B, G, R, alpha in memory) */
+void	scan_convert_rgb24_to_bgra32( const void *src, void *dst, int32 pixels,
+								uint8 alpha );
+
+/* B_RGB_32_BIT -> interleaved RGB, red first; alpha is dropped */
+void	scan_convert_bgra32_to_rgb24( const void *src, void *dst, int32 pixels );
+
+/* interleaved RGB, red first -> blue first, as TGA and BMP store it;
+	src and dst may be the same */
+void	scan_convert_rgb24_to_bgr24( const void *src, void *dst, int32 pixels );
+
+/* 8-bit gray -> B_RGB_32_BIT */
+void	scan_convert_gray8_to_bgra32( const void *src, void *dst, int32 pixels,
+								uint8 alpha );
+
+/* SCAN_TYPE_BINARY row, most significant bit first, 1 is black ->
+	8-bit gray, 0 black and 255 white */
+void	scan_convert_bits_to_gray8( const void *src, void *dst, int32 pixels );
+
+/* 16-bit big-endian samples, as scan_data() delivers them -> 8 bits */
+void	scan_convert_16_to_8( const void *src, void *dst, int32 samples );
+
+/* The same, rounded with an 8x8 ordered dither instead of cut off, so
+	smooth gradients don't band. row is the image row, which picks the
+	line of the pattern; channels is 1 for gray, 3 for RGB. */
+void	scan_convert_16_to_8_dither( const void *src, void *dst, int32 pixels,
+								int32 channels, int32 row );
+
+/* Swaps the bytes of 16-bit samples, big-endian <-> little-endian; src
+	and dst may be the same */
+void	scan_convert_swap16( const void *src, void *dst, int32 samples );
+
+/* Looks every byte up in a 256-entry table; luts holds one table per
+	channel, and byte i of src uses table i % channels. For RGB pass 3
+	tables and start src on a pixel. src and dst may be the same. */
+void	scan_convert_lut8( const void *src, void *dst, int32 bytes,
+								const uint8 *luts, int32 channels );
+
+/* The same for 16-bit big-endian samples and 65536-entry tables. */
+void	scan_convert_lut16( const void *src, void *dst, int32 samples,
+								const uint16 *luts, int32 channels );
+
+/* Which set of converters is in use, for diagnostics. */
+const char*	scan_convert_implementation();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SCANCONVERT_H */
@@ -0,0 +1,56 @@
+/*
+	ScannerBe -- background image encoding.
+	Copyright (c) 1997, Jim Moy, All Rights Reserved
+*/
+
+#ifndef _SCANENCODER_H
+#define _SCANENCODER_H
+
+#include <SupportDefs.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A pool of threads that compress image files in the background, so a
+	multi-page scan doesn't wait for one page to be encoded before it
+	starts on the next. Hand it to scan_writer_open_pooled(): the writer
+	cuts the image into strips as rows arrive, the pool's threads deflate
+	the strips side by side, and they go into the file in order as they
+	finish. Closing a pooled writer only queues the end of its file.
+
+	memory bounds what's waiting in the pool, rows and compressed strips,
+	across all its writers. When it's used up, scan_writer_write() waits
+	for the pool to catch up. 0 threads means one for each CPU, and 0
+	memory means 16MB. */
+
+typedef struct scan_encoder_pool scan_encoder_pool;
+
+status_t	scan_encoder_pool_create( int32 threads, size_t memory,
+							scan_encoder_pool **pool );
+
+/* Waits until everything queued so far is in its file. Returns the first
+	error any of the pool's files had since the last wait. */
+status_t	scan_encoder_pool_wait( scan_encoder_pool *pool );
+
+/* Waits, then stops the threads. */
+status_t	scan_encoder_pool_delete( scan_encoder_pool *pool );
+
+#ifdef __cplusplus
+}
+
+/*	What the writers queue. run() is called once, on one of the pool's
+	threads; the job must call encoder_job_done() with its cost once its
+	memory is given back. Without a pool, it runs on the caller's thread. */
+struct encoder_job {
+	void			(*run)( encoder_job *job );
+	encoder_job*	next;
+};
+
+/* Waits for cost bytes of the pool's memory, then queues the job. */
+void	encoder_submit( scan_encoder_pool *pool, encoder_job *job, int32 cost );
+void	encoder_job_done( scan_encoder_pool *pool, int32 cost, status_t status );
+
+#endif
+
+#endif /* _SCANENCODER_H */
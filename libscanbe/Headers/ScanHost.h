@@ -0,0 +1,164 @@
+/*
+	ScannerBe -- running an add-on in a host process of its own.
+	Copyright (c) 1997, Jim Moy, All Rights Reserved
+*/
+
+#ifndef _SCANHOST_H
+#define _SCANHOST_H
+
+#include <OS.h>
+#include <SupportDefs.h>
+#include "ScannerBe.h"
+#include "ScanAddOn.h"
+
+/* Private to libscanbe and the ScanHost program, not part of the API.
+
+	With SCANBE_HOST set to the path of ScanHost, scan_open() doesn't load
+	the add-on at all: it starts ScanHost on it, and the session's hooks
+	are stand-ins that pass each call over to the host. A driver that
+	hangs or crashes then only takes its own team with it, and each
+	session's driver runs on whatever CPU the host's threads get.
+
+	Calls go as a host_request on the request port, with the hook's code,
+	and come back as a host_reply on the reply port. Cancelling has a port
+	of its own, so it gets through while the host is busy in a hook.
+
+	Image data doesn't go through the ports. When an image is opened, the
+	host makes a ring of slots in an area and a thread that keeps them
+	filled from the add-on's data hook; the client clones the area and
+	takes the rows straight out of it, lending them from there for
+	scan_data_ex(). The full semaphore counts slots ready for the client,
+	the empty one slots ready for the host.
+
+	Run as ScanHost -server, the host is a daemon that any number of apps
+	share. While its port is there, scan_open() connects to it instead of
+	starting a host of its own: it sends the server kHostConnect with the
+	session's ports, and from then on it's the same as a host of its own,
+	except that the server keeps each scanner open between sessions and
+	takes turns between the sessions using it. See ScanHost/main.cp. */
+
+const char* const kHostEnvVar = "SCANBE_HOST";
+const char* const kServerEnvVar = "SCANBE_SERVER";	// 0 to leave the server alone
+const char* const kServerPortName = "scan_server";
+const int32 kHostPathLength = 1024;
+const int32 kHostMaxSlots = 8;
+const int32 kHostSlotAlignment = 64;	// a cache line
+
+/* Port message codes, one per hook. */
+enum {
+	kHostOpen = 'Hopn',
+	kHostClose = 'Hcls',
+	kHostGetCapabilities = 'Hcap',
+	kHostGetSetting = 'Hget',
+	kHostPutSetting = 'Hput',
+	kHostGetSettings = 'Hgts',
+	kHostPutSettings = 'Hpts',
+	kHostOpenImage = 'Hopi',
+	kHostCloseImage = 'Hcli',
+	kHostStart = 'Hsta',
+	kHostAdfReady = 'Hadf',
+	kHostErrorMessage = 'Herr',
+	kHostGetTransferInfo = 'Hxfr',
+	kHostCancel = 'Hcan',			// on the cancel port
+	kHostQuit = 'Hqut',				// on the cancel port, or the server's
+	kHostConnect = 'Hcon'			// on the server's port
+};
+
+/* A session's ports, sent with kHostConnect. */
+typedef struct {
+	port_id		request;
+	port_id		reply;
+	port_id		cancel;
+	char		name[SCAN_STRING_LENGTH];
+	char		path[kHostPathLength];
+} host_connect_info;
+
+/* Settings that are pointers, so they can't be passed to a host. */
+const scan_settings_mask kHostLocalSettings = SCAN_SETTING_TONEMAP
+	| SCAN_SETTING_TONEMAP3 | SCAN_SETTING_SPECIFIC;
+
+/* Which optional hooks the add-on has, in host_reply.hooks for kHostOpen. */
+const uint32 kHostHasGetSettings = 1;
+const uint32 kHostHasPutSettings = 2;
+
+/* Everything any call needs; each uses the fields it's named for. */
+typedef struct {
+	scan_setting_id		setting;
+	scan_setting_kind	kind;
+	scan_value			value;
+	scan_settings		settings;
+	bool				want[3];		// kHostGetSettings: current, min, max
+	status_t			error;			// kHostErrorMessage
+	scan_transfer_info	transfer;
+} host_request;
+
+/* Where the image's ring is, in the kHostOpenImage reply. */
+typedef struct {
+	area_id		area;
+	sem_id		full;
+	sem_id		empty;
+	int32		slots;
+	int32		slot_size;				// bytes, whole rows
+	int32		row_bytes;
+} host_ring_info;
+
+typedef struct {
+	status_t			status;
+	uint32				hooks;			// kHostOpen
+	scan_version		version;
+	scan_settings_mask	mask;
+	scan_value			value;
+	scan_settings		settings[3];	// kHostGetSettings by kind - 1
+	bool				ready;			// kHostAdfReady
+	char				message[SCAN_STRING_LENGTH];
+	scan_transfer_info	transfer;
+	host_ring_info		ring;
+} host_reply;
+
+/* The start of the ring's area; the slots follow it. */
+typedef struct {
+	int32		count;					// bytes of rows in it
+	status_t	status;					// what the data hook said about them
+} host_slot;
+
+typedef struct {
+	int32		slots;
+	int32		slot_size;
+	int32		quit;					// set by the host to stop its thread
+	host_slot	slot[kHostMaxSlots];
+} host_ring;
+
+inline size_t host_ring_header_size()
+{
+	return ( sizeof( host_ring ) + kHostSlotAlignment - 1 )
+			& ~( (size_t) kHostSlotAlignment - 1 );
+}
+
+inline char* host_slot_data( host_ring *ring, int32 slot )
+{
+	return (char *) ring + host_ring_header_size() + (size_t) slot * ring->slot_size;
+}
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* libscanbe's end. host_wanted() is true if there's a server to connect
+	to, or SCANBE_HOST is set. host_launch() connects to the server, or
+	starts ScanHost, on the add-on at path for the scanner name, and
+	returns the connection to pass to the hooks below as their cookie; the
+	open hook takes it in through its cookie argument, and the close hook
+	ends it. If the host dies, its hooks return SCAN_ADDON_ERROR from then
+	on. */
+typedef struct scan_host scan_host;
+
+bool			host_wanted();
+status_t		host_launch( const char *path, const char *name, scan_host **host );
+scan_hooks*		host_hooks();
+scan_ext_hooks*	host_ext_hooks( scan_host *host );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SCANHOST_H */
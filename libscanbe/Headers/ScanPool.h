@@ -0,0 +1,60 @@
+/*
+	ScannerBe -- reusable page buffers for multi-page sessions.
+	Copyright (c) 1997, Jim Moy, All Rights Reserved
+*/
+
+#ifndef _SCANPOOL_H
+#define _SCANPOOL_H
+
+#include <OS.h>
+#include <SupportDefs.h>
+#include "ScannerBe.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Keeps whole-page buffers around between the pages of a session, so a
+	feeder full of pages the same size doesn't allocate, fault in and free
+	a few megabytes for every one of them. Get a page for the image's
+	settings once it's open, fill it with scan_data_into(), and put it
+	back when you're done with it; the next get with the same geometry
+	hands the same memory out again.
+
+	Pages are areas, page aligned and locked in memory from the start, so
+	the scan never waits on a page fault. bytes_per_row is the image's
+	row_bytes for SCAN_PIXEL_SCANNED, and a multiple of 64 for the others.
+	The pool keeps up to keep pages that aren't out, the ones put back
+	longest ago going first. Pages can be got and put from any thread. */
+
+typedef struct scan_page_pool scan_page_pool;
+
+typedef struct {
+	void				*bits;
+	int32				bytes_per_row;
+	int32				width;			/* in pixels */
+	int32				height;
+	scan_pixel_format	format;
+	size_t				size;			/* of bits, in whole memory pages */
+	area_id				area;
+} scan_page;
+
+/* keep of 0 means 4. */
+status_t	scan_page_pool_create( int32 keep, scan_page_pool **pool );
+
+/* A page for settings' image in format, with whatever the last user of
+	it left there. */
+status_t	scan_page_pool_get( scan_page_pool *pool, const scan_settings *settings,
+						scan_pixel_format format, scan_page **page );
+
+status_t	scan_page_pool_put( scan_page_pool *pool, scan_page *page );
+
+/* Frees the pool and the pages in it. Every page has to be back first,
+	or it returns SCAN_BAD_PHASE. */
+status_t	scan_page_pool_delete( scan_page_pool *pool );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SCANPOOL_H */
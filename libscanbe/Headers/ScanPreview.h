@@ -0,0 +1,70 @@
+/*
+	ScannerBe -- progressive low-resolution previews.
+	Copyright (c) 1997, Jim Moy, All Rights Reserved
+*/
+
+#ifndef _SCANPREVIEW_H
+#define _SCANPREVIEW_H
+
+#include <SupportDefs.h>
+#include "ScannerBe.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Shrinks an image as it's scanned, so an interactive app can show the
+	page building up instead of waiting for all of it. Every box of
+	factor by factor pixels is averaged into one, with factor picked to
+	make the preview no wider than max_width, and the reduced rows are
+	handed to a sink every update_rows rows (0 for 16), and at the end.
+
+	The preview is always 8-bit gray or 24-bit RGB with no padding,
+	whatever the scan: binary images become gray, and 16-bit samples are
+	cut to 8 bits. Other image types aren't supported. The sink is called
+	on the thread that writes the rows; if it returns an error, so does
+	that write. */
+
+typedef struct {
+	scan_type		image_type;		/* SCAN_TYPE_GRAY or SCAN_TYPE_RGB */
+	int32			width;			/* in preview pixels */
+	int32			height;
+	int32			row_bytes;		/* width times 1 or 3 */
+	int32			factor;			/* scanned pixels per preview pixel, each way */
+	scan_settings	settings;		/* of the image being scanned */
+} scan_preview_info;
+
+typedef struct {
+	status_t	(*begin)( void *data, const scan_preview_info *info );
+	status_t	(*rows)( void *data, int32 first_row, const void *rows,
+						int32 row_count );
+	void		*data;
+} scan_preview_sink;
+
+typedef struct scan_preview scan_preview;
+
+/* The preview of one image, fed like a scan_writer: open it with the
+	settings from after scan_open_image(), write it every buffer of rows
+	scan_data() returns, and close it. The sink's begin() is called before
+	open returns. Closing hands over the last rows, including a part box
+	at the bottom. max_width of 0 means no reduction. */
+status_t	scan_preview_open( const scan_settings *settings, int32 max_width,
+							int32 update_rows, const scan_preview_sink *sink,
+							scan_preview **preview );
+status_t	scan_preview_write( scan_preview *preview, const void *rows,
+							int32 count );
+status_t	scan_preview_close( scan_preview *preview );
+
+/* A quick pass just for the preview: scans an image at resolution dpi,
+	or the scanner's lowest if that's higher, into a scan_preview, then
+	puts the resolution back as it was. 0 leaves the resolution alone.
+	Call between scan_start() and scan_close(), outside of an image. */
+status_t	scan_preview_pass( const scan_id id, uint32 resolution,
+							int32 max_width, int32 update_rows,
+							const scan_preview_sink *sink );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SCANPREVIEW_H */
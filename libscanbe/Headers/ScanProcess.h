@@ -0,0 +1,49 @@
+/*
+	ScannerBe -- row processing, internal to libscanbe.
+	Copyright (c) 1997, Jim Moy, All Rights Reserved
+*/
+
+#ifndef _SCANPROCESS_H
+#define _SCANPROCESS_H
+
+#include <SupportDefs.h>
+#include "ScannerBe.h"
+
+/*	One per session that has asked for processing, or had a tone map put
+	that the add-on can't do. What's asked for is kept as it is; the
+	tables are only built in processor_begin_image(), once the image type
+	is known, and are read-only while the image is open. */
+struct scan_processor;
+
+scan_processor*	processor_create();
+void			processor_delete( scan_processor *p );
+
+/* NULL process turns off everything but emulated tone maps. */
+status_t		processor_set( scan_processor *p, const scan_process *process );
+
+/* which is SCAN_SETTING_TONEMAP or TONEMAP3; map is copied. NULL clears it. */
+status_t		processor_set_tonemap( scan_processor *p, scan_setting_id which,
+							const int32 *map );
+const int32*	processor_tonemap( scan_processor *p, scan_setting_id which );
+
+/* Whether images of the type can be processed; others are passed through. */
+bool			processor_handles( scan_type type, uint32 pixelBits );
+
+/* Returns whether the image needs processing at all. */
+bool			processor_begin_image( scan_processor *p,
+							const scan_settings *settings );
+
+/*	count bytes of whole rows, in place in a buffer of room bytes; returns
+	how many of them are done. Bands must come in image order. Despeckling
+	needs the row below each row, so it holds the last row of a band back
+	until the next band comes, and puts it first in that one. With last
+	set it goes at the end, if there's room; otherwise it's left for
+	processor_flush(), and processor_holding_end() says so. */
+int32			processor_run( scan_processor *p, void *rows, int32 count,
+							int32 room, bool last );
+bool			processor_holding_end( scan_processor *p );
+
+/* Puts the row that's held back into rows, returns its size or 0. */
+int32			processor_flush( scan_processor *p, void *rows );
+
+#endif /* _SCANPROCESS_H */
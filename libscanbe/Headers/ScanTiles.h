@@ -0,0 +1,78 @@
+/*
+	ScannerBe -- tiled image store for scans bigger than memory.
+	Copyright (c) 1997, Jim Moy, All Rights Reserved
+*/
+
+#ifndef _SCANTILES_H
+#define _SCANTILES_H
+
+#include <SupportDefs.h>
+#include "ScannerBe.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Keeps a scanned image in a file, cut into square tiles, instead of in
+	memory. A bed scan at 1200 dpi and 48 bits is well over a gigabyte,
+	but only one band of tiles is ever mapped in while rows are written,
+	and one tile per lock while they're read, so the memory used is the
+	same at any resolution.
+
+	Fill the store like a scan_writer: create it with the settings of the
+	image (after scan_open_image()), and write it every buffer scan_data()
+	returns. Tiles can be locked as soon as their band is complete, from
+	any thread, while the rest is still being written.
+
+	Tiles hold the pixels as scan_data() delivers them, packed bits for
+	binary and big-endian samples for 16 bits, but with rows of
+	tile_row_bytes. The parts of the tiles at the right and bottom edges
+	that lie outside the image are 0. */
+
+typedef struct scan_tile_store scan_tile_store;
+
+typedef struct {
+	scan_type	image_type;
+	uint32		pixel_bits;
+	int32		width;			/* of the image, in pixels */
+	int32		height;
+	int32		tile_size;		/* pixels on a side */
+	int32		tiles_across;
+	int32		tiles_down;
+	int32		tile_row_bytes;
+	int32		rows_done;		/* written so far */
+} scan_tile_info;
+
+/* tile_size is rounded up to a multiple of 8, and 0 means 256. A NULL
+	path keeps the tiles in a temporary file that goes away with the
+	store; otherwise the file is left behind when it's deleted. */
+status_t	scan_tiles_create( const char *path, const scan_settings *settings,
+							int32 tile_size, scan_tile_store **store );
+
+/* count is in bytes, and must be whole rows of settings->row_bytes each,
+	as scan_data() returns them. */
+status_t	scan_tiles_write( scan_tile_store *store, const void *rows,
+							int32 count );
+
+status_t	scan_tiles_get_info( scan_tile_store *store, scan_tile_info *info );
+
+/* Maps in tile x, y (counting tiles, from the top left) and points data
+	at it. Every lock needs an unlock with the same pointer. Returns
+	SCAN_BAD_PHASE if the tile's rows haven't all been written yet. */
+status_t	scan_tiles_lock( scan_tile_store *store, int32 x, int32 y,
+							const void **data );
+status_t	scan_tiles_unlock( scan_tile_store *store, const void *data );
+
+/* Copies count rows, starting at first_row, back out as scan_data() gave
+	them, into buffer, which must hold count times the image's row_bytes. */
+status_t	scan_tiles_read_rows( scan_tile_store *store, int32 first_row,
+							int32 count, void *buffer );
+
+/* All tiles must be unlocked. */
+status_t	scan_tiles_delete( scan_tile_store *store );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SCANTILES_H */
@@ -0,0 +1,117 @@
+/*
+	ScannerBe -- event trace, internal to libscanbe.
+	Copyright (c) 1997, Jim Moy, All Rights Reserved
+*/
+
+#ifndef _SCANTRACE_H
+#define _SCANTRACE_H
+
+#include <SupportDefs.h>
+#include <OS.h>
+#include "ScannerBe.h"
+
+/*	libscanbe records every public call, every call into an add-on and
+	every change of a session's state in a ring of fixed-size events in
+	memory. Recording is a few stores and an atomic_add, so it's always on;
+	the ring keeps the last kTraceEvents events. scan_trace_save() (see
+	ScannerBe.h) writes them to a file, and Tools/trace2json turns that
+	into Chrome trace JSON for chrome://tracing or Perfetto.
+
+	The file is a trace_file_header followed by its count of trace_events,
+	oldest first, in the byte order of the machine that wrote it. */
+
+const int32 kTraceEvents = 8192;		// a power of two
+const uint32 kTraceMagic = 'SCtr';
+const int32 kTraceVersion = 1;
+
+/* trace_event.kind */
+enum {
+	kTraceApi = 1,			// public call; what is a trace_api
+	kTraceHook,				// add-on hook; what is a scan_hook_id, arg its result
+	kTraceState				// session state change; what is the new state
+};
+
+/* Public calls, for kTraceApi. */
+enum trace_api {
+	kTraceGetAddons,
+	kTraceOpen,
+	kTraceClose,
+	kTraceGetCapabilities,
+	kTraceGetSettings,
+	kTracePutSettings,
+	kTraceGetOneSetting,
+	kTracePutOneSetting,
+	kTraceOpenImage,
+	kTraceCloseImage,
+	kTraceStart,
+	kTraceData,
+	kTraceDataEx,
+	kTraceReleaseData,
+	kTraceSetReadahead,
+	kTraceAdfReady,
+	kTraceSetProcess,
+	kTraceCancel,
+	kTraceGetTransferInfo,
+	kTraceDataInto,
+	kTraceWatchAddons,
+	kTraceUnwatchAddons,
+	kTraceApiCount
+};
+
+struct trace_event {
+	bigtime_t	start;
+	int32		duration;		// microseconds, 0 for state changes; at most
+								// 0x7fffffff, about 35 minutes
+	thread_id	thread;
+	int32		session;		// the scan_id, 0 if there's none (yet)
+	int16		kind;
+	int16		what;
+	int32		arg;
+	uint32		sequence;		// position in the trace, plus one
+};
+
+struct trace_file_header {
+	uint32		magic;
+	int32		version;
+	int32		event_size;		// sizeof( trace_event )
+	int32		count;
+};
+
+/* Names, for printing. */
+static const char * const kTraceApiNames[kTraceApiCount] = {
+	"scan_get_addons", "scan_open", "scan_close", "scan_get_capabilities",
+	"scan_get_settings", "scan_put_settings", "scan_get_one_setting",
+	"scan_put_one_setting", "scan_open_image", "scan_close_image",
+	"scan_start", "scan_data", "scan_data_ex", "scan_release_data",
+	"scan_set_readahead", "scan_adf_ready", "scan_set_process",
+	"scan_cancel", "scan_get_transfer_info", "scan_data_into",
+	"scan_watch_addons", "scan_unwatch_addons"
+};
+static const char * const kTraceHookNames[SCAN_HOOK_COUNT] = {
+	"open", "close", "get_capabilities", "get_setting", "put_setting",
+	"open_image", "close_image", "start", "data", "adf_ready",
+	"error_message", "acquire_data", "release_data", "get_settings",
+	"put_settings", "cancel", "get_transfer_info"
+};
+static const char * const kTraceStateNames[] = {
+	"closed", "open", "image open", "data"
+};
+
+void	trace_event_add( int16 kind, int16 what, void *session,
+						bigtime_t start, bigtime_t end, int32 arg );
+
+/* Brackets a public call. Records the event when it goes out of scope. */
+class api_trace {
+public:
+				api_trace( trace_api api, void *id )
+					{ what = api; session = id; start = system_time(); }
+				~api_trace()
+					{ trace_event_add( kTraceApi, what, session, start,
+										system_time(), 0 ); }
+	void*		session;		// set it once scan_open() has an id
+private:
+	int16		what;
+	bigtime_t	start;
+};
+
+#endif /* _SCANTRACE_H */
@@ -0,0 +1,69 @@
+/*
+	ScannerBe -- streaming image file writer.
+	Copyright (c) 1997, Jim Moy, All Rights Reserved
+*/
+
+#ifndef _SCANWRITER_H
+#define _SCANWRITER_H
+
+#include <SupportDefs.h>
+#include "ScannerBe.h"
+#include "ScanEncoder.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Writes an image file straight from scan_data() rows, in one pass with
+	no temporary file. Open a writer with the settings of the image
+	(scan_get_settings() after scan_open_image(), so the size is final),
+	hand it every buffer scan_data() returns, then close it.
+
+	RGB and gray images with one or two bytes per sample, and binary
+	images, are supported. 16-bit samples stay 16 bits in every format but
+	TGA, which has no deep format and gets them dithered down to 8. TGA
+	has no one-bit format either, so binary images go into it as gray.
+	If the scan comes up short of pixel_height rows, the rest of the
+	image is filled with white so the file is still valid.
+
+	PNG and deflated TIFF are compressed a strip at a time, each strip on
+	its own, so the strips can be compressed in parallel by a
+	scan_encoder_pool. Without one, they're compressed on the thread
+	that writes the rows. */
+
+typedef struct scan_writer scan_writer;
+
+typedef uint32 scan_file_format;
+const scan_file_format	SCAN_FORMAT_TGA		= 1;	/* uncompressed, top-down, 8-bit */
+const scan_file_format	SCAN_FORMAT_PNM		= 2;	/* PPM, PGM or PBM by image type */
+const scan_file_format	SCAN_FORMAT_TIFF	= 3;	/* baseline, uncompressed strips */
+const scan_file_format	SCAN_FORMAT_PNG		= 4;	/* 8 or 16-bit RGB or gray, or 1-bit gray */
+const scan_file_format	SCAN_FORMAT_TIFF_DEFLATE = 5;	/* deflated strips, with a predictor */
+
+status_t	scan_writer_open( const char *path, scan_file_format format,
+							const scan_settings *settings, scan_writer **writer );
+
+/* The same, with the compression done by pool's threads. The uncompressed
+	formats ignore pool. */
+status_t	scan_writer_open_pooled( const char *path, scan_file_format format,
+							const scan_settings *settings, scan_encoder_pool *pool,
+							scan_writer **writer );
+
+/* count is in bytes, and must be whole rows of settings->row_bytes each,
+	as scan_data() returns them. */
+status_t	scan_writer_write( scan_writer *writer, const void *rows, int32 count );
+
+/* Finishes the file. Returns the first error seen while writing. A pooled
+	writer returns as soon as the end of the file is queued; errors after
+	that come from scan_encoder_pool_wait(). Either way the writer is gone. */
+status_t	scan_writer_close( scan_writer *writer );
+
+/* Gives up on the file and removes it. A pooled writer first waits for
+	the pool to be done with its strips. */
+void		scan_writer_abort( scan_writer *writer );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SCANWRITER_H */
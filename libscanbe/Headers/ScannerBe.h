@@ -68,7 +68,7 @@ typedef struct {
 typedef struct {
 	scan_rect	scan_area;		/* area on scanner bed to scan */
 	scan_type	image_type;		/* mask or value, see docs */
-	uint32		pixel_bits;		/* bits per pixel */
+	uint32		pixel_bits;		/* bits per pixel, see below */
 	uint32		resolution;		/* dpi */
 	int32		brightness;		/* arbitrary, scanner-specific values */
 	int32		contrast;		/* arbitrary, scanner-specific values */
@@ -80,6 +80,15 @@ typedef struct {
 	uint32		row_bytes;		/* accounts for padding */
 } scan_settings;
 
+/* What scan_data() delivers for each image_type and pixel_bits:
+		SCAN_TYPE_BINARY, 1		packed bits, first pixel in the top bit, 1 is black
+		SCAN_TYPE_GRAY, 8		one byte per pixel, 0 is black
+		SCAN_TYPE_GRAY, 16		one 16-bit sample per pixel
+		SCAN_TYPE_RGB, 24		interleaved red, green, blue, a byte each
+		SCAN_TYPE_RGB, 48		the same with 16-bit samples
+	16-bit samples are big-endian whatever the CPU, and use the whole
+	range, so 0xffff is white however many bits the scanner really has.
+	Every row starts row_bytes after the last. */
 /* Have to look up the field in scan_settings corresponding to the
 	scan_setting_id below to find out which is the right field in
 	the union to use. The ptr field is only for SCAN_SETTING_SPECIFIC
@@ -130,9 +139,102 @@ typedef struct {
 } CallbackInfo;
 typedef status_t (*ScanAddonProc)( const CallbackInfo *info, void *data );
 
+/* Callback for scan_watch_addons(). */
+typedef uint32 scan_addon_change;
+const scan_addon_change		SCAN_ADDON_ADDED			= 1;
+const scan_addon_change		SCAN_ADDON_REMOVED			= 2;
+const scan_addon_change		SCAN_ADDON_CHANGED			= 3;
+typedef void (*ScanWatchProc)( scan_addon_change change, const CallbackInfo *info,
+								void *data );
+
+/* Per-session statistics, see scan_get_stats(). Times are in
+	microseconds. The histogram counts calls by how long they took:
+	bucket 0 is under 1us, bucket i from 2^(i-1) up to 2^i us, and the
+	last bucket everything longer. */
+const int32 SCAN_STATS_BUCKETS = 24;
+typedef struct {
+	uint32		calls;
+	uint32		errors;			/* results other than B_OK and SCAN_DATA_END */
+	bigtime_t	total_time;
+	bigtime_t	max_time;
+	uint32		histogram[SCAN_STATS_BUCKETS];
+} scan_call_stats;
+
+/* Index into scan_stats.hooks, one per add-on hook. */
+typedef uint32 scan_hook_id;
+const scan_hook_id	SCAN_HOOK_OPEN				= 0;
+const scan_hook_id	SCAN_HOOK_CLOSE				= 1;
+const scan_hook_id	SCAN_HOOK_GET_CAPABILITIES	= 2;
+const scan_hook_id	SCAN_HOOK_GET_SETTING		= 3;
+const scan_hook_id	SCAN_HOOK_PUT_SETTING		= 4;
+const scan_hook_id	SCAN_HOOK_OPEN_IMAGE		= 5;
+const scan_hook_id	SCAN_HOOK_CLOSE_IMAGE		= 6;
+const scan_hook_id	SCAN_HOOK_START				= 7;
+const scan_hook_id	SCAN_HOOK_DATA				= 8;
+const scan_hook_id	SCAN_HOOK_ADF_READY			= 9;
+const scan_hook_id	SCAN_HOOK_ERROR_MESSAGE		= 10;
+const scan_hook_id	SCAN_HOOK_ACQUIRE_DATA		= 11;
+const scan_hook_id	SCAN_HOOK_RELEASE_DATA		= 12;
+const scan_hook_id	SCAN_HOOK_GET_SETTINGS		= 13;
+const scan_hook_id	SCAN_HOOK_PUT_SETTINGS		= 14;
+const scan_hook_id	SCAN_HOOK_CANCEL			= 15;
+const scan_hook_id	SCAN_HOOK_GET_TRANSFER_INFO	= 16;
+const int32			SCAN_HOOK_COUNT				= 17;
+
+typedef struct {
+	int32			size;			/* set to sizeof( scan_stats ) before calling */
+	bigtime_t		since;			/* system_time() when counting started */
+	int64			bytes;			/* image data handed to the app */
+	uint32			images;			/* opened with scan_open_image() */
+	uint32			settings_cached;	/* setting reads answered from the cache */
+	bigtime_t		readahead_wait;	/* app waiting on read-ahead for a band */
+	scan_call_stats	data_calls;		/* scan_data() and scan_data_ex() */
+	scan_call_stats	app_time;		/* from a data call returning to the next */
+	scan_call_stats	hooks[SCAN_HOOK_COUNT];	/* calls into the add-on */
+} scan_stats;
+
+/* Processing libscanbe does to the rows itself, see scan_set_process(). */
+typedef struct {
+	int32		size;			/* set to sizeof( scan_process ) */
+	int32		black;			/* input level that becomes 0, normally 0 */
+	int32		white;			/* input level that becomes 255, normally 255 */
+	float		gamma;			/* above 1 lightens the midtones, 0 or 1 for none */
+	int32		threshold;		/* gray only: below is black, the rest white; 0 for none */
+	bool		despeckle;		/* with threshold, clear pixels unlike all 8 neighbors */
+	int32		threads;		/* to split big bands over, 0 for one per CPU */
+} scan_process;
+
+/* How big the add-on likes its data calls, see scan_get_transfer_info(). */
+typedef struct {
+	int32		size;			/* set to sizeof( scan_transfer_info ) */
+	int32		preferred;		/* bytes per data call, 0 if it doesn't care */
+	int32		maximum;		/* most bytes per data call, 0 for no limit */
+	int32		alignment;		/* of buffers, a power of two, 1 for any */
+} scan_transfer_info;
+
+/* Pixel formats scan_data_into() can write. */
+typedef uint32 scan_pixel_format;
+const scan_pixel_format	SCAN_PIXEL_SCANNED	= 0;	/* as scan_data() has them, minus any padding */
+const scan_pixel_format	SCAN_PIXEL_BGRA32	= 1;	/* B_RGB_32_BIT; from any image */
+const scan_pixel_format	SCAN_PIXEL_RGB24	= 2;	/* red first; from RGB */
+const scan_pixel_format	SCAN_PIXEL_GRAY8	= 3;	/* from gray or binary */
+
+/* Where scan_data_into() puts the rows. */
+typedef struct {
+	int32				size;			/* set to sizeof( scan_destination ) */
+	void				*bits;			/* where first_row goes */
+	int32				bytes_per_row;	/* from one row to the next; negative for bottom-up */
+	scan_pixel_format	format;
+	int32				first_row;		/* image row that goes at bits */
+	int32				rows;			/* how many, 0 for the rest of the image */
+	uint8				alpha;			/* for SCAN_PIXEL_BGRA32 */
+} scan_destination;
+
 /* libscanbe interface */
 void		scan_get_version( scan_version *version );
 status_t	scan_get_addons( ScanAddonProc callback, void *data );
+status_t	scan_watch_addons( ScanWatchProc callback, void *data );
+status_t	scan_unwatch_addons( ScanWatchProc callback, void *data );
 status_t	scan_open( const char* name, scan_id *id, scan_version *version );
 status_t	scan_close( const scan_id id );
 status_t	scan_get_capabilities( const scan_id id, scan_settings_mask *mask );
@@ -151,8 +253,116 @@ status_t	scan_start( const scan_id id );
 status_t	scan_open_image( const scan_id id );
 status_t	scan_close_image( const scan_id id );
 status_t	scan_data( const scan_id id, void *buffer, int32 *count );
+status_t	scan_data_ex( const scan_id id, const void **buffer, int32 *count );
+status_t	scan_release_data( const scan_id id, const void *buffer );
+status_t	scan_data_into( const scan_id id, const scan_destination *dest,
+								int32 *rows );
+status_t	scan_set_readahead( const scan_id id, int32 depth, int32 band_size );
 bool		scan_adf_ready( const scan_id id );
 void		scan_error_message( const scan_id id, status_t error_id, char *msg );
+status_t	scan_get_stats( const scan_id id, scan_stats *stats );
+status_t	scan_reset_stats( const scan_id id );
+status_t	scan_trace_save( const char *path );
+status_t	scan_set_process( const scan_id id, const scan_process *process );
+status_t	scan_cancel( const scan_id id );
+status_t	scan_get_transfer_info( const scan_id id, scan_transfer_info *info );
+
+/* scan_get_addons() answers from a catalog libscanbe keeps in memory.
+	The first call reads every add-on's type and resources, a few files at
+	a time on threads of their own, up to one per CPU; after that each
+	call only looks at the modification times of the directory and the
+	files in it, and reads again just the ones that are new or have
+	changed. scan_watch_addons() has callback called for each add-on that
+	appears, goes away or is replaced from then on. A thread of
+	libscanbe's looks for changes about once a second while anyone's
+	watching, so the callback comes from that thread, or from the one
+	whose scan_get_addons() noticed first; info is only good for the
+	length of the call. scan_unwatch_addons() takes the same callback and
+	data off again; a call already under way on another thread may still
+	finish after it returns. */
+
+/* scan_data_ex() is scan_data() without the copy: instead of filling your
+	buffer, it points buffer at a read-only band of whole rows and returns
+	its size in count. Pass the most you want in count, or 0 to take what
+	the add-on finds convenient. Hand each band back with scan_release_data()
+	before asking for the next one. Add-ons that can't lend their buffers
+	are copied into one libscanbe owns, so this works with all of them. */
+
+/* scan_data_into() reads rows of the open image straight into memory of
+	yours, a BBitmap's bits for example, converting them to dest's format
+	on the way: 16-bit samples are dithered to 8 and binary rows spread out
+	to gray. Each row goes at its own bytes_per_row, so neither the
+	scanner's padding nor the destination's matters. It reads until the
+	image has reached first_row + rows; rows before first_row that haven't
+	been read yet are skipped. rows returns how many were written. The
+	result is B_OK, or SCAN_DATA_END once the image has ended, as with
+	scan_data(), and the calls can be mixed. The bands are borrowed
+	from the add-on and kept small enough to stay in the cache while they
+	are converted, so there's no buffer in between. */
+
+/* scan_set_readahead() turns on pipelined reading for the images that
+	follow. While an image is open, a thread of libscanbe's keeps reading
+	bands of band_size bytes (0 for a default) from the add-on into a ring
+	of depth buffers, so the scanner keeps going while you process what
+	you already have; scan_data() and scan_data_ex() drain the ring. When
+	all depth bands are waiting to be read, the scanner is paused. Call it
+	between scan_open() and scan_open_image(); a depth of 0 turns it off. */
+
+/* scan_set_process() has libscanbe process the rows of the images that
+	follow as they come out of the add-on, for scanners that can't do it
+	themselves: levels, gamma and thresholding are folded into one lookup
+	table per channel, followed by despeckling. It works on gray and RGB
+	with 8 or 16-bit samples, despeckling only on 8-bit gray; other images
+	are passed through. SCAN_SETTING_TONEMAP and TONEMAP3 are done the
+	same way when the add-on doesn't support them, and come before the
+	rest; putting one then fails with SCAN_BAD_PARAM if the scanner is set
+	to an image type that isn't processed. With read-ahead on, the
+	processing is done by the read-ahead thread, overlapping your own work
+	on the band before; big bands are also split over threads. Call it
+	between scan_open() and scan_open_image(); NULL turns it off. */
+
+/* scan_cancel() stops the scan_start() or the image in progress from
+	any thread, without waiting for the call running on the session. A
+	cancelled scan_start() returns SCAN_USER_CANCEL, and so do the data
+	calls from then until scan_close_image(), so the thread doing the scan
+	sees it the next time it asks for rows. If the add-on has a cancel
+	hook, a start or data call already waiting on it is woken up; otherwise
+	that call finishes first. A cancel with neither going on is forgotten
+	by the next scan_start() or scan_open_image(). ScanAsync.h does the
+	scan in the background, where it can always be cancelled. With no
+	cancel hook, scan_close() still breaks a waiting scan_start() out the
+	old way: it closes the add-on under it, then waits for it to return. */
+
+/* scan_get_transfer_info() says how much to ask for in each data call.
+	A scanner's transfer unit, or the driver's per-call overhead, makes
+	some sizes go faster than others; add-ons that know say so with the
+	optional get_transfer_info hook, and the rest get a default preferred
+	size of 64K. Once an image is open the sizes are whole rows of it, at
+	least one. libscanbe itself uses them for the bands it reads ahead and
+	lends, and won't ask the add-on for more than the maximum at a time,
+	whatever the app passes. ScanChunk.h tunes the size as it goes. */
+
+/* Any number of sessions may be open at once, on the same or different
+	scanners, and each may be driven from its own thread. Calls on one
+	scan_id are serialized, so sharing a session between threads is safe
+	but gains nothing. scan_cancel() is the exception, it doesn't wait. */
+
+/* scan_get_stats() copies out what a session has counted since it was
+	opened or last passed to scan_reset_stats(). It doesn't wait for other
+	calls on the session, so it can be polled from another thread during a
+	scan. To see where time goes on a slow page: hooks[SCAN_HOOK_DATA] (or
+	ACQUIRE_DATA) is the scanner and its add-on, data_calls beyond that is
+	libscanbe, and app_time is the app itself. hooks[SCAN_HOOK_START] is
+	the time spent in the add-on's interface, and the setting hooks are
+	round trips to the scanner. Set SCAN_STATS before the library is loaded
+	to have each session's statistics printed when it closes; set it to a
+	number of seconds to also have them printed that often while scanning. */
+
+/* libscanbe keeps a trace of the last few thousand calls, into it and into
+	the add-ons, with timestamps and threads. scan_trace_save() writes it to
+	a file, which Tools/trace2json converts for chrome://tracing. If
+	SCAN_TRACE is set to a path when the library is unloaded, the trace is
+	saved there. */
 
 #ifdef __cplusplus
 }
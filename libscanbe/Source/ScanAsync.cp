@@ -0,0 +1,178 @@
+/*
+	ScannerBe -- scanning in the background, with cancellation.
+	Copyright (c) 1997, Jim Moy, All Rights Reserved
+*/
+
+#include "ScanAsync.h"
+
+#include <OS.h>
+#include <Errors.h>
+
+/*	The request's thread makes the blocking calls, and signals done once
+	the sink has seen the end. done stays signalled: whoever waits on it
+	puts the count straight back. */
+struct scan_request {
+	scan_id				id;
+	scan_request_flags	flags;
+	scan_request_sink	sink;
+	thread_id			thread;
+	sem_id				done;
+	status_t			status;			// once done
+	int32				cancelled;
+};
+
+/*	Some local function prototypes. */
+static status_t request_thread( void *data );
+static status_t read_image( scan_request *r );
+static bool cancelled( scan_request *r );
+
+#pragma mark ---- Public Functions ----
+
+status_t scan_submit( const scan_id id, scan_request_flags flags,
+						const scan_request_sink *sink, scan_request **request )
+{
+	if( ! request )
+		return SCAN_BAD_PARAM;
+	*request = NULL;
+	if( ! sink || flags == 0
+			|| ( flags & ~( SCAN_REQUEST_START | SCAN_REQUEST_IMAGE ) ) )
+		return SCAN_BAD_PARAM;
+
+	scan_request *r = new scan_request;
+	r->id = id;
+	r->flags = flags;
+	r->sink = *sink;
+	r->status = B_OK;
+	r->cancelled = 0;
+	r->done = create_sem( 0, "scan request done" );
+	if( r->done < B_OK ) {
+		delete r;
+		return B_NO_MORE_SEMS;
+	}
+	r->thread = spawn_thread( request_thread, "scan request",
+								B_NORMAL_PRIORITY, r );
+	if( r->thread < B_OK ) {
+		delete_sem( r->done );
+		delete r;
+		return B_NO_MORE_THREADS;
+	}
+	resume_thread( r->thread );
+	*request = r;
+	return B_OK;
+}
+
+
+status_t scan_request_cancel( scan_request *request )
+{
+	if( ! request )
+		return SCAN_BAD_PARAM;
+	if( atomic_or( &request->cancelled, 1 ) != 0 )
+		return B_OK;					// already on its way
+	int32 count;
+	if( get_sem_count( request->done, &count ) == B_OK && count > 0 )
+		return B_OK;					// too late
+	return scan_cancel( request->id );
+}
+
+
+status_t scan_request_wait( scan_request *request, bigtime_t timeout,
+						status_t *result )
+{
+	if( ! request )
+		return SCAN_BAD_PARAM;
+	status_t status;
+	while( ( status = acquire_sem_etc( request->done, 1, B_RELATIVE_TIMEOUT,
+										timeout ) ) == B_INTERRUPTED )
+		;
+	if( status != B_OK )
+		return status;
+	release_sem( request->done );
+	if( result )
+		*result = request->status;
+	return B_OK;
+}
+
+
+status_t scan_request_delete( scan_request *request )
+{
+	if( ! request )
+		return SCAN_BAD_PARAM;
+	status_t exitValue;
+	wait_for_thread( request->thread, &exitValue );
+	delete_sem( request->done );
+	delete request;
+	return B_OK;
+}
+
+#pragma mark ---- Other Functions ----
+
+static status_t request_thread( void *data )
+{
+	scan_request *r = (scan_request *) data;
+	status_t status = B_OK;
+
+	if( r->flags & SCAN_REQUEST_START )
+		status = cancelled( r ) ? SCAN_USER_CANCEL : scan_start( r->id );
+	if( status == B_OK && ( r->flags & SCAN_REQUEST_IMAGE ) )
+		status = cancelled( r ) ? SCAN_USER_CANCEL : read_image( r );
+
+	r->status = status;
+	if( r->sink.done )
+		r->sink.done( r->sink.data, status );
+	if( r->sink.port >= 0 ) {
+		scan_request_event event;
+		event.request = r;
+		event.status = status;
+		event.data = r->sink.data;
+		write_port( r->sink.port, SCAN_REQUEST_DONE, &event, sizeof( event ) );
+	}
+	release_sem( r->done );
+	return B_OK;
+}
+
+/* Reads one image through the sink. The bands are borrowed with
+	scan_data_ex(), so the sink sees the add-on's own buffers when it
+	can lend them. */
+static status_t read_image( scan_request *r )
+{
+	status_t status = scan_open_image( r->id );
+	if( status != B_OK )
+		return status;
+
+	scan_settings settings;
+	status = scan_get_settings( r->id, &settings, NULL, NULL );
+	if( status == B_OK && settings.row_bytes == 0 )
+		status = SCAN_ADDON_ERROR;
+	if( status == B_OK && r->sink.begin )
+		status = r->sink.begin( r->sink.data, &settings );
+
+	int32 row = 0;
+	while( status == B_OK ) {
+		if( cancelled( r ) ) {
+			status = SCAN_USER_CANCEL;
+			break;
+		}
+		const void *rows;
+		int32 count = 0;
+		status = scan_data_ex( r->id, &rows, &count );
+		if( ( status == B_OK || status == SCAN_DATA_END ) && rows ) {
+			status_t sinkStat = B_OK;
+			if( count > 0 && r->sink.rows )
+				sinkStat = r->sink.rows( r->sink.data, row, rows, count );
+			row += count / settings.row_bytes;
+			scan_release_data( r->id, rows );
+			if( sinkStat != B_OK )
+				status = sinkStat;
+		}
+	}
+	if( status == SCAN_DATA_END )
+		status = B_OK;
+
+	status_t closeStat = scan_close_image( r->id );
+	return status != B_OK ? status : closeStat;
+}
+
+static bool cancelled( scan_request *r )
+{
+	return atomic_get( &r->cancelled ) != 0;
+}
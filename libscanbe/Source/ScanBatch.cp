@@ -0,0 +1,359 @@
+/*
+	ScannerBe -- multi-page scanning from a document feeder.
+	Copyright (c) 1997, Jim Moy, All Rights Reserved
+*/
+
+#include "ScanBatch.h"
+
+#include <OS.h>
+#include <Errors.h>
+#include <StorageDefs.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+const int32 kDefaultDepth = 32;
+const int32 kDefaultBandSize = 64 * 1024L;
+const int32 kMaxDepth = 1024;
+
+/*	What the scanning thread hands the sink thread. Bands go round a
+	ring like the read-ahead one in libscanbe.cp: the empty and full
+	semaphores count slots free for the scanner and waiting for the sink. */
+enum {
+	kBandBegin,						// a page, with its settings
+	kBandRows,
+	kBandEnd,						// end of the page, with its status
+	kBandQuit						// no more pages
+};
+
+struct batch_band {
+	int32			kind;
+	int32			page;
+	char*			data;
+	int32			size;			// of data
+	int32			count;			// bytes of rows in it
+	status_t		status;
+	scan_settings	settings;
+};
+
+struct batch_queue {
+	batch_band*				bands;
+	int32					depth;
+	int32					head;			// next band for the sink
+	int32					tail;			// next band for the scanner
+	sem_id					empty;
+	sem_id					full;
+	const scan_batch_sink*	sink;
+	volatile status_t		sink_status;	// first error from the sink
+	int32					pages;			// pages the sink finished
+};
+
+/* For scan_batch_to_files(). */
+struct file_sink {
+	const char*			pattern;
+	scan_file_format	format;
+	scan_encoder_pool*	pool;
+	scan_writer*		writer;
+};
+
+/*	Some local function prototypes. */
+static batch_band* claim_band( batch_queue *queue );
+static void post_band( batch_queue *queue );
+static status_t post_marker( batch_queue *queue, int32 kind, int32 page,
+								status_t status, const scan_settings *settings );
+static status_t scan_page( const scan_id id, batch_queue *queue, int32 page );
+static status_t sink_thread( void *data );
+static status_t file_begin_page( void *data, int32 page,
+								const scan_settings *settings );
+static status_t file_rows( void *data, const void *rows, int32 count );
+static status_t file_end_page( void *data, int32 page, status_t status );
+
+#pragma mark ---- Public Functions ----
+
+status_t scan_batch( const scan_id id, scan_settings *profile,
+						const scan_batch_sink *sink, int32 depth,
+						int32 band_size, int32 *pages )
+{
+	if( pages )
+		*pages = 0;
+	if( ! sink || ! sink->begin_page || ! sink->rows || ! sink->end_page
+			|| depth < 0 || depth > kMaxDepth || band_size < 0 )
+		return SCAN_BAD_PARAM;
+
+	status_t status = B_OK;
+	if( profile ) {
+		scan_settings_mask mask;
+		status = scan_put_settings( id, profile, &mask );
+		if( status != B_OK )
+			return status;
+	}
+
+	batch_queue queue;
+	queue.depth = depth > 0 ? depth : kDefaultDepth;
+	queue.bands = new batch_band[ queue.depth ];
+	for( int32 i = 0; i < queue.depth; i++ ) {
+		queue.bands[i].size = band_size > 0 ? band_size : kDefaultBandSize;
+		queue.bands[i].data = (char *) malloc( queue.bands[i].size );
+		if( ! queue.bands[i].data )
+			status = B_NO_MEMORY;
+	}
+	queue.head = queue.tail = 0;
+	queue.empty = create_sem( queue.depth, "scan batch empty" );
+	queue.full = create_sem( 0, "scan batch full" );
+	queue.sink = sink;
+	queue.sink_status = B_OK;
+	queue.pages = 0;
+	if( status == B_OK && ( queue.empty < B_OK || queue.full < B_OK ) )
+		status = B_NO_MORE_SEMS;
+
+	thread_id thread = -1;
+	if( status == B_OK ) {
+		thread = spawn_thread( sink_thread, "scan batch sink",
+								B_NORMAL_PRIORITY, &queue );
+		if( thread >= B_OK )
+			resume_thread( thread );
+		else
+			status = B_NO_MORE_THREADS;
+	}
+
+	// The sink may still be busy with the last page while the feeder
+	// loads the next one and it's scanned.
+	for( int32 page = 0; status == B_OK && queue.sink_status == B_OK
+							&& scan_adf_ready( id ); page++ )
+		status = scan_page( id, &queue, page );
+
+	if( thread >= B_OK ) {
+		post_marker( &queue, kBandQuit, 0, B_OK, NULL );
+		status_t exitValue;
+		wait_for_thread( thread, &exitValue );
+	}
+
+	if( queue.empty >= B_OK )
+		delete_sem( queue.empty );
+	if( queue.full >= B_OK )
+		delete_sem( queue.full );
+	for( int32 i = 0; i < queue.depth; i++ )
+		free( queue.bands[i].data );
+	delete[] queue.bands;
+
+	if( pages )
+		*pages = queue.pages;
+	return status != B_OK ? status : queue.sink_status;
+}
+
+
+status_t scan_batch_to_files( const scan_id id, scan_settings *profile,
+						const char *name_pattern, scan_file_format format,
+						int32 *pages )
+{
+	return scan_batch_to_files_etc( id, profile, name_pattern, format, NULL,
+									pages );
+}
+
+
+status_t scan_batch_to_files_etc( const scan_id id, scan_settings *profile,
+						const char *name_pattern, scan_file_format format,
+						scan_encoder_pool *pool, int32 *pages )
+{
+	if( pages )
+		*pages = 0;
+	if( ! name_pattern )
+		return SCAN_BAD_PARAM;
+
+	scan_encoder_pool *ownPool = NULL;
+	if( ! pool && ( format == SCAN_FORMAT_PNG
+					|| format == SCAN_FORMAT_TIFF_DEFLATE ) ) {
+		status_t status = scan_encoder_pool_create( 0, 0, &ownPool );
+		if( status != B_OK )
+			return status;
+		pool = ownPool;
+	}
+
+	file_sink files;
+	files.pattern = name_pattern;
+	files.format = format;
+	files.pool = pool;
+	files.writer = NULL;
+
+	scan_batch_sink sink;
+	sink.begin_page = file_begin_page;
+	sink.rows = file_rows;
+	sink.end_page = file_end_page;
+	sink.data = &files;
+	status_t status = scan_batch( id, profile, &sink, 0, 0, pages );
+
+		// the last pages may still be in the pool
+	status_t poolStat = B_OK;
+	if( ownPool )
+		poolStat = scan_encoder_pool_delete( ownPool );
+	else if( pool )
+		poolStat = scan_encoder_pool_wait( pool );
+	return status != B_OK ? status : poolStat;
+}
+
+#pragma mark ---- Other Functions ----
+
+/* Waits for a free band. Returns NULL if the queue has gone away. */
+static batch_band* claim_band( batch_queue *queue )
+{
+	status_t status;
+	while( ( status = acquire_sem( queue->empty ) ) == B_INTERRUPTED )
+		;
+	if( status != B_OK )
+		return NULL;
+	return &queue->bands[queue->tail];
+}
+
+/* Passes the claimed band on to the sink. */
+static void post_band( batch_queue *queue )
+{
+	queue->tail = ( queue->tail + 1 ) % queue->depth;
+	release_sem( queue->full );
+}
+
+static status_t post_marker( batch_queue *queue, int32 kind, int32 page,
+								status_t status, const scan_settings *settings )
+{
+	batch_band *band = claim_band( queue );
+	if( ! band )
+		return B_ERROR;
+	band->kind = kind;
+	band->page = page;
+	band->count = 0;
+	band->status = status;
+	if( settings )
+		band->settings = *settings;
+	post_band( queue );
+	return B_OK;
+}
+
+/* Scans one page into the queue. Returns what ended it, if that wasn't
+	the end of the page. */
+static status_t scan_page( const scan_id id, batch_queue *queue, int32 page )
+{
+	status_t status = scan_open_image( id );
+	if( status != B_OK )
+		return status;
+
+	// the size is only final once the image is open
+	scan_settings settings;
+	status = scan_get_settings( id, &settings, NULL, NULL );
+	if( status == B_OK && settings.row_bytes == 0 )
+		status = SCAN_ADDON_ERROR;
+	if( status == B_OK )
+		status = post_marker( queue, kBandBegin, page, B_OK, &settings );
+
+	while( status == B_OK ) {
+		if( queue->sink_status != B_OK )
+			break;					// no use scanning what won't be kept
+		batch_band *band = claim_band( queue );
+		if( ! band ) {
+			status = B_ERROR;
+			break;
+		}
+		if( band->size < (int32) settings.row_bytes ) {
+			char *data = (char *) realloc( band->data, settings.row_bytes );
+			if( ! data ) {
+				status = B_NO_MEMORY;
+				release_sem( queue->empty );
+				break;
+			}
+			band->data = data;
+			band->size = settings.row_bytes;
+		}
+		band->kind = kBandRows;
+		band->page = page;
+		band->count = band->size;
+		status = scan_data( id, band->data, &band->count );
+		if( status != B_OK && status != SCAN_DATA_END )
+			band->count = 0;
+		post_band( queue );
+	}
+	if( status == SCAN_DATA_END )
+		status = B_OK;
+
+	status_t closeStat = scan_close_image( id );
+	if( status == B_OK )
+		status = closeStat;
+	status_t endStat = post_marker( queue, kBandEnd, page, status, NULL );
+	return status != B_OK ? status : endStat;
+}
+
+/* Feeds the bands to the sink, in order, until told to quit. Once the
+	sink returns an error the rest of the page is thrown away. */
+static status_t sink_thread( void *data )
+{
+	batch_queue *queue = (batch_queue *) data;
+	const scan_batch_sink *sink = queue->sink;
+	bool pageOpen = false;
+	status_t sinkStat = B_OK;		// for the page
+
+	for( bool quit = false; ! quit; ) {
+		status_t status;
+		while( ( status = acquire_sem( queue->full ) ) == B_INTERRUPTED )
+			;
+		if( status != B_OK )
+			break;
+		batch_band *band = &queue->bands[queue->head];
+
+		switch( band->kind ) {
+		case kBandBegin:
+			sinkStat = sink->begin_page( sink->data, band->page, &band->settings );
+			pageOpen = sinkStat == B_OK;
+			break;
+		case kBandRows:
+			if( pageOpen && sinkStat == B_OK && band->count > 0 )
+				sinkStat = sink->rows( sink->data, band->data, band->count );
+			break;
+		case kBandEnd:
+			if( pageOpen ) {
+				status_t pageStat = sinkStat != B_OK ? sinkStat : band->status;
+				status = sink->end_page( sink->data, band->page, pageStat );
+				if( sinkStat == B_OK )
+					sinkStat = status;
+				if( pageStat == B_OK && status == B_OK )
+					queue->pages++;
+			}
+			pageOpen = false;
+			break;
+		case kBandQuit:
+			quit = true;
+			break;
+		}
+		if( sinkStat != B_OK && queue->sink_status == B_OK )
+			queue->sink_status = sinkStat;
+
+		queue->head = ( queue->head + 1 ) % queue->depth;
+		release_sem( queue->empty );
+	}
+	return B_OK;
+}
+
+static status_t file_begin_page( void *data, int32 page,
+								const scan_settings *settings )
+{
+	file_sink *files = (file_sink *) data;
+	char path[B_PATH_NAME_LENGTH];
+	snprintf( path, sizeof( path ), files->pattern, (long) page + 1 );
+	return scan_writer_open_pooled( path, files->format, settings, files->pool,
+									&files->writer );
+}
+
+static status_t file_rows( void *data, const void *rows, int32 count )
+{
+	file_sink *files = (file_sink *) data;
+	return scan_writer_write( files->writer, rows, count );
+}
+
+static status_t file_end_page( void *data, int32 page, status_t status )
+{
+	file_sink *files = (file_sink *) data;
+	scan_writer *writer = files->writer;
+	files->writer = NULL;
+	if( status != B_OK ) {
+		scan_writer_abort( writer );
+		return status;
+	}
+	return scan_writer_close( writer );
+}
@@ -0,0 +1,162 @@
+/*
+	ScannerBe -- self-tuning data call sizes.
+	Copyright (c) 1997, Jim Moy, All Rights Reserved
+*/
+
+#include "ScanChunk.h"
+
+#include <OS.h>
+#include <Errors.h>
+
+const int32 kDefaultMaxChunk = 1024 * 1024L;
+const int32 kTuneCalls = 4;				// timed at each size before judging it
+const int32 kTuneGain = 105;			// percent faster a bigger size has to be
+
+/*	Tuning is a climb: time kTuneCalls calls at a size, and if the rate
+	beats the best so far by enough, double the size and go again;
+	otherwise go back to the best and stay there. The last call of an
+	image is usually short, so it isn't counted. */
+struct scan_chunk_reader {
+	scan_id			id;
+	int32			row_bytes;
+	int32			size;			// asked for now
+	int32			maximum;
+	bool			settled;
+	int32			best_size;
+	double			best_rate;		// bytes per microsecond, 0 if none yet
+	int32			calls;			// at this size so far
+	int64			bytes;
+	bigtime_t		time;
+	const void*		lent;			// the last chunk, until the next read
+};
+
+/*	Some local function prototypes. */
+static void tune( scan_chunk_reader *r, int32 count, bigtime_t time );
+static int32 whole_rows( int32 bytes, int32 rowBytes );
+
+#pragma mark ---- Public Functions ----
+
+status_t scan_chunk_open( const scan_id id, int32 max_bytes,
+						scan_chunk_reader **reader )
+{
+	if( ! reader )
+		return SCAN_BAD_PARAM;
+	*reader = NULL;
+	if( max_bytes < 0 )
+		return SCAN_BAD_PARAM;
+
+	scan_value rowBytes;
+	status_t status = scan_get_one_setting( id, SCAN_SETTING_ROWBYTES,
+											SCAN_SETTING_CURRENT, &rowBytes );
+	if( status != B_OK )
+		return status;
+	if( rowBytes.u_int == 0 )
+		return SCAN_ADDON_ERROR;
+	scan_transfer_info transfer;
+	transfer.size = sizeof( transfer );
+	status = scan_get_transfer_info( id, &transfer );
+	if( status != B_OK )
+		return status;
+
+	scan_chunk_reader *r = new scan_chunk_reader;
+	r->id = id;
+	r->row_bytes = rowBytes.u_int;
+	r->maximum = max_bytes > 0 ? max_bytes : kDefaultMaxChunk;
+	if( transfer.maximum > 0 && transfer.maximum < r->maximum )
+		r->maximum = transfer.maximum;
+	r->maximum = whole_rows( r->maximum, r->row_bytes );
+	r->size = whole_rows( transfer.preferred, r->row_bytes );
+	if( r->size > r->maximum )
+		r->size = r->maximum;
+	r->settled = ( r->size == r->maximum );
+	r->best_size = r->size;
+	r->best_rate = 0;
+	r->calls = 0;
+	r->bytes = 0;
+	r->time = 0;
+	r->lent = NULL;
+	*reader = r;
+	return B_OK;
+}
+
+
+status_t scan_chunk_read( scan_chunk_reader *reader, const void **rows,
+						int32 *count )
+{
+	if( ! reader || ! rows || ! count )
+		return SCAN_BAD_PARAM;
+	scan_chunk_reader *r = reader;
+	*rows = NULL;
+	*count = 0;
+	if( r->lent ) {
+		scan_release_data( r->id, r->lent );
+		r->lent = NULL;
+	}
+
+	int32 want = r->size;
+	bigtime_t start = system_time();
+	status_t status = scan_data_ex( r->id, rows, &want );
+	bigtime_t time = system_time() - start;
+	if( status != B_OK && status != SCAN_DATA_END )
+		return status;
+	r->lent = *rows;
+	*count = want;
+	if( status == B_OK && ! r->settled )
+		tune( r, want, time );
+	return status;
+}
+
+
+int32 scan_chunk_size( scan_chunk_reader *reader, bool *settled )
+{
+	if( ! reader )
+		return 0;
+	if( settled )
+		*settled = reader->settled;
+	return reader->size;
+}
+
+
+status_t scan_chunk_close( scan_chunk_reader *reader )
+{
+	if( ! reader )
+		return SCAN_BAD_PARAM;
+	status_t status = B_OK;
+	if( reader->lent )
+		status = scan_release_data( reader->id, reader->lent );
+	delete reader;
+	return status;
+}
+
+#pragma mark ---- Other Functions ----
+
+static void tune( scan_chunk_reader *r, int32 count, bigtime_t time )
+{
+	r->bytes += count;
+	r->time += time;
+	if( ++r->calls < kTuneCalls )
+		return;
+
+	double rate = (double) r->bytes / ( r->time > 0 ? r->time : 1 );
+	if( rate * 100 >= r->best_rate * kTuneGain ) {
+		r->best_rate = rate;
+		r->best_size = r->size;
+		if( r->size < r->maximum ) {
+			r->size = r->size * 2 < r->maximum ? r->size * 2 : r->maximum;
+			r->size = whole_rows( r->size, r->row_bytes );
+		} else
+			r->settled = true;
+	} else {
+		r->size = r->best_size;
+		r->settled = true;
+	}
+	r->calls = 0;
+	r->bytes = 0;
+	r->time = 0;
+}
+
+/* bytes rounded down to whole rows, but at least one. */
+static int32 whole_rows( int32 bytes, int32 rowBytes )
+{
+	return bytes < rowBytes ? rowBytes : bytes - bytes % rowBytes;
+}
@@ -0,0 +1,810 @@
+/*
+	ScannerBe -- pixel format conversion helpers.
+	Copyright (c) 1997, Jim Moy, All Rights Reserved
+*/
+
+#include "ScanConvert.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*	The vector versions need per-function target attributes so the rest of
+	the library still runs on CPUs without them; only newer gcc and clang
+	have those. Everything else gets the C versions, which are always
+	here as the reference anyway. */
+#if ( defined( __i386__ ) || defined( __x86_64__ ) ) \
+	&& ( ( defined( __GNUC__ ) && __GNUC__ >= 5 ) || defined( __clang__ ) )
+#define SCAN_CONVERT_X86 1
+#include <immintrin.h>
+#define TARGET( isa ) __attribute__(( target( isa ) ))
+#endif
+
+#if defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+#define SCAN_CONVERT_NEON 1
+#include <arm_neon.h>
+#endif
+
+typedef void (*rgb_to_bgra_proc)( const uint8 *src, uint8 *dst, int32 pixels,
+								uint8 alpha );
+typedef void (*bgra_to_rgb_proc)( const uint8 *src, uint8 *dst, int32 pixels );
+typedef void (*rgb_to_bgr_proc)( const uint8 *src, uint8 *dst, int32 pixels );
+typedef void (*gray_to_bgra_proc)( const uint8 *src, uint8 *dst, int32 pixels,
+								uint8 alpha );
+typedef void (*wide_to_8_proc)( const uint8 *src, uint8 *dst, int32 samples );
+typedef void (*dither_to_8_proc)( const uint8 *src, uint8 *dst, int32 samples,
+								const uint8 *pattern, int32 period, int32 phase );
+typedef void (*swap16_proc)( const uint8 *src, uint8 *dst, int32 samples );
+typedef void (*lut8_proc)( const uint8 *src, uint8 *dst, int32 bytes,
+								const uint8 *luts, int32 channels );
+
+/* The converters in use, filled in at load time by convert_init. */
+static struct {
+	const char*			name;
+	rgb_to_bgra_proc	rgb24_to_bgra32;
+	bgra_to_rgb_proc	bgra32_to_rgb24;
+	rgb_to_bgr_proc		rgb24_to_bgr24;
+	gray_to_bgra_proc	gray8_to_bgra32;
+	wide_to_8_proc		wide_to_8;
+	dither_to_8_proc	dither_to_8;
+	swap16_proc			swap16;
+	lut8_proc			lut8;
+} gConvert;
+
+/* Eight gray pixels for every possible byte of binary data. */
+static uint8 gBitsLUT[256][8];
+
+/* The ordered dither's thresholds, 0 to 63. */
+static const uint8 kBayer[8][8] = {
+	{  0, 32,  8, 40,  2, 34, 10, 42 },
+	{ 48, 16, 56, 24, 50, 18, 58, 26 },
+	{ 12, 44,  4, 36, 14, 46,  6, 38 },
+	{ 60, 28, 52, 20, 62, 30, 54, 22 },
+	{  3, 35, 11, 43,  1, 33,  9, 41 },
+	{ 51, 19, 59, 27, 49, 17, 57, 25 },
+	{ 15, 47,  7, 39, 13, 45,  5, 37 },
+	{ 63, 31, 55, 23, 61, 29, 53, 21 }
+};
+const int32 kMaxDitherChannels = 4;
+const int32 kDitherPatternSize = 8 * kMaxDitherChannels + 32;
+
+#pragma mark ---- Scalar ----
+
+static void rgb24_to_bgra32_scalar( const uint8 *src, uint8 *dst, int32 pixels,
+								uint8 alpha )
+{
+	for( int32 i = 0; i < pixels; i++ ) {
+		dst[0] = src[2];
+		dst[1] = src[1];
+		dst[2] = src[0];
+		dst[3] = alpha;
+		src += 3;
+		dst += 4;
+	}
+}
+
+static void bgra32_to_rgb24_scalar( const uint8 *src, uint8 *dst, int32 pixels )
+{
+	for( int32 i = 0; i < pixels; i++ ) {
+		dst[0] = src[2];
+		dst[1] = src[1];
+		dst[2] = src[0];
+		src += 4;
+		dst += 3;
+	}
+}
+
+static void rgb24_to_bgr24_scalar( const uint8 *src, uint8 *dst, int32 pixels )
+{
+	for( int32 i = 0; i < pixels; i++ ) {
+		uint8 red = src[0];
+		dst[1] = src[1];
+		dst[0] = src[2];
+		dst[2] = red;
+		src += 3;
+		dst += 3;
+	}
+}
+
+static void gray8_to_bgra32_scalar( const uint8 *src, uint8 *dst, int32 pixels,
+								uint8 alpha )
+{
+	for( int32 i = 0; i < pixels; i++ ) {
+		uint8 gray = *src++;
+		dst[0] = gray;
+		dst[1] = gray;
+		dst[2] = gray;
+		dst[3] = alpha;
+		dst += 4;
+	}
+}
+
+static void wide_to_8_scalar( const uint8 *src, uint8 *dst, int32 samples )
+{
+		// big-endian, so the byte we keep comes first
+	for( int32 i = 0; i < samples; i++ ) {
+		*dst++ = *src;
+		src += 2;
+	}
+}
+
+/*	x - x / 256 takes 16 bits to 0..65280, so adding up to 255 and keeping
+	the high byte rounds to 8 bits without overflowing, up or down by the
+	threshold. pattern is a row's thresholds, period samples of them,
+	repeated out past the end for the vector versions to load from
+	anywhere within the period; src starts at phase in it. */
+static void dither_to_8_scalar( const uint8 *src, uint8 *dst, int32 samples,
+								const uint8 *pattern, int32 period, int32 phase )
+{
+	int32 j = phase;
+	for( int32 i = 0; i < samples; i++ ) {
+		uint32 v = ( src[0] << 8 ) | src[1];
+		*dst++ = ( v - ( v >> 8 ) + pattern[j] ) >> 8;
+		src += 2;
+		if( ++j == period )
+			j = 0;
+	}
+}
+
+static void swap16_scalar( const uint8 *src, uint8 *dst, int32 samples )
+{
+	for( int32 i = 0; i < samples; i++ ) {
+		uint8 high = src[0];
+		dst[0] = src[1];
+		dst[1] = high;
+		src += 2;
+		dst += 2;
+	}
+}
+
+static void lut8_scalar( const uint8 *src, uint8 *dst, int32 bytes,
+								const uint8 *luts, int32 channels )
+{
+	int32 i = 0;
+	if( channels == 1 ) {
+		for( ; i + 4 <= bytes; i += 4 ) {
+			uint8 a = luts[src[i]], b = luts[src[i + 1]];
+			uint8 c = luts[src[i + 2]], d = luts[src[i + 3]];
+			dst[i] = a;
+			dst[i + 1] = b;
+			dst[i + 2] = c;
+			dst[i + 3] = d;
+		}
+	} else if( channels == 3 ) {
+		for( ; i + 3 <= bytes; i += 3 ) {
+			uint8 r = luts[src[i]], g = luts[256 + src[i + 1]];
+			uint8 b = luts[512 + src[i + 2]];
+			dst[i] = r;
+			dst[i + 1] = g;
+			dst[i + 2] = b;
+		}
+	}
+	for( ; i < bytes; i++ )
+		dst[i] = luts[ ( i % channels ) * 256 + src[i] ];
+}
+
+#pragma mark ---- x86 ----
+
+#if SCAN_CONVERT_X86
+
+static TARGET( "ssse3" )
+void rgb24_to_bgra32_ssse3( const uint8 *src, uint8 *dst, int32 pixels,
+								uint8 alpha )
+{
+	const __m128i swizzle = _mm_setr_epi8( 2, 1, 0, -1, 5, 4, 3, -1,
+											8, 7, 6, -1, 11, 10, 9, -1 );
+	const __m128i alphas = _mm_set1_epi32( (int32) ( (uint32) alpha << 24 ) );
+	int32 i = 0;
+		// 16 pixels, 48 bytes in, 64 out
+	for( ; i + 16 <= pixels; i += 16 ) {
+		__m128i a = _mm_loadu_si128( (const __m128i *) src );
+		__m128i b = _mm_loadu_si128( (const __m128i *) ( src + 16 ) );
+		__m128i c = _mm_loadu_si128( (const __m128i *) ( src + 32 ) );
+		__m128i p0 = a;
+		__m128i p1 = _mm_alignr_epi8( b, a, 12 );
+		__m128i p2 = _mm_alignr_epi8( c, b, 8 );
+		__m128i p3 = _mm_srli_si128( c, 4 );
+		_mm_storeu_si128( (__m128i *) dst,
+			_mm_or_si128( _mm_shuffle_epi8( p0, swizzle ), alphas ) );
+		_mm_storeu_si128( (__m128i *) ( dst + 16 ),
+			_mm_or_si128( _mm_shuffle_epi8( p1, swizzle ), alphas ) );
+		_mm_storeu_si128( (__m128i *) ( dst + 32 ),
+			_mm_or_si128( _mm_shuffle_epi8( p2, swizzle ), alphas ) );
+		_mm_storeu_si128( (__m128i *) ( dst + 48 ),
+			_mm_or_si128( _mm_shuffle_epi8( p3, swizzle ), alphas ) );
+		src += 48;
+		dst += 64;
+	}
+	rgb24_to_bgra32_scalar( src, dst, pixels - i, alpha );
+}
+
+static TARGET( "ssse3" )
+void bgra32_to_rgb24_ssse3( const uint8 *src, uint8 *dst, int32 pixels )
+{
+	const __m128i pack = _mm_setr_epi8( 2, 1, 0, 6, 5, 4, 10, 9,
+										8, 14, 13, 12, -1, -1, -1, -1 );
+	int32 i = 0;
+		// 16 pixels, 64 bytes in, 48 out
+	for( ; i + 16 <= pixels; i += 16 ) {
+		__m128i p0 = _mm_shuffle_epi8(
+						_mm_loadu_si128( (const __m128i *) src ), pack );
+		__m128i p1 = _mm_shuffle_epi8(
+						_mm_loadu_si128( (const __m128i *) ( src + 16 ) ), pack );
+		__m128i p2 = _mm_shuffle_epi8(
+						_mm_loadu_si128( (const __m128i *) ( src + 32 ) ), pack );
+		__m128i p3 = _mm_shuffle_epi8(
+						_mm_loadu_si128( (const __m128i *) ( src + 48 ) ), pack );
+		_mm_storeu_si128( (__m128i *) dst,
+			_mm_or_si128( p0, _mm_slli_si128( p1, 12 ) ) );
+		_mm_storeu_si128( (__m128i *) ( dst + 16 ),
+			_mm_or_si128( _mm_srli_si128( p1, 4 ), _mm_slli_si128( p2, 8 ) ) );
+		_mm_storeu_si128( (__m128i *) ( dst + 32 ),
+			_mm_or_si128( _mm_srli_si128( p2, 8 ), _mm_slli_si128( p3, 4 ) ) );
+		src += 64;
+		dst += 48;
+	}
+	bgra32_to_rgb24_scalar( src, dst, pixels - i );
+}
+
+static TARGET( "ssse3" )
+void rgb24_to_bgr24_ssse3( const uint8 *src, uint8 *dst, int32 pixels )
+{
+		// pixels straddle the 16-byte vectors, so each output vector is
+		// pieced together from shuffles of the inputs it overlaps
+	const __m128i a0 = _mm_setr_epi8( 2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, -1 );
+	const __m128i b0 = _mm_setr_epi8( -1, -1, -1, -1, -1, -1, -1, -1,
+										-1, -1, -1, -1, -1, -1, -1, 1 );
+	const __m128i a1 = _mm_setr_epi8( -1, 15, -1, -1, -1, -1, -1, -1,
+										-1, -1, -1, -1, -1, -1, -1, -1 );
+	const __m128i b1 = _mm_setr_epi8( 0, -1, 4, 3, 2, 7, 6, 5, 10, 9, 8, 13, 12, 11, -1, 15 );
+	const __m128i c1 = _mm_setr_epi8( -1, -1, -1, -1, -1, -1, -1, -1,
+										-1, -1, -1, -1, -1, -1, 0, -1 );
+	const __m128i b2 = _mm_setr_epi8( 14, -1, -1, -1, -1, -1, -1, -1,
+										-1, -1, -1, -1, -1, -1, -1, -1 );
+	const __m128i c2 = _mm_setr_epi8( -1, 3, 2, 1, 6, 5, 4, 9, 8, 7, 12, 11, 10, 15, 14, 13 );
+	int32 i = 0;
+		// 16 pixels, 48 bytes each way
+	for( ; i + 16 <= pixels; i += 16 ) {
+		__m128i a = _mm_loadu_si128( (const __m128i *) src );
+		__m128i b = _mm_loadu_si128( (const __m128i *) ( src + 16 ) );
+		__m128i c = _mm_loadu_si128( (const __m128i *) ( src + 32 ) );
+		_mm_storeu_si128( (__m128i *) dst,
+			_mm_or_si128( _mm_shuffle_epi8( a, a0 ), _mm_shuffle_epi8( b, b0 ) ) );
+		_mm_storeu_si128( (__m128i *) ( dst + 16 ),
+			_mm_or_si128( _mm_or_si128( _mm_shuffle_epi8( a, a1 ),
+				_mm_shuffle_epi8( b, b1 ) ), _mm_shuffle_epi8( c, c1 ) ) );
+		_mm_storeu_si128( (__m128i *) ( dst + 32 ),
+			_mm_or_si128( _mm_shuffle_epi8( b, b2 ), _mm_shuffle_epi8( c, c2 ) ) );
+		src += 48;
+		dst += 48;
+	}
+	rgb24_to_bgr24_scalar( src, dst, pixels - i );
+}
+
+static TARGET( "sse2" )
+void gray8_to_bgra32_sse2( const uint8 *src, uint8 *dst, int32 pixels,
+								uint8 alpha )
+{
+	const __m128i alphas = _mm_set1_epi8( (char) alpha );
+	int32 i = 0;
+	for( ; i + 16 <= pixels; i += 16 ) {
+		__m128i g = _mm_loadu_si128( (const __m128i *) src );
+		__m128i ggLo = _mm_unpacklo_epi8( g, g );
+		__m128i ggHi = _mm_unpackhi_epi8( g, g );
+		__m128i gaLo = _mm_unpacklo_epi8( g, alphas );
+		__m128i gaHi = _mm_unpackhi_epi8( g, alphas );
+		_mm_storeu_si128( (__m128i *) dst, _mm_unpacklo_epi16( ggLo, gaLo ) );
+		_mm_storeu_si128( (__m128i *) ( dst + 16 ), _mm_unpackhi_epi16( ggLo, gaLo ) );
+		_mm_storeu_si128( (__m128i *) ( dst + 32 ), _mm_unpacklo_epi16( ggHi, gaHi ) );
+		_mm_storeu_si128( (__m128i *) ( dst + 48 ), _mm_unpackhi_epi16( ggHi, gaHi ) );
+		src += 16;
+		dst += 64;
+	}
+	gray8_to_bgra32_scalar( src, dst, pixels - i, alpha );
+}
+
+static TARGET( "sse2" )
+void wide_to_8_sse2( const uint8 *src, uint8 *dst, int32 samples )
+{
+		// the first byte of each sample is the low byte of a little-endian word
+	const __m128i lowBytes = _mm_set1_epi16( 0x00ff );
+	int32 i = 0;
+	for( ; i + 16 <= samples; i += 16 ) {
+		__m128i a = _mm_and_si128( _mm_loadu_si128( (const __m128i *) src ), lowBytes );
+		__m128i b = _mm_and_si128( _mm_loadu_si128( (const __m128i *) ( src + 16 ) ),
+									lowBytes );
+		_mm_storeu_si128( (__m128i *) dst, _mm_packus_epi16( a, b ) );
+		src += 32;
+		dst += 16;
+	}
+	wide_to_8_scalar( src, dst, samples - i );
+}
+
+/* Eight big-endian samples, dithered, as words. */
+static TARGET( "sse2" )
+__m128i dither_8_sse2( const uint8 *src, const uint8 *pattern )
+{
+	__m128i w = _mm_loadu_si128( (const __m128i *) src );
+	__m128i v = _mm_or_si128( _mm_slli_epi16( w, 8 ), _mm_srli_epi16( w, 8 ) );
+	__m128i t = _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i *) pattern ),
+									_mm_setzero_si128() );
+	v = _mm_add_epi16( _mm_sub_epi16( v, _mm_srli_epi16( v, 8 ) ), t );
+	return _mm_srli_epi16( v, 8 );
+}
+
+static TARGET( "sse2" )
+void dither_to_8_sse2( const uint8 *src, uint8 *dst, int32 samples,
+								const uint8 *pattern, int32 period, int32 phase )
+{
+	int32 i = 0, j = phase;
+	for( ; i + 16 <= samples; i += 16 ) {
+		__m128i a = dither_8_sse2( src, pattern + j );
+		__m128i b = dither_8_sse2( src + 16, pattern + ( j + 8 ) % period );
+		_mm_storeu_si128( (__m128i *) dst, _mm_packus_epi16( a, b ) );
+		src += 32;
+		dst += 16;
+		j = ( j + 16 ) % period;
+	}
+	dither_to_8_scalar( src, dst, samples - i, pattern, period, j );
+}
+
+static TARGET( "ssse3" )
+void swap16_ssse3( const uint8 *src, uint8 *dst, int32 samples )
+{
+	const __m128i swap = _mm_setr_epi8( 1, 0, 3, 2, 5, 4, 7, 6,
+										9, 8, 11, 10, 13, 12, 15, 14 );
+	int32 i = 0;
+	for( ; i + 8 <= samples; i += 8 ) {
+		_mm_storeu_si128( (__m128i *) dst,
+			_mm_shuffle_epi8( _mm_loadu_si128( (const __m128i *) src ), swap ) );
+		src += 16;
+		dst += 16;
+	}
+	swap16_scalar( src, dst, samples - i );
+}
+
+static TARGET( "avx2" )
+void rgb24_to_bgra32_avx2( const uint8 *src, uint8 *dst, int32 pixels,
+								uint8 alpha )
+{
+		// spread 24 bytes over the two lanes, 12 in each, then swizzle per lane
+	const __m256i spread = _mm256_setr_epi32( 0, 1, 2, 3, 3, 4, 5, 6 );
+	const __m256i swizzle = _mm256_setr_epi8(
+								2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1,
+								2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1 );
+	const __m256i alphas = _mm256_set1_epi32( (int32) ( (uint32) alpha << 24 ) );
+	int32 i = 0;
+		// 8 pixels at a time, but each load reads 32 bytes for 24
+	for( ; i + 11 <= pixels; i += 8 ) {
+		__m256i v = _mm256_loadu_si256( (const __m256i *) src );
+		v = _mm256_permutevar8x32_epi32( v, spread );
+		v = _mm256_or_si256( _mm256_shuffle_epi8( v, swizzle ), alphas );
+		_mm256_storeu_si256( (__m256i *) dst, v );
+		src += 24;
+		dst += 32;
+	}
+	rgb24_to_bgra32_ssse3( src, dst, pixels - i, alpha );
+}
+
+static TARGET( "avx2" )
+void gray8_to_bgra32_avx2( const uint8 *src, uint8 *dst, int32 pixels,
+								uint8 alpha )
+{
+	const __m256i expand0 = _mm256_setr_epi8(
+								0, 0, 0, -1, 1, 1, 1, -1, 2, 2, 2, -1, 3, 3, 3, -1,
+								4, 4, 4, -1, 5, 5, 5, -1, 6, 6, 6, -1, 7, 7, 7, -1 );
+	const __m256i expand1 = _mm256_add_epi8( expand0, _mm256_setr_epi8(
+								8, 8, 8, 0, 8, 8, 8, 0, 8, 8, 8, 0, 8, 8, 8, 0,
+								8, 8, 8, 0, 8, 8, 8, 0, 8, 8, 8, 0, 8, 8, 8, 0 ) );
+	const __m256i alphas = _mm256_set1_epi32( (int32) ( (uint32) alpha << 24 ) );
+	int32 i = 0;
+	for( ; i + 16 <= pixels; i += 16 ) {
+		__m256i g = _mm256_broadcastsi128_si256(
+						_mm_loadu_si128( (const __m128i *) src ) );
+		_mm256_storeu_si256( (__m256i *) dst,
+			_mm256_or_si256( _mm256_shuffle_epi8( g, expand0 ), alphas ) );
+		_mm256_storeu_si256( (__m256i *) ( dst + 32 ),
+			_mm256_or_si256( _mm256_shuffle_epi8( g, expand1 ), alphas ) );
+		src += 16;
+		dst += 64;
+	}
+	gray8_to_bgra32_scalar( src, dst, pixels - i, alpha );
+}
+
+static TARGET( "avx2" )
+void wide_to_8_avx2( const uint8 *src, uint8 *dst, int32 samples )
+{
+	const __m256i lowBytes = _mm256_set1_epi16( 0x00ff );
+	int32 i = 0;
+	for( ; i + 32 <= samples; i += 32 ) {
+		__m256i a = _mm256_and_si256(
+						_mm256_loadu_si256( (const __m256i *) src ), lowBytes );
+		__m256i b = _mm256_and_si256(
+						_mm256_loadu_si256( (const __m256i *) ( src + 32 ) ), lowBytes );
+			// packus works per lane, put the quadwords back in order
+		__m256i v = _mm256_permute4x64_epi64( _mm256_packus_epi16( a, b ), 0xd8 );
+		_mm256_storeu_si256( (__m256i *) dst, v );
+		src += 64;
+		dst += 32;
+	}
+	wide_to_8_sse2( src, dst, samples - i );
+}
+
+static TARGET( "avx2" )
+void dither_to_8_avx2( const uint8 *src, uint8 *dst, int32 samples,
+								const uint8 *pattern, int32 period, int32 phase )
+{
+	int32 i = 0, j = phase;
+		// the pattern is read 32 at a time, so it repeats at least that far
+	for( ; i + 32 <= samples; i += 32 ) {
+		__m256i t = _mm256_loadu_si256( (const __m256i *) ( pattern + j ) );
+		__m256i tLow = _mm256_cvtepu8_epi16( _mm256_castsi256_si128( t ) );
+		__m256i tHigh = _mm256_cvtepu8_epi16( _mm256_extracti128_si256( t, 1 ) );
+		__m256i a = _mm256_loadu_si256( (const __m256i *) src );
+		__m256i b = _mm256_loadu_si256( (const __m256i *) ( src + 32 ) );
+		a = _mm256_or_si256( _mm256_slli_epi16( a, 8 ), _mm256_srli_epi16( a, 8 ) );
+		b = _mm256_or_si256( _mm256_slli_epi16( b, 8 ), _mm256_srli_epi16( b, 8 ) );
+		a = _mm256_add_epi16( _mm256_sub_epi16( a, _mm256_srli_epi16( a, 8 ) ), tLow );
+		b = _mm256_add_epi16( _mm256_sub_epi16( b, _mm256_srli_epi16( b, 8 ) ), tHigh );
+		__m256i v = _mm256_packus_epi16( _mm256_srli_epi16( a, 8 ),
+										_mm256_srli_epi16( b, 8 ) );
+		_mm256_storeu_si256( (__m256i *) dst, _mm256_permute4x64_epi64( v, 0xd8 ) );
+		src += 64;
+		dst += 32;
+		j = ( j + 32 ) % period;
+	}
+	dither_to_8_sse2( src, dst, samples - i, pattern, period, j );
+}
+
+static TARGET( "avx2" )
+void swap16_avx2( const uint8 *src, uint8 *dst, int32 samples )
+{
+	const __m256i swap = _mm256_setr_epi8( 1, 0, 3, 2, 5, 4, 7, 6,
+										9, 8, 11, 10, 13, 12, 15, 14,
+										1, 0, 3, 2, 5, 4, 7, 6,
+										9, 8, 11, 10, 13, 12, 15, 14 );
+	int32 i = 0;
+	for( ; i + 16 <= samples; i += 16 ) {
+		_mm256_storeu_si256( (__m256i *) dst, _mm256_shuffle_epi8(
+			_mm256_loadu_si256( (const __m256i *) src ), swap ) );
+		src += 32;
+		dst += 32;
+	}
+	swap16_ssse3( src, dst, samples - i );
+}
+
+/*	VBMI's two-table byte permute looks up 64 bytes at a time in half a
+	table, so a whole table takes two of them and a blend on the top bit of
+	each index. RGB does that for all three tables and blends the results
+	by channel; 64 isn't a multiple of 3, so each block starts one channel
+	further on than the last, and the masks go round with it. */
+static TARGET( "avx512f,avx512bw,avx512vbmi" )
+void lut8_avx512vbmi( const uint8 *src, uint8 *dst, int32 bytes,
+								const uint8 *luts, int32 channels )
+{
+	if( channels != 1 && channels != 3 ) {
+		lut8_scalar( src, dst, bytes, luts, channels );
+		return;
+	}
+
+	__m512i table[3][4];
+	for( int32 c = 0; c < channels; c++ )
+		for( int32 q = 0; q < 4; q++ )
+			table[c][q] = _mm512_loadu_si512( luts + c * 256 + q * 64 );
+
+		// masks[phase][c]: the bytes of a block using table c, when the
+		// block starts on channel phase
+	__mmask64 masks[3][3];
+	for( int32 phase = 0; phase < 3; phase++ )
+		for( int32 c = 0; c < 3; c++ ) {
+			uint64 m = 0;
+			for( int32 j = 0; j < 64; j++ )
+				if( ( phase + j ) % 3 == c )
+					m |= (uint64) 1 << j;
+			masks[phase][c] = m;
+		}
+
+	int32 i = 0;
+	int32 phase = 0;
+	for( ; i + 64 <= bytes; i += 64 ) {
+		__m512i index = _mm512_loadu_si512( src + i );
+		__mmask64 high = _mm512_movepi8_mask( index );
+		__m512i out = _mm512_mask_blend_epi8( high,
+				_mm512_permutex2var_epi8( table[0][0], index, table[0][1] ),
+				_mm512_permutex2var_epi8( table[0][2], index, table[0][3] ) );
+		if( channels == 3 ) {
+			for( int32 c = 1; c < 3; c++ ) {
+				__m512i t = _mm512_mask_blend_epi8( high,
+						_mm512_permutex2var_epi8( table[c][0], index, table[c][1] ),
+						_mm512_permutex2var_epi8( table[c][2], index, table[c][3] ) );
+				out = _mm512_mask_blend_epi8( masks[phase][c], out, t );
+			}
+			phase = ( phase + 1 ) % 3;			// 64 % 3
+		}
+		_mm512_storeu_si512( dst + i, out );
+	}
+	for( ; i < bytes; i++ )
+		dst[i] = luts[ ( i % channels ) * 256 + src[i] ];
+}
+
+#endif // SCAN_CONVERT_X86
+
+#pragma mark ---- NEON ----
+
+#if SCAN_CONVERT_NEON
+
+static void rgb24_to_bgra32_neon( const uint8 *src, uint8 *dst, int32 pixels,
+								uint8 alpha )
+{
+	int32 i = 0;
+	uint8x16_t alphas = vdupq_n_u8( alpha );
+	for( ; i + 16 <= pixels; i += 16 ) {
+		uint8x16x3_t rgb = vld3q_u8( src );
+		uint8x16x4_t bgra;
+		bgra.val[0] = rgb.val[2];
+		bgra.val[1] = rgb.val[1];
+		bgra.val[2] = rgb.val[0];
+		bgra.val[3] = alphas;
+		vst4q_u8( dst, bgra );
+		src += 48;
+		dst += 64;
+	}
+	rgb24_to_bgra32_scalar( src, dst, pixels - i, alpha );
+}
+
+static void bgra32_to_rgb24_neon( const uint8 *src, uint8 *dst, int32 pixels )
+{
+	int32 i = 0;
+	for( ; i + 16 <= pixels; i += 16 ) {
+		uint8x16x4_t bgra = vld4q_u8( src );
+		uint8x16x3_t rgb;
+		rgb.val[0] = bgra.val[2];
+		rgb.val[1] = bgra.val[1];
+		rgb.val[2] = bgra.val[0];
+		vst3q_u8( dst, rgb );
+		src += 64;
+		dst += 48;
+	}
+	bgra32_to_rgb24_scalar( src, dst, pixels - i );
+}
+
+static void rgb24_to_bgr24_neon( const uint8 *src, uint8 *dst, int32 pixels )
+{
+	int32 i = 0;
+	for( ; i + 16 <= pixels; i += 16 ) {
+		uint8x16x3_t rgb = vld3q_u8( src );
+		uint8x16_t red = rgb.val[0];
+		rgb.val[0] = rgb.val[2];
+		rgb.val[2] = red;
+		vst3q_u8( dst, rgb );
+		src += 48;
+		dst += 48;
+	}
+	rgb24_to_bgr24_scalar( src, dst, pixels - i );
+}
+
+static void gray8_to_bgra32_neon( const uint8 *src, uint8 *dst, int32 pixels,
+								uint8 alpha )
+{
+	int32 i = 0;
+	uint8x16_t alphas = vdupq_n_u8( alpha );
+	for( ; i + 16 <= pixels; i += 16 ) {
+		uint8x16_t g = vld1q_u8( src );
+		uint8x16x4_t bgra;
+		bgra.val[0] = g;
+		bgra.val[1] = g;
+		bgra.val[2] = g;
+		bgra.val[3] = alphas;
+		vst4q_u8( dst, bgra );
+		src += 16;
+		dst += 64;
+	}
+	gray8_to_bgra32_scalar( src, dst, pixels - i, alpha );
+}
+
+static void wide_to_8_neon( const uint8 *src, uint8 *dst, int32 samples )
+{
+	int32 i = 0;
+	for( ; i + 16 <= samples; i += 16 ) {
+		uint8x16x2_t wide = vld2q_u8( src );
+		vst1q_u8( dst, wide.val[0] );
+		src += 32;
+		dst += 16;
+	}
+	wide_to_8_scalar( src, dst, samples - i );
+}
+
+static void dither_to_8_neon( const uint8 *src, uint8 *dst, int32 samples,
+								const uint8 *pattern, int32 period, int32 phase )
+{
+	int32 i = 0, j = phase;
+	for( ; i + 16 <= samples; i += 16 ) {
+		uint8x16x2_t wide = vld2q_u8( src );		// high bytes, then low
+		uint8x16_t t = vld1q_u8( pattern + j );
+		uint16x8_t a = vorrq_u16( vshll_n_u8( vget_low_u8( wide.val[0] ), 8 ),
+									vmovl_u8( vget_low_u8( wide.val[1] ) ) );
+		uint16x8_t b = vorrq_u16( vshll_n_u8( vget_high_u8( wide.val[0] ), 8 ),
+									vmovl_u8( vget_high_u8( wide.val[1] ) ) );
+		a = vaddw_u8( vsubq_u16( a, vshrq_n_u16( a, 8 ) ), vget_low_u8( t ) );
+		b = vaddw_u8( vsubq_u16( b, vshrq_n_u16( b, 8 ) ), vget_high_u8( t ) );
+		vst1q_u8( dst, vcombine_u8( vshrn_n_u16( a, 8 ), vshrn_n_u16( b, 8 ) ) );
+		src += 32;
+		dst += 16;
+		j = ( j + 16 ) % period;
+	}
+	dither_to_8_scalar( src, dst, samples - i, pattern, period, j );
+}
+
+static void swap16_neon( const uint8 *src, uint8 *dst, int32 samples )
+{
+	int32 i = 0;
+	for( ; i + 8 <= samples; i += 8 ) {
+		vst1q_u8( dst, vrev16q_u8( vld1q_u8( src ) ) );
+		src += 16;
+		dst += 16;
+	}
+	swap16_scalar( src, dst, samples - i );
+}
+
+#endif // SCAN_CONVERT_NEON
+
+#pragma mark ---- Dispatch ----
+
+/* Picks the converters once, when the library is loaded. */
+static struct convert_init {
+	convert_init();
+} sConvertInit;
+
+convert_init::convert_init()
+{
+	for( int32 byte = 0; byte < 256; byte++ )
+		for( int32 bit = 0; bit < 8; bit++ )
+			gBitsLUT[byte][bit] = ( byte & ( 0x80 >> bit ) ) ? 0 : 255;
+
+	gConvert.name = "scalar";
+	gConvert.rgb24_to_bgra32 = rgb24_to_bgra32_scalar;
+	gConvert.bgra32_to_rgb24 = bgra32_to_rgb24_scalar;
+	gConvert.rgb24_to_bgr24 = rgb24_to_bgr24_scalar;
+	gConvert.gray8_to_bgra32 = gray8_to_bgra32_scalar;
+	gConvert.wide_to_8 = wide_to_8_scalar;
+	gConvert.dither_to_8 = dither_to_8_scalar;
+	gConvert.swap16 = swap16_scalar;
+	gConvert.lut8 = lut8_scalar;
+
+	const char *force = getenv( "SCAN_CONVERT" );
+	if( force && strcmp( force, "scalar" ) == 0 )
+		return;
+
+#if SCAN_CONVERT_X86
+	__builtin_cpu_init();
+	if( __builtin_cpu_supports( "sse2" ) ) {
+		gConvert.name = "sse2";
+		gConvert.gray8_to_bgra32 = gray8_to_bgra32_sse2;
+		gConvert.wide_to_8 = wide_to_8_sse2;
+		gConvert.dither_to_8 = dither_to_8_sse2;
+	}
+	if( __builtin_cpu_supports( "ssse3" ) ) {
+		gConvert.name = "ssse3";
+		gConvert.rgb24_to_bgra32 = rgb24_to_bgra32_ssse3;
+		gConvert.bgra32_to_rgb24 = bgra32_to_rgb24_ssse3;
+		gConvert.rgb24_to_bgr24 = rgb24_to_bgr24_ssse3;
+		gConvert.swap16 = swap16_ssse3;
+	}
+	if( __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "ssse3" ) ) {
+		gConvert.name = "avx2";
+		gConvert.rgb24_to_bgra32 = rgb24_to_bgra32_avx2;
+		gConvert.gray8_to_bgra32 = gray8_to_bgra32_avx2;
+		gConvert.wide_to_8 = wide_to_8_avx2;
+		gConvert.dither_to_8 = dither_to_8_avx2;
+		gConvert.swap16 = swap16_avx2;
+	}
+	if( __builtin_cpu_supports( "avx512vbmi" ) && __builtin_cpu_supports( "avx512bw" ) ) {
+		gConvert.name = "avx512vbmi";
+		gConvert.lut8 = lut8_avx512vbmi;
+	}
+#elif SCAN_CONVERT_NEON
+	gConvert.name = "neon";
+	gConvert.rgb24_to_bgra32 = rgb24_to_bgra32_neon;
+	gConvert.bgra32_to_rgb24 = bgra32_to_rgb24_neon;
+	gConvert.rgb24_to_bgr24 = rgb24_to_bgr24_neon;
+	gConvert.gray8_to_bgra32 = gray8_to_bgra32_neon;
+	gConvert.wide_to_8 = wide_to_8_neon;
+	gConvert.dither_to_8 = dither_to_8_neon;
+	gConvert.swap16 = swap16_neon;
+#endif
+}
+
+#pragma mark ---- Public Functions ----
+
+void scan_convert_rgb24_to_bgra32( const void *src, void *dst, int32 pixels,
+								uint8 alpha )
+{
+	gConvert.rgb24_to_bgra32( (const uint8 *) src, (uint8 *) dst, pixels, alpha );
+}
+
+void scan_convert_bgra32_to_rgb24( const void *src, void *dst, int32 pixels )
+{
+	gConvert.bgra32_to_rgb24( (const uint8 *) src, (uint8 *) dst, pixels );
+}
+
+void scan_convert_rgb24_to_bgr24( const void *src, void *dst, int32 pixels )
+{
+	gConvert.rgb24_to_bgr24( (const uint8 *) src, (uint8 *) dst, pixels );
+}
+
+void scan_convert_gray8_to_bgra32( const void *src, void *dst, int32 pixels,
+								uint8 alpha )
+{
+	gConvert.gray8_to_bgra32( (const uint8 *) src, (uint8 *) dst, pixels, alpha );
+}
+
+/*	A table lookup per byte already beats anything vectorized for this
+	one, so there's only the one version. */
+void scan_convert_bits_to_gray8( const void *src, void *dst, int32 pixels )
+{
+	const uint8 *in = (const uint8 *) src;
+	uint8 *out = (uint8 *) dst;
+	int32 whole = pixels / 8;
+	for( int32 i = 0; i < whole; i++ ) {
+		memcpy( out, gBitsLUT[*in++], 8 );
+		out += 8;
+	}
+	if( pixels % 8 )
+		memcpy( out, gBitsLUT[*in], pixels % 8 );
+}
+
+void scan_convert_lut8( const void *src, void *dst, int32 bytes,
+								const uint8 *luts, int32 channels )
+{
+	if( channels < 1 )
+		return;
+	gConvert.lut8( (const uint8 *) src, (uint8 *) dst, bytes, luts, channels );
+}
+
+/*	The tables are too big for the vector shuffles, so there's only the
+	one version of this too. */
+void scan_convert_lut16( const void *src, void *dst, int32 samples,
+								const uint16 *luts, int32 channels )
+{
+	if( channels < 1 )
+		return;
+	const uint8 *in = (const uint8 *) src;
+	uint8 *out = (uint8 *) dst;
+	int32 c = 0;
+	for( int32 i = 0; i < samples; i++ ) {
+		uint16 v = luts[ c * 65536 + ( in[0] << 8 | in[1] ) ];
+		out[0] = v >> 8;
+		out[1] = v;
+		in += 2;
+		out += 2;
+		if( ++c == channels )
+			c = 0;
+	}
+}
+
+void scan_convert_16_to_8( const void *src, void *dst, int32 samples )
+{
+	gConvert.wide_to_8( (const uint8 *) src, (uint8 *) dst, samples );
+}
+
+void scan_convert_16_to_8_dither( const void *src, void *dst, int32 pixels,
+								int32 channels, int32 row )
+{
+	if( channels < 1 || channels > kMaxDitherChannels )
+		return;
+	uint8 pattern[kDitherPatternSize];
+	const uint8 *bayer = kBayer[ row & 7 ];
+	for( int32 i = 0; i < kDitherPatternSize; i++ )
+		pattern[i] = bayer[ ( i / channels ) & 7 ] * 4 + 2;
+	gConvert.dither_to_8( (const uint8 *) src, (uint8 *) dst, pixels * channels,
+							pattern, 8 * channels, 0 );
+}
+
+void scan_convert_swap16( const void *src, void *dst, int32 samples )
+{
+	gConvert.swap16( (const uint8 *) src, (uint8 *) dst, samples );
+}
+
+const char* scan_convert_implementation()
+{
+	return gConvert.name;
+}
@@ -0,0 +1,206 @@
+/*
+	ScannerBe -- background image encoding.
+	Copyright (c) 1997, Jim Moy, All Rights Reserved
+*/
+
+#include "ScannerBe.h"
+#include "ScanEncoder.h"
+
+#include <OS.h>
+#include <Errors.h>
+#include <Locker.h>
+#include <Autolock.h>
+
+const int32 kMaxEncoders = 64;
+const size_t kDefaultMemory = 16 * 1024L * 1024L;
+
+/*	Memory is counted by the budget semaphore, in kilobytes, so waiting
+	for room is just acquire_sem_etc(). Once every kilobyte is back, the
+	pool has nothing left to do. */
+struct scan_encoder_pool {
+	BLocker			lock;			// the queue and error
+	encoder_job*	first;
+	encoder_job*	last;
+	sem_id			work;			// counts queued jobs
+	sem_id			budget;
+	int32			budget_size;	// in K
+	thread_id		threads[kMaxEncoders];
+	int32			thread_count;
+	bool			quitting;
+	status_t		error;			// first error since the last wait
+};
+
+/*	Some local function prototypes. */
+static int32 cost_to_units( scan_encoder_pool *pool, int32 cost );
+static status_t encoder_thread( void *data );
+
+#pragma mark ---- Public Functions ----
+
+status_t scan_encoder_pool_create( int32 threads, size_t memory,
+						scan_encoder_pool **pool )
+{
+	if( ! pool || threads < 0 )
+		return SCAN_BAD_PARAM;
+	*pool = NULL;
+
+	if( threads == 0 ) {
+		system_info info;
+		threads = get_system_info( &info ) == B_OK ? info.cpu_count : 1;
+	}
+	if( threads > kMaxEncoders )
+		threads = kMaxEncoders;
+	if( memory == 0 )
+		memory = kDefaultMemory;
+
+	scan_encoder_pool *p = new scan_encoder_pool;
+	p->first = p->last = NULL;
+	p->budget_size = memory / 1024 > 0 ? memory / 1024 : 1;
+	p->work = create_sem( 0, "scan encoder work" );
+	p->budget = create_sem( p->budget_size, "scan encoder memory" );
+	p->thread_count = 0;
+	p->quitting = false;
+	p->error = B_OK;
+	if( p->work < B_OK || p->budget < B_OK ) {
+		scan_encoder_pool_delete( p );
+		return B_NO_MORE_SEMS;
+	}
+
+	for( int32 i = 0; i < threads; i++ ) {
+		thread_id thread = spawn_thread( encoder_thread, "scan encoder",
+										B_LOW_PRIORITY, p );
+		if( thread < B_OK )
+			break;
+		p->threads[ p->thread_count++ ] = thread;
+		resume_thread( thread );
+	}
+	if( p->thread_count == 0 ) {
+		scan_encoder_pool_delete( p );
+		return B_NO_MORE_THREADS;
+	}
+
+	*pool = p;
+	return B_OK;
+}
+
+
+status_t scan_encoder_pool_wait( scan_encoder_pool *pool )
+{
+	if( ! pool )
+		return SCAN_BAD_PARAM;
+
+	status_t status;
+	while( ( status = acquire_sem_etc( pool->budget, pool->budget_size, 0, 0 ) )
+				== B_INTERRUPTED )
+		;
+	if( status == B_OK )
+		release_sem_etc( pool->budget, pool->budget_size, 0 );
+
+	BAutolock lock( pool->lock );
+	if( status == B_OK ) {
+		status = pool->error;
+		pool->error = B_OK;
+	}
+	return status;
+}
+
+
+status_t scan_encoder_pool_delete( scan_encoder_pool *pool )
+{
+	if( ! pool )
+		return SCAN_BAD_PARAM;
+
+	status_t status = B_OK;
+	if( pool->thread_count > 0 ) {
+		status = scan_encoder_pool_wait( pool );
+		pool->lock.Lock();
+		pool->quitting = true;
+		pool->lock.Unlock();
+		release_sem_etc( pool->work, pool->thread_count, 0 );
+		for( int32 i = 0; i < pool->thread_count; i++ ) {
+			status_t exitValue;
+			wait_for_thread( pool->threads[i], &exitValue );
+		}
+	}
+
+	if( pool->work >= B_OK )
+		delete_sem( pool->work );
+	if( pool->budget >= B_OK )
+		delete_sem( pool->budget );
+	delete pool;
+	return status;
+}
+
+#pragma mark ---- Other Functions ----
+
+void encoder_submit( scan_encoder_pool *pool, encoder_job *job, int32 cost )
+{
+	if( ! pool ) {
+		job->run( job );
+		return;
+	}
+
+	int32 units = cost_to_units( pool, cost );
+	while( acquire_sem_etc( pool->budget, units, 0, 0 ) == B_INTERRUPTED )
+		;
+
+	pool->lock.Lock();
+	job->next = NULL;
+	if( pool->last )
+		pool->last->next = job;
+	else
+		pool->first = job;
+	pool->last = job;
+	pool->lock.Unlock();
+	release_sem( pool->work );
+}
+
+void encoder_job_done( scan_encoder_pool *pool, int32 cost, status_t status )
+{
+	if( ! pool )
+		return;
+	if( status != B_OK ) {
+		BAutolock lock( pool->lock );
+		if( pool->error == B_OK )
+			pool->error = status;
+	}
+	release_sem_etc( pool->budget, cost_to_units( pool, cost ), 0 );
+}
+
+/* A job bigger than the whole budget gets all of it, and runs alone. */
+static int32 cost_to_units( scan_encoder_pool *pool, int32 cost )
+{
+	int32 units = ( cost + 1023 ) / 1024;
+	if( units < 1 )
+		units = 1;
+	if( units > pool->budget_size )
+		units = pool->budget_size;
+	return units;
+}
+
+static status_t encoder_thread( void *data )
+{
+	scan_encoder_pool *pool = (scan_encoder_pool *) data;
+	for( ;; ) {
+		status_t status;
+		while( ( status = acquire_sem( pool->work ) ) == B_INTERRUPTED )
+			;
+		if( status != B_OK )
+			break;
+
+		pool->lock.Lock();
+		encoder_job *job = pool->first;
+		if( job ) {
+			pool->first = job->next;
+			if( ! pool->first )
+				pool->last = NULL;
+		}
+		bool quit = ( ! job && pool->quitting );
+		pool->lock.Unlock();
+
+		if( quit )
+			break;
+		if( job )
+			job->run( job );
+	}
+	return B_OK;
+}
@@ -0,0 +1,564 @@
+/*
+	ScannerBe -- running an add-on in a host process of its own.
+	Copyright (c) 1997, Jim Moy, All Rights Reserved
+*/
+
+#include "ScanHost.h"
+
+#include <Autolock.h>
+#include <Errors.h>
+#include <Locker.h>
+#include <image.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+const bigtime_t kHostPoll = 250000;		// how often a wait checks the host is alive
+const bigtime_t kHostQuitWait = 2000000;	// before a host that won't go is killed
+
+/*	The client's end of one host. Calls are one at a time, but the ring is
+	read without the call lock, since with read-ahead that's a thread of
+	its own while the app goes on making calls. */
+struct scan_host {
+	team_id			team;			// B_ERROR if it's the server's
+	port_id			server;			// the server's port, if it is
+	port_id			request;
+	port_id			reply;
+	port_id			cancel;
+	BLocker			call_lock;
+	int32			dead;			// set once the host is found gone
+	scan_ext_hooks	ext;
+		// the open image's ring, mapped into our team
+	area_id			area;			// -1 if there's no image open
+	host_ring*		ring;
+	sem_id			full;
+	sem_id			empty;
+	int32			row_bytes;
+	int32			head;			// the slot being read
+	int32			offset;			// how far into it
+	bool			have_slot;		// taken from full, not given back yet
+	status_t		slot_status;	// what the host said about it
+	bool			ended;			// the slot with the last rows is back
+	status_t		end_status;
+};
+
+/*	Some local function prototypes. */
+static status_t host_call( scan_host *host, int32 code, const host_request *request,
+							host_reply *reply );
+static bool host_alive( scan_host *host );
+static status_t host_wait( scan_host *host, sem_id sem );
+static status_t ring_take( scan_host *host, int32 max, const void **rows,
+							int32 *count );
+static void ring_give_back( scan_host *host );
+static void ring_unmap( scan_host *host );
+static status_t host_connect( scan_host *host, port_id server, const char *path,
+							const char *name );
+static status_t host_start( scan_host *host, const char *hostPath, const char *path,
+							const char *name );
+static void host_disconnect( scan_host *host );
+
+static status_t hook_open( scan_version *version, void **cookie );
+static status_t hook_close( void *cookie );
+static status_t hook_get_capabilities( void *cookie, scan_settings_mask *mask );
+static status_t hook_get_setting( void *cookie, const scan_setting_id id,
+							const scan_setting_kind kind, scan_value *value );
+static status_t hook_put_setting( void *cookie, const scan_setting_id id,
+							scan_value *value, scan_settings_mask *mask );
+static status_t hook_open_image( void *cookie );
+static status_t hook_close_image( void *cookie );
+static status_t hook_start( void *cookie );
+static status_t hook_data( void *cookie, void *buffer, int32 *count );
+static bool hook_adf_ready( void *cookie );
+static void hook_error_message( void *cookie, status_t err, char *msg );
+static status_t hook_acquire_data( void *cookie, const void **rows, int32 *count );
+static status_t hook_release_data( void *cookie, const void *rows );
+static status_t hook_get_settings( void *cookie, scan_settings *current,
+							scan_settings *minimum, scan_settings *maximum );
+static status_t hook_put_settings( void *cookie, scan_settings *settings,
+							scan_settings_mask *mask );
+static void hook_cancel( void *cookie );
+static status_t hook_get_transfer_info( void *cookie, scan_transfer_info *info );
+
+static scan_hooks gHostHooks = {
+	hook_open,
+	hook_close,
+	hook_get_capabilities,
+	hook_get_setting,
+	hook_put_setting,
+	hook_open_image,
+	hook_close_image,
+	hook_start,
+	hook_data,
+	hook_adf_ready,
+	hook_error_message
+};
+
+#pragma mark ---- Public Functions ----
+
+bool host_wanted()
+{
+	const char *path = getenv( kHostEnvVar );
+	if( path && *path )
+		return true;
+	const char *server = getenv( kServerEnvVar );
+	if( server && strcmp( server, "0" ) == 0 )
+		return false;
+	return find_port( kServerPortName ) >= B_OK;
+}
+
+
+status_t host_launch( const char *path, const char *name, scan_host **host )
+{
+	if( ! host )
+		return SCAN_BAD_PARAM;
+	*host = NULL;
+	if( ! path || ! name )
+		return SCAN_BAD_PARAM;
+	const char *hostPath = getenv( kHostEnvVar );
+	const char *useServer = getenv( kServerEnvVar );
+	port_id server = B_NAME_NOT_FOUND;
+	if( ! useServer || strcmp( useServer, "0" ) != 0 )
+		server = find_port( kServerPortName );
+	if( server < B_OK && ( ! hostPath || ! *hostPath ) )
+		return SCAN_BAD_PARAM;
+
+	scan_host *h = new scan_host;
+	h->team = B_ERROR;
+	h->server = B_ERROR;
+	h->request = create_port( 1, "scan host request" );
+	h->reply = create_port( 1, "scan host reply" );
+	h->cancel = create_port( 4, "scan host cancel" );
+	h->dead = 0;
+	memset( &h->ext, 0, sizeof( h->ext ) );
+	h->area = -1;
+	h->ring = NULL;
+	if( h->request < B_OK || h->reply < B_OK || h->cancel < B_OK ) {
+		host_disconnect( h );
+		return B_NO_MORE_PORTS;
+	}
+
+	status_t status = server >= B_OK ? host_connect( h, server, path, name )
+									: host_start( h, hostPath, path, name );
+	if( status != B_OK ) {
+		host_disconnect( h );
+		return status;
+	}
+	*host = h;
+	return B_OK;
+}
+
+
+scan_hooks* host_hooks()
+{
+	return &gHostHooks;
+}
+
+
+scan_ext_hooks* host_ext_hooks( scan_host *host )
+{
+	return &host->ext;
+}
+
+#pragma mark ---- Hooks ----
+
+/* cookie comes in holding the scan_host, from host_launch(). */
+static status_t hook_open( scan_version *version, void **cookie )
+{
+	scan_host *host = (scan_host *) *cookie;
+	host_reply reply;
+	status_t status = host_call( host, kHostOpen, NULL, &reply );
+	if( status != B_OK ) {
+		host_disconnect( host );
+		*cookie = NULL;
+		return status;
+	}
+	*version = reply.version;
+
+	scan_ext_hooks *ext = &host->ext;
+	ext->acquire_data = hook_acquire_data;
+	ext->release_data = hook_release_data;
+	if( reply.hooks & kHostHasGetSettings )
+		ext->get_settings = hook_get_settings;
+	if( reply.hooks & kHostHasPutSettings )
+		ext->put_settings = hook_put_settings;
+	ext->cancel = hook_cancel;
+	ext->get_transfer_info = hook_get_transfer_info;
+	ext->size = sizeof( scan_ext_hooks );
+	return B_OK;
+}
+
+static status_t hook_close( void *cookie )
+{
+	scan_host *host = (scan_host *) cookie;
+	host_reply reply;
+	status_t status = host_call( host, kHostClose, NULL, &reply );
+	if( atomic_get( &host->dead ) )
+		status = B_OK;			// nothing left to close
+	host_disconnect( host );
+	return status;
+}
+
+static status_t hook_get_capabilities( void *cookie, scan_settings_mask *mask )
+{
+	host_reply reply;
+	status_t status = host_call( (scan_host *) cookie, kHostGetCapabilities,
+								NULL, &reply );
+	if( status == B_OK )
+		*mask = reply.mask;
+	return status;
+}
+
+/* Tonemaps and scanner-specific settings are pointers, which mean nothing
+	in the host; it leaves tonemaps out of its capabilities for libscanbe
+	to do them. */
+static status_t hook_get_setting( void *cookie, const scan_setting_id id,
+							const scan_setting_kind kind, scan_value *value )
+{
+	if( id & kHostLocalSettings )
+		return SCAN_BAD_PARAM;
+	host_request request;
+	request.setting = id;
+	request.kind = kind;
+	host_reply reply;
+	status_t status = host_call( (scan_host *) cookie, kHostGetSetting,
+								&request, &reply );
+	if( status == B_OK )
+		*value = reply.value;
+	return status;
+}
+
+static status_t hook_put_setting( void *cookie, const scan_setting_id id,
+							scan_value *value, scan_settings_mask *mask )
+{
+	if( id & kHostLocalSettings )
+		return SCAN_BAD_PARAM;
+	host_request request;
+	request.setting = id;
+	request.value = *value;
+	host_reply reply;
+	status_t status = host_call( (scan_host *) cookie, kHostPutSetting,
+								&request, &reply );
+	if( status == B_OK ) {
+		*value = reply.value;
+		if( mask )
+			*mask = reply.mask;
+	}
+	return status;
+}
+
+static status_t hook_open_image( void *cookie )
+{
+	scan_host *host = (scan_host *) cookie;
+	host_reply reply;
+	status_t status = host_call( host, kHostOpenImage, NULL, &reply );
+	if( status != B_OK )
+		return status;
+
+	void *address;
+	host->area = clone_area( "scan host ring", &address, B_ANY_ADDRESS,
+							B_READ_AREA, reply.ring.area );
+	if( host->area < B_OK ) {
+		host_call( host, kHostCloseImage, NULL, &reply );
+		return host->area;
+	}
+	host->ring = (host_ring *) address;
+	host->full = reply.ring.full;
+	host->empty = reply.ring.empty;
+	host->row_bytes = reply.ring.row_bytes;
+	host->head = 0;
+	host->offset = 0;
+	host->have_slot = false;
+	host->ended = false;
+	return B_OK;
+}
+
+static status_t hook_close_image( void *cookie )
+{
+	scan_host *host = (scan_host *) cookie;
+	host_reply reply;
+	status_t status = host_call( host, kHostCloseImage, NULL, &reply );
+	if( atomic_get( &host->dead ) )
+		status = B_OK;
+	ring_unmap( host );
+	return status;
+}
+
+static status_t hook_start( void *cookie )
+{
+	host_reply reply;
+	return host_call( (scan_host *) cookie, kHostStart, NULL, &reply );
+}
+
+/* Copies out of as many slots as it takes. */
+static status_t hook_data( void *cookie, void *buffer, int32 *count )
+{
+	scan_host *host = (scan_host *) cookie;
+	int32 want = *count;
+	int32 got = 0;
+	status_t status = B_OK;
+	while( got < want && status == B_OK ) {
+		const void *rows;
+		int32 n;
+		status = ring_take( host, want - got, &rows, &n );
+		if( n > 0 )
+			memcpy( (char *) buffer + got, rows, n );
+		got += n;
+		ring_give_back( host );
+	}
+	*count = got;
+	return status;
+}
+
+static bool hook_adf_ready( void *cookie )
+{
+	host_reply reply;
+	if( host_call( (scan_host *) cookie, kHostAdfReady, NULL, &reply ) != B_OK )
+		return false;
+	return reply.ready;
+}
+
+static void hook_error_message( void *cookie, status_t err, char *msg )
+{
+	host_request request;
+	request.error = err;
+	host_reply reply;
+	if( host_call( (scan_host *) cookie, kHostErrorMessage, &request, &reply ) == B_OK )
+		strcpy( msg, reply.message );
+	else
+		sprintf( msg, "The scanner's host has quit (error %ld)", err );
+}
+
+/* Lends straight out of the slot, no more than what's left in it. */
+static status_t hook_acquire_data( void *cookie, const void **rows, int32 *count )
+{
+	scan_host *host = (scan_host *) cookie;
+	int32 max = *count;
+	if( max > 0 && host->row_bytes > 0 )
+		max = max < host->row_bytes ? host->row_bytes : max - max % host->row_bytes;
+	return ring_take( host, max, rows, count );
+}
+
+static status_t hook_release_data( void *cookie, const void * )
+{
+	ring_give_back( (scan_host *) cookie );
+	return B_OK;
+}
+
+static status_t hook_get_settings( void *cookie, scan_settings *current,
+							scan_settings *minimum, scan_settings *maximum )
+{
+	host_request request;
+	request.want[0] = current != NULL;
+	request.want[1] = minimum != NULL;
+	request.want[2] = maximum != NULL;
+	host_reply reply;
+	status_t status = host_call( (scan_host *) cookie, kHostGetSettings,
+								&request, &reply );
+	if( status != B_OK )
+		return status;
+	if( current )
+		*current = reply.settings[0];
+	if( minimum )
+		*minimum = reply.settings[1];
+	if( maximum )
+		*maximum = reply.settings[2];
+	return B_OK;
+}
+
+static status_t hook_put_settings( void *cookie, scan_settings *settings,
+							scan_settings_mask *mask )
+{
+	host_request request;
+	request.settings = *settings;
+	host_reply reply;
+	status_t status = host_call( (scan_host *) cookie, kHostPutSettings,
+								&request, &reply );
+	if( status == B_OK ) {
+		*settings = reply.settings[0];
+		if( mask )
+			*mask = reply.mask;
+	}
+	return status;
+}
+
+/* Mustn't wait, so if the port's full there's a cancel in it already. */
+static void hook_cancel( void *cookie )
+{
+	scan_host *host = (scan_host *) cookie;
+	write_port_etc( host->cancel, kHostCancel, NULL, 0, B_RELATIVE_TIMEOUT, 0 );
+}
+
+static status_t hook_get_transfer_info( void *cookie, scan_transfer_info *info )
+{
+	host_request request;
+	request.transfer = *info;
+	host_reply reply;
+	status_t status = host_call( (scan_host *) cookie, kHostGetTransferInfo,
+								&request, &reply );
+	if( status == B_OK )
+		*info = reply.transfer;
+	return status;
+}
+
+#pragma mark ---- Other Functions ----
+
+/* One call over to the host and its answer, or SCAN_ADDON_ERROR if it's gone. */
+static status_t host_call( scan_host *host, int32 code, const host_request *request,
+							host_reply *reply )
+{
+	BAutolock lock( host->call_lock );
+	if( atomic_get( &host->dead ) )
+		return SCAN_ADDON_ERROR;
+	status_t status = write_port( host->request, code, request,
+								request ? sizeof( host_request ) : 0 );
+	if( status != B_OK )
+		return SCAN_ADDON_ERROR;
+	for( ;; ) {
+		int32 replyCode;
+		ssize_t size = read_port_etc( host->reply, &replyCode, reply,
+								sizeof( host_reply ), B_RELATIVE_TIMEOUT, kHostPoll );
+		if( size == B_TIMED_OUT && host_alive( host ) )
+			continue;
+		if( size != (ssize_t) sizeof( host_reply ) || replyCode != code ) {
+			atomic_set( &host->dead, 1 );
+			return SCAN_ADDON_ERROR;
+		}
+		return reply->status;
+	}
+}
+
+static bool host_alive( scan_host *host )
+{
+	team_info info;
+	port_info serverInfo;
+	if( host->team >= B_OK ? get_team_info( host->team, &info ) == B_OK
+						: get_port_info( host->server, &serverInfo ) == B_OK )
+		return true;
+	atomic_set( &host->dead, 1 );
+	return false;
+}
+
+static status_t host_wait( scan_host *host, sem_id sem )
+{
+	for( ;; ) {
+		status_t status = acquire_sem_etc( sem, 1, B_RELATIVE_TIMEOUT, kHostPoll );
+		if( status == B_OK )
+			return B_OK;
+		if( status != B_TIMED_OUT || ! host_alive( host ) )
+			return SCAN_ADDON_ERROR;
+	}
+}
+
+/*	Points rows at up to max bytes of the current slot (the rest of it if
+	max is 0), waiting for the host to fill one if need be. The slot's own
+	status comes back with its last rows. */
+static status_t ring_take( scan_host *host, int32 max, const void **rows,
+							int32 *count )
+{
+	*rows = NULL;
+	*count = 0;
+	if( ! host->ring )
+		return SCAN_BAD_PHASE;
+	if( host->ended )
+		return host->end_status;
+	if( ! host->have_slot ) {
+		status_t status = host_wait( host, host->full );
+		if( status != B_OK )
+			return status;
+		host->have_slot = true;
+		host->offset = 0;
+		host->slot_status = host->ring->slot[host->head].status;
+	}
+
+	int32 left = host->ring->slot[host->head].count - host->offset;
+	int32 n = ( max > 0 && max < left ) ? max : left;
+	*rows = host_slot_data( host->ring, host->head ) + host->offset;
+	*count = n;
+	host->offset += n;
+	return n == left ? host->slot_status : B_OK;
+}
+
+/* Hands the slot back to the host once it's all been taken. */
+static void ring_give_back( scan_host *host )
+{
+	if( ! host->have_slot || host->offset < host->ring->slot[host->head].count )
+		return;
+	host->have_slot = false;
+	host->head = ( host->head + 1 ) % host->ring->slots;
+	if( host->slot_status != B_OK ) {
+		// the host has stopped filling
+		host->ended = true;
+		host->end_status = host->slot_status;
+	} else
+		release_sem( host->empty );
+}
+
+static void ring_unmap( scan_host *host )
+{
+	if( host->area >= B_OK )
+		delete_area( host->area );
+	host->area = -1;
+	host->ring = NULL;
+}
+
+/*	Hands the session's ports to the server, which serves it on a thread
+	of its own from then on. */
+static status_t host_connect( scan_host *host, port_id server, const char *path,
+							const char *name )
+{
+	host_connect_info info;
+	if( strlen( path ) >= sizeof( info.path ) || strlen( name ) >= sizeof( info.name ) )
+		return B_NAME_TOO_LONG;
+	memset( &info, 0, sizeof( info ) );
+	info.request = host->request;
+	info.reply = host->reply;
+	info.cancel = host->cancel;
+	strcpy( info.name, name );
+	strcpy( info.path, path );
+	status_t status = write_port_etc( server, kHostConnect, &info, sizeof( info ),
+									B_RELATIVE_TIMEOUT, kHostQuitWait );
+	if( status != B_OK )
+		return status;
+	host->server = server;
+	return B_OK;
+}
+
+static status_t host_start( scan_host *host, const char *hostPath, const char *path,
+							const char *name )
+{
+	char ports[3][16];
+	sprintf( ports[0], "%ld", host->request );
+	sprintf( ports[1], "%ld", host->reply );
+	sprintf( ports[2], "%ld", host->cancel );
+	const char *argv[] = { hostPath, path, name, ports[0], ports[1], ports[2] };
+	host->team = load_image( 6, argv, (const char **) environ );
+	if( host->team < B_OK )
+		return host->team;
+	resume_thread( host->team );
+	return B_OK;
+}
+
+/*	Deleting the ports tells a host, or the server's thread for the
+	session, that's still waiting for calls to quit; a host of our own
+	that doesn't within a while is killed. */
+static void host_disconnect( scan_host *host )
+{
+	ring_unmap( host );
+	if( host->request >= B_OK )
+		delete_port( host->request );
+	if( host->reply >= B_OK )
+		delete_port( host->reply );
+	if( host->cancel >= B_OK )
+		delete_port( host->cancel );
+	if( host->team >= B_OK ) {
+		team_info info;
+		bigtime_t giveUp = system_time() + kHostQuitWait;
+		while( get_team_info( host->team, &info ) == B_OK && system_time() < giveUp )
+			snooze( 1000 );
+		kill_team( host->team );
+		status_t exitValue;
+		wait_for_thread( host->team, &exitValue );
+	}
+	delete host;
+}
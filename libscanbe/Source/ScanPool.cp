@@ -0,0 +1,189 @@
+/*
+	ScannerBe -- reusable page buffers for multi-page sessions.
+	Copyright (c) 1997, Jim Moy, All Rights Reserved
+*/
+
+#include "ScanPool.h"
+
+#include <Autolock.h>
+#include <Errors.h>
+#include <Locker.h>
+
+const int32 kDefaultKeep = 4;
+const int32 kRowAlignment = 64;			// a cache line
+
+/*	Pages that are in the pool are on the free list, most recently put
+	back first; the ones that are out are only counted. A page's record
+	is the scan_page the caller sees, so putting it back finds it without
+	a search. */
+struct pool_page {
+	scan_page		page;				// first, see scan_page_pool_put()
+	pool_page*		next;
+};
+
+struct scan_page_pool {
+	BLocker			lock;
+	pool_page*		free;
+	int32			free_count;
+	int32			keep;
+	int32			out;
+};
+
+/*	Some local function prototypes. */
+static int32 page_row_bytes( const scan_settings *settings,
+							scan_pixel_format format );
+static pool_page* new_page( int32 width, int32 height, int32 rowBytes,
+							scan_pixel_format format );
+static void delete_page( pool_page *p );
+
+#pragma mark ---- Public Functions ----
+
+status_t scan_page_pool_create( int32 keep, scan_page_pool **pool )
+{
+	if( ! pool )
+		return SCAN_BAD_PARAM;
+	*pool = NULL;
+	if( keep < 0 )
+		return SCAN_BAD_PARAM;
+
+	scan_page_pool *p = new scan_page_pool;
+	p->free = NULL;
+	p->free_count = 0;
+	p->keep = keep > 0 ? keep : kDefaultKeep;
+	p->out = 0;
+	*pool = p;
+	return B_OK;
+}
+
+
+status_t scan_page_pool_get( scan_page_pool *pool, const scan_settings *settings,
+						scan_pixel_format format, scan_page **page )
+{
+	if( ! page )
+		return SCAN_BAD_PARAM;
+	*page = NULL;
+	if( ! pool || ! settings || settings->pixel_width == 0
+			|| settings->pixel_height == 0 )
+		return SCAN_BAD_PARAM;
+	int32 rowBytes = page_row_bytes( settings, format );
+	if( rowBytes == 0 )
+		return SCAN_BAD_PARAM;
+	int32 width = settings->pixel_width;
+	int32 height = settings->pixel_height;
+
+	{
+		BAutolock lock( pool->lock );
+		for( pool_page **prev = &pool->free; *prev; prev = &(*prev)->next ) {
+			pool_page *p = *prev;
+			if( p->page.width == width && p->page.height == height
+					&& p->page.bytes_per_row == rowBytes && p->page.format == format ) {
+				*prev = p->next;
+				pool->free_count--;
+				pool->out++;
+				*page = &p->page;
+				return B_OK;
+			}
+		}
+	}
+
+	// none to reuse, so make one without holding up the other threads
+	pool_page *p = new_page( width, height, rowBytes, format );
+	if( ! p )
+		return B_NO_MEMORY;
+	BAutolock lock( pool->lock );
+	pool->out++;
+	*page = &p->page;
+	return B_OK;
+}
+
+
+status_t scan_page_pool_put( scan_page_pool *pool, scan_page *page )
+{
+	if( ! pool || ! page )
+		return SCAN_BAD_PARAM;
+	pool_page *p = (pool_page *) page;
+	pool_page *gone = NULL;
+	{
+		BAutolock lock( pool->lock );
+		if( pool->out == 0 )
+			return SCAN_BAD_PARAM;
+		pool->out--;
+		p->next = pool->free;
+		pool->free = p;
+		if( ++pool->free_count > pool->keep ) {
+			// let the oldest go
+			pool_page **prev = &pool->free;
+			while( (*prev)->next )
+				prev = &(*prev)->next;
+			gone = *prev;
+			*prev = NULL;
+			pool->free_count--;
+		}
+	}
+	if( gone )
+		delete_page( gone );
+	return B_OK;
+}
+
+
+status_t scan_page_pool_delete( scan_page_pool *pool )
+{
+	if( ! pool )
+		return SCAN_BAD_PARAM;
+	if( pool->out > 0 )
+		return SCAN_BAD_PHASE;
+	while( pool->free ) {
+		pool_page *p = pool->free;
+		pool->free = p->next;
+		delete_page( p );
+	}
+	delete pool;
+	return B_OK;
+}
+
+#pragma mark ---- Other Functions ----
+
+static int32 page_row_bytes( const scan_settings *settings,
+							scan_pixel_format format )
+{
+	int32 width = settings->pixel_width;
+	bool rgb = ( settings->image_type == SCAN_TYPE_RGB );
+	int32 bytes;
+	switch( format ) {
+	case SCAN_PIXEL_SCANNED:	return settings->row_bytes;
+	case SCAN_PIXEL_BGRA32:		bytes = width * 4; break;
+	case SCAN_PIXEL_RGB24:		bytes = rgb ? width * 3 : 0; break;
+	case SCAN_PIXEL_GRAY8:		bytes = rgb ? 0 : width; break;
+	default:					return 0;
+	}
+	return ( bytes + kRowAlignment - 1 ) & ~( kRowAlignment - 1 );
+}
+
+static pool_page* new_page( int32 width, int32 height, int32 rowBytes,
+							scan_pixel_format format )
+{
+	size_t size = (size_t) rowBytes * height;
+	size = ( size + B_PAGE_SIZE - 1 ) & ~( (size_t) B_PAGE_SIZE - 1 );
+	void *bits;
+	area_id area = create_area( "scan page", &bits, B_ANY_ADDRESS, size,
+								B_FULL_LOCK, B_READ_AREA | B_WRITE_AREA );
+	if( area < B_OK )
+		return NULL;
+
+	pool_page *p = new pool_page;
+	p->page.bits = bits;
+	p->page.bytes_per_row = rowBytes;
+	p->page.width = width;
+	p->page.height = height;
+	p->page.format = format;
+	p->page.size = size;
+	p->page.area = area;
+	p->next = NULL;
+	return p;
+}
+
+static void delete_page( pool_page *p )
+{
+	delete_area( p->page.area );
+	delete p;
+}
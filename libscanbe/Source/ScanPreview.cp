@@ -0,0 +1,319 @@
+/*
+	ScannerBe -- progressive low-resolution previews.
+	Copyright (c) 1997, Jim Moy, All Rights Reserved
+*/
+
+#include "ScanPreview.h"
+#include "ScanConvert.h"
+
+#include <Errors.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+const int32 kDefaultUpdateRows = 16;
+
+/*	The scanned rows are summed into one box row at a time; when factor
+	of them are in, it's averaged into the next preview row, and those
+	wait in out until there are update_rows of them for the sink. */
+struct scan_preview {
+	scan_preview_info	info;
+	scan_preview_sink	sink;
+	int32				channels;		// 1 or 3
+	int32				in_width;		// scanned pixels
+	int32				in_row_bytes;
+	uint32				pixel_bits;
+	int32				update_rows;
+	uint8*				samples;		// a scanned row at 8 bits, if it isn't
+	uint32*				sums;			// one per preview sample
+	int32				box_rows;		// scanned rows in sums
+	uint8*				out;
+	int32				out_rows;		// preview rows waiting in out
+	int32				first_row;		// of out
+	status_t			status;			// first error from the sink
+};
+
+/*	Some local function prototypes. */
+static const uint8* row_samples( scan_preview *p, const uint8 *row );
+static void add_row( scan_preview *p, const uint8 *s );
+static void end_box( scan_preview *p );
+static void put_row( scan_preview *p, const uint8 *s );
+static status_t flush_rows( scan_preview *p );
+static void free_preview( scan_preview *p );
+static status_t preview_image( const scan_id id, int32 max_width,
+								int32 update_rows, const scan_preview_sink *sink );
+
+#pragma mark ---- Public Functions ----
+
+status_t scan_preview_open( const scan_settings *settings, int32 max_width,
+							int32 update_rows, const scan_preview_sink *sink,
+							scan_preview **preview )
+{
+	if( ! preview )
+		return SCAN_BAD_PARAM;
+	*preview = NULL;
+	if( ! settings || ! sink || ! sink->begin || ! sink->rows
+			|| max_width < 0 || update_rows < 0 )
+		return SCAN_BAD_PARAM;
+
+	int32 channels;
+	uint32 bits = settings->pixel_bits;
+	if( settings->image_type == SCAN_TYPE_BINARY && bits == 1 )
+		channels = 1;
+	else if( settings->image_type == SCAN_TYPE_GRAY && ( bits == 8 || bits == 16 ) )
+		channels = 1;
+	else if( settings->image_type == SCAN_TYPE_RGB && ( bits == 24 || bits == 48 ) )
+		channels = 3;
+	else
+		return SCAN_BAD_PARAM;
+	int32 width = settings->pixel_width;
+	if( width == 0 || settings->row_bytes < ( width * bits + 7 ) / 8 )
+		return SCAN_BAD_PARAM;
+
+	int32 factor = 1;
+	if( max_width > 0 && width > max_width )
+		factor = ( width + max_width - 1 ) / max_width;
+
+	scan_preview *p = new scan_preview;
+	p->info.image_type = channels == 3 ? SCAN_TYPE_RGB : SCAN_TYPE_GRAY;
+	p->info.width = ( width + factor - 1 ) / factor;
+	p->info.height = ( settings->pixel_height + factor - 1 ) / factor;
+	p->info.row_bytes = p->info.width * channels;
+	p->info.factor = factor;
+	p->info.settings = *settings;
+	p->sink = *sink;
+	p->channels = channels;
+	p->in_width = width;
+	p->in_row_bytes = settings->row_bytes;
+	p->pixel_bits = bits;
+	p->update_rows = update_rows > 0 ? update_rows : kDefaultUpdateRows;
+	p->samples = ( bits == 8 || bits == 24 ) ? NULL : new uint8[ width * channels ];
+	p->sums = factor > 1 ? new uint32[ p->info.row_bytes ] : NULL;
+	if( p->sums )
+		memset( p->sums, 0, p->info.row_bytes * sizeof( uint32 ) );
+	p->box_rows = 0;
+	p->out = new uint8[ p->update_rows * p->info.row_bytes ];
+	p->out_rows = 0;
+	p->first_row = 0;
+	p->status = B_OK;
+
+	status_t status = sink->begin( sink->data, &p->info );
+	if( status != B_OK ) {
+		free_preview( p );
+		return status;
+	}
+	*preview = p;
+	return B_OK;
+}
+
+
+status_t scan_preview_write( scan_preview *preview, const void *rows,
+							int32 count )
+{
+	if( ! preview || ( count > 0 && ! rows ) || count < 0
+			|| count % preview->in_row_bytes != 0 )
+		return SCAN_BAD_PARAM;
+	scan_preview *p = preview;
+
+	const uint8 *row = (const uint8 *) rows;
+	for( int32 n = count / p->in_row_bytes; n > 0 && p->status == B_OK;
+			n--, row += p->in_row_bytes ) {
+		const uint8 *s = row_samples( p, row );
+		if( p->info.factor == 1 ) {
+			put_row( p, s );
+			continue;
+		}
+		add_row( p, s );
+		if( ++p->box_rows == p->info.factor )
+			end_box( p );
+	}
+	return p->status;
+}
+
+
+status_t scan_preview_close( scan_preview *preview )
+{
+	if( ! preview )
+		return SCAN_BAD_PARAM;
+	scan_preview *p = preview;
+
+	if( p->status == B_OK && p->box_rows > 0 )
+		end_box( p );
+	if( p->status == B_OK && p->out_rows > 0 )
+		flush_rows( p );
+	status_t status = p->status;
+	free_preview( p );
+	return status;
+}
+
+
+status_t scan_preview_pass( const scan_id id, uint32 resolution,
+							int32 max_width, int32 update_rows,
+							const scan_preview_sink *sink )
+{
+	if( ! sink || ! sink->begin || ! sink->rows || max_width < 0 || update_rows < 0 )
+		return SCAN_BAD_PARAM;
+
+	status_t status = B_OK;
+	scan_value oldRes;
+	bool changed = false;
+	scan_settings_mask caps;
+	if( resolution > 0 && scan_get_capabilities( id, &caps ) == B_OK
+			&& ( caps & SCAN_SETTING_RESOLUTION ) ) {
+		status = scan_get_one_setting( id, SCAN_SETTING_RESOLUTION,
+										SCAN_SETTING_CURRENT, &oldRes );
+		scan_value lowest;
+		if( status == B_OK && scan_get_one_setting( id, SCAN_SETTING_RESOLUTION,
+								SCAN_SETTING_MINIMUM, &lowest ) == B_OK
+				&& lowest.u_int > resolution )
+			resolution = lowest.u_int;
+		if( status == B_OK && resolution < oldRes.u_int ) {
+			scan_value value;
+			value.u_int = resolution;
+			scan_settings_mask mask;
+			status = scan_put_one_setting( id, SCAN_SETTING_RESOLUTION, &value, &mask );
+			changed = ( status == B_OK );
+		}
+		if( status != B_OK )
+			return status;
+	}
+
+	status = scan_open_image( id );
+	if( status == B_OK ) {
+		status = preview_image( id, max_width, update_rows, sink );
+		status_t closeStat = scan_close_image( id );
+		if( status == B_OK )
+			status = closeStat;
+	}
+
+	if( changed ) {
+		scan_settings_mask mask;
+		status_t putStat = scan_put_one_setting( id, SCAN_SETTING_RESOLUTION,
+												&oldRes, &mask );
+		if( status == B_OK )
+			status = putStat;
+	}
+	return status;
+}
+
+#pragma mark ---- Other Functions ----
+
+/* The row at 8 bits a sample. */
+static const uint8* row_samples( scan_preview *p, const uint8 *row )
+{
+	switch( p->pixel_bits ) {
+	case 1:
+		scan_convert_bits_to_gray8( row, p->samples, p->in_width );
+		return p->samples;
+	case 16:
+	case 48:
+		scan_convert_16_to_8( row, p->samples, p->in_width * p->channels );
+		return p->samples;
+	}
+	return row;
+}
+
+static void add_row( scan_preview *p, const uint8 *s )
+{
+	int32 factor = p->info.factor;
+	uint32 *sum = p->sums;
+	if( p->channels == 1 ) {
+		for( int32 x = 0; x < p->in_width; x += factor, sum++ ) {
+			int32 n = p->in_width - x < factor ? p->in_width - x : factor;
+			uint32 total = 0;
+			for( int32 i = 0; i < n; i++ )
+				total += *s++;
+			*sum += total;
+		}
+		return;
+	}
+	for( int32 x = 0; x < p->in_width; x += factor, sum += 3 ) {
+		int32 n = p->in_width - x < factor ? p->in_width - x : factor;
+		uint32 r = 0, g = 0, b = 0;
+		for( int32 i = 0; i < n; i++, s += 3 ) {
+			r += s[0];
+			g += s[1];
+			b += s[2];
+		}
+		sum[0] += r;
+		sum[1] += g;
+		sum[2] += b;
+	}
+}
+
+/* Averages the box row into the next preview row. The last column, and
+	the last row at the bottom, may be narrower than the rest. */
+static void end_box( scan_preview *p )
+{
+	int32 factor = p->info.factor;
+	uint8 *dst = p->out + p->out_rows * p->info.row_bytes;
+	uint32 full = factor * p->box_rows;
+	uint32 last = ( p->in_width - ( p->info.width - 1 ) * factor ) * p->box_rows;
+	int32 lastColumn = p->info.row_bytes - p->channels;
+	for( int32 i = 0; i < p->info.row_bytes; i++ ) {
+		uint32 pixels = i < lastColumn ? full : last;
+		dst[i] = (uint8) ( ( p->sums[i] + pixels / 2 ) / pixels );
+		p->sums[i] = 0;
+	}
+	p->box_rows = 0;
+	if( ++p->out_rows == p->update_rows )
+		flush_rows( p );
+}
+
+/* A scanned row that doesn't need reducing. */
+static void put_row( scan_preview *p, const uint8 *s )
+{
+	memcpy( p->out + p->out_rows * p->info.row_bytes, s, p->info.row_bytes );
+	if( ++p->out_rows == p->update_rows )
+		flush_rows( p );
+}
+
+static status_t flush_rows( scan_preview *p )
+{
+	p->status = p->sink.rows( p->sink.data, p->first_row, p->out, p->out_rows );
+	p->first_row += p->out_rows;
+	p->out_rows = 0;
+	return p->status;
+}
+
+static void free_preview( scan_preview *p )
+{
+	delete[] p->samples;
+	delete[] p->sums;
+	delete[] p->out;
+	delete p;
+}
+
+/* Reads the open image into a preview, a box row at a time so the first
+	rows show up as soon as the scanner has them. */
+static status_t preview_image( const scan_id id, int32 max_width,
+								int32 update_rows, const scan_preview_sink *sink )
+{
+	scan_settings settings;
+	status_t status = scan_get_settings( id, &settings, NULL, NULL );
+	if( status != B_OK )
+		return status;
+
+	scan_preview *preview;
+	status = scan_preview_open( &settings, max_width, update_rows, sink, &preview );
+	if( status != B_OK )
+		return status;
+
+	int32 want = settings.row_bytes * preview->info.factor;
+	while( status == B_OK ) {
+		const void *rows;
+		int32 count = want;
+		status = scan_data_ex( id, &rows, &count );
+		if( ( status == B_OK || status == SCAN_DATA_END ) && rows ) {
+			status_t writeStat = scan_preview_write( preview, rows, count );
+			scan_release_data( id, rows );
+			if( writeStat != B_OK )
+				status = writeStat;
+		}
+	}
+	if( status == SCAN_DATA_END )
+		status = B_OK;
+
+	status_t closeStat = scan_preview_close( preview );
+	return status != B_OK ? status : closeStat;
+}
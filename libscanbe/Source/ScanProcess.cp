@@ -0,0 +1,424 @@
+/*
+	ScannerBe -- row processing, internal to libscanbe.
+	Copyright (c) 1997, Jim Moy, All Rights Reserved
+*/
+
+#include "ScanProcess.h"
+#include "ScanConvert.h"
+#include "ScanEncoder.h"
+
+#include <OS.h>
+#include <Errors.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*	Bands are only split when each thread gets at least this much; below
+	it, handing the work out costs more than the lookups. */
+const int32 kMinSlice = 32 * 1024L;
+const int32 kMaxSlices = 16;
+const int32 kMaxTonemapSize = 65536;
+
+struct process_slice {
+	encoder_job		job;			// first, it's all the pool sees
+	scan_processor*	processor;
+	uint8*			rows;
+	int32			count;			// rows
+};
+
+struct scan_processor {
+	scan_process		process;
+	bool				enabled;		// process was set
+	int32*				tonemap;		// as put, count first
+	int32*				tonemap3;
+	scan_encoder_pool*	pool;			// to split bands over, NULL for none
+	int32				threads;
+	sem_id				slices_done;
+
+									// for the open image
+	bool				active;
+	bool				use_luts;
+	bool				despeckle;
+	int32				channels;		// 1 or 3
+	int32				sample_bytes;	// 1, or 2 for 16-bit samples
+	int32				width;
+	int32				row_bytes;
+	uint8				luts[3 * 256];
+	uint16*				luts16;			// 3 tables of 65536, made for 16 bits
+	uint8*				above;			// the row before, as it was thresholded
+	uint8*				row_copy;
+	bool				have_above;
+	uint8*				held;			// a band's last row, waiting for the next
+	uint8*				spare;			// row_bytes, to swap with held
+	bool				have_held;
+	bool				ended;			// no more bands, but a row's still held
+};
+
+/*	Some local function prototypes. */
+static void build_luts( scan_processor *p );
+static const int32* channel_map( scan_processor *p, int32 channel,
+							int32 *size );
+static void lut_rows( scan_processor *p, uint8 *rows, int32 count );
+static void run_slice( encoder_job *job );
+static void despeckle_rows( scan_processor *p, uint8 *rows, int32 count,
+							const uint8 *after );
+
+#pragma mark ---- Processor ----
+
+scan_processor* processor_create()
+{
+	scan_processor *p = new scan_processor;
+	memset( &p->process, 0, sizeof( p->process ) );
+	p->enabled = false;
+	p->tonemap = p->tonemap3 = NULL;
+	p->pool = NULL;
+	p->threads = 1;
+	p->slices_done = create_sem( 0, "scan process slices" );
+	p->active = false;
+	p->use_luts = p->despeckle = false;
+	p->channels = p->sample_bytes = 1;
+	p->width = p->row_bytes = 0;
+	p->luts16 = NULL;
+	p->above = p->row_copy = NULL;
+	p->have_above = false;
+	p->held = p->spare = NULL;
+	p->have_held = p->ended = false;
+	return p;
+}
+
+void processor_delete( scan_processor *p )
+{
+	if( ! p )
+		return;
+	if( p->pool )
+		scan_encoder_pool_delete( p->pool );
+	if( p->slices_done >= B_OK )
+		delete_sem( p->slices_done );
+	free( p->tonemap );
+	free( p->tonemap3 );
+	delete[] p->luts16;
+	delete[] p->above;
+	delete[] p->row_copy;
+	delete[] p->held;
+	delete[] p->spare;
+	delete p;
+}
+
+status_t processor_set( scan_processor *p, const scan_process *process )
+{
+	if( ! process ) {
+		p->enabled = false;
+		return B_OK;
+	}
+	if( process->size < (int32) sizeof( scan_process )
+			|| process->black < 0 || process->white > 255
+			|| process->black >= process->white || process->gamma < 0
+			|| process->threshold < 0 || process->threshold > 255
+			|| process->threads < 0 )
+		return SCAN_BAD_PARAM;
+
+	int32 threads = process->threads;
+	if( threads == 0 ) {
+		system_info info;
+		threads = get_system_info( &info ) == B_OK ? info.cpu_count : 1;
+	}
+	if( threads > kMaxSlices )
+		threads = kMaxSlices;
+	if( threads != p->threads ) {
+		if( p->pool )
+			scan_encoder_pool_delete( p->pool );
+		p->pool = NULL;
+		if( threads > 1 && p->slices_done >= B_OK
+				&& scan_encoder_pool_create( threads - 1, 0, &p->pool ) != B_OK )
+			p->pool = NULL;
+		p->threads = p->pool ? threads : 1;
+	}
+
+	p->process = *process;
+	p->enabled = true;
+	return B_OK;
+}
+
+status_t processor_set_tonemap( scan_processor *p, scan_setting_id which,
+							const int32 *map )
+{
+	int32 **slot = ( which == SCAN_SETTING_TONEMAP3 ) ? &p->tonemap3 : &p->tonemap;
+	if( ! map ) {
+		free( *slot );
+		*slot = NULL;
+		return B_OK;
+	}
+	if( map[0] < 2 || map[0] > kMaxTonemapSize )
+		return SCAN_BAD_PARAM;
+
+	int32 values = map[0] * ( which == SCAN_SETTING_TONEMAP3 ? 3 : 1 );
+	int32 *copy = (int32 *) malloc( ( values + 1 ) * sizeof( int32 ) );
+	if( ! copy )
+		return B_NO_MEMORY;
+	memcpy( copy, map, ( values + 1 ) * sizeof( int32 ) );
+	free( *slot );
+	*slot = copy;
+	return B_OK;
+}
+
+const int32* processor_tonemap( scan_processor *p, scan_setting_id which )
+{
+	return ( which == SCAN_SETTING_TONEMAP3 ) ? p->tonemap3 : p->tonemap;
+}
+
+bool processor_handles( scan_type type, uint32 pixelBits )
+{
+	return ( type == SCAN_TYPE_GRAY && ( pixelBits == 8 || pixelBits == 16 ) )
+		|| ( type == SCAN_TYPE_RGB && ( pixelBits == 24 || pixelBits == 48 ) );
+}
+
+bool processor_begin_image( scan_processor *p, const scan_settings *settings )
+{
+	p->active = false;
+	if( ! processor_handles( settings->image_type, settings->pixel_bits ) )
+		return false;
+	p->channels = ( settings->image_type == SCAN_TYPE_RGB ) ? 3 : 1;
+	p->sample_bytes = settings->pixel_bits / ( p->channels * 8 );
+	if( settings->pixel_width == 0 || settings->row_bytes
+			< settings->pixel_width * p->channels * p->sample_bytes )
+		return false;
+
+	p->width = settings->pixel_width;
+	p->row_bytes = settings->row_bytes;
+	if( p->sample_bytes == 2 && ! p->luts16 )
+		p->luts16 = new uint16[ 3 * 65536 ];
+	build_luts( p );
+	p->despeckle = p->enabled && p->process.despeckle && p->process.threshold > 0
+					&& p->channels == 1 && p->sample_bytes == 1;
+	p->have_held = p->ended = false;
+	if( p->despeckle ) {
+		delete[] p->above;
+		delete[] p->row_copy;
+		delete[] p->held;
+		delete[] p->spare;
+		p->above = new uint8[ p->width ];
+		p->row_copy = new uint8[ p->width ];
+		p->held = new uint8[ p->row_bytes ];
+		p->spare = new uint8[ p->row_bytes ];
+		p->have_above = false;
+	}
+	p->active = p->use_luts || p->despeckle;
+	return p->active;
+}
+
+/*	The lookups don't depend on other rows, so a big band is cut into
+	slices of rows for the pool, with this thread doing the first. The
+	despeckling does, and runs over the whole band afterwards, each row
+	moved down one behind the row held back from the band before. */
+int32 processor_run( scan_processor *p, void *data, int32 count, int32 room,
+					bool last )
+{
+	if( ! p->active || count < 0 )
+		return count;
+	uint8 *rows = (uint8 *) data;
+	int32 rowCount = count / p->row_bytes;
+
+	if( p->use_luts && rowCount > 0 ) {
+		int32 slices = p->pool ? count / kMinSlice : 1;
+		if( slices > p->threads )
+			slices = p->threads;
+		if( slices > rowCount )
+			slices = rowCount;
+		if( slices > 1 ) {
+			process_slice slice[kMaxSlices];
+			uint8 *r = rows;
+			for( int32 i = 0; i < slices; i++ ) {
+				slice[i].job.run = run_slice;
+				slice[i].processor = p;
+				slice[i].rows = r;
+				slice[i].count = rowCount / slices + ( i < rowCount % slices ? 1 : 0 );
+				r += slice[i].count * p->row_bytes;
+				if( i > 0 )
+					encoder_submit( p->pool, &slice[i].job, 0 );
+			}
+			lut_rows( p, slice[0].rows, slice[0].count );
+			while( acquire_sem_etc( p->slices_done, slices - 1, 0, 0 ) == B_INTERRUPTED )
+				;
+		} else
+			lut_rows( p, rows, rowCount );
+	}
+	if( ! p->despeckle )
+		return count;
+
+	int32 rowBytes = p->row_bytes;
+	int32 ready = 0;
+	if( rowCount > 0 ) {
+		uint8 *lastRow = rows + ( rowCount - 1 ) * rowBytes;
+		if( p->have_held ) {
+			memcpy( p->spare, lastRow, rowBytes );
+			memmove( rows + rowBytes, rows, ( rowCount - 1 ) * rowBytes );
+			memcpy( rows, p->held, rowBytes );
+			uint8 *t = p->held;
+			p->held = p->spare;
+			p->spare = t;
+			ready = rowCount;
+		} else {
+			memcpy( p->held, lastRow, rowBytes );
+			p->have_held = true;
+			ready = rowCount - 1;
+		}
+		despeckle_rows( p, rows, ready, p->held );
+	}
+	ready *= rowBytes;
+	if( last && p->have_held ) {
+		if( ready + rowBytes <= room )
+			ready += processor_flush( p, rows + ready );
+		else
+			p->ended = true;
+	}
+	return ready;
+}
+
+bool processor_holding_end( scan_processor *p )
+{
+	return p->ended;
+}
+
+int32 processor_flush( scan_processor *p, void *data )
+{
+	if( ! p->have_held )
+		return 0;
+	memcpy( data, p->held, p->row_bytes );
+	despeckle_rows( p, (uint8 *) data, 1, NULL );
+	p->have_held = p->ended = false;
+	return p->row_bytes;
+}
+
+#pragma mark ---- Other Functions ----
+
+/*	Folds everything into one table per channel: the tone map first, then
+	the levels, gamma and threshold. The levels and threshold are given
+	for 8 bits, and scaled up for 16-bit samples. */
+static void build_luts( scan_processor *p )
+{
+	const scan_process *process = &p->process;
+	bool levels = p->enabled && ( process->black != 0 || process->white != 255 );
+	bool gamma = p->enabled && process->gamma > 0 && process->gamma != 1.0;
+	bool threshold = p->enabled && process->threshold > 0 && p->channels == 1;
+	int32 top = ( p->sample_bytes == 2 ) ? 65535 : 255;
+	double scale = top / 255.0;
+
+	p->use_luts = levels || gamma || threshold;
+	for( int32 c = 0; c < p->channels; c++ ) {
+		int32 size;
+		const int32 *map = channel_map( p, c, &size );
+		if( map )
+			p->use_luts = true;
+
+		for( int32 x = 0; x <= top; x++ ) {
+			double y = x;
+			if( map ) {
+				int32 v = map[ ( (int64) x * ( size - 1 ) + top / 2 ) / top ];
+				if( v < 0 )
+					v = 0;
+				if( v > size - 1 )
+					v = size - 1;
+				y = v * (double) top / ( size - 1 );
+			}
+			if( levels ) {
+				y = ( y - process->black * scale ) * 255.0
+					/ ( process->white - process->black );
+				y = y < 0 ? 0 : y > top ? top : y;
+			}
+			if( gamma )
+				y = top * pow( y / top, 1.0 / process->gamma );
+			if( threshold )
+				y = y >= process->threshold * scale ? top : 0;
+			if( top == 255 )
+				p->luts[ c * 256 + x ] = (uint8) ( y + 0.5 );
+			else
+				p->luts16[ c * 65536 + x ] = (uint16) ( y + 0.5 );
+		}
+	}
+}
+
+/* The values of the tone map for a channel, or NULL. Gray images use
+	TONEMAP, or failing that TONEMAP3's green; RGB prefers TONEMAP3. */
+static const int32* channel_map( scan_processor *p, int32 channel,
+							int32 *size )
+{
+	*size = 0;
+	if( p->channels == 3 && p->tonemap3 ) {
+		*size = p->tonemap3[0];
+		return p->tonemap3 + 1 + channel * *size;
+	}
+	if( p->tonemap ) {
+		*size = p->tonemap[0];
+		return p->tonemap + 1;
+	}
+	if( p->tonemap3 ) {
+		*size = p->tonemap3[0];
+		return p->tonemap3 + 1 + *size;
+	}
+	return NULL;
+}
+
+static void lut_rows( scan_processor *p, uint8 *rows, int32 count )
+{
+	if( p->sample_bytes == 2 ) {
+		int32 samples = p->width * p->channels;
+		if( p->row_bytes == samples * 2 ) {
+			samples *= count;		// no padding, one call does it
+			count = 1;
+		}
+		for( int32 i = 0; i < count; i++, rows += p->row_bytes )
+			scan_convert_lut16( rows, rows, samples, p->luts16, p->channels );
+		return;
+	}
+	if( p->row_bytes % p->channels == 0 ) {
+			// padding and all, every row starts on a pixel
+		scan_convert_lut8( rows, rows, count * p->row_bytes, p->luts, p->channels );
+		return;
+	}
+	for( int32 i = 0; i < count; i++, rows += p->row_bytes )
+		scan_convert_lut8( rows, rows, p->width * p->channels, p->luts, p->channels );
+}
+
+static void run_slice( encoder_job *job )
+{
+	process_slice *slice = (process_slice *) job;
+	scan_processor *p = slice->processor;
+	lut_rows( p, slice->rows, slice->count );
+	release_sem( p->slices_done );
+	encoder_job_done( p->pool, 0, B_OK );
+}
+
+/*	Flips thresholded pixels that differ from all their neighbors. after
+	is the row below the last, NULL at the bottom of the image. */
+static void despeckle_rows( scan_processor *p, uint8 *rows, int32 count,
+							const uint8 *after )
+{
+	int32 width = p->width;
+	for( int32 r = 0; r < count; r++ ) {
+		uint8 *row = rows + r * p->row_bytes;
+		memcpy( p->row_copy, row, width );
+		const uint8 *cur = p->row_copy;
+		const uint8 *above = p->have_above ? p->above : NULL;
+		const uint8 *below = r + 1 < count ? row + p->row_bytes : after;
+
+		for( int32 x = 0; x < width; x++ ) {
+			uint8 v = cur[x];
+			if( ( x > 0 && cur[x - 1] == v ) || ( x + 1 < width && cur[x + 1] == v ) )
+				continue;				// the usual case
+			int32 first = x > 0 ? x - 1 : x;
+			int32 last = x + 1 < width ? x + 1 : x;
+			bool lone = ( above || below || first != last );
+			for( int32 n = first; lone && n <= last; n++ )
+				if( ( above && above[n] == v ) || ( below && below[n] == v ) )
+					lone = false;
+			if( lone )
+				row[x] = 255 - v;
+		}
+
+		uint8 *t = p->above;
+		p->above = p->row_copy;
+		p->row_copy = t;
+		p->have_above = true;
+	}
+}
@@ -0,0 +1,284 @@
+/*
+	ScannerBe -- tiled image store for scans bigger than memory.
+	Copyright (c) 1997, Jim Moy, All Rights Reserved
+*/
+
+#include "ScanTiles.h"
+
+#include <OS.h>
+#include <Errors.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+const int32 kDefaultTileSize = 256;
+const char *kTempPattern = "/tmp/scantiles.XXXXXX";
+
+/*	The file is the tiles in order, left to right and then down, each
+	padded out to whole pages so it can be mapped by itself. A band, the
+	tiles_across tiles in one row of them, is contiguous, and is mapped
+	in as a whole while its rows are being written. */
+struct scan_tile_store {
+	scan_tile_info	info;
+	int32			row_bytes;		// of the rows written
+	int32			data_bytes;		// of those, without the padding
+	int				fd;
+	off_t			tile_bytes;		// in the file, whole pages
+	uint8*			band;			// mapped for writing, or NULL
+	int32			band_index;
+	int32			locked;			// tiles mapped for reading
+};
+
+/*	Some local function prototypes. */
+static status_t map_band( scan_tile_store *s, int32 index );
+static void unmap_band( scan_tile_store *s );
+static void put_row( scan_tile_store *s, const uint8 *row, int32 y );
+
+#pragma mark ---- Public Functions ----
+
+status_t scan_tiles_create( const char *path, const scan_settings *settings,
+							int32 tile_size, scan_tile_store **store )
+{
+	if( ! settings || ! store || tile_size < 0 )
+		return B_BAD_VALUE;
+	*store = NULL;
+
+	int32 width = settings->pixel_width;
+	int32 height = settings->pixel_height;
+	uint32 bits = settings->pixel_bits;
+	if( width <= 0 || height <= 0 )
+		return B_BAD_VALUE;
+	switch( settings->image_type ) {
+	case SCAN_TYPE_BINARY:
+		if( bits != 1 )
+			return B_BAD_VALUE;
+		break;
+	case SCAN_TYPE_GRAY:
+		if( bits != 8 && bits != 16 )
+			return B_BAD_VALUE;
+		break;
+	case SCAN_TYPE_RGB:
+		if( bits != 24 && bits != 48 )
+			return B_BAD_VALUE;
+		break;
+	default:
+		return B_BAD_VALUE;
+	}
+	int32 dataBytes = ( width * bits + 7 ) / 8;
+	if( (int32) settings->row_bytes < dataBytes )
+		return B_BAD_VALUE;
+
+	if( tile_size == 0 )
+		tile_size = kDefaultTileSize;
+	tile_size = ( tile_size + 7 ) & ~7;		// so binary tiles start on a byte
+
+	scan_tile_store *s = new scan_tile_store;
+	s->info.image_type = settings->image_type;
+	s->info.pixel_bits = bits;
+	s->info.width = width;
+	s->info.height = height;
+	s->info.tile_size = tile_size;
+	s->info.tiles_across = ( width + tile_size - 1 ) / tile_size;
+	s->info.tiles_down = ( height + tile_size - 1 ) / tile_size;
+	s->info.tile_row_bytes = tile_size * bits / 8;
+	s->info.rows_done = 0;
+	s->row_bytes = settings->row_bytes;
+	s->data_bytes = dataBytes;
+	s->tile_bytes = ( (off_t) s->info.tile_row_bytes * tile_size + B_PAGE_SIZE - 1 )
+						& ~( (off_t) B_PAGE_SIZE - 1 );
+	s->band = NULL;
+	s->band_index = -1;
+	s->locked = 0;
+
+	if( path )
+		s->fd = open( path, O_RDWR | O_CREAT | O_TRUNC, 0644 );
+	else {
+		char temp[32];
+		strcpy( temp, kTempPattern );
+		s->fd = mkstemp( temp );
+		if( s->fd >= 0 )
+			unlink( temp );				// gone once it's closed
+	}
+	if( s->fd < 0 ) {
+		status_t status = errno;
+		delete s;
+		return status;
+	}
+
+	// Sized up front, so the whole image reads back as 0 until written.
+	off_t size = s->tile_bytes * s->info.tiles_across * s->info.tiles_down;
+	if( ftruncate( s->fd, size ) != 0 ) {
+		status_t status = errno;
+		close( s->fd );
+		if( path )
+			unlink( path );
+		delete s;
+		return status;
+	}
+
+	*store = s;
+	return B_OK;
+}
+
+
+status_t scan_tiles_write( scan_tile_store *store, const void *rows,
+							int32 count )
+{
+	if( ! store || count < 0 || ( count > 0 && ! rows )
+			|| count % store->row_bytes != 0 )
+		return B_BAD_VALUE;
+	scan_tile_store *s = store;
+
+	const uint8 *row = (const uint8 *) rows;
+	int32 tileSize = s->info.tile_size;
+	for( int32 n = count / s->row_bytes; n > 0; n--, row += s->row_bytes ) {
+		int32 y = s->info.rows_done;
+		if( y >= s->info.height )
+			break;						// past the end, same as the writers
+		if( y / tileSize != s->band_index ) {
+			status_t status = map_band( s, y / tileSize );
+			if( status != B_OK )
+				return status;
+		}
+		put_row( s, row, y );
+
+		// readers can have the band once it's all there
+		if( ( y + 1 ) % tileSize == 0 || y + 1 == s->info.height )
+			unmap_band( s );
+		atomic_add( &s->info.rows_done, 1 );
+	}
+	return B_OK;
+}
+
+
+status_t scan_tiles_get_info( scan_tile_store *store, scan_tile_info *info )
+{
+	if( ! store || ! info )
+		return B_BAD_VALUE;
+	*info = store->info;
+	info->rows_done = atomic_get( &store->info.rows_done );
+	return B_OK;
+}
+
+
+status_t scan_tiles_lock( scan_tile_store *store, int32 x, int32 y,
+							const void **data )
+{
+	if( ! store || ! data || x < 0 || y < 0
+			|| x >= store->info.tiles_across || y >= store->info.tiles_down )
+		return B_BAD_VALUE;
+	scan_tile_store *s = store;
+	*data = NULL;
+
+	int32 lastRow = ( y + 1 ) * s->info.tile_size;
+	if( lastRow > s->info.height )
+		lastRow = s->info.height;
+	if( atomic_get( &s->info.rows_done ) < lastRow )
+		return SCAN_BAD_PHASE;
+
+	off_t offset = s->tile_bytes * ( (off_t) y * s->info.tiles_across + x );
+	void *tile = mmap( NULL, s->tile_bytes, PROT_READ, MAP_SHARED, s->fd, offset );
+	if( tile == MAP_FAILED )
+		return errno;
+	atomic_add( &s->locked, 1 );
+	*data = tile;
+	return B_OK;
+}
+
+
+status_t scan_tiles_unlock( scan_tile_store *store, const void *data )
+{
+	if( ! store || ! data )
+		return B_BAD_VALUE;
+	if( munmap( (void *) data, store->tile_bytes ) != 0 )
+		return errno;
+	atomic_add( &store->locked, -1 );
+	return B_OK;
+}
+
+
+status_t scan_tiles_read_rows( scan_tile_store *store, int32 first_row,
+							int32 count, void *buffer )
+{
+	if( ! store || ! buffer || first_row < 0 || count < 0
+			|| first_row + count > store->info.height )
+		return B_BAD_VALUE;
+	scan_tile_store *s = store;
+	if( atomic_get( &s->info.rows_done ) < first_row + count )
+		return SCAN_BAD_PHASE;
+
+	uint8 *row = (uint8 *) buffer;
+	int32 tileSize = s->info.tile_size;
+	int32 tileRowBytes = s->info.tile_row_bytes;
+	for( int32 y = first_row; y < first_row + count; y++, row += s->row_bytes ) {
+		off_t offset = s->tile_bytes * ( (off_t) ( y / tileSize ) * s->info.tiles_across )
+						+ (off_t) ( y % tileSize ) * tileRowBytes;
+		for( int32 x = 0; x < s->data_bytes; x += tileRowBytes ) {
+			int32 bytes = s->data_bytes - x < tileRowBytes ? s->data_bytes - x : tileRowBytes;
+			ssize_t got;
+			while( ( got = pread( s->fd, row + x, bytes, offset ) ) < 0 && errno == EINTR )
+				;
+			if( got != bytes )
+				return got < 0 ? errno : B_IO_ERROR;
+			offset += s->tile_bytes;
+		}
+		memset( row + s->data_bytes, 0, s->row_bytes - s->data_bytes );
+	}
+	return B_OK;
+}
+
+
+status_t scan_tiles_delete( scan_tile_store *store )
+{
+	if( ! store )
+		return B_BAD_VALUE;
+	if( atomic_get( &store->locked ) > 0 )
+		return SCAN_BAD_PHASE;
+	unmap_band( store );
+	status_t status = close( store->fd ) == 0 ? B_OK : errno;
+	delete store;
+	return status;
+}
+
+#pragma mark ---- Other Functions ----
+
+static status_t map_band( scan_tile_store *s, int32 index )
+{
+	unmap_band( s );
+	size_t size = s->tile_bytes * s->info.tiles_across;
+	off_t offset = (off_t) size * index;
+	void *band = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, s->fd, offset );
+	if( band == MAP_FAILED )
+		return errno;
+	s->band = (uint8 *) band;
+	s->band_index = index;
+	return B_OK;
+}
+
+/* Starts the band on its way to the disk and lets go of it, so what the
+	store holds in memory doesn't grow with the image. */
+static void unmap_band( scan_tile_store *s )
+{
+	if( ! s->band )
+		return;
+	size_t size = s->tile_bytes * s->info.tiles_across;
+	msync( s->band, size, MS_ASYNC );
+	munmap( s->band, size );
+	s->band = NULL;
+	s->band_index = -1;
+}
+
+/* Deals the row out to the band's tiles. */
+static void put_row( scan_tile_store *s, const uint8 *row, int32 y )
+{
+	int32 tileRowBytes = s->info.tile_row_bytes;
+	uint8 *dst = s->band + ( y % s->info.tile_size ) * tileRowBytes;
+	for( int32 x = 0; x < s->data_bytes; x += tileRowBytes, dst += s->tile_bytes ) {
+		int32 bytes = s->data_bytes - x < tileRowBytes ? s->data_bytes - x : tileRowBytes;
+		memcpy( dst, row + x, bytes );
+	}
+}
@@ -0,0 +1,125 @@
+/*
+	ScannerBe -- event trace, internal to libscanbe.
+	Copyright (c) 1997, Jim Moy, All Rights Reserved
+*/
+
+#include "ScannerBe.h"
+#include "ScanTrace.h"
+
+#include <Errors.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*	The ring. Writers claim a position with atomic_add and own that slot
+	until they store its sequence number: 0 first, then the fields, then
+	the position plus one, with fences so the fields stay in between. A
+	reader takes a slot only if its sequence number matches the position
+	it expects both before and after copying it, so half-written and
+	overwritten slots are skipped. Positions count on through the wrap of
+	the uint32; the one whose sequence number would be 0 is never saved. */
+static trace_event gTrace[kTraceEvents];
+static int32 gTraceNext = 0;			// a uint32, for atomic_add
+const bigtime_t kMaxTraceDuration = 0x7fffffff;
+
+/* Saves the trace when the library is unloaded, if SCAN_TRACE names a file. */
+class trace_saver {
+public:
+	~trace_saver();
+};
+static trace_saver gTraceSaver;
+
+/*	Some local function prototypes. */
+static status_t write_all( int fd, const void *data, size_t size );
+
+#pragma mark ---- Public Functions ----
+
+status_t scan_trace_save( const char *path )
+{
+	if( ! path )
+		return SCAN_BAD_PARAM;
+
+	// Copy out what's there first, so the file isn't written while
+	// the ring moves on. Slots never written have a sequence number of 0.
+	uint32 next = (uint32) atomic_get( &gTraceNext );
+	uint32 first = next - kTraceEvents;
+	trace_event *events = new trace_event[ kTraceEvents ];
+	int32 count = 0;
+	for( uint32 i = first; i != next; i++ ) {
+		trace_event *e = &gTrace[ i & ( kTraceEvents - 1 ) ];
+		uint32 sequence = (uint32) atomic_get( (int32 *) &e->sequence );
+		if( sequence != i + 1 || sequence == 0 )
+			continue;
+		events[count] = *e;
+		__atomic_thread_fence( __ATOMIC_ACQUIRE );
+		if( (uint32) atomic_get( (int32 *) &e->sequence ) == sequence )
+			count++;				// not overwritten while it was copied
+	}
+
+	trace_file_header header;
+	header.magic = kTraceMagic;
+	header.version = kTraceVersion;
+	header.event_size = sizeof( trace_event );
+	header.count = count;
+
+	status_t status = B_OK;
+	int fd = open( path, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+	if( fd < 0 )
+		status = errno;
+	if( status == B_OK )
+		status = write_all( fd, &header, sizeof( header ) );
+	if( status == B_OK )
+		status = write_all( fd, events, count * sizeof( trace_event ) );
+	if( fd >= 0 && close( fd ) < 0 && status == B_OK )
+		status = errno;
+
+	delete[] events;
+	return status;
+}
+
+#pragma mark ---- Other Functions ----
+
+void trace_event_add( int16 kind, int16 what, void *session,
+						bigtime_t start, bigtime_t end, int32 arg )
+{
+	uint32 position = (uint32) atomic_add( &gTraceNext, 1 );
+	trace_event *e = &gTrace[ position & ( kTraceEvents - 1 ) ];
+	atomic_set( (int32 *) &e->sequence, 0 );
+	__atomic_thread_fence( __ATOMIC_RELEASE );
+	bigtime_t duration = end - start;
+	e->start = start;
+	e->duration = (int32) ( duration < kMaxTraceDuration ? duration
+														: kMaxTraceDuration );
+	e->thread = find_thread( NULL );
+	e->session = (int32) (size_t) session;
+	e->kind = kind;
+	e->what = what;
+	e->arg = arg;
+	atomic_set( (int32 *) &e->sequence, (int32) ( position + 1 ) );
+}
+
+trace_saver::~trace_saver()
+{
+	const char *path = getenv( "SCAN_TRACE" );
+	if( path && strlen( path ) > 0 )
+		scan_trace_save( path );
+}
+
+static status_t write_all( int fd, const void *data, size_t size )
+{
+	const char *p = (const char *) data;
+	while( size > 0 ) {
+		ssize_t done = write( fd, p, size );
+		if( done < 0 ) {
+			if( errno == EINTR )
+				continue;
+			return errno;
+		}
+		p += done;
+		size -= done;
+	}
+	return B_OK;
+}
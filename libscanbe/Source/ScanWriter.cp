@@ -0,0 +1,979 @@
+/*
+	ScannerBe -- streaming image file writer.
+	Copyright (c) 1997, Jim Moy, All Rights Reserved
+*/
+
+#include "ScanWriter.h"
+#include "ScanConvert.h"
+
+#include <OS.h>
+#include <Errors.h>
+#include <Locker.h>
+#include <Autolock.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <zlib.h>
+
+/*	Output is collected in a buffer of this size. Rows that can go out as
+	the scanner delivered them skip it: they're written together with
+	whatever is buffered in one writev(). */
+const int32 kWriteBufSize = 64 * 1024L;
+const int32 kMaxIovecs = 64;
+
+/*	About how much goes in each TIFF strip. Compressed strips are bigger,
+	since each one starts its compression from scratch. */
+const int32 kTIFFStripSize = 8 * 1024L;
+const int32 kDeflateStripSize = 128 * 1024L;
+
+/* Room around a compressed strip for its PNG chunk header and CRC. */
+const int32 kChunkHead = 8;
+const int32 kChunkTail = 4;
+
+struct strip_job {
+	encoder_job		job;			// first, it's all the pool sees
+	scan_writer*	writer;
+	strip_job*		next;			// in file order
+	int32			index;
+	int32			rows;
+	char*			raw;			// rows, as they go in the file
+	char*			out;			// compressed, with room for a chunk header
+	int32			out_size;
+	uint32			adler;			// of raw, for PNG
+	int32			cost;			// charged to the pool
+	bool			final;
+	bool			done;
+	status_t		status;
+};
+
+struct scan_writer {
+	int					fd;
+	char*				path;
+	scan_file_format	format;
+	scan_type			type;
+	int32				width;
+	int32				height;
+	uint32				dpi;
+	int32				channels;		// samples per pixel
+	bool				deep;			// 16-bit samples from the scanner
+	int32				sample_bytes;	// in the file
+	int32				in_row_bytes;	// as scan_data() delivers them
+	int32				out_row_bytes;	// as they go in the file
+	int32				rows_done;
+	bool				convert;		// rows need more than trimming
+	char*				buf;
+	int32				buf_used;
+	off_t				offset;			// bytes written so far
+	status_t			error;			// first error, sticks
+
+									// for the compressed formats
+	scan_encoder_pool*	pool;			// NULL to compress here
+	BLocker				lock;			// the strip queue and the file
+	int32				rows_per_strip;
+	int32				strip_stride;	// bytes a row takes in a strip, 0 if uncompressed
+	strip_job*			strip;			// being filled
+	strip_job*			first_job;		// queued, not yet written
+	strip_job*			last_job;
+	int32				strips;			// queued so far
+	uint32*				strip_offsets;	// TIFF, filled in as they're written
+	uint32*				strip_counts;
+	uint32				adler;			// PNG, of what's written so far
+	bool				aborted;
+};
+
+/*	Some local function prototypes. */
+static status_t write_header( scan_writer *w );
+static status_t write_tga_header( scan_writer *w );
+static status_t write_pnm_header( scan_writer *w );
+static status_t write_tiff_header( scan_writer *w );
+static status_t write_png_header( scan_writer *w );
+static uint32 tiff_directory_size( scan_writer *w, int32 strips );
+static void put_tiff_directory( scan_writer *w, uint8 *&p, uint32 ifdOffset,
+						int32 rowsPerStrip, int32 strips, const uint32 *offsets,
+						const uint32 *counts );
+static status_t put_png_chunk( scan_writer *w, const char *type,
+						const void *data, int32 size );
+static uint8 white_byte( scan_writer *w );
+static status_t write_strips( scan_writer *w, const char *src, int32 rowCount );
+static status_t new_strip( scan_writer *w );
+static void queue_strip( scan_writer *w, bool final );
+static void encode_strip( encoder_job *job );
+static status_t deflate_strip( scan_writer *w, strip_job *job );
+static void difference_rows( char *row, int32 bytes, int32 step );
+static void difference_rows16( char *row, int32 samples, int32 step );
+static void write_strip( scan_writer *w, strip_job *job );
+static void finish_file( scan_writer *w );
+static void free_strip( strip_job *job );
+static void delete_writer( scan_writer *w );
+static status_t put_bytes( scan_writer *w, const void *data, int32 size );
+static status_t write_vector( scan_writer *w, struct iovec *iov, int32 count );
+static status_t flush_buffer( scan_writer *w );
+static void convert_row( scan_writer *w, const char *src, char *dst, int32 row );
+
+#pragma mark ---- Public Functions ----
+
+status_t scan_writer_open( const char *path, scan_file_format format,
+						const scan_settings *settings, scan_writer **writer )
+{
+	return scan_writer_open_pooled( path, format, settings, NULL, writer );
+}
+
+
+status_t scan_writer_open_pooled( const char *path, scan_file_format format,
+						const scan_settings *settings, scan_encoder_pool *pool,
+						scan_writer **writer )
+{
+	if( ! path || ! settings || ! writer )
+		return B_BAD_VALUE;
+	*writer = NULL;
+
+	int32 width = settings->pixel_width;
+	int32 height = settings->pixel_height;
+	if( width <= 0 || height <= 0 )
+		return B_BAD_VALUE;
+
+		// TGA has no deep format, so 16-bit samples go into it as 8
+	bool deep = ( settings->image_type == SCAN_TYPE_RGB && settings->pixel_bits == 48 )
+				|| ( settings->image_type == SCAN_TYPE_GRAY && settings->pixel_bits == 16 );
+	int32 sampleBytes = ( deep && format != SCAN_FORMAT_TGA ) ? 2 : 1;
+	int32 outRowBytes, neededBytes;
+	switch( settings->image_type ) {
+	case SCAN_TYPE_RGB:
+		neededBytes = width * 3 * ( deep ? 2 : 1 );
+		outRowBytes = width * 3 * sampleBytes;
+		break;
+	case SCAN_TYPE_GRAY:
+		neededBytes = width * ( deep ? 2 : 1 );
+		outRowBytes = width * sampleBytes;
+		break;
+	case SCAN_TYPE_BINARY:
+		neededBytes = ( width + 7 ) / 8;
+		outRowBytes = ( format == SCAN_FORMAT_TGA ) ? width : neededBytes;
+		break;
+	default:
+		return B_BAD_VALUE;
+	}
+	if( (int32) settings->row_bytes < neededBytes )
+		return B_BAD_VALUE;
+	if( format == SCAN_FORMAT_TGA && ( width > 0xffff || height > 0xffff ) )
+		return B_BAD_VALUE;
+	if( format < SCAN_FORMAT_TGA || format > SCAN_FORMAT_TIFF_DEFLATE )
+		return B_BAD_VALUE;
+
+	scan_writer *w = new scan_writer;
+	w->fd = open( path, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+	if( w->fd < 0 ) {
+		delete w;
+		return errno;
+	}
+	w->path = strdup( path );
+	w->format = format;
+	w->type = settings->image_type;
+	w->width = width;
+	w->height = height;
+	w->channels = ( w->type == SCAN_TYPE_RGB ) ? 3 : 1;
+	w->deep = deep;
+	w->sample_bytes = sampleBytes;
+	w->dpi = settings->resolution ? settings->resolution : 72;
+	w->in_row_bytes = settings->row_bytes;
+	w->out_row_bytes = outRowBytes;
+	w->rows_done = 0;
+	w->buf = new char[ kWriteBufSize + outRowBytes ];
+	w->buf_used = 0;
+	w->offset = 0;
+	w->error = B_OK;
+		// TGA stores blue first, and has no one-bit format; TIFF is
+		// little-endian
+	w->convert = ( format == SCAN_FORMAT_TGA && ( w->type != SCAN_TYPE_GRAY || deep ) )
+				|| ( ( format == SCAN_FORMAT_TIFF || format == SCAN_FORMAT_TIFF_DEFLATE )
+					&& deep );
+
+	w->pool = pool;
+	w->strip = w->first_job = w->last_job = NULL;
+	w->strips = 0;
+	w->strip_offsets = w->strip_counts = NULL;
+	w->adler = adler32( 0, NULL, 0 );
+	w->aborted = false;
+	w->strip_stride = 0;
+	if( format == SCAN_FORMAT_PNG || format == SCAN_FORMAT_TIFF_DEFLATE ) {
+			// PNG starts each row with its filter type
+		w->strip_stride = outRowBytes + ( format == SCAN_FORMAT_PNG ? 1 : 0 );
+		w->rows_per_strip = kDeflateStripSize / w->strip_stride;
+		if( w->rows_per_strip < 1 )
+			w->rows_per_strip = 1;
+		if( w->rows_per_strip > height )
+			w->rows_per_strip = height;
+		if( format == SCAN_FORMAT_TIFF_DEFLATE ) {
+			int32 strips = ( height + w->rows_per_strip - 1 ) / w->rows_per_strip;
+			w->strip_offsets = new uint32[ strips ];
+			w->strip_counts = new uint32[ strips ];
+		}
+	}
+
+	status_t status = write_header( w );
+	if( status != B_OK ) {
+		scan_writer_abort( w );
+		return status;
+	}
+	*writer = w;
+	return B_OK;
+}
+
+
+status_t scan_writer_write( scan_writer *w, const void *rows, int32 count )
+{
+	if( ! w )
+		return B_BAD_VALUE;
+	if( w->error != B_OK )
+		return w->error;
+	if( count % w->in_row_bytes )
+		return B_BAD_VALUE;
+
+	int32 rowCount = count / w->in_row_bytes;
+	if( rowCount > w->height - w->rows_done )
+		rowCount = w->height - w->rows_done;		// ignore any extra
+	const char *src = (const char *) rows;
+
+	if( w->strip_stride )
+		return write_strips( w, src, rowCount );
+
+	if( w->convert ) {
+		for( int32 i = 0; i < rowCount; i++ ) {
+			if( w->buf_used + w->out_row_bytes > kWriteBufSize
+					&& flush_buffer( w ) != B_OK )
+				return w->error;
+			convert_row( w, src, w->buf + w->buf_used, w->rows_done + i );
+			w->buf_used += w->out_row_bytes;
+			src += w->in_row_bytes;
+		}
+	} else if( w->in_row_bytes == w->out_row_bytes ) {
+									// the whole band goes out as is
+		struct iovec iov[2];
+		int32 n = 0;
+		if( w->buf_used ) {
+			iov[n].iov_base = w->buf;
+			iov[n++].iov_len = w->buf_used;
+		}
+		iov[n].iov_base = (char *) src;
+		iov[n++].iov_len = rowCount * w->out_row_bytes;
+		w->buf_used = 0;
+		if( write_vector( w, iov, n ) != B_OK )
+			return w->error;
+	} else {
+									// padded rows, gather just the pixels
+		struct iovec iov[kMaxIovecs];
+		int32 n = 0;
+		if( w->buf_used ) {
+			iov[n].iov_base = w->buf;
+			iov[n++].iov_len = w->buf_used;
+			w->buf_used = 0;
+		}
+		for( int32 i = 0; i < rowCount; i++ ) {
+			iov[n].iov_base = (char *) src;
+			iov[n++].iov_len = w->out_row_bytes;
+			src += w->in_row_bytes;
+			if( n == kMaxIovecs ) {
+				if( write_vector( w, iov, n ) != B_OK )
+					return w->error;
+				n = 0;
+			}
+		}
+		if( n && write_vector( w, iov, n ) != B_OK )
+			return w->error;
+	}
+
+	w->rows_done += rowCount;
+	return B_OK;
+}
+
+
+status_t scan_writer_close( scan_writer *w )
+{
+	if( ! w )
+		return B_BAD_VALUE;
+
+	if( w->strip_stride ) {
+		w->lock.Lock();
+		status_t status = w->error;
+		w->lock.Unlock();
+									// a short scan gets filled with white
+		if( status == B_OK )
+			status = write_strips( w, NULL, w->height - w->rows_done );
+		if( ! w->strip )
+			new_strip( w );
+
+			// Once the last strip is queued a pooled writer is the pool's
+			// to finish and free.
+		scan_encoder_pool *pool = w->pool;
+		queue_strip( w, true );
+		if( pool )
+			return status;
+		status = w->error;
+		delete_writer( w );
+		return status;
+	}
+
+									// a short scan gets filled with white
+	while( w->rows_done < w->height && w->error == B_OK ) {
+		if( w->buf_used + w->out_row_bytes > kWriteBufSize
+				&& flush_buffer( w ) != B_OK )
+			break;
+		memset( w->buf + w->buf_used, white_byte( w ), w->out_row_bytes );
+		w->buf_used += w->out_row_bytes;
+		w->rows_done++;
+	}
+	flush_buffer( w );
+
+	if( close( w->fd ) != 0 && w->error == B_OK )
+		w->error = errno;
+
+	status_t status = w->error;
+	delete_writer( w );
+	return status;
+}
+
+
+void scan_writer_abort( scan_writer *w )
+{
+	if( ! w )
+		return;
+
+	if( w->strip_stride ) {
+			// let the pool finish with what's queued, then drop it
+		w->lock.Lock();
+		w->aborted = true;
+		while( w->first_job ) {
+			w->lock.Unlock();
+			snooze( 1000 );
+			w->lock.Lock();
+		}
+		w->lock.Unlock();
+		free_strip( w->strip );
+	}
+	close( w->fd );
+	unlink( w->path );
+	delete_writer( w );
+}
+
+#pragma mark ---- Other Functions ----
+
+static status_t write_header( scan_writer *w )
+{
+	switch( w->format ) {
+	case SCAN_FORMAT_TGA:
+		return write_tga_header( w );
+	case SCAN_FORMAT_PNM:
+		return write_pnm_header( w );
+	case SCAN_FORMAT_TIFF:
+	case SCAN_FORMAT_TIFF_DEFLATE:
+		return write_tiff_header( w );
+	case SCAN_FORMAT_PNG:
+		return write_png_header( w );
+	}
+	return B_BAD_VALUE;
+}
+
+static status_t write_tga_header( scan_writer *w )
+{
+	uint8 header[18];
+	memset( header, 0, sizeof( header ) );
+	header[2] = ( w->type == SCAN_TYPE_RGB ) ? 2 : 3;	// true color : gray
+	header[12] = w->width & 0xff;
+	header[13] = w->width >> 8;
+	header[14] = w->height & 0xff;
+	header[15] = w->height >> 8;
+	header[16] = ( w->type == SCAN_TYPE_RGB ) ? 24 : 8;
+	header[17] = 0x20;								// rows go top to bottom
+	return put_bytes( w, header, sizeof( header ) );
+}
+
+static status_t write_pnm_header( scan_writer *w )
+{
+	char header[64];
+	int maxValue = w->deep ? 65535 : 255;		// deep samples are big-endian, as scanned
+	switch( w->type ) {
+	case SCAN_TYPE_RGB:
+		sprintf( header, "P6\n%ld %ld\n%d\n", (long) w->width, (long) w->height,
+				maxValue );
+		break;
+	case SCAN_TYPE_GRAY:
+		sprintf( header, "P5\n%ld %ld\n%d\n", (long) w->width, (long) w->height,
+				maxValue );
+		break;
+	default:
+			// PBM is 1 for black, just like the scanner
+		sprintf( header, "P4\n%ld %ld\n", (long) w->width, (long) w->height );
+		break;
+	}
+	return put_bytes( w, header, strlen( header ) );
+}
+
+/* Little-endian TIFF building blocks. */
+static void put16( uint8 *&p, uint32 value )
+{
+	*p++ = value & 0xff;
+	*p++ = ( value >> 8 ) & 0xff;
+}
+
+static void put32( uint8 *&p, uint32 value )
+{
+	put16( p, value & 0xffff );
+	put16( p, value >> 16 );
+}
+
+static void put_tag( uint8 *&p, uint16 tag, uint16 type, uint32 count, uint32 value )
+{
+	put16( p, tag );
+	put16( p, type );
+	put32( p, count );
+	if( type == 3 && count == 1 ) {
+		put16( p, value );		// shorts sit in the low end of the field
+		put16( p, 0 );
+	} else
+		put32( p, value );
+}
+
+/*	The image size is known before the first row arrives, so every strip's
+	offset can be worked out up front and the whole directory written
+	ahead of the pixels. Deflated strips aren't known until they're done,
+	so that directory goes at the end of the file instead, and the header
+	is patched to point at it once it's there. */
+static status_t write_tiff_header( scan_writer *w )
+{
+	uint8 header[8];
+	uint8 *p = header;
+	*p++ = 'I';
+	*p++ = 'I';
+	put16( p, 42 );
+	if( w->format == SCAN_FORMAT_TIFF_DEFLATE ) {
+		put32( p, 0 );
+		return put_bytes( w, header, p - header );
+	}
+	put32( p, 8 );
+
+	int32 rowsPerStrip = kTIFFStripSize / w->out_row_bytes;
+	if( rowsPerStrip < 1 )
+		rowsPerStrip = 1;
+	if( rowsPerStrip > w->height )
+		rowsPerStrip = w->height;
+	int32 strips = ( w->height + rowsPerStrip - 1 ) / rowsPerStrip;
+
+	uint32 dataOffset = 8 + tiff_directory_size( w, strips );
+	uint32 *offsets = new uint32[ strips ];
+	uint32 *counts = new uint32[ strips ];
+	for( int32 i = 0; i < strips; i++ ) {
+		int32 rows = w->height - i * rowsPerStrip;
+		if( rows > rowsPerStrip )
+			rows = rowsPerStrip;
+		offsets[i] = dataOffset + i * rowsPerStrip * w->out_row_bytes;
+		counts[i] = rows * w->out_row_bytes;
+	}
+
+	uint8 *directory = new uint8[ dataOffset ];
+	memcpy( directory, header, 8 );
+	p = directory + 8;
+	put_tiff_directory( w, p, 8, rowsPerStrip, strips, offsets, counts );
+
+	status_t status = put_bytes( w, directory, p - directory );
+	delete[] directory;
+	delete[] offsets;
+	delete[] counts;
+	return status;
+}
+
+static uint32 tiff_directory_size( scan_writer *w, int32 strips )
+{
+	int32 tags = ( w->format == SCAN_FORMAT_TIFF_DEFLATE
+					&& w->type != SCAN_TYPE_BINARY ) ? 14 : 13;
+	int32 samples = ( w->type == SCAN_TYPE_RGB ) ? 3 : 1;
+	return 2 + tags * 12 + 4 + ( samples > 1 ? samples * 2 : 0 ) + 16
+			+ ( strips > 1 ? strips * 8 : 0 );
+}
+
+/*	The directory at ifdOffset in the file, followed by the values that
+	don't fit in their tags. */
+static void put_tiff_directory( scan_writer *w, uint8 *&p, uint32 ifdOffset,
+						int32 rowsPerStrip, int32 strips, const uint32 *offsets,
+						const uint32 *counts )
+{
+	const uint16 kShort = 3, kLong = 4, kRational = 5;
+
+	bool deflate = ( w->format == SCAN_FORMAT_TIFF_DEFLATE );
+	bool predictor = ( deflate && w->type != SCAN_TYPE_BINARY );
+	int32 tagCount = predictor ? 14 : 13;
+	int32 samples = ( w->type == SCAN_TYPE_RGB ) ? 3 : 1;
+
+									// lay out what follows the directory
+	uint32 ifdSize = 2 + tagCount * 12 + 4;
+	uint32 bitsOffset = ifdOffset + ifdSize;
+	uint32 xresOffset = bitsOffset + ( samples > 1 ? samples * 2 : 0 );
+	uint32 yresOffset = xresOffset + 8;
+	uint32 offsetsOffset = yresOffset + 8;
+	uint32 countsOffset = offsetsOffset + ( strips > 1 ? strips * 4 : 0 );
+
+	uint32 bitsPerSample = w->type == SCAN_TYPE_BINARY ? 1 : 8 * w->sample_bytes;
+	uint32 photometric = ( w->type == SCAN_TYPE_RGB ) ? 2
+						: ( w->type == SCAN_TYPE_GRAY ) ? 1 : 0;	// binary is WhiteIsZero
+
+	put16( p, tagCount );
+	put_tag( p, 254, kLong, 1, 0 );							// NewSubfileType
+	put_tag( p, 256, kLong, 1, w->width );					// ImageWidth
+	put_tag( p, 257, kLong, 1, w->height );					// ImageLength
+	put_tag( p, 258, kShort, samples,						// BitsPerSample
+		samples > 1 ? bitsOffset : bitsPerSample );
+	put_tag( p, 259, kShort, 1, deflate ? 8 : 1 );			// Compression: deflate or none
+	put_tag( p, 262, kShort, 1, photometric );				// PhotometricInterpretation
+	put_tag( p, 273, kLong, strips,							// StripOffsets
+		strips > 1 ? offsetsOffset : offsets[0] );
+	put_tag( p, 277, kShort, 1, samples );					// SamplesPerPixel
+	put_tag( p, 278, kLong, 1, rowsPerStrip );				// RowsPerStrip
+	put_tag( p, 279, kLong, strips,							// StripByteCounts
+		strips > 1 ? countsOffset : counts[0] );
+	put_tag( p, 282, kRational, 1, xresOffset );			// XResolution
+	put_tag( p, 283, kRational, 1, yresOffset );			// YResolution
+	put_tag( p, 296, kShort, 1, 2 );						// ResolutionUnit: inch
+	if( predictor )
+		put_tag( p, 317, kShort, 1, 2 );					// Predictor: differences
+	put32( p, 0 );											// no more directories
+
+	if( samples > 1 )
+		for( int32 i = 0; i < samples; i++ )
+			put16( p, bitsPerSample );
+	put32( p, w->dpi );
+	put32( p, 1 );
+	put32( p, w->dpi );
+	put32( p, 1 );
+	if( strips > 1 ) {
+		for( int32 i = 0; i < strips; i++ )
+			put32( p, offsets[i] );
+		for( int32 i = 0; i < strips; i++ )
+			put32( p, counts[i] );
+	}
+}
+
+/* Big-endian, for PNG. */
+static void put_be32( uint8 *p, uint32 value )
+{
+	p[0] = value >> 24;
+	p[1] = ( value >> 16 ) & 0xff;
+	p[2] = ( value >> 8 ) & 0xff;
+	p[3] = value & 0xff;
+}
+
+/*	The deflate stream is split over one IDAT chunk per strip. The first
+	holds just the zlib header; the checksum that ends the stream goes in
+	a chunk of its own once the last strip is written. */
+static status_t write_png_header( scan_writer *w )
+{
+	static const uint8 kSignature[8] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+	put_bytes( w, kSignature, sizeof( kSignature ) );
+
+	uint8 header[13];
+	put_be32( header, w->width );
+	put_be32( header + 4, w->height );
+	header[8] = ( w->type == SCAN_TYPE_BINARY ) ? 1 : 8 * w->sample_bytes;	// bit depth
+	header[9] = ( w->type == SCAN_TYPE_RGB ) ? 2 : 0;		// true color : gray
+	header[10] = 0;											// deflate
+	header[11] = 0;											// adaptive filtering
+	header[12] = 0;											// not interlaced
+	put_png_chunk( w, "IHDR", header, sizeof( header ) );
+
+	uint8 phys[9];
+	uint32 perMeter = (uint32) ( w->dpi / 0.0254 + 0.5 );
+	put_be32( phys, perMeter );
+	put_be32( phys + 4, perMeter );
+	phys[8] = 1;											// meters
+	put_png_chunk( w, "pHYs", phys, sizeof( phys ) );
+
+	const uint8 kZlibHeader[2] = { 0x78, 0x9c };			// 32K window, default level
+	return put_png_chunk( w, "IDAT", kZlibHeader, sizeof( kZlibHeader ) );
+}
+
+static status_t put_png_chunk( scan_writer *w, const char *type,
+						const void *data, int32 size )
+{
+	uint8 head[8];
+	put_be32( head, size );
+	memcpy( head + 4, type, 4 );
+	uint8 tail[4];
+	uLong crc = crc32( crc32( 0, NULL, 0 ), head + 4, 4 );
+	if( size > 0 )
+		crc = crc32( crc, (const Bytef *) data, size );
+	put_be32( tail, crc );
+
+	put_bytes( w, head, sizeof( head ) );
+	put_bytes( w, data, size );
+	return put_bytes( w, tail, sizeof( tail ) );
+}
+
+/* White, as it's stored in the file. */
+static uint8 white_byte( scan_writer *w )
+{
+	if( w->type != SCAN_TYPE_BINARY || w->format == SCAN_FORMAT_TGA )
+		return 0xff;
+		// PNG's one-bit gray is 1 for white, the rest follow the scanner
+	return ( w->format == SCAN_FORMAT_PNG ) ? 0xff : 0;
+}
+
+/* Copies into the output buffer, flushing as it fills. */
+static status_t put_bytes( scan_writer *w, const void *data, int32 size )
+{
+	const char *src = (const char *) data;
+	while( size > 0 && w->error == B_OK ) {
+		int32 chunk = kWriteBufSize - w->buf_used;
+		if( chunk > size )
+			chunk = size;
+		memcpy( w->buf + w->buf_used, src, chunk );
+		w->buf_used += chunk;
+		src += chunk;
+		size -= chunk;
+		if( w->buf_used == kWriteBufSize )
+			flush_buffer( w );
+	}
+	return w->error;
+}
+
+static status_t flush_buffer( scan_writer *w )
+{
+	if( w->buf_used == 0 || w->error != B_OK )
+		return w->error;
+	struct iovec iov;
+	iov.iov_base = w->buf;
+	iov.iov_len = w->buf_used;
+	w->buf_used = 0;
+	return write_vector( w, &iov, 1 );
+}
+
+/* writev() until all of it is out. iov is used up along the way. */
+static status_t write_vector( scan_writer *w, struct iovec *iov, int32 count )
+{
+	while( count > 0 ) {
+		ssize_t written = writev( w->fd, iov, count );
+		if( written < 0 ) {
+			if( errno == EINTR )
+				continue;
+			w->error = errno;
+			return w->error;
+		}
+		w->offset += written;
+		while( count > 0 && (size_t) written >= iov->iov_len ) {
+			written -= iov->iov_len;
+			iov++;
+			count--;
+		}
+		if( count > 0 ) {
+			iov->iov_base = (char *) iov->iov_base + written;
+			iov->iov_len -= written;
+		}
+	}
+	return B_OK;
+}
+
+static void convert_row( scan_writer *w, const char *src, char *dst, int32 row )
+{
+	if( w->deep ) {
+		if( w->sample_bytes == 2 ) {
+			scan_convert_swap16( src, dst, w->width * w->channels );
+			return;
+		}
+		scan_convert_16_to_8_dither( src, dst, w->width, w->channels, row );
+		src = dst;
+		if( w->type != SCAN_TYPE_RGB )
+			return;
+	}
+	if( w->type == SCAN_TYPE_RGB )
+		scan_convert_rgb24_to_bgr24( src, dst, w->width );
+	else
+		scan_convert_bits_to_gray8( src, dst, w->width );
+}
+
+#pragma mark ---- Compressed Strips ----
+
+/*	Copies rows into strips, queueing each strip as it fills. The last one
+	is kept back for scan_writer_close() to queue, so the pool knows which
+	strip ends the file. NULL src means white rows. */
+static status_t write_strips( scan_writer *w, const char *src, int32 rowCount )
+{
+	bool invert = ( w->format == SCAN_FORMAT_PNG && w->type == SCAN_TYPE_BINARY );
+	for( int32 i = 0; i < rowCount; i++ ) {
+		if( ! w->strip && new_strip( w ) != B_OK )
+			return B_NO_MEMORY;
+		strip_job *job = w->strip;
+		char *dst = job->raw + job->rows * w->strip_stride;
+		if( w->format == SCAN_FORMAT_PNG )
+			*dst++ = 0;					// the filter type, set when it's encoded
+		if( ! src )
+			memset( dst, white_byte( w ), w->out_row_bytes );
+		else if( w->convert )
+			convert_row( w, src, dst, w->rows_done );
+		else if( invert ) {
+			for( int32 j = 0; j < w->out_row_bytes; j++ )
+				dst[j] = ~src[j];
+		} else
+			memcpy( dst, src, w->out_row_bytes );
+		if( src )
+			src += w->in_row_bytes;
+		job->rows++;
+		w->rows_done++;
+		if( job->rows == w->rows_per_strip && w->rows_done < w->height )
+			queue_strip( w, false );
+	}
+
+	w->lock.Lock();
+	status_t status = w->error;
+	w->lock.Unlock();
+	return status;
+}
+
+static status_t new_strip( scan_writer *w )
+{
+	strip_job *job = new strip_job;
+	job->job.run = encode_strip;
+	job->writer = w;
+	job->next = NULL;
+	job->index = 0;
+	job->rows = 0;
+	job->raw = (char *) malloc( w->rows_per_strip * w->strip_stride );
+	job->out = NULL;
+	job->out_size = 0;
+	job->adler = 0;
+	job->cost = 0;
+	job->final = false;
+	job->done = false;
+	job->status = job->raw ? B_OK : B_NO_MEMORY;
+	w->strip = job;
+	if( ! job->raw ) {
+		BAutolock lock( w->lock );
+		if( w->error == B_OK )
+			w->error = B_NO_MEMORY;
+		return B_NO_MEMORY;
+	}
+	return B_OK;
+}
+
+/* Hands the strip being filled to the pool. Its compressed copy is
+	charged up front, so the pool can't overrun its memory. */
+static void queue_strip( scan_writer *w, bool final )
+{
+	strip_job *job = w->strip;
+	w->strip = NULL;
+	job->index = w->strips++;
+	job->final = final;
+	job->cost = 2 * job->rows * w->strip_stride;
+
+	w->lock.Lock();
+	if( w->last_job )
+		w->last_job->next = job;
+	else
+		w->first_job = job;
+	w->last_job = job;
+	w->lock.Unlock();
+
+	encoder_submit( w->pool, &job->job, job->cost );
+}
+
+/*	Runs on one of the pool's threads. Strips finish in any order, but
+	whichever thread finishes the oldest one writes it out, along with
+	any after it that are done by then. */
+static void encode_strip( encoder_job *j )
+{
+	strip_job *job = (strip_job *) j;
+	scan_writer *w = job->writer;
+	status_t status = B_OK;
+	if( job->status == B_OK && ! w->aborted )
+		status = deflate_strip( w, job );
+	free( job->raw );
+	job->raw = NULL;
+
+	bool finished = false;
+	w->lock.Lock();
+	job->done = true;
+	if( job->status == B_OK )
+		job->status = status;
+	while( w->first_job && w->first_job->done ) {
+		job = w->first_job;
+		w->first_job = job->next;
+		if( ! w->first_job )
+			w->last_job = NULL;
+
+		if( job->status != B_OK && w->error == B_OK )
+			w->error = job->status;
+		if( w->error == B_OK && ! w->aborted )
+			write_strip( w, job );
+		if( job->final ) {
+			finish_file( w );
+			finished = true;
+		}
+		int32 cost = job->cost;
+		free_strip( job );
+		encoder_job_done( w->pool, cost, finished ? w->error : B_OK );
+	}
+	scan_encoder_pool *pool = w->pool;
+	w->lock.Unlock();
+
+	if( finished && pool )
+		delete_writer( w );
+}
+
+/*	Each TIFF strip is a zlib stream of its own. PNG's strips are pieces
+	of one raw deflate stream, each ended with a sync flush so the next
+	can start on a byte boundary; their checksums are combined as they're
+	written. Rows are differenced first, by PNG's Sub filter or TIFF's
+	horizontal predictor, which are the same thing. */
+static status_t deflate_strip( scan_writer *w, strip_job *job )
+{
+	bool png = ( w->format == SCAN_FORMAT_PNG );
+	int32 size = job->rows * w->strip_stride;
+
+	if( w->type != SCAN_TYPE_BINARY ) {
+			// PNG works in bytes a pixel apart, TIFF in samples
+		int32 step = w->channels * ( png ? w->sample_bytes : 1 );
+		char *row = job->raw;
+		for( int32 i = 0; i < job->rows; i++, row += w->strip_stride ) {
+			if( png ) {
+				row[0] = 1;						// Sub
+				difference_rows( row + 1, w->out_row_bytes, step );
+			} else if( w->sample_bytes == 2 )
+				difference_rows16( row, w->out_row_bytes / 2, step );
+			else
+				difference_rows( row, w->out_row_bytes, step );
+		}
+	}
+
+	z_stream z;
+	memset( &z, 0, sizeof( z ) );
+	if( deflateInit2( &z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, png ? -15 : 15,
+				8, Z_DEFAULT_STRATEGY ) != Z_OK )
+		return B_NO_MEMORY;
+	uLong bound = deflateBound( &z, size ) + 16;		// and a sync flush
+	job->out = (char *) malloc( kChunkHead + bound + kChunkTail );
+	if( ! job->out ) {
+		deflateEnd( &z );
+		return B_NO_MEMORY;
+	}
+
+	z.next_in = (Bytef *) job->raw;
+	z.avail_in = size;
+	z.next_out = (Bytef *) job->out + kChunkHead;
+	z.avail_out = bound;
+	int flush = ( png && ! job->final ) ? Z_SYNC_FLUSH : Z_FINISH;
+	int err = deflate( &z, flush );
+	bool ok = ( flush == Z_FINISH ) ? err == Z_STREAM_END
+									: err == Z_OK && z.avail_in == 0;
+	job->out_size = bound - z.avail_out;
+	deflateEnd( &z );
+	if( ! ok )
+		return B_ERROR;
+
+	if( png ) {
+		job->adler = adler32( adler32( 0, NULL, 0 ), (Bytef *) job->raw, size );
+		uint8 *chunk = (uint8 *) job->out;
+		put_be32( chunk, job->out_size );
+		memcpy( chunk + 4, "IDAT", 4 );
+		put_be32( chunk + kChunkHead + job->out_size,
+					crc32( crc32( 0, NULL, 0 ), chunk + 4, 4 + job->out_size ) );
+	}
+	return B_OK;
+}
+
+/* Each byte less the one step bytes before it, done from the end back. */
+static void difference_rows( char *row, int32 bytes, int32 step )
+{
+	uint8 *p = (uint8 *) row;
+	for( int32 i = bytes - 1; i >= step; i-- )
+		p[i] -= p[i - step];
+}
+
+/* The same for little-endian 16-bit samples. */
+static void difference_rows16( char *row, int32 samples, int32 step )
+{
+	uint8 *p = (uint8 *) row;
+	for( int32 i = samples - 1; i >= step; i-- ) {
+		uint16 v = ( p[2 * i] | ( p[2 * i + 1] << 8 ) )
+					- ( p[2 * ( i - step )] | ( p[2 * ( i - step ) + 1] << 8 ) );
+		p[2 * i] = v & 0xff;
+		p[2 * i + 1] = v >> 8;
+	}
+}
+
+/* Called with the writer locked, for strips in file order. */
+static void write_strip( scan_writer *w, strip_job *job )
+{
+	struct iovec iov[2];
+	int32 n = 0;
+	if( w->buf_used ) {
+		iov[n].iov_base = w->buf;
+		iov[n++].iov_len = w->buf_used;
+	}
+	if( w->format == SCAN_FORMAT_PNG ) {
+		iov[n].iov_base = job->out;
+		iov[n++].iov_len = kChunkHead + job->out_size + kChunkTail;
+		w->adler = adler32_combine( w->adler, job->adler,
+									job->rows * w->strip_stride );
+	} else {
+		w->strip_offsets[ job->index ] = w->offset + w->buf_used;
+		w->strip_counts[ job->index ] = job->out_size;
+		iov[n].iov_base = job->out + kChunkHead;
+		iov[n++].iov_len = job->out_size;
+	}
+	w->buf_used = 0;
+	write_vector( w, iov, n );
+}
+
+/* Ends the file once its last strip is written, and closes it. */
+static void finish_file( scan_writer *w )
+{
+	if( w->error == B_OK && ! w->aborted ) {
+		if( w->format == SCAN_FORMAT_PNG ) {
+			uint8 adler[4];
+			put_be32( adler, w->adler );
+			put_png_chunk( w, "IDAT", adler, sizeof( adler ) );
+			put_png_chunk( w, "IEND", NULL, 0 );
+		} else {
+			if( ( w->offset + w->buf_used ) & 1 )
+				put_bytes( w, "", 1 );			// directories start on a word
+			uint32 ifdOffset = w->offset + w->buf_used;
+			uint8 *directory = new uint8[ tiff_directory_size( w, w->strips ) ];
+			uint8 *p = directory;
+			put_tiff_directory( w, p, ifdOffset, w->rows_per_strip, w->strips,
+								w->strip_offsets, w->strip_counts );
+			put_bytes( w, directory, p - directory );
+			delete[] directory;
+
+			uint8 offset[4];
+			p = offset;
+			put32( p, ifdOffset );
+			if( flush_buffer( w ) == B_OK
+					&& pwrite( w->fd, offset, sizeof( offset ), 4 ) != sizeof( offset ) )
+				w->error = errno;
+		}
+		flush_buffer( w );
+	}
+
+	if( close( w->fd ) != 0 && w->error == B_OK )
+		w->error = errno;
+	w->fd = -1;
+}
+
+static void free_strip( strip_job *job )
+{
+	if( ! job )
+		return;
+	free( job->raw );
+	free( job->out );
+	delete job;
+}
+
+static void delete_writer( scan_writer *w )
+{
+	free( w->path );
+	delete[] w->buf;
+	delete[] w->strip_offsets;
+	delete[] w->strip_counts;
+	delete w;
+}
@@ -12,11 +12,17 @@
 
 #include "ScanAddOn.h"
 #include "ScanBeConst.h"
+#include "ScanTrace.h"
+#include "ScanProcess.h"
+#include "ScanConvert.h"
+#include "ScanHost.h"
 
+#include <Autolock.h>
 #include <Directory.h>
 #include <File.h>
 #include <FindDirectory.h>
 #include <List.h>
+#include <Locker.h>
 #include <Path.h>
 #include <Resources.h>
 #define DEBUG 1
@@ -26,6 +32,7 @@
 #include <image.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <assert.h>
 
 /*	This is just a dummy placeholder, so I can identify my library's
@@ -54,31 +61,239 @@ Preferences gPrefs( "x-vnd.jbm-libscanbe" );
 PreferenceSet gSettings( gPrefs, "settings", true );
 const char* kPrefScannerName = "current_scanner";
 
-/* List to keep track of valid scan session identifiers. */
+/* One per open scan session, see the slot table below. */
+class readahead_ring;
+static void default_transfer( scan_transfer_info *info );
+static char* aligned_new( int32 size, int32 alignment );
+static void aligned_delete( char *data );
 class scanner_entry {
 public:
-	scanner_entry() { image = 0; hooks = NULL, cookie = NULL;
-						state = kScanStateClosed; }
+	scanner_entry() { image = 0; hooks = NULL, ext = NULL; cookie = NULL; id = NULL;
+						state = kScanStateClosed; lent = NULL;
+						lent_from_ring = false; lend_buf = NULL; lend_size = 0;
+						ra_depth = 0; ra_band_size = 0; ring = NULL;
+						cache_valid[0] = cache_valid[1] = cache_valid[2] = 0;
+						memset( &stats, 0, sizeof( stats ) );
+						stats.size = sizeof( stats ); stats.since = system_time();
+						last_data = 0; next_dump = 0;
+						processor = NULL; processing = false; cancelled = 0;
+						can_cancel = true; starting = 0;
+						row_bytes = 0; image_row = 0; caps = 0;
+						default_transfer( &transfer ); }
+	~scanner_entry() { aligned_delete( lend_buf ); processor_delete( processor ); }
 	image_id		image;
 	scan_hooks*		hooks;
+	scan_ext_hooks*	ext;			// NULL if the add-on has none
 	void*			cookie;
 	scan_state		state;
+	const void*		lent;			// band out on loan from scan_data_ex()
+	bool			lent_from_ring;
+	char*			lend_buf;		// copy buffer for add-ons that can't lend
+	int32			lend_size;
+	int32			ra_depth;		// from scan_set_readahead(), 0 is off
+	int32			ra_band_size;
+	readahead_ring*	ring;			// only while an image is open
+	scan_id			id;				// once it's in the slot table
+	BLocker			lock;			// held by every call on the session
+	BLocker			hook_lock;		// held around calls into the add-on
+	scan_settings	cache[3];		// by scan_setting_kind - 1
+	scan_settings_mask	cache_valid[3];	// which cache fields are up to date
+	BLocker			stats_lock;		// held only while counting
+	scan_stats		stats;
+	bigtime_t		last_data;		// when the last data call returned
+	bigtime_t		next_dump;		// for SCAN_STATS
+	scan_processor*	processor;		// NULL until processing is asked for
+	bool			processing;		// the open image is being processed
+	int32			cancelled;		// set by scan_cancel(), from any thread
+	BLocker			cancel_lock;	// held around the cancel hook
+	bool			can_cancel;		// until the close hook, under cancel_lock
+	int32			starting;		// in the start hook, see scan_close()
+	scan_transfer_info	transfer;	// for the open image, in whole rows
+	int32			row_bytes;		// of the open image, 0 if unknown
+	int32			image_row;		// next one the data calls hand out
+	scan_settings_mask	caps;		// from the get_capabilities hook
+};
+
+/*	The scan_settings fields that are cached, in the order get_settings()
+	fetches them. The current values are invalidated by the masks that
+	put_setting returns, and everything is invalidated whenever the add-on
+	may have changed things on its own (scan_start(), scan_open_image()). */
+static const scan_setting_id kSettingFields[] = {
+	SCAN_SETTING_AREA, SCAN_SETTING_IMAGETYPE, SCAN_SETTING_PIXELBITS,
+	SCAN_SETTING_RESOLUTION, SCAN_SETTING_BRIGHTNESS, SCAN_SETTING_CONTRAST,
+	SCAN_SETTING_SCALING, SCAN_SETTING_WIDTH, SCAN_SETTING_HEIGHT,
+	SCAN_SETTING_ROWBYTES
+};
+const int32 kNumSettingFields = sizeof( kSettingFields ) / sizeof( kSettingFields[0] );
+const scan_settings_mask kCachedSettings = SCAN_SETTING_AREA | SCAN_SETTING_IMAGETYPE
+	| SCAN_SETTING_PIXELBITS | SCAN_SETTING_RESOLUTION | SCAN_SETTING_BRIGHTNESS
+	| SCAN_SETTING_CONTRAST | SCAN_SETTING_SCALING | SCAN_SETTING_WIDTH
+	| SCAN_SETTING_HEIGHT | SCAN_SETTING_ROWBYTES;
+const scan_settings_mask kDerivedSettings = SCAN_SETTING_WIDTH | SCAN_SETTING_HEIGHT
+	| SCAN_SETTING_ROWBYTES;
+
+/*	Read-ahead pipeline. While an image is open, a producer thread keeps
+	pulling bands from the add-on into a ring of buffers; scan_data() and
+	scan_data_ex() drain them. The empty/full semaphores count free and
+	filled slots, so the producer stalls when the consumer falls behind. */
+struct readahead_slot {
+	char*			data;
+	int32			count;			// bytes the add-on delivered
+	int32			offset;			// bytes already handed out
+	status_t		status;			// data hook result for this band
+};
+
+class readahead_ring {
+public:
+	readahead_ring( int32 depth, int32 bandSize, int32 rowBytes,
+					int32 alignment );
+	~readahead_ring();
+	readahead_slot*	slots;
+	int32			depth;
+	int32			band_size;
+	int32			row_bytes;
+	int32			head;			// next slot drained by the consumer
+	int32			tail;			// next slot filled by the producer
+	sem_id			empty;
+	sem_id			full;
+	thread_id		thread;
+	volatile bool	quit;
+	bool			current;		// consumer has acquired slots[head]
+	bool			done;			// consumer has seen the last band
+};
+
+const int32 kDefaultBandSize = 64 * 1024L;
+const int32 kMaxReadaheadDepth = 64;
+
+/* Band size lent by scan_data_ex() when the caller leaves it up to us
+	and the add-on can't lend its own buffers. */
+const int32 kDefaultLendSize = 64 * 1024L;
+
+/* Most scan_data_into() borrows at a time, so a band is still in the
+	cache when it's converted. */
+const int32 kIntoBandSize = 128 * 1024L;
+
+/*	Session handles. A scan_id is a slot in this table plus the slot's
+	generation when the session was opened, so a stale or bogus id fails
+	the generation check instead of being searched for. Calls hold a
+	reference on the slot while they run; scan_close() retires the slot,
+	and whoever drops the last reference frees the entry and unloads the
+	add-on. Only opening and freeing take gSlotLocker. */
+struct scanner_slot {
+	scanner_entry*	entry;			// NULL when the slot is free
+	int32			generation;
+	int32			refs;
+	int32			closing;
+};
+
+const int32 kSlotBits = 8;
+const int32 kMaxSessions = 1 << kSlotBits;
+const int32 kGenerationMask = ( 1 << ( 31 - kSlotBits ) ) - 1;
+
+static scanner_slot gSlots[kMaxSessions];
+static BLocker gSlotLocker;
+
+/* Holds a session's slot for the length of a call. */
+class session_ref {
+public:
+	session_ref( scan_id id );
+	~session_ref();
+	scanner_entry*	entry;			// NULL if the id isn't valid
+private:
+	scanner_slot*	slot;
 };
-static BList gScannerList;
-static BLocker gListLocker;
 
 /* For passing data to a callback function. */
 struct walk_info {
 	char		*name;
 	image_id	id;
+	char		*path;		// if not NULL, gets the add-on's path instead of loading it
+};
+
+/*	Persistent index of which add-on file publishes which scanner names,
+	saved with the settings so scan_open() only loads the add-on it needs.
+	Records are revalidated against the file's modification time and size. */
+class addon_record {
+public:
+	addon_record() { path = NULL; names = NULL; names_size = 0;
+						mtime = 0; size = 0; seen = false; }
+	~addon_record() { delete[] path; delete[] names; }
+	bool			has_name( const char *name ) const;
+	char*			path;
+	char*			names;		// NUL separated, empty string terminated
+	int32			names_size;
+	int64			mtime;
+	int64			size;
+	bool			seen;
+};
+static BList gAddonIndex;
+static BLocker gIndexLocker;		// also guards gSettings
+static bool gIndexLoaded = false;
+const char* kPrefAddonIndex = "addon_index";
+const int32 kAddonIndexVersion = 1;
+
+/* For the index refresh callback. */
+struct index_walk {
+	walk_info	*want;
+	bool		changed;
+};
+
+/*	In-memory catalog of the add-on directory, which scan_get_addons()
+	answers from. Files that aren't add-ons are kept too, so they aren't
+	read again. Entries are in directory order and hold resolved paths. */
+struct catalog_entry {
+	CallbackInfo	info;
+	int64			mtime;
+	int64			size;
+	bool			addon;
+	bool			was_addon;		// before it was last read
+};
+static BList gCatalog;
+static BLocker gCatalogLocker;
+static char gCatalogDir[B_PATH_NAME_LENGTH];	// empty until it's found
+static time_t gCatalogDirTime = 0;		// the directory's, when it was listed
+static time_t gCatalogListed = 0;		// when that was
+const int32 kCatalogReaders = 4;
+const int32 kCatalogPerReader = 8;		// files, so a thread is worth starting
+
+/* For the threads reading new entries, see read_catalog(). */
+struct catalog_read {
+	BList		*entries;
+	int32		next;
 };
 
-/* Troubleshooting. */
-static bool gDebug = false;
+/* A change refresh_catalog() found, for the watchers. */
+struct catalog_change {
+	scan_addon_change	change;
+	CallbackInfo		info;
+};
+
+/* See scan_watch_addons(). */
+struct addon_watcher {
+	ScanWatchProc	callback;
+	void			*data;
+	int32			calls;			// notify_watchers() going through it
+	bool			removed;		// deleted by the last of them
+};
+static BList gWatchers;
+static BLocker gWatchLocker;
+static thread_id gWatchThread = -1;
+static sem_id gWatchQuit = -1;			// deleted to stop the thread
+const bigtime_t kWatchInterval = 1000000;
+
+/* Troubleshooting. Set SCAN_DEBUG before the library is loaded. */
+static bool debug_enabled();
+static const bool gDebug = debug_enabled();
+
+/* Statistics printout, also set before the library is loaded. -1 is off,
+	0 when each session closes, more is that many microseconds apart. */
+static bigtime_t stats_interval();
+static const bigtime_t gStatsInterval = stats_interval();
 const char *dbgname = "libscanbe";
 
 /*	These are for querying the image of the add-on. */
 typedef scan_hooks* (*find_proc)( const char *name );
+typedef scan_ext_hooks* (*find_ext_proc)( const char *name );
 
 /*	Some local function prototypes. */
 static status_t get_settings( scanner_entry *entry, scan_setting_kind kind,
@@ -86,9 +301,72 @@ static status_t get_settings( scanner_entry *entry, scan_setting_kind kind,
 static status_t put_settings( scanner_entry *entry,
 								scan_settings *settings,
 								scan_settings_mask *mask );
-static status_t check_addon_name( const CallbackInfo *info, void *data );
+static status_t get_all_settings( scanner_entry *entry, scan_settings *current,
+								scan_settings *minimum, scan_settings *maximum );
+static status_t get_one_setting( scanner_entry *entry, scan_setting_id setting,
+								scan_setting_kind kind, scan_value *value );
+static void invalidate_settings( scanner_entry *entry, scan_settings_mask written,
+								scan_settings_mask changed );
+static scan_id add_entry( scanner_entry *entry );
+static void retire_entry( scan_id id );
+static void free_entry( scanner_slot *slot );
+static void get_field( const scan_settings *settings, scan_setting_id setting,
+								scan_value *value );
+static void set_field( scan_settings *settings, scan_setting_id setting,
+								const scan_value *value );
+static status_t index_addon( const CallbackInfo *info, void *data );
+static status_t find_addon_image( walk_info *info );
+static status_t find_indexed_addon( walk_info *info, BList *changes );
+static addon_record* find_record_by_name( const char *name );
+static addon_record* find_record_by_path( const char *path );
+static status_t stat_addon( const char *path, int64 *mtime, int64 *size );
+static void load_addon_index();
+static void save_addon_index();
 static status_t get_addon_dir( BDirectory* dir );
 static status_t get_addon_info( const BEntry &entry, CallbackInfo &info );
+static status_t refresh_catalog( BList *changes, bool files );
+static status_t walk_catalog( ScanAddonProc callback, void *data );
+static catalog_entry* take_catalog_entry( const char *path );
+static void read_catalog( BList *entries );
+static status_t catalog_reader( void *data );
+static void read_catalog_entry( catalog_entry *e );
+static void add_change( BList *changes, scan_addon_change change,
+						const CallbackInfo *info );
+static void notify_watchers( BList *changes );
+static status_t watch_thread( void *data );
+static status_t release_lent_data( scanner_entry *entry );
+static status_t lend_band( scanner_entry *entry, const void **buffer,
+								int32 *count );
+static int32 into_row_bytes( const scan_settings *settings,
+								scan_pixel_format format );
+static void convert_into( const scan_settings *settings,
+								const scan_destination *dest, const char *src,
+								char *dst, char *temp, int32 row );
+static status_t read_band( scanner_entry *entry, void *buffer, int32 *count );
+static status_t fetch_band( scanner_entry *entry, void *buffer, int32 *count );
+static bool emulates_tonemap( scanner_entry *entry, scan_setting_id setting );
+static status_t start_readahead( scanner_entry *entry );
+static void stop_readahead( scanner_entry *entry );
+static status_t readahead_thread( void *data );
+static status_t readahead_take( scanner_entry *entry, int32 max,
+								const void **rows, int32 *count );
+static void readahead_recycle( scanner_entry *entry );
+static status_t call_get_setting( scanner_entry *entry, scan_setting_id setting,
+								scan_setting_kind kind, scan_value *value );
+static status_t call_put_setting( scanner_entry *entry, scan_setting_id setting,
+								scan_value *value, scan_settings_mask *mask );
+static void add_time( scan_call_stats *stats, bigtime_t time, status_t status );
+static void count_hook( scanner_entry *entry, scan_hook_id hook, bigtime_t start,
+								status_t status );
+static void count_data( scanner_entry *entry, bigtime_t start, status_t status,
+								int32 count );
+static bigtime_t histogram_percentile( const scan_call_stats *stats, int32 pct );
+static void print_call_stats( const char *name, const scan_call_stats *stats );
+static void dump_stats( scanner_entry *entry );
+static void set_state( scanner_entry *entry, scan_state state );
+static void get_transfer_info( scanner_entry *entry, int32 rowBytes,
+								scan_transfer_info *info );
+static int32 whole_rows( int32 bytes, int32 rowBytes );
 
 /* Used by the prefs applet, but not officially part of the API. */
 #pragma export on
@@ -109,76 +387,91 @@ void scan_get_version( scan_version *version )
 
 status_t scan_get_addons( ScanAddonProc callback, void *data )
 {
+	api_trace trace( kTraceGetAddons, NULL );
 	if( ! callback )
 		return SCAN_BAD_PARAM;
 		
-	BEntry entry;
-	BNode node;
-	int32 len = 0;
-	bool keepGoing = true;
-	status_t status;
-									// grab add-on subdir
-	BDirectory dir;
-	status = get_addon_dir( &dir );
+	BList changes;
+	status_t status = refresh_catalog( &changes, false );
+	notify_watchers( &changes );
 	if( status != B_OK ) {
 		if( gDebug )
 			printf( "%s: couldn't find add-on directory\n", dbgname );
 		return status;
 	}
-	dir.Rewind();
-									// add-ons can be symlinks
-	while( keepGoing ) {
-		status = dir.GetNextEntry( &entry );
-		if( status != B_OK ) {
-			keepGoing = false;
-			continue;
-		}
-		if( entry.IsSymLink() ) {	// resolve sym-link
-			entry_ref ref;
-			status = entry.GetRef( &ref );
-			if( status != B_OK )
-				continue;
-			status = entry.SetTo( &ref, true );
-			if( status != B_OK )
-				continue;
+	return walk_catalog( callback, data );
+}
+
+
+status_t scan_watch_addons( ScanWatchProc callback, void *data )
+{
+	api_trace trace( kTraceWatchAddons, NULL );
+	if( ! callback )
+		return SCAN_BAD_PARAM;
+									// up to date, so it only hears
+									// about what changes from now on
+	BList changes;
+	refresh_catalog( &changes, true );
+	notify_watchers( &changes );
+	
+	BAutolock lock( gWatchLocker );
+	addon_watcher *w = new addon_watcher;
+	w->callback = callback;
+	w->data = data;
+	w->calls = 0;
+	w->removed = false;
+	gWatchers.AddItem( w );
+	if( gWatchThread < B_OK ) {
+		gWatchQuit = create_sem( 0, "scan add-on watch" );
+		gWatchThread = spawn_thread( watch_thread, "scan add-on watch",
+									B_LOW_PRIORITY, NULL );
+		if( gWatchThread >= B_OK )
+			resume_thread( gWatchThread );
+	}
+	return B_OK;
+}
+
+
+status_t scan_unwatch_addons( ScanWatchProc callback, void *data )
+{
+	api_trace trace( kTraceUnwatchAddons, NULL );
+	thread_id thread = -1;
+	{
+		BAutolock lock( gWatchLocker );
+		addon_watcher *w = NULL;
+		for( int32 i = 0; ( w = (addon_watcher *) gWatchers.ItemAt( i ) ); i++ ) {
+			if( w->callback == callback && w->data == data )
+				break;
 		}
-		if( ! entry.IsFile() )
-			continue;
-		if( B_OK != node.SetTo( &entry ) )
-			continue;
-									// check for right file type
-		char buf[256];
-		len = node.ReadAttr( kTypeAttr, 0, 0, buf, 255 );
-		if( len <= 0 )
-			continue;
-		buf[len] = 0;
-		if( strcmp( buf, kAddonMimeType ) )
-			continue;
-									// whoever wanted the info, here it is
-		CallbackInfo info;
-		status = get_addon_info( entry, info );
-		if( status == B_OK ) {
-			status = callback( &info, data );
-			if( status == 0 )
-				continue;
-			else
-				return status;
+		if( ! w )
+			return SCAN_BAD_PARAM;
+		gWatchers.RemoveItem( w );
+		if( w->calls > 0 )
+			w->removed = true;
+		else
+			delete w;
+		if( gWatchers.IsEmpty() && gWatchThread >= B_OK ) {
+			thread = gWatchThread;
+			delete_sem( gWatchQuit );
+			gWatchThread = -1;
+			gWatchQuit = -1;
 		}
-		if( info.path )
-			delete[] info.path;
 	}
-	
+									// not if it's the watch thread
+									// itself, from a callback
+	if( thread >= B_OK && thread != find_thread( NULL ) ) {
+		status_t exitValue;
+		wait_for_thread( thread, &exitValue );
+	}
 	return B_OK;
 }
 
-/* Loads the scanner add-on and call its open() function. */
+/* Loads the scanner add-on and call its open() function. With SCANBE_HOST
+	set, the add-on is loaded by a ScanHost team instead, see ScanHost.h. */
 status_t scan_open( const char* name, scan_id *id, scan_version *version )
 {
 	status_t status = B_OK;
-	char *debugEnviron = getenv( "SCAN_DEBUG" );
-	gDebug = debugEnviron && strlen( debugEnviron ) > 0;
-	if( gDebug )
-		printf( "%s: entering scan_open\n", dbgname );
+	api_trace trace( kTraceOpen, NULL );
 		
 								// locate the add-on dir
 	BDirectory dir;
@@ -189,8 +482,8 @@ status_t scan_open( const char* name, scan_id *id, scan_version *version )
 		return status;
 	}
 								// none specified, take the prefs applet one
+	char buf[SCAN_STRING_LENGTH];
 	if( ! name ) {
-		char buf[SCAN_STRING_LENGTH];
 		if( libscanbe_get_scanner( buf ) )
 			name = buf;
 		else {
@@ -202,11 +495,36 @@ status_t scan_open( const char* name, scan_id *id, scan_version *version )
 	
 	walk_info info;
 	info.name = (char *) name;
-	status = scan_get_addons( check_addon_name, &info );
-	if( status != B_OK || info.id < B_OK )
+	info.id = B_ERROR;
+	char path[B_PATH_NAME_LENGTH];
+	info.path = NULL;
+	if( host_wanted() ) {
+		path[0] = 0;
+		info.path = path;
+	}
+	status = find_addon_image( &info );
+	if( status != B_OK || ( info.path ? ! path[0] : info.id < B_OK ) )
 		return SCAN_NO_ADDON;
 								// make the scanner entry
 	find_proc func;
+	scan_hooks* hooks;
+	scanner_entry *entry;
+	if( info.path ) {
+								// or leave the add-on to a host team
+		scan_host *host;
+		status = host_launch( path, name, &host );
+		if( status != B_OK ) {
+			if( gDebug )
+				printf( "%s: couldn't start a host for '%s'\n", dbgname, path );
+			return status;
+		}
+		entry = new scanner_entry;
+		entry->image = B_ERROR;
+		entry->hooks = host_hooks();
+		entry->ext = host_ext_hooks( host );
+		entry->cookie = host;			// the open hook takes it from here
+		goto openHook;
+	}
 	status = get_image_symbol( info.id, kFindScannerFunction,
 								B_SYMBOL_TYPE_TEXT, &func );
 	if( status != B_OK ) {
@@ -215,49 +533,94 @@ status_t scan_open( const char* name, scan_id *id, scan_version *version )
 		goto errXit;
 	}
 	
-	scan_hooks* hooks = func( name );
+	hooks = func( name );
 	if( ! hooks ) {
 		if( gDebug )
 			printf( "%s: no add-on hooks for %s\n", dbgname, name );
-		return B_BAD_ADDRESS;
+		status = B_BAD_ADDRESS;
+		goto errXit;
 	}
 	
-	scanner_entry *entry = new scanner_entry;
+	entry = new scanner_entry;
 	ASSERT( entry );
 	entry->image = info.id;
 	entry->hooks = hooks;
-	gListLocker.Lock();
-	gScannerList.AddItem( entry );
-	gListLocker.Unlock();
-	*id = entry;
-
+								// optional hooks, if the add-on has any
+	find_ext_proc extFunc;
+	if( get_image_symbol( info.id, kFindScannerExtFunction,
+							B_SYMBOL_TYPE_TEXT, &extFunc ) == B_OK )
+		entry->ext = extFunc( name );
+
+openHook:
+	bigtime_t start;
+	start = system_time();
 	status = entry->hooks->open( version, &entry->cookie );
-	if( status == B_OK )
-		entry->state = kScanStateOpen;
-	else {
+	count_hook( entry, SCAN_HOOK_OPEN, start, status );
+	if( status != B_OK ) {
 		if( gDebug )
-			printf( "%s: open hook failed: %ld\n", status );
+			printf( "%s: open hook failed: %ld\n", dbgname, status );
+		delete entry;
+		goto errXit;
 	}
-	return status;
+								// 0 if it fails, so tone maps are emulated
+	start = system_time();
+	status = entry->hooks->get_capabilities( entry->cookie, &entry->caps );
+	count_hook( entry, SCAN_HOOK_GET_CAPABILITIES, start, status );
+	if( status != B_OK )
+		entry->caps = 0;
+	*id = add_entry( entry );
+	if( ! *id ) {
+		if( gDebug )
+			printf( "%s: too many open sessions\n", dbgname );
+		entry->hooks->close( entry->cookie );
+		delete entry;
+		status = B_NO_MEMORY;
+		goto errXit;
+	}
+	trace.session = *id;
+	set_state( entry, kScanStateOpen );
+	return B_OK;
 	
 errXit:
-	unload_add_on( info.id );
+	if( info.id >= B_OK )
+		unload_add_on( info.id );
 	return status;
 }
 
 
 status_t scan_close( const scan_id id )
 {
-	if( gDebug )
-		printf( "%s: entering scan_close\n", dbgname );
+	api_trace trace( kTraceClose, id );
 		
-	if( gScannerList.IndexOf( id ) < 0 ) {
+	session_ref ref( id );
+	scanner_entry *entry = ref.entry;
+	if( ! entry ) {
 		if( gDebug )
 			printf( "%s: invalid scan_id\n", dbgname );
 		return SCAN_BADID;
 	}
 	
-	scanner_entry *entry = (scanner_entry *) id;
+	// A scan_start() waiting on the add-on's interface holds the lock
+	// until the user is done with it. An add-on without a cancel hook
+	// is closed under it instead, as it always was, which is what makes
+	// scan_start() return; the rest of the close waits for that.
+	status_t status = B_OK;
+	bool closedEarly = false;
+	if( ! HAS_EXT_HOOK( entry, cancel ) && atomic_get( &entry->starting ) ) {
+		atomic_or( &entry->cancelled, 1 );
+		retire_entry( id );
+		bigtime_t start = system_time();
+		status = entry->hooks->close( entry->cookie );
+		count_hook( entry, SCAN_HOOK_CLOSE, start, status );
+		closedEarly = true;
+	}
+	BAutolock lock( entry->lock );
+	if( closedEarly ) {
+		set_state( entry, kScanStateClosed );
+		if( gStatsInterval >= 0 )
+			dump_stats( entry );
+		return status;
+	}
 	
 	if( entry->state < kScanStateOpen ) {
 		if( gDebug )
@@ -265,18 +628,34 @@ status_t scan_close( const scan_id id )
 		return SCAN_BAD_PHASE;
 	}
 	
-	status_t status = B_OK;
 	if( entry->state >= kScanStateImageOpen ) {
+		release_lent_data( entry );
+		stop_readahead( entry );
+		BAutolock hookLock( entry->hook_lock );
+		bigtime_t start = system_time();
 		status = entry->hooks->close_image( entry->cookie );
+		count_hook( entry, SCAN_HOOK_CLOSE_IMAGE, start, status );
 		if( status != B_OK )
 			return status;
 	}
 	
-	gListLocker.Lock();
-	gScannerList.RemoveItem( entry );
-	gListLocker.Unlock();
+	// no new calls get in from here on; the entry goes away once
+	// the ones already running are done with it
+	retire_entry( id );
+	{
+			// a scan_cancel() already past the slot check is done with
+			// the cookie before it goes
+		BAutolock cancelLock( entry->cancel_lock );
+		entry->can_cancel = false;
+	}
 
+	BAutolock hookLock( entry->hook_lock );
+	bigtime_t start = system_time();
 	status = entry->hooks->close( entry->cookie );
+	count_hook( entry, SCAN_HOOK_CLOSE, start, status );
+	set_state( entry, kScanStateClosed );
+	if( gStatsInterval >= 0 )
+		dump_stats( entry );
 	if( status != B_OK ) {
 		if( gDebug )
 			printf( "%s: close hook failed: %ld\n", dbgname, status );
@@ -289,16 +668,16 @@ status_t scan_close( const scan_id id )
 
 status_t scan_get_capabilities( const scan_id id , scan_settings_mask *mask )
 {
-	if( gDebug )
-		printf( "%s: entering scan_get_capabilities\n", dbgname );
+	api_trace trace( kTraceGetCapabilities, id );
 		
-	if( gScannerList.IndexOf( id ) < 0 ) {
+	session_ref ref( id );
+	scanner_entry *entry = ref.entry;
+	if( ! entry ) {
 		if( gDebug )
 			printf( "%s: invalid scan_id\n", dbgname );
 		return SCAN_BADID;
 	}
-		
-	scanner_entry *entry = (scanner_entry *) id;
+	BAutolock lock( entry->lock );
 
 	if( entry->state < kScanStateOpen ) {
 		if( gDebug )
@@ -306,26 +685,34 @@ status_t scan_get_capabilities( const scan_id id , scan_settings_mask *mask )
 		return SCAN_BAD_PHASE;
 	}
 
+	BAutolock hookLock( entry->hook_lock );
+	bigtime_t start = system_time();
 	status_t status = entry->hooks->get_capabilities( entry->cookie, mask );
+	count_hook( entry, SCAN_HOOK_GET_CAPABILITIES, start, status );
 	if( status != B_OK && gDebug )
 		printf( "%s: get_capabilities hook failed: %d\n", dbgname, status );
-		
+	if( status == B_OK )
+		entry->caps = *mask;
+	
+	// tone maps are done here when the scanner can't
+	if( status == B_OK )
+		*mask |= SCAN_SETTING_TONEMAP | SCAN_SETTING_TONEMAP3;
 	return status;
 }
 
 status_t scan_get_settings( const scan_id id, scan_settings *current,
 						scan_settings *minimum, scan_settings *maximum )
 {
-	if( gDebug )
-		printf( "%s: entering scan_get_settings\n", dbgname );
+	api_trace trace( kTraceGetSettings, id );
 		
-	if( gScannerList.IndexOf( id ) < 0 ) {
+	session_ref ref( id );
+	scanner_entry *entry = ref.entry;
+	if( ! entry ) {
 		if( gDebug )
 			printf( "%s: invalid scan_id\n", dbgname );
 		return SCAN_BADID;
 	}
-		
-	scanner_entry *entry = (scanner_entry *) id;
+	BAutolock lock( entry->lock );
 
 	if( entry->state < kScanStateOpen ) {
 		if( gDebug )
@@ -333,41 +720,23 @@ status_t scan_get_settings( const scan_id id, scan_settings *current,
 		return SCAN_BAD_PHASE;
 	}
 
-	status_t status = B_OK;
-	
-	if( current ) {
-		status = get_settings( entry, SCAN_SETTING_CURRENT, current );
-		if( status != B_OK )
-			return status;
-	}
-	if( minimum ) {
-		status = get_settings( entry, SCAN_SETTING_MINIMUM, minimum );
-		if( status != B_OK )
-			return status;
-	}
-	if( maximum ) {
-		status = get_settings( entry, SCAN_SETTING_MAXIMUM, maximum );
-		if( status != B_OK )
-			return status;
-	}
-	
-	return B_OK;
+	return get_all_settings( entry, current, minimum, maximum );
 }
 
 
 status_t scan_put_settings( const scan_id id, scan_settings *settings,
 							scan_settings_mask *mask )
 {
-	if( gDebug )
-		printf( "%s: entering scan_put_settings\n", dbgname );
+	api_trace trace( kTracePutSettings, id );
 		
-	if( gScannerList.IndexOf( id ) < 0 ) {
+	session_ref ref( id );
+	scanner_entry *entry = ref.entry;
+	if( ! entry ) {
 		if( gDebug )
 			printf( "%s: invalid scan_id\n", dbgname );
 		return SCAN_BADID;
 	}
-		
-	scanner_entry *entry = (scanner_entry *) id;
+	BAutolock lock( entry->lock );
 
 	if( entry->state < kScanStateOpen || entry->state >= kScanStateImageOpen ) {
 		if( gDebug )
@@ -376,6 +745,8 @@ status_t scan_put_settings( const scan_id id, scan_settings *settings,
 	}
 
 	status_t status = put_settings( entry, settings, mask );
+	invalidate_settings( entry, kCachedSettings & ~kDerivedSettings,
+						status == B_OK ? *mask : kCachedSettings );
 	return status;
 }
 
@@ -384,16 +755,16 @@ status_t scan_get_one_setting( const scan_id id, const scan_setting_id setting,
 								const scan_setting_kind setting_kind,
 								scan_value *value_ptr )
 {
-	if( gDebug )
-		printf( "%s: entering scan_get_one_setting (%ld)\n", dbgname, setting );
+	api_trace trace( kTraceGetOneSetting, id );
 		
-	if( gScannerList.IndexOf( id ) < 0 ) {
+	session_ref ref( id );
+	scanner_entry *entry = ref.entry;
+	if( ! entry ) {
 		if( gDebug )
 			printf( "%s: invalid scan_id\n", dbgname );
 		return SCAN_BADID;
 	}
-		
-	scanner_entry *entry = (scanner_entry *) id;
+	BAutolock lock( entry->lock );
 
 	if( entry->state < kScanStateOpen ) {
 		if( gDebug )
@@ -401,29 +772,30 @@ status_t scan_get_one_setting( const scan_id id, const scan_setting_id setting,
 		return SCAN_BAD_PHASE;
 	}
 
-	status_t status = entry->hooks->get_setting( entry->cookie, setting,
-												setting_kind, value_ptr );
-	if( status != B_OK && gDebug )
-		printf( "%s: get_setting hook failed: %ld, setting=%ld\n",
-			dbgname, status, setting );
-		
-	return status;
+	if( emulates_tonemap( entry, setting ) ) {
+		if( setting_kind != SCAN_SETTING_CURRENT )
+			return SCAN_INVALID_SETTING;
+		value_ptr->ptr = entry->processor
+				? (void *) processor_tonemap( entry->processor, setting ) : NULL;
+		return B_OK;
+	}
+	return get_one_setting( entry, setting, setting_kind, value_ptr );
 }
 
 
 status_t scan_put_one_setting( const scan_id id, const scan_setting_id setting,
 								scan_value *value_ptr, scan_settings_mask *mask )
 {
-	if( gDebug )
-		printf( "%s: entering scan_put_one_setting (%ld)\n", dbgname, setting );
+	api_trace trace( kTracePutOneSetting, id );
 		
-	if( gScannerList.IndexOf( id ) < 0 ) {
+	session_ref ref( id );
+	scanner_entry *entry = ref.entry;
+	if( ! entry ) {
 		if( gDebug )
 			printf( "%s: invalid scan_id\n", dbgname );
 		return SCAN_BADID;
 	}
-		
-	scanner_entry *entry = (scanner_entry *) id;
+	BAutolock lock( entry->lock );
 
 	if( entry->state < kScanStateOpen || entry->state >= kScanStateImageOpen ) {
 		if( gDebug )
@@ -431,11 +803,37 @@ status_t scan_put_one_setting( const scan_id id, const scan_setting_id setting,
 		return SCAN_BAD_PHASE;
 	}
 
-	status_t status = entry->hooks->put_setting( entry->cookie, setting,
-												value_ptr, mask );
+	if( emulates_tonemap( entry, setting ) ) {
+		if( value_ptr->ptr ) {
+				// a map the processor wouldn't apply mustn't look taken
+			scan_value type, bits;
+			status_t status = get_one_setting( entry, SCAN_SETTING_IMAGETYPE,
+										SCAN_SETTING_CURRENT, &type );
+			if( status == B_OK )
+				status = get_one_setting( entry, SCAN_SETTING_PIXELBITS,
+										SCAN_SETTING_CURRENT, &bits );
+			if( status != B_OK )
+				return status;
+			if( ! processor_handles( type.type, bits.u_int ) ) {
+				if( gDebug )
+					printf( "%s: can't do tone maps for type %ld at %ld bits\n",
+						dbgname, type.type, bits.u_int );
+				return SCAN_BAD_PARAM;
+			}
+		}
+		if( ! entry->processor )
+			entry->processor = processor_create();
+		*mask = 0;
+		return processor_set_tonemap( entry->processor, setting,
+									(const int32 *) value_ptr->ptr );
+	}
+	
+	BAutolock hookLock( entry->hook_lock );
+	status_t status = call_put_setting( entry, setting, value_ptr, mask );
 	if( status != B_OK && gDebug )
 		printf( "%s: put_setting hook failed: %ld, setting=%ld\n",
 			dbgname, status, setting );
+	invalidate_settings( entry, setting, status == B_OK ? *mask : kCachedSettings );
 	
 	return status;
 }
@@ -443,28 +841,50 @@ status_t scan_put_one_setting( const scan_id id, const scan_setting_id setting,
 
 status_t scan_open_image( const scan_id id )
 {
-	if( gDebug )
-		printf( "%s: entering scan_open_image\n", dbgname );
+	api_trace trace( kTraceOpenImage, id );
 		
-	if( gScannerList.IndexOf( id ) < 0 ) {
+	session_ref ref( id );
+	scanner_entry *entry = ref.entry;
+	if( ! entry ) {
 		if( gDebug )
 			printf( "%s: invalid scan_id\n", dbgname );
 		return SCAN_BADID;
 	}
-		
-	scanner_entry *entry = (scanner_entry *) id;
+	BAutolock lock( entry->lock );
 
 	if( entry->state != kScanStateOpen ) {
 		if( gDebug )
 			printf( "%s: id not open\n", dbgname );
 		return SCAN_BAD_PHASE;
 	}
+	atomic_set( &entry->cancelled, 0 );		// forget one from before
 	
+	BAutolock hookLock( entry->hook_lock );
+	bigtime_t start = system_time();
 	status_t status = entry->hooks->open_image( entry->cookie );
+	count_hook( entry, SCAN_HOOK_OPEN_IMAGE, start, status );
 	
-	if( status == B_OK )
-		entry->state = kScanStateImageOpen;
-	else if( gDebug )
+	// the image size may only be final now
+	invalidate_settings( entry, kCachedSettings, kCachedSettings );
+	
+	if( status == B_OK ) {
+		set_state( entry, kScanStateImageOpen );
+		{
+			BAutolock statsLock( entry->stats_lock );
+			entry->stats.images++;
+			entry->last_data = 0;		// the wait for this one isn't the app's
+		}
+		entry->processing = false;
+		scan_settings settings;
+		status_t settingsStat = get_all_settings( entry, &settings, NULL, NULL );
+		entry->row_bytes = settingsStat == B_OK ? settings.row_bytes : 0;
+		entry->image_row = 0;
+		get_transfer_info( entry, entry->row_bytes, &entry->transfer );
+		if( entry->processor && settingsStat == B_OK )
+			entry->processing = processor_begin_image( entry->processor, &settings );
+		if( entry->ra_depth > 0 && start_readahead( entry ) != B_OK && gDebug )
+			printf( "%s: couldn't start read-ahead, reading directly\n", dbgname );
+	} else if( gDebug )
 		printf( "%s: open_image hook failed\n", dbgname );
 		
 	return status;
@@ -473,27 +893,33 @@ status_t scan_open_image( const scan_id id )
 
 status_t scan_close_image( const scan_id id )
 {
-	if( gDebug )
-		printf( "%s: entering scan_close_image\n", dbgname );
+	api_trace trace( kTraceCloseImage, id );
 		
-	if( gScannerList.IndexOf( id ) < 0 ) {
+	session_ref ref( id );
+	scanner_entry *entry = ref.entry;
+	if( ! entry ) {
 		if( gDebug )
 			printf( "%s: invalid scan_id\n", dbgname );
 		return SCAN_BADID;
 	}
-		
-	scanner_entry *entry = (scanner_entry *) id;
+	BAutolock lock( entry->lock );
 	
 	if( entry->state < kScanStateImageOpen ) {
 		if( gDebug )
 			printf( "%s: image not open\n", dbgname );
 		return SCAN_BAD_PHASE;
 	}
-		
+	
+	release_lent_data( entry );
+	stop_readahead( entry );
+	atomic_set( &entry->cancelled, 0 );		// it was for this image
+	BAutolock hookLock( entry->hook_lock );
+	bigtime_t start = system_time();
 	status_t status = entry->hooks->close_image( entry->cookie );
+	count_hook( entry, SCAN_HOOK_CLOSE_IMAGE, start, status );
 	
 	if( status == B_OK )
-		entry->state = kScanStateOpen;
+		set_state( entry, kScanStateOpen );
 	else if( gDebug )
 		printf( "%s: close_image hook failed\n", dbgname );
 		
@@ -503,24 +929,35 @@ status_t scan_close_image( const scan_id id )
 
 status_t scan_start( const scan_id id )
 {
-	if( gDebug )
-		printf( "%s: entering scan_start\n", dbgname );
+	api_trace trace( kTraceStart, id );
 		
-	if( gScannerList.IndexOf( id ) < 0 ) {
+	session_ref ref( id );
+	scanner_entry *entry = ref.entry;
+	if( ! entry ) {
 		if( gDebug )
 			printf( "%s: invalid scan_id\n", dbgname );
 		return SCAN_BADID;
 	}
-		
-	scanner_entry *entry = (scanner_entry *) id;
+	BAutolock lock( entry->lock );
 
 	if( entry->state < kScanStateOpen || entry->state >= kScanStateImageOpen ) {
 		if( gDebug )
 			printf( "%s: id not open, or image already open\n", dbgname );
 		return SCAN_BAD_PHASE;
 	}
+	atomic_set( &entry->cancelled, 0 );		// forget one from before
 		
+	BAutolock hookLock( entry->hook_lock );
+	bigtime_t start = system_time();
+	atomic_set( &entry->starting, 1 );
 	status_t status = entry->hooks->start( entry->cookie );
+	atomic_set( &entry->starting, 0 );
+	count_hook( entry, SCAN_HOOK_START, start, status );
+	if( atomic_and( &entry->cancelled, 0 ) )
+		status = SCAN_USER_CANCEL;		// whatever the add-on made of it
+	
+	// the user may have changed anything in the add-on's interface
+	invalidate_settings( entry, kCachedSettings, kCachedSettings );
 	
 	if( status != B_OK && gDebug )
 		printf( "%s: start hook failed\n", dbgname );
@@ -531,16 +968,16 @@ status_t scan_start( const scan_id id )
 
 status_t scan_data( const scan_id id, void *buffer, int32 *count )
 {
-	if( gDebug )
-		printf( "%s: entering scan_data\n", dbgname );
+	api_trace trace( kTraceData, id );
 		
-	if( gScannerList.IndexOf( id ) < 0 ) {
+	session_ref ref( id );
+	scanner_entry *entry = ref.entry;
+	if( ! entry ) {
 		if( gDebug )
 			printf( "%s: invalid scan_id\n", dbgname );
 		return SCAN_BADID;
 	}
-		
-	scanner_entry *entry = (scanner_entry *) id;
+	BAutolock lock( entry->lock );
 
 	if( entry->state < kScanStateImageOpen ) {
 		if( gDebug )
@@ -548,10 +985,34 @@ status_t scan_data( const scan_id id, void *buffer, int32 *count )
 		return SCAN_BAD_PHASE;
 	}
 	
-	status_t result = entry->hooks->data( entry->cookie, buffer, count );
+	if( entry->lent ) {
+		if( gDebug )
+			printf( "%s: scan_data with a band still lent out\n", dbgname );
+		return SCAN_BAD_PHASE;
+	}
+	if( atomic_get( &entry->cancelled ) ) {
+		*count = 0;
+		return SCAN_USER_CANCEL;
+	}
+	
+	bigtime_t start = system_time();
+	status_t result;
+	if( entry->ring ) {
+			// a max of 0 would take the rest of the band, however big
+		if( *count <= 0 )
+			return SCAN_BAD_PARAM;
+		const void *rows;
+		int32 max = *count;
+		result = readahead_take( entry, max, &rows, count );
+		if( *count > 0 )
+			memcpy( buffer, rows, *count );
+		readahead_recycle( entry );
+	} else
+		result = read_band( entry, buffer, count );
+	count_data( entry, start, result, *count );
 	
 	if( result == B_OK )
-		entry->state = kScanStateData;
+		set_state( entry, kScanStateData );
 	else if (gDebug )
 		printf( "%s: data hook failed\n", dbgname );
 		
@@ -559,170 +1020,1483 @@ status_t scan_data( const scan_id id, void *buffer, int32 *count )
 }
 
 
-bool scan_adf_ready( const scan_id id )
+status_t scan_data_ex( const scan_id id, const void **buffer, int32 *count )
 {
-	if( gDebug )
-		printf( "%s: entering scan_adf_ready\n", dbgname );
-		
-	if( gScannerList.IndexOf( id ) < 0 )
-		return false;
+	api_trace trace( kTraceDataEx, id );
 		
-	scanner_entry *entry = (scanner_entry *) id;
+	session_ref ref( id );
+	scanner_entry *entry = ref.entry;
+	if( ! entry ) {
+		if( gDebug )
+			printf( "%s: invalid scan_id\n", dbgname );
+		return SCAN_BADID;
+	}
+	BAutolock lock( entry->lock );
 
-	if( entry->state < kScanStateOpen )
+	if( entry->state < kScanStateImageOpen || entry->lent ) {
+		if( gDebug )
+			printf( "%s: image not open, or band still lent out\n", dbgname );
 		return SCAN_BAD_PHASE;
-		
-	return entry->hooks->adf_ready( entry->cookie );
+	}
+	if( ! buffer || ! count || *count < 0 )
+		return SCAN_BAD_PARAM;
+	return lend_band( entry, buffer, count );
 }
 
 
-void scan_error_message( const scan_id id, status_t err, char *msg )
+status_t scan_release_data( const scan_id id, const void *buffer )
 {
-	scanner_entry *entry = static_cast<scanner_entry*>( id );
-	entry->hooks->error_message( entry->cookie, err, msg );
-		// take care of libscanbe error codes, if they haven't
-		// already been taken care of by the add-on
-	if( msg && strlen( msg ) == 0 ) {
-		switch( err ) {
-		case SCAN_INVALID_SETTING:
-		case SCAN_BAD_PHASE:
-		case SCAN_BADID:
-		case SCAN_BAD_PARAM:
-			strcpy( msg, "There was a programming error calling libscanbe." );
-			break;
-		case SCAN_NO_ADDON:
-			strcpy( msg, "An add-on for your scanner was not found." );
-			break;
-		case SCAN_NO_SCANNER:
-			strcpy( msg, "Could not communicate with your scanner." );
-			break;
-		case SCAN_USER_CANCEL:
-			strcpy( msg, "The operation was cancelled." );
-			break;
-		default:
-			strcpy( msg, "A scanning error occurred." );
-			break;
-		}
+	api_trace trace( kTraceReleaseData, id );
+		
+	session_ref ref( id );
+	scanner_entry *entry = ref.entry;
+	if( ! entry ) {
+		if( gDebug )
+			printf( "%s: invalid scan_id\n", dbgname );
+		return SCAN_BADID;
 	}
-}
+	BAutolock lock( entry->lock );
 
+	if( ! entry->lent || entry->lent != buffer ) {
+		if( gDebug )
+			printf( "%s: releasing a band that wasn't lent\n", dbgname );
+		return SCAN_BAD_PARAM;
+	}
+	
+	return release_lent_data( entry );
+}
 
-#pragma mark ---- Other Functions ----
 
-/* Callback for walk_addons, finds the one with a give name passed in
-	the walk_info structure. On error conditions, B_OK is still returned
-	because I want the directory traversal to finish, just in case the
-	one they want to open is further down the list. */
-static status_t check_addon_name( const CallbackInfo *info, void *data )
+status_t scan_data_into( const scan_id id, const scan_destination *dest,
+								int32 *rows )
 {
-	image_id ident = load_add_on( info->path );
-	if( ident < B_OK ) {
+	api_trace trace( kTraceDataInto, id );
+		
+	session_ref ref( id );
+	scanner_entry *entry = ref.entry;
+	if( ! entry ) {
 		if( gDebug )
-			printf( "%s: load_add_on() failed on '%s'\n", dbgname, info->path );
-		return B_OK;
+			printf( "%s: invalid scan_id\n", dbgname );
+		return SCAN_BADID;
 	}
-		
-	walk_info *wInfo = (walk_info *) data;
-	publish_proc func;
-	status_t status = get_image_symbol( ident, kPublishNamesFunction,
-								B_SYMBOL_TYPE_TEXT, &func );
-	if( status != B_OK ) {
+	if( rows )
+		*rows = 0;
+	if( ! dest || dest->size < (int32) sizeof( scan_destination ) || ! dest->bits
+			|| dest->first_row < 0 || dest->rows < 0 )
+		return SCAN_BAD_PARAM;
+	BAutolock lock( entry->lock );
+
+	if( entry->state < kScanStateImageOpen || entry->lent ) {
 		if( gDebug )
-			printf( "%s: no %s in '%s'\n", dbgname, kPublishNamesFunction, info->path );
-		unload_add_on( ident );
-		return B_OK;
+			printf( "%s: image not open, or band still lent out\n", dbgname );
+		return SCAN_BAD_PHASE;
+	}
+	scan_settings settings;
+	status_t result = get_all_settings( entry, &settings, NULL, NULL );
+	if( result != B_OK )
+		return result;
+	int32 rowBytes = into_row_bytes( &settings, dest->format );
+	int32 stride = dest->bytes_per_row < 0 ? -dest->bytes_per_row
+											: dest->bytes_per_row;
+	if( rowBytes == 0 || stride < rowBytes || entry->row_bytes == 0 ) {
+		if( gDebug )
+			printf( "%s: can't convert to that destination\n", dbgname );
+		return SCAN_BAD_PARAM;
+	}
+	int32 end = dest->rows > 0 ? dest->first_row + dest->rows
+								: (int32) settings.pixel_height;
+	if( entry->image_row > dest->first_row ) {
+		if( gDebug )
+			printf( "%s: rows already read\n", dbgname );
+		return SCAN_BAD_PARAM;
 	}
 	
-	if( gDebug )
-		printf( "%s: looking at exported names for '%s'\n", dbgname, info->path );
-		
-	const char **nameArray = func();
-	for( int32 i = 0; nameArray[i]; i++ ) {
-		if( gDebug ) {
-			printf( "%s: [%ld] %s\n", dbgname, i, nameArray[i] );
-			printf( "%s: [%ld] %s\n", dbgname, i+1, nameArray[i+1] );
-		}
-		if( strcmp( wInfo->name, nameArray[i] ) == 0 ) {
-			wInfo->id = ident;
-			return B_OK;	// leave loaded to use
+	// binary and 16-bit rows go to BGRA32 by way of 8 bits
+	char *temp = NULL;
+	if( dest->format == SCAN_PIXEL_BGRA32 && ( settings.image_type == SCAN_TYPE_BINARY
+			|| settings.pixel_bits == 16 || settings.pixel_bits == 48 ) )
+		temp = new char[ settings.pixel_width * 3 ];
+	
+	int32 band = entry->transfer.preferred > 0 ? entry->transfer.preferred
+											: kDefaultLendSize;
+	if( band > kIntoBandSize )
+		band = kIntoBandSize;
+	band = whole_rows( band, entry->row_bytes );
+	int32 written = 0;
+	while( entry->image_row < end ) {
+		int32 row = entry->image_row;
+		int32 count = ( end - row ) * entry->row_bytes;
+		if( count > band )
+			count = band;
+		const void *data;
+		result = lend_band( entry, &data, &count );
+		if( result != B_OK && result != SCAN_DATA_END )
+			break;
+		const char *src = (const char *) data;
+		for( int32 n = count / entry->row_bytes; n > 0; n--, row++ ) {
+			if( row >= dest->first_row ) {
+				char *dst = (char *) dest->bits
+							+ ( row - dest->first_row ) * dest->bytes_per_row;
+				convert_into( &settings, dest, src, dst, temp, row );
+				written++;
+			}
+			src += entry->row_bytes;
 		}
-		if( ! nameArray[++i] )
+		release_lent_data( entry );
+		if( result == SCAN_DATA_END )
 			break;
 	}
+	delete[] temp;
+	if( rows )
+		*rows = written;
+	return result;
+}
+
+
+status_t scan_set_readahead( const scan_id id, int32 depth, int32 band_size )
+{
+	api_trace trace( kTraceSetReadahead, id );
+		
+	session_ref ref( id );
+	scanner_entry *entry = ref.entry;
+	if( ! entry ) {
+		if( gDebug )
+			printf( "%s: invalid scan_id\n", dbgname );
+		return SCAN_BADID;
+	}
+	BAutolock lock( entry->lock );
+
+	if( entry->state < kScanStateOpen || entry->state >= kScanStateImageOpen ) {
+		if( gDebug )
+			printf( "%s: id not open, or image already open\n", dbgname );
+		return SCAN_BAD_PHASE;
+	}
+	if( depth < 0 || depth > kMaxReadaheadDepth || band_size < 0 )
+		return SCAN_BAD_PARAM;
 	
-	unload_add_on( ident );
+	entry->ra_depth = depth;
+	entry->ra_band_size = band_size;
 	return B_OK;
 }
 
-static status_t get_settings( scanner_entry *entry, uint32 kind,
-								scan_settings *settings )
+
+status_t scan_set_process( const scan_id id, const scan_process *process )
 {
-	status_t status = B_OK;
-	scan_value value;
-	
-	status = entry->hooks->get_setting( entry->cookie,
-					SCAN_SETTING_AREA, kind, &value );
-	if( status != B_OK )
-		return status;
-	settings->scan_area = value.rect;
-	
-	status = entry->hooks->get_setting( entry->cookie,
-					SCAN_SETTING_IMAGETYPE, kind, &value );
-	if( status != B_OK )
-		return status;
-	settings->image_type = value.type;
-	
-	status = entry->hooks->get_setting( entry->cookie,
-					SCAN_SETTING_PIXELBITS, kind, &value );
-	if( status != B_OK )
-		return status;
-	settings->pixel_bits = value.u_int;
-	
-	status = entry->hooks->get_setting( entry->cookie,
-					SCAN_SETTING_RESOLUTION, kind, &value );
-	if( status != B_OK )
-		return status;
-	settings->resolution = value.u_int;
+	api_trace trace( kTraceSetProcess, id );
 		
-	status = entry->hooks->get_setting( entry->cookie,
-					SCAN_SETTING_BRIGHTNESS, kind, &value );
-	if( status != B_OK )
-		return status;
-	settings->brightness = value.s_int;
+	session_ref ref( id );
+	scanner_entry *entry = ref.entry;
+	if( ! entry ) {
+		if( gDebug )
+			printf( "%s: invalid scan_id\n", dbgname );
+		return SCAN_BADID;
+	}
+	BAutolock lock( entry->lock );
+
+	if( entry->state < kScanStateOpen || entry->state >= kScanStateImageOpen ) {
+		if( gDebug )
+			printf( "%s: id not open, or image already open\n", dbgname );
+		return SCAN_BAD_PHASE;
+	}
+	if( ! process && ! entry->processor )
+		return B_OK;
+	
+	if( ! entry->processor )
+		entry->processor = processor_create();
+	return processor_set( entry->processor, process );
+}
+
+
+status_t scan_cancel( const scan_id id )
+{
+	api_trace trace( kTraceCancel, id );
+		
+	session_ref ref( id );
+	scanner_entry *entry = ref.entry;
+	if( ! entry ) {
+		if( gDebug )
+			printf( "%s: invalid scan_id\n", dbgname );
+		return SCAN_BADID;
+	}
+	
+	// not entry->lock or hook_lock, the call being cancelled may be
+	// holding them for as long as the user takes
+	atomic_or( &entry->cancelled, 1 );
+	BAutolock cancelLock( entry->cancel_lock );
+	if( entry->can_cancel && HAS_EXT_HOOK( entry, cancel ) ) {
+		bigtime_t start = system_time();
+		entry->ext->cancel( entry->cookie );
+		count_hook( entry, SCAN_HOOK_CANCEL, start, B_OK );
+	}
+	return B_OK;
+}
+
+
+status_t scan_get_transfer_info( const scan_id id, scan_transfer_info *info )
+{
+	api_trace trace( kTraceGetTransferInfo, id );
+		
+	session_ref ref( id );
+	scanner_entry *entry = ref.entry;
+	if( ! entry ) {
+		if( gDebug )
+			printf( "%s: invalid scan_id\n", dbgname );
+		return SCAN_BADID;
+	}
+	if( ! info || info->size < (int32) sizeof( int32 ) )
+		return SCAN_BAD_PARAM;
+	BAutolock lock( entry->lock );
+
+	if( entry->state < kScanStateOpen ) {
+		if( gDebug )
+			printf( "%s: id not open\n", dbgname );
+		return SCAN_BAD_PHASE;
+	}
+	
+	// an open image's were fetched when it was opened
+	scan_transfer_info transfer = entry->transfer;
+	if( entry->state < kScanStateImageOpen )
+		get_transfer_info( entry, 0, &transfer );
+	if( transfer.preferred == 0 )
+		transfer.preferred = kDefaultBandSize;
+	
+	int32 size = info->size;
+	if( size > (int32) sizeof( scan_transfer_info ) )
+		size = sizeof( scan_transfer_info );
+	memcpy( info, &transfer, size );
+	info->size = size;
+	return B_OK;
+}
+
+
+bool scan_adf_ready( const scan_id id )
+{
+	api_trace trace( kTraceAdfReady, id );
 		
-	status = entry->hooks->get_setting( entry->cookie,
-					SCAN_SETTING_CONTRAST, kind, &value );
+	session_ref ref( id );
+	scanner_entry *entry = ref.entry;
+	if( ! entry )
+		return false;
+	BAutolock lock( entry->lock );
+
+	if( entry->state < kScanStateOpen )
+		return false;
+		
+	BAutolock hookLock( entry->hook_lock );
+	bigtime_t start = system_time();
+	bool ready = entry->hooks->adf_ready( entry->cookie );
+	count_hook( entry, SCAN_HOOK_ADF_READY, start, B_OK );
+	return ready;
+}
+
+
+void scan_error_message( const scan_id id, status_t err, char *msg )
+{
+	session_ref ref( id );
+	scanner_entry *entry = ref.entry;
+	if( entry ) {
+		BAutolock lock( entry->lock );
+		BAutolock hookLock( entry->hook_lock );
+		bigtime_t start = system_time();
+		entry->hooks->error_message( entry->cookie, err, msg );
+		count_hook( entry, SCAN_HOOK_ERROR_MESSAGE, start, B_OK );
+	}
+	else if( msg )
+		*msg = 0;
+		// take care of libscanbe error codes, if they haven't
+		// already been taken care of by the add-on
+	if( msg && strlen( msg ) == 0 ) {
+		switch( err ) {
+		case SCAN_INVALID_SETTING:
+		case SCAN_BAD_PHASE:
+		case SCAN_BADID:
+		case SCAN_BAD_PARAM:
+			strcpy( msg, "There was a programming error calling libscanbe." );
+			break;
+		case SCAN_NO_ADDON:
+			strcpy( msg, "An add-on for your scanner was not found." );
+			break;
+		case SCAN_NO_SCANNER:
+			strcpy( msg, "Could not communicate with your scanner." );
+			break;
+		case SCAN_USER_CANCEL:
+			strcpy( msg, "The operation was cancelled." );
+			break;
+		default:
+			strcpy( msg, "A scanning error occurred." );
+			break;
+		}
+	}
+}
+
+
+status_t scan_get_stats( const scan_id id, scan_stats *stats )
+{
+	session_ref ref( id );
+	scanner_entry *entry = ref.entry;
+	if( ! entry ) {
+		if( gDebug )
+			printf( "%s: invalid scan_id\n", dbgname );
+		return SCAN_BADID;
+	}
+	if( ! stats || stats->size < (int32) sizeof( int32 ) )
+		return SCAN_BAD_PARAM;
+	
+	// not entry->lock, so this can be polled while another thread
+	// is waiting in scan_data()
+	BAutolock statsLock( entry->stats_lock );
+	int32 size = stats->size;
+	if( size > (int32) sizeof( scan_stats ) )
+		size = sizeof( scan_stats );
+	memcpy( stats, &entry->stats, size );
+	stats->size = size;
+	return B_OK;
+}
+
+
+status_t scan_reset_stats( const scan_id id )
+{
+	session_ref ref( id );
+	scanner_entry *entry = ref.entry;
+	if( ! entry ) {
+		if( gDebug )
+			printf( "%s: invalid scan_id\n", dbgname );
+		return SCAN_BADID;
+	}
+	
+	BAutolock statsLock( entry->stats_lock );
+	memset( &entry->stats, 0, sizeof( entry->stats ) );
+	entry->stats.size = sizeof( entry->stats );
+	entry->stats.since = system_time();
+	entry->last_data = 0;
+	return B_OK;
+}
+
+
+#pragma mark ---- Other Functions ----
+
+static bool debug_enabled()
+{
+	const char *debugEnviron = getenv( "SCAN_DEBUG" );
+	return debugEnviron && strlen( debugEnviron ) > 0;
+}
+
+static bigtime_t stats_interval()
+{
+	const char *statsEnviron = getenv( "SCAN_STATS" );
+	if( ! statsEnviron || strlen( statsEnviron ) == 0 )
+		return -1;
+	bigtime_t seconds = atol( statsEnviron );
+	return seconds > 0 ? seconds * 1000000LL : 0;
+}
+
+/* Adds one call to a set of counters. */
+static void add_time( scan_call_stats *stats, bigtime_t time, status_t status )
+{
+	stats->calls++;
+	if( status != B_OK && status != SCAN_DATA_END )
+		stats->errors++;
+	stats->total_time += time;
+	if( time > stats->max_time )
+		stats->max_time = time;
+	
+	int32 bucket = 0;
+	while( time > 0 && bucket < SCAN_STATS_BUCKETS - 1 ) {
+		time >>= 1;
+		bucket++;
+	}
+	stats->histogram[bucket]++;
+}
+
+/* Counts a call into the add-on that started at start. */
+static void count_hook( scanner_entry *entry, scan_hook_id hook, bigtime_t start,
+								status_t status )
+{
+	bigtime_t now = system_time();
+	BAutolock statsLock( entry->stats_lock );
+	add_time( &entry->stats.hooks[hook], now - start, status );
+	trace_event_add( kTraceHook, hook, entry->id, start, now, status );
+}
+
+static void set_state( scanner_entry *entry, scan_state state )
+{
+	if( entry->state == state )
+		return;
+	entry->state = state;
+	bigtime_t now = system_time();
+	trace_event_add( kTraceState, state, entry->id, now, now, 0 );
+}
+
+static void default_transfer( scan_transfer_info *info )
+{
+	info->size = sizeof( scan_transfer_info );
+	info->preferred = 0;
+	info->maximum = 0;
+	info->alignment = 1;
+}
+
+/*	Asks the add-on, if it has the hook, and makes sense of the answer:
+	sizes in whole rows when rowBytes is known, and at least one of them,
+	and an alignment that's a power of two no bigger than a page. */
+static void get_transfer_info( scanner_entry *entry, int32 rowBytes,
+								scan_transfer_info *info )
+{
+	default_transfer( info );
+	if( HAS_EXT_HOOK( entry, get_transfer_info ) ) {
+		BAutolock hookLock( entry->hook_lock );
+		bigtime_t start = system_time();
+		status_t status = entry->ext->get_transfer_info( entry->cookie, info );
+		count_hook( entry, SCAN_HOOK_GET_TRANSFER_INFO, start, status );
+		info->size = sizeof( scan_transfer_info );
+		if( status != B_OK )
+			default_transfer( info );
+	}
+	
+	if( info->preferred < 0 )
+		info->preferred = 0;
+	if( info->maximum < 0 )
+		info->maximum = 0;
+	if( info->maximum > 0 && info->preferred > info->maximum )
+		info->preferred = info->maximum;
+	if( info->alignment < 1 || info->alignment > B_PAGE_SIZE
+			|| ( info->alignment & ( info->alignment - 1 ) ) != 0 )
+		info->alignment = 1;
+	if( rowBytes > 0 ) {
+		if( info->preferred > 0 )
+			info->preferred = whole_rows( info->preferred, rowBytes );
+		if( info->maximum > 0 )
+			info->maximum = whole_rows( info->maximum, rowBytes );
+	}
+}
+
+/* bytes rounded down to whole rows, but at least one. */
+static int32 whole_rows( int32 bytes, int32 rowBytes )
+{
+	return bytes < rowBytes ? rowBytes : bytes - bytes % rowBytes;
+}
+
+/*	new[] with the start rounded up to alignment, a power of two. The
+	block's own address is kept just in front, for aligned_delete(). */
+static char* aligned_new( int32 size, int32 alignment )
+{
+	if( alignment < (int32) sizeof( char * ) )
+		alignment = sizeof( char * );
+	char *block = new char[ size + alignment + sizeof( char * ) ];
+	size_t start = (size_t) block + sizeof( char * );
+	char *data = (char *) ( ( start + alignment - 1 ) & ~(size_t) ( alignment - 1 ) );
+	( (char **) data )[-1] = block;
+	return data;
+}
+
+static void aligned_delete( char *data )
+{
+	if( data )
+		delete[] ( (char **) data )[-1];
+}
+
+/*	Counts a scan_data() or scan_data_ex() call that started at start, and
+	the time the app took since the one before it, and moves the image row
+	on past the rows it handed out. Prints the statistics every so often if
+	SCAN_STATS asks for it. */
+static void count_data( scanner_entry *entry, bigtime_t start, status_t status,
+								int32 count )
+{
+	if( ( status == B_OK || status == SCAN_DATA_END ) && entry->row_bytes > 0 )
+		entry->image_row += count / entry->row_bytes;
+	bigtime_t now = system_time();
+	bool dump = false;
+	{
+		BAutolock statsLock( entry->stats_lock );
+		scan_stats *stats = &entry->stats;
+		if( entry->last_data )
+			add_time( &stats->app_time, start - entry->last_data, B_OK );
+		add_time( &stats->data_calls, now - start, status );
+		if( ( status == B_OK || status == SCAN_DATA_END ) && count > 0 )
+			stats->bytes += count;
+		entry->last_data = now;
+		
+		if( gStatsInterval > 0 && now >= entry->next_dump ) {
+			dump = entry->next_dump != 0;
+			entry->next_dump = now + gStatsInterval;
+		}
+	}
+	if( dump )
+		dump_stats( entry );
+}
+
+/* Percentile of the calls in a histogram, as the top of its bucket. */
+static bigtime_t histogram_percentile( const scan_call_stats *stats, int32 pct )
+{
+	uint32 want = ( (uint64) stats->calls * pct + 99 ) / 100;
+	uint32 seen = 0;
+	for( int32 i = 0; i < SCAN_STATS_BUCKETS; i++ ) {
+		seen += stats->histogram[i];
+		if( seen >= want )
+			return (bigtime_t) 1 << i;
+	}
+	return stats->max_time;
+}
+
+static void print_call_stats( const char *name, const scan_call_stats *stats )
+{
+	if( ! stats->calls )
+		return;
+	printf( "  %-16s %7lu calls %5lu errors  avg %Ld  p50 <%Ld  p99 <%Ld  max %Ld us\n",
+			name, stats->calls, stats->errors, stats->total_time / stats->calls,
+			histogram_percentile( stats, 50 ), histogram_percentile( stats, 99 ),
+			stats->max_time );
+}
+
+static void dump_stats( scanner_entry *entry )
+{
+	scan_stats stats;
+	{
+		BAutolock statsLock( entry->stats_lock );
+		stats = entry->stats;
+	}
+	
+	bigtime_t elapsed = system_time() - stats.since;
+	printf( "%s: session %p, %Ld.%03Ld s, %lu image(s), %Ld bytes, "
+			"%lu cached setting reads, %Ld us read-ahead wait\n",
+			dbgname, entry, elapsed / 1000000, ( elapsed / 1000 ) % 1000,
+			stats.images, stats.bytes, stats.settings_cached,
+			stats.readahead_wait );
+	print_call_stats( "scan_data", &stats.data_calls );
+	print_call_stats( "app", &stats.app_time );
+	for( int32 i = 0; i < SCAN_HOOK_COUNT; i++ )
+		print_call_stats( kTraceHookNames[i], &stats.hooks[i] );
+}
+
+session_ref::session_ref( scan_id id )
+{
+	entry = NULL;
+	slot = NULL;
+	
+	uint32 handle = (uint32) (size_t) id;
+	int32 index = handle & ( kMaxSessions - 1 );
+	int32 generation = handle >> kSlotBits;
+	if( handle == 0 )
+		return;
+	
+	// Take the reference first, so the entry can't be freed between
+	// checking the generation and using it.
+	scanner_slot *s = &gSlots[index];
+	atomic_add( &s->refs, 1 );
+	slot = s;
+	if( atomic_get( &s->generation ) == generation && ! atomic_get( &s->closing ) )
+		entry = s->entry;
+}
+
+session_ref::~session_ref()
+{
+	if( slot && atomic_add( &slot->refs, -1 ) == 1 && atomic_get( &slot->closing ) )
+		free_entry( slot );
+}
+
+/* Gives the entry a free slot and returns its handle, or NULL if every
+	slot is taken. */
+static scan_id add_entry( scanner_entry *entry )
+{
+	BAutolock lock( gSlotLocker );
+	for( int32 i = 0; i < kMaxSessions; i++ ) {
+		scanner_slot *s = &gSlots[i];
+		if( s->entry )
+			continue;
+		if( s->generation == 0 )
+			atomic_set( &s->generation, 1 );
+		entry->id = (scan_id) (size_t) ( ( (uint32) s->generation << kSlotBits ) | i );
+		s->entry = entry;
+		return entry->id;
+	}
+	return NULL;
+}
+
+/* Stops the handle from validating by moving the slot on to its next
+	generation. The caller must hold a reference, so the entry lives until
+	the last call using it returns. */
+static void retire_entry( scan_id id )
+{
+	scanner_slot *s = &gSlots[(uint32) (size_t) id & ( kMaxSessions - 1 )];
+	atomic_set( &s->closing, 1 );
+	int32 generation = ( s->generation + 1 ) & kGenerationMask;
+	atomic_set( &s->generation, generation ? generation : 1 );
+}
+
+static void free_entry( scanner_slot *slot )
+{
+	scanner_entry *entry;
+	{
+		BAutolock lock( gSlotLocker );
+			// someone else may have gotten here first
+		if( ! slot->entry || atomic_get( &slot->refs ) != 0
+				|| ! atomic_get( &slot->closing ) )
+			return;
+		entry = slot->entry;
+		slot->entry = NULL;
+		atomic_set( &slot->closing, 0 );
+	}
+	image_id image = entry->image;
+	delete entry;
+	if( image >= B_OK )
+		unload_add_on( image );
+}
+
+/* Callback for walk_addons, refreshes the add-on index entry for one
+	file and checks it for the name passed in the walk_info structure.
+	Files that haven't changed since they were indexed are not loaded.
+	On error conditions, B_OK is still returned because I want the
+	directory traversal to finish, just in case the one they want to
+	open is further down the list. */
+static status_t index_addon( const CallbackInfo *info, void *data )
+{
+	index_walk *walk = (index_walk *) data;
+	walk_info *wInfo = walk->want;
+	
+	int64 mtime, size;
+	if( stat_addon( info->path, &mtime, &size ) != B_OK )
+		return B_OK;
+	
+	addon_record *rec = find_record_by_path( info->path );
+	if( rec && rec->mtime == mtime && rec->size == size ) {
+		rec->seen = true;
+		return B_OK;
+	}
+	
+	image_id ident = load_add_on( info->path );
+	if( ident < B_OK ) {
+		if( gDebug )
+			printf( "%s: load_add_on() failed on '%s'\n", dbgname, info->path );
+		return B_OK;
+	}
+	
+	publish_proc func;
+	status_t status = get_image_symbol( ident, kPublishNamesFunction,
+								B_SYMBOL_TYPE_TEXT, &func );
+	if( status != B_OK ) {
+		if( gDebug )
+			printf( "%s: no %s in '%s'\n", dbgname, kPublishNamesFunction, info->path );
+		unload_add_on( ident );
+		return B_OK;
+	}
+	
+	if( gDebug )
+		printf( "%s: indexing exported names for '%s'\n", dbgname, info->path );
+	
+	if( ! rec ) {
+		rec = new addon_record;
+		rec->path = new char[ strlen( info->path ) + 1 ];
+		strcpy( rec->path, info->path );
+		gAddonIndex.AddItem( rec );
+	}
+	rec->mtime = mtime;
+	rec->size = size;
+	rec->seen = true;
+	walk->changed = true;
+	
+	bool keep = false;
+	const char **nameArray = func();
+	int32 namesSize = 1;
+	for( int32 i = 0; nameArray[i]; i += 2 ) {
+		namesSize += strlen( nameArray[i] ) + 1;
+		if( ! nameArray[i+1] )
+			break;
+	}
+	delete[] rec->names;
+	rec->names = new char[ namesSize ];
+	rec->names_size = namesSize;
+	char *dest = rec->names;
+	for( int32 i = 0; nameArray[i]; i++ ) {
+		if( gDebug ) {
+			printf( "%s: [%ld] %s\n", dbgname, i, nameArray[i] );
+			printf( "%s: [%ld] %s\n", dbgname, i+1, nameArray[i+1] );
+		}
+		strcpy( dest, nameArray[i] );
+		dest += strlen( dest ) + 1;
+		if( wInfo->id < B_OK && ! wInfo->path && strcmp( wInfo->name, nameArray[i] ) == 0 ) {
+			wInfo->id = ident;
+			keep = true;	// leave loaded to use
+		}
+		if( ! nameArray[++i] )
+			break;
+	}
+	*dest = 0;
+	
+	if( ! keep )
+		unload_add_on( ident );
+	return B_OK;
+}
+
+/*	Finds and loads the add-on publishing the name in info, or only finds
+	its path if info has somewhere to put it. The index is tried first;
+	only if the name isn't there, or its file has changed, is the add-on
+	directory walked again. The watchers hear about what that turned up
+	once gIndexLocker is let go, since their callbacks may wait on threads
+	that want it. */
+static status_t find_addon_image( walk_info *info )
+{
+	BList changes;
+	status_t status;
+	{
+		BAutolock lock( gIndexLocker );
+		status = find_indexed_addon( info, &changes );
+	}
+	notify_watchers( &changes );
+	return status;
+}
+
+static status_t find_indexed_addon( walk_info *info, BList *changes )
+{
+	load_addon_index();
+	
+	addon_record *rec = find_record_by_name( info->name );
+	if( rec ) {
+		int64 mtime, size;
+		if( stat_addon( rec->path, &mtime, &size ) == B_OK
+				&& rec->mtime == mtime && rec->size == size ) {
+			if( info->path ) {
+				strcpy( info->path, rec->path );
+				return B_OK;
+			}
+			info->id = load_add_on( rec->path );
+			if( info->id >= B_OK )
+				return B_OK;
+			if( gDebug )
+				printf( "%s: load_add_on() failed on indexed '%s'\n",
+					dbgname, rec->path );
+		}
+	}
+	
+	index_walk walk;
+	walk.want = info;
+	walk.changed = false;
+	for( int32 i = 0; ( rec = (addon_record *) gAddonIndex.ItemAt( i ) ); i++ )
+		rec->seen = false;
+	status_t status = refresh_catalog( changes, false );
+	if( status == B_OK )
+		status = walk_catalog( index_addon, &walk );
 	if( status != B_OK )
 		return status;
-	settings->contrast = value.s_int;
-		
-	status = entry->hooks->get_setting( entry->cookie,
-					SCAN_SETTING_SCALING, kind, &value );
+									// forget add-ons that went away
+	for( int32 i = gAddonIndex.CountItems() - 1; i >= 0; i-- ) {
+		rec = (addon_record *) gAddonIndex.ItemAt( i );
+		if( ! rec->seen ) {
+			gAddonIndex.RemoveItem( i );
+			delete rec;
+			walk.changed = true;
+		}
+	}
+	if( walk.changed )
+		save_addon_index();
+									// wanted one was indexed but unchanged
+	if( info->id < B_OK ) {
+		rec = find_record_by_name( info->name );
+		if( rec && info->path )
+			strcpy( info->path, rec->path );
+		else if( rec )
+			info->id = load_add_on( rec->path );
+	}
+	return B_OK;
+}
+
+/*	One band from the add-on, processed if that was asked for. With
+	read-ahead this runs on its thread, so the processing of one band
+	overlaps the app's work on the one before. Despeckling comes out a
+	row behind the add-on, so a band can be a row short, and the image's
+	last row can come by itself after the add-on has ended. */
+static status_t read_band( scanner_entry *entry, void *buffer, int32 *count )
+{
+	if( ! entry->processing )
+		return fetch_band( entry, buffer, count );
+	scan_processor *processor = entry->processor;
+	if( processor_holding_end( processor ) ) {
+		*count = processor_flush( processor, buffer );
+		return SCAN_DATA_END;
+	}
+
+	int32 room = *count;
+	status_t result;
+	do {							// a one-row band may only be held back
+		*count = room;
+		result = fetch_band( entry, buffer, count );
+		if( result != B_OK && result != SCAN_DATA_END )
+			return result;
+		*count = processor_run( processor, buffer, *count, room,
+								result == SCAN_DATA_END );
+	} while( *count == 0 && result == B_OK );
+	if( result == SCAN_DATA_END && processor_holding_end( processor ) )
+		result = B_OK;				// the last row comes with the next call
+	return result;
+}
+
+/* One band straight from the add-on, copying if it only knows how to lend. */
+static status_t fetch_band( scanner_entry *entry, void *buffer, int32 *count )
+{
+	if( atomic_get( &entry->cancelled ) ) {
+		*count = 0;
+		return SCAN_USER_CANCEL;
+	}
+	int32 maximum = entry->transfer.maximum;
+	if( maximum > 0 && ( *count > maximum || *count == 0 ) )
+		*count = maximum;
+	BAutolock hookLock( entry->hook_lock );
+	bigtime_t start = system_time();
+	status_t result;
+	if( entry->hooks->data ) {
+		result = entry->hooks->data( entry->cookie, buffer, count );
+		count_hook( entry, SCAN_HOOK_DATA, start, result );
+		if( result != B_OK && result != SCAN_DATA_END
+				&& atomic_get( &entry->cancelled ) )
+			result = SCAN_USER_CANCEL;		// woken up by the cancel hook
+		return result;
+	}
+	if( ! HAS_EXT_HOOK( entry, acquire_data ) )
+		return SCAN_ADDON_ERROR;
+	
+	const void *rows = NULL;
+	result = entry->ext->acquire_data( entry->cookie, &rows, count );
+	count_hook( entry, SCAN_HOOK_ACQUIRE_DATA, start, result );
+	if( result != B_OK && result != SCAN_DATA_END
+			&& atomic_get( &entry->cancelled ) )
+		result = SCAN_USER_CANCEL;
+	if( ( result == B_OK || result == SCAN_DATA_END ) && *count > 0 )
+		memcpy( buffer, rows, *count );
+	if( rows && HAS_EXT_HOOK( entry, release_data ) ) {
+		start = system_time();
+		status_t status = entry->ext->release_data( entry->cookie, rows );
+		count_hook( entry, SCAN_HOOK_RELEASE_DATA, start, status );
+	}
+	return result;
+}
+
+readahead_ring::readahead_ring( int32 d, int32 bandSize, int32 rowBytes,
+								int32 alignment )
+{
+	depth = d;
+	row_bytes = rowBytes;
+	band_size = ( bandSize / rowBytes ) * rowBytes;
+	if( band_size < row_bytes )
+		band_size = row_bytes;
+	slots = new readahead_slot[ depth ];
+	for( int32 i = 0; i < depth; i++ ) {
+		slots[i].data = aligned_new( band_size, alignment );
+		slots[i].count = slots[i].offset = 0;
+		slots[i].status = B_OK;
+	}
+	head = tail = 0;
+	empty = create_sem( depth, "scan readahead empty" );
+	full = create_sem( 0, "scan readahead full" );
+	thread = -1;
+	quit = false;
+	current = false;
+	done = false;
+}
+
+readahead_ring::~readahead_ring()
+{
+	if( empty >= B_OK )
+		delete_sem( empty );
+	if( full >= B_OK )
+		delete_sem( full );
+	for( int32 i = 0; i < depth; i++ )
+		aligned_delete( slots[i].data );
+	delete[] slots;
+}
+
+/* Called once the image is open. Needs the row size so bands can be
+	handed out in whole rows even when the caller asks for less. */
+static status_t start_readahead( scanner_entry *entry )
+{
+	scan_value value;
+	status_t status = get_one_setting( entry, SCAN_SETTING_ROWBYTES,
+					SCAN_SETTING_CURRENT, &value );
 	if( status != B_OK )
 		return status;
-	settings->scaling = value.s_int;
-		
-	status = entry->hooks->get_setting( entry->cookie,
-					SCAN_SETTING_WIDTH, kind, &value );
+	if( value.u_int == 0 )
+		return SCAN_ADDON_ERROR;
+	
+	int32 bandSize = entry->ra_band_size;
+	if( bandSize == 0 )
+		bandSize = entry->transfer.preferred > 0 ? entry->transfer.preferred
+												: kDefaultBandSize;
+	if( entry->transfer.maximum > 0 && bandSize > entry->transfer.maximum )
+		bandSize = entry->transfer.maximum;
+	readahead_ring *ring = new readahead_ring( entry->ra_depth, bandSize,
+												value.u_int, entry->transfer.alignment );
+	if( ring->empty < B_OK || ring->full < B_OK ) {
+		delete ring;
+		return B_NO_MORE_SEMS;
+	}
+	entry->ring = ring;
+	ring->thread = spawn_thread( readahead_thread, "scan readahead",
+								B_NORMAL_PRIORITY, entry );
+	if( ring->thread < B_OK ) {
+		entry->ring = NULL;
+		delete ring;
+		return B_NO_MORE_THREADS;
+	}
+	resume_thread( ring->thread );
+	return B_OK;
+}
+
+/* Waits for the producer to notice, which may mean waiting out a data
+	hook call already in progress. */
+static void stop_readahead( scanner_entry *entry )
+{
+	readahead_ring *ring = entry->ring;
+	if( ! ring )
+		return;
+	ring->quit = true;
+	delete_sem( ring->empty );		// wakes the producer up
+	ring->empty = -1;
+	status_t exitValue;
+	wait_for_thread( ring->thread, &exitValue );
+	entry->ring = NULL;
+	delete ring;
+}
+
+static status_t readahead_thread( void *data )
+{
+	scanner_entry *entry = (scanner_entry *) data;
+	readahead_ring *ring = entry->ring;
+	
+	for( ;; ) {
+		if( acquire_sem( ring->empty ) != B_OK || ring->quit )
+			break;
+		readahead_slot *slot = &ring->slots[ring->tail];
+		slot->offset = 0;
+		slot->count = ring->band_size;
+		slot->status = read_band( entry, slot->data, &slot->count );
+		if( slot->status != B_OK && slot->status != SCAN_DATA_END )
+			slot->count = 0;
+		ring->tail = ( ring->tail + 1 ) % ring->depth;
+		release_sem( ring->full );
+		if( slot->status != B_OK )
+			break;					// end of image, or an error
+	}
+	return B_OK;
+}
+
+/*	Hands out up to max bytes (0 for the rest of the band) of whole rows
+	from the band at the head of the ring, waiting for the producer if
+	need be. Returns B_OK while there's more in the band, otherwise the
+	add-on's result for it. Follow with readahead_recycle(). */
+static status_t readahead_take( scanner_entry *entry, int32 max,
+								const void **rows, int32 *count )
+{
+	readahead_ring *ring = entry->ring;
+	*rows = NULL;
+	*count = 0;
+	if( ring->done )
+		return SCAN_DATA_END;
+	if( ! ring->current ) {
+		status_t status;
+		bigtime_t start = system_time();
+		while( ( status = acquire_sem( ring->full ) ) == B_INTERRUPTED )
+			;
+		bigtime_t wait = system_time() - start;
+		{
+			BAutolock statsLock( entry->stats_lock );
+			entry->stats.readahead_wait += wait;
+		}
+		if( status != B_OK )
+			return status;
+		ring->current = true;
+	}
+	
+	readahead_slot *slot = &ring->slots[ring->head];
+	int32 take = slot->count - slot->offset;
+	if( max > 0 && take > max ) {
+		take = ( max / ring->row_bytes ) * ring->row_bytes;
+		if( take <= 0 )
+			return SCAN_BAD_PARAM;
+	}
+	*rows = slot->data + slot->offset;
+	*count = take;
+	slot->offset += take;
+	return slot->offset < slot->count ? B_OK : slot->status;
+}
+
+/* Gives the head slot back to the producer once it's been drained. */
+static void readahead_recycle( scanner_entry *entry )
+{
+	readahead_ring *ring = entry->ring;
+	if( ! ring || ! ring->current )
+		return;
+	readahead_slot *slot = &ring->slots[ring->head];
+	if( slot->offset < slot->count )
+		return;
+	ring->current = false;
+	if( slot->status != B_OK )
+		ring->done = true;
+	ring->head = ( ring->head + 1 ) % ring->depth;
+	release_sem( ring->empty );
+}
+
+/* The guts of scan_data_ex(), for scan_data_into() too: borrows a band from
+	the ring, or the add-on, or copies one for add-ons that can't lend. */
+static status_t lend_band( scanner_entry *entry, const void **buffer,
+								int32 *count )
+{
+	*buffer = NULL;
+	if( atomic_get( &entry->cancelled ) ) {
+		*count = 0;
+		return SCAN_USER_CANCEL;
+	}
+	
+	bigtime_t start = system_time();
+	status_t result;
+	if( entry->ring ) {
+								// lend straight out of the ring
+		result = readahead_take( entry, *count, buffer, count );
+		if( ( result == B_OK || result == SCAN_DATA_END ) && *count > 0 )
+			entry->lent_from_ring = true;
+		else {
+			readahead_recycle( entry );
+			*buffer = NULL;
+		}
+	} else if( HAS_EXT_HOOK( entry, acquire_data ) && ! entry->processing ) {
+		BAutolock hookLock( entry->hook_lock );
+		bigtime_t hookStart = system_time();
+		result = entry->ext->acquire_data( entry->cookie, buffer, count );
+		count_hook( entry, SCAN_HOOK_ACQUIRE_DATA, hookStart, result );
+		if( result != B_OK && result != SCAN_DATA_END
+				&& atomic_get( &entry->cancelled ) )
+			result = SCAN_USER_CANCEL;
+	} else {
+								// old add-on, lend our own copy
+		int32 want = *count;
+		if( want <= 0 )
+			want = entry->transfer.preferred > 0 ? entry->transfer.preferred
+												: kDefaultLendSize;
+		if( want > entry->lend_size ) {
+			aligned_delete( entry->lend_buf );
+			entry->lend_buf = aligned_new( want, entry->transfer.alignment );
+			entry->lend_size = want;
+		}
+		*count = want;
+		result = read_band( entry, entry->lend_buf, count );
+		if( result == B_OK || result == SCAN_DATA_END )
+			*buffer = entry->lend_buf;
+	}
+	count_data( entry, start, result, *count );
+	
+	if( result == B_OK || result == SCAN_DATA_END )
+		entry->lent = *buffer;
+	if( result == B_OK )
+		set_state( entry, kScanStateData );
+	else if( result != SCAN_DATA_END && gDebug )
+		printf( "%s: acquire_data hook failed\n", dbgname );
+	
+	return result;
+}
+
+/* Bytes a row of the image takes in format, 0 if it can't be converted. */
+static int32 into_row_bytes( const scan_settings *settings,
+								scan_pixel_format format )
+{
+	bool rgb = ( settings->image_type == SCAN_TYPE_RGB );
+	switch( format ) {
+	case SCAN_PIXEL_SCANNED:
+		return ( settings->pixel_width * settings->pixel_bits + 7 ) / 8;
+	case SCAN_PIXEL_BGRA32:
+		return settings->pixel_width * 4;
+	case SCAN_PIXEL_RGB24:
+		return rgb ? settings->pixel_width * 3 : 0;
+	case SCAN_PIXEL_GRAY8:
+		return rgb ? 0 : settings->pixel_width;
+	default:
+		return 0;
+	}
+}
+
+/* One image row into dest's format; temp holds a row of 8-bit samples. */
+static void convert_into( const scan_settings *settings,
+								const scan_destination *dest, const char *src,
+								char *dst, char *temp, int32 row )
+{
+	int32 width = settings->pixel_width;
+	int32 channels = ( settings->image_type == SCAN_TYPE_RGB ) ? 3 : 1;
+	bool deep = ( settings->pixel_bits == 16 || settings->pixel_bits == 48 );
+	bool binary = ( settings->image_type == SCAN_TYPE_BINARY );
+	
+	if( dest->format == SCAN_PIXEL_SCANNED )
+		memcpy( dst, src, into_row_bytes( settings, SCAN_PIXEL_SCANNED ) );
+	else if( dest->format != SCAN_PIXEL_BGRA32 ) {
+		if( deep )
+			scan_convert_16_to_8_dither( src, dst, width, channels, row );
+		else if( binary )
+			scan_convert_bits_to_gray8( src, dst, width );
+		else
+			memcpy( dst, src, width * channels );
+	} else {
+		if( deep ) {
+			scan_convert_16_to_8_dither( src, temp, width, channels, row );
+			src = temp;
+		} else if( binary ) {
+			scan_convert_bits_to_gray8( src, temp, width );
+			src = temp;
+		}
+		if( channels == 3 )
+			scan_convert_rgb24_to_bgra32( src, dst, width, dest->alpha );
+		else
+			scan_convert_gray8_to_bgra32( src, dst, width, dest->alpha );
+	}
+}
+
+/* Gives back a band lent out by scan_data_ex(), if there is one. */
+static status_t release_lent_data( scanner_entry *entry )
+{
+	const void *rows = entry->lent;
+	if( ! rows )
+		return B_OK;
+	entry->lent = NULL;
+	if( entry->lent_from_ring ) {
+		entry->lent_from_ring = false;
+		readahead_recycle( entry );
+		return B_OK;
+	}
+	if( rows == entry->lend_buf || ! HAS_EXT_HOOK( entry, release_data ) )
+		return B_OK;
+	BAutolock hookLock( entry->hook_lock );
+	bigtime_t start = system_time();
+	status_t status = entry->ext->release_data( entry->cookie, rows );
+	count_hook( entry, SCAN_HOOK_RELEASE_DATA, start, status );
+	if( status != B_OK && gDebug )
+		printf( "%s: release_data hook failed\n", dbgname );
+	return status;
+}
+
+bool addon_record::has_name( const char *name ) const
+{
+	if( ! names )
+		return false;
+	for( const char *ptr = names; *ptr; ptr += strlen( ptr ) + 1 )
+		if( strcmp( ptr, name ) == 0 )
+			return true;
+	return false;
+}
+
+static addon_record* find_record_by_name( const char *name )
+{
+	addon_record *rec;
+	for( int32 i = 0; ( rec = (addon_record *) gAddonIndex.ItemAt( i ) ); i++ )
+		if( rec->has_name( name ) )
+			return rec;
+	return NULL;
+}
+
+static addon_record* find_record_by_path( const char *path )
+{
+	addon_record *rec;
+	for( int32 i = 0; ( rec = (addon_record *) gAddonIndex.ItemAt( i ) ); i++ )
+		if( strcmp( rec->path, path ) == 0 )
+			return rec;
+	return NULL;
+}
+
+static status_t stat_addon( const char *path, int64 *mtime, int64 *size )
+{
+	BEntry entry( path, true );
+	status_t status = entry.InitCheck();
 	if( status != B_OK )
 		return status;
-	settings->pixel_width = value.u_int;
-		
-	status = entry->hooks->get_setting( entry->cookie,
-					SCAN_SETTING_HEIGHT, kind, &value );
+	time_t modTime;
+	off_t fileSize;
+	status = entry.GetModificationTime( &modTime );
+	if( status == B_OK )
+		status = entry.GetSize( &fileSize );
 	if( status != B_OK )
 		return status;
-	settings->pixel_height = value.u_int;
-		
-	status = entry->hooks->get_setting( entry->cookie,
-					SCAN_SETTING_ROWBYTES, kind, &value );
-	if( status != B_OK )
+	*mtime = modTime;
+	*size = fileSize;
+	return B_OK;
+}
+
+/*	The index is flattened into one raw block in the settings file:
+	a version and count, then for each add-on file its mtime, size,
+	path and NUL-separated scanner names. */
+static void load_addon_index()
+{
+	if( gIndexLoaded )
+		return;
+	gIndexLoaded = true;
+	if( gPrefs.InitCheck() || gSettings.InitCheck() )
+		return;
+	
+	uint32 type;
+	ssize_t size;
+	void *data;
+	if( gSettings.GetData( kPrefAddonIndex, data, size, type ) != B_OK )
+		return;
+	
+	const char *ptr = (const char *) data;
+	const char *end = ptr + size;
+	int32 version, count;
+	if( size < (ssize_t) ( 2 * sizeof( int32 ) ) )
+		return;
+	memcpy( &version, ptr, sizeof( int32 ) );
+	memcpy( &count, ptr + sizeof( int32 ), sizeof( int32 ) );
+	ptr += 2 * sizeof( int32 );
+	if( version != kAddonIndexVersion )
+		return;
+	
+	const size_t kHeaderSize = 2 * sizeof( int64 ) + 2 * sizeof( int32 );
+	for( int32 i = 0; i < count; i++ ) {
+		if( end - ptr < (ssize_t) kHeaderSize )
+			break;
+		addon_record *rec = new addon_record;
+		int32 pathSize;
+		memcpy( &rec->mtime, ptr, sizeof( int64 ) );
+		memcpy( &rec->size, ptr + sizeof( int64 ), sizeof( int64 ) );
+		memcpy( &pathSize, ptr + 2 * sizeof( int64 ), sizeof( int32 ) );
+		memcpy( &rec->names_size, ptr + 2 * sizeof( int64 ) + sizeof( int32 ),
+				sizeof( int32 ) );
+		ptr += kHeaderSize;
+		if( pathSize <= 0 || rec->names_size <= 0
+				|| end - ptr < pathSize + rec->names_size ) {
+			delete rec;
+			break;
+		}
+		rec->path = new char[ pathSize ];
+		memcpy( rec->path, ptr, pathSize );
+		rec->path[pathSize - 1] = 0;
+		ptr += pathSize;
+		rec->names = new char[ rec->names_size + 1 ];
+		memcpy( rec->names, ptr, rec->names_size );
+		rec->names[rec->names_size - 1] = 0;
+		rec->names[rec->names_size] = 0;
+		ptr += rec->names_size;
+		gAddonIndex.AddItem( rec );
+	}
+}
+
+static void save_addon_index()
+{
+	if( gPrefs.InitCheck() || gSettings.InitCheck() )
+		return;
+	
+	const size_t kHeaderSize = 2 * sizeof( int64 ) + 2 * sizeof( int32 );
+	int32 count = gAddonIndex.CountItems();
+	size_t size = 2 * sizeof( int32 );
+	addon_record *rec;
+	for( int32 i = 0; i < count; i++ ) {
+		rec = (addon_record *) gAddonIndex.ItemAt( i );
+		size += kHeaderSize + strlen( rec->path ) + 1 + rec->names_size;
+	}
+	
+	char *data = new char[ size ];
+	char *ptr = data;
+	memcpy( ptr, &kAddonIndexVersion, sizeof( int32 ) );
+	memcpy( ptr + sizeof( int32 ), &count, sizeof( int32 ) );
+	ptr += 2 * sizeof( int32 );
+	for( int32 i = 0; i < count; i++ ) {
+		rec = (addon_record *) gAddonIndex.ItemAt( i );
+		int32 pathSize = strlen( rec->path ) + 1;
+		memcpy( ptr, &rec->mtime, sizeof( int64 ) );
+		memcpy( ptr + sizeof( int64 ), &rec->size, sizeof( int64 ) );
+		memcpy( ptr + 2 * sizeof( int64 ), &pathSize, sizeof( int32 ) );
+		memcpy( ptr + 2 * sizeof( int64 ) + sizeof( int32 ), &rec->names_size,
+				sizeof( int32 ) );
+		ptr += kHeaderSize;
+		memcpy( ptr, rec->path, pathSize );
+		ptr += pathSize;
+		memcpy( ptr, rec->names, rec->names_size );
+		ptr += rec->names_size;
+	}
+	
+	if( gSettings.SetData( kPrefAddonIndex, data, size, B_RAW_TYPE ) == B_OK )
+		gSettings.Save();
+	delete[] data;
+}
+
+/*	Fetch any of the current, minimum and maximum settings. Whatever isn't
+	already cached comes from the add-on, in one call if it has the bulk
+	hook. */
+static status_t get_all_settings( scanner_entry *entry, scan_settings *current,
+								scan_settings *minimum, scan_settings *maximum )
+{
+	status_t status = B_OK;
+	scan_settings *want[3] = { current, minimum, maximum };
+	scan_settings *fetch[3];
+	bool needed = false;
+	
+	for( int32 i = 0; i < 3; i++ ) {
+		fetch[i] = NULL;
+		if( want[i] && entry->cache_valid[i] != kCachedSettings ) {
+			fetch[i] = &entry->cache[i];
+			needed = true;
+		}
+	}
+	
+	if( ! needed ) {
+		BAutolock statsLock( entry->stats_lock );
+		entry->stats.settings_cached++;
+	} else if( HAS_EXT_HOOK( entry, get_settings ) ) {
+		BAutolock hookLock( entry->hook_lock );
+		bigtime_t start = system_time();
+		status = entry->ext->get_settings( entry->cookie, fetch[0], fetch[1],
+											fetch[2] );
+		count_hook( entry, SCAN_HOOK_GET_SETTINGS, start, status );
+		if( status != B_OK ) {
+			if( gDebug )
+				printf( "%s: get_settings hook failed: %ld\n", dbgname, status );
+			for( int32 i = 0; i < 3; i++ )
+				if( fetch[i] )
+					entry->cache_valid[i] = 0;
+			return status;
+		}
+		for( int32 i = 0; i < 3; i++ )
+			if( fetch[i] )
+				entry->cache_valid[i] = kCachedSettings;
+	}
+	
+	for( int32 i = 0; i < 3; i++ ) {
+		if( ! want[i] )
+			continue;
+		status = get_settings( entry, i + 1, want[i] );
+		if( status != B_OK )
+			return status;
+	}
+	
+	return B_OK;
+}
+
+/*	Fill in settings of the given kind, asking the add-on for just the
+	fields that aren't cached. */
+static status_t get_settings( scanner_entry *entry, uint32 kind,
+								scan_settings *settings )
+{
+	status_t status = B_OK;
+	scan_settings *cached = &entry->cache[kind - 1];
+	scan_value value;
+	
+	for( int32 i = 0; i < kNumSettingFields; i++ ) {
+		scan_setting_id field = kSettingFields[i];
+		if( entry->cache_valid[kind - 1] & field )
+			continue;
+		BAutolock hookLock( entry->hook_lock );
+		status = call_get_setting( entry, field, kind, &value );
+		if( status != B_OK )
+			return status;
+		set_field( cached, field, &value );
+		entry->cache_valid[kind - 1] |= field;
+	}
+	
+	*settings = *cached;
+	return B_OK;
+}
+
+/*	One setting, from the cache if we have it. Anything that isn't one of
+	the scan_settings fields (tone maps, add-on specific) always goes to the
+	add-on. */
+static status_t get_one_setting( scanner_entry *entry, scan_setting_id setting,
+								scan_setting_kind kind, scan_value *value )
+{
+	bool cacheable = ( setting & kCachedSettings ) && ! ( setting & ( setting - 1 ) )
+					&& kind >= SCAN_SETTING_CURRENT && kind <= SCAN_SETTING_MAXIMUM;
+	
+	if( cacheable && ( entry->cache_valid[kind - 1] & setting ) ) {
+		get_field( &entry->cache[kind - 1], setting, value );
+		BAutolock statsLock( entry->stats_lock );
+		entry->stats.settings_cached++;
+		return B_OK;
+	}
+	
+	status_t status;
+	{
+		BAutolock hookLock( entry->hook_lock );
+		status = call_get_setting( entry, setting, kind, value );
+	}
+	if( status != B_OK ) {
+		if( gDebug )
+			printf( "%s: get_setting hook failed: %ld, setting=%ld\n",
+				dbgname, status, setting );
 		return status;
-	settings->row_bytes = value.u_int;
+	}
 	
+	if( cacheable ) {
+		set_field( &entry->cache[kind - 1], setting, value );
+		entry->cache_valid[kind - 1] |= setting;
+	}
 	return B_OK;
 }
 
+/* Whether the tone map setting is left to the processor, because the
+	add-on doesn't do it, going by the capabilities scan_open() got. */
+static bool emulates_tonemap( scanner_entry *entry, scan_setting_id setting )
+{
+	if( setting != SCAN_SETTING_TONEMAP && setting != SCAN_SETTING_TONEMAP3 )
+		return false;
+	return ! ( entry->caps & setting );
+}
+
+/* The get_setting and put_setting hooks, counted. Hold hook_lock. */
+static status_t call_get_setting( scanner_entry *entry, scan_setting_id setting,
+								scan_setting_kind kind, scan_value *value )
+{
+	bigtime_t start = system_time();
+	status_t status = entry->hooks->get_setting( entry->cookie, setting, kind, value );
+	count_hook( entry, SCAN_HOOK_GET_SETTING, start, status );
+	return status;
+}
+
+static status_t call_put_setting( scanner_entry *entry, scan_setting_id setting,
+								scan_value *value, scan_settings_mask *mask )
+{
+	bigtime_t start = system_time();
+	status_t status = entry->hooks->put_setting( entry->cookie, setting, value, mask );
+	count_hook( entry, SCAN_HOOK_PUT_SETTING, start, status );
+	return status;
+}
+
+/*	Forget cached values after settings were written. The written ones and
+	the image size they're derived from lose their current values; the
+	ones the add-on reported as changed lose their limits too, since a new
+	value can move the limits of other settings. */
+static void invalidate_settings( scanner_entry *entry, scan_settings_mask written,
+								scan_settings_mask changed )
+{
+	if( written )
+		written |= kDerivedSettings;
+	entry->cache_valid[SCAN_SETTING_CURRENT - 1] &= ~( written | changed );
+	entry->cache_valid[SCAN_SETTING_MINIMUM - 1] &= ~changed;
+	entry->cache_valid[SCAN_SETTING_MAXIMUM - 1] &= ~changed;
+}
+
+static void get_field( const scan_settings *settings, scan_setting_id setting,
+								scan_value *value )
+{
+	switch( setting ) {
+	case SCAN_SETTING_AREA:			value->rect = settings->scan_area; break;
+	case SCAN_SETTING_IMAGETYPE:	value->type = settings->image_type; break;
+	case SCAN_SETTING_PIXELBITS:	value->u_int = settings->pixel_bits; break;
+	case SCAN_SETTING_RESOLUTION:	value->u_int = settings->resolution; break;
+	case SCAN_SETTING_BRIGHTNESS:	value->s_int = settings->brightness; break;
+	case SCAN_SETTING_CONTRAST:		value->s_int = settings->contrast; break;
+	case SCAN_SETTING_SCALING:		value->s_int = settings->scaling; break;
+	case SCAN_SETTING_WIDTH:		value->u_int = settings->pixel_width; break;
+	case SCAN_SETTING_HEIGHT:		value->u_int = settings->pixel_height; break;
+	case SCAN_SETTING_ROWBYTES:		value->u_int = settings->row_bytes; break;
+	}
+}
+
+static void set_field( scan_settings *settings, scan_setting_id setting,
+								const scan_value *value )
+{
+	switch( setting ) {
+	case SCAN_SETTING_AREA:			settings->scan_area = value->rect; break;
+	case SCAN_SETTING_IMAGETYPE:	settings->image_type = value->type; break;
+	case SCAN_SETTING_PIXELBITS:	settings->pixel_bits = value->u_int; break;
+	case SCAN_SETTING_RESOLUTION:	settings->resolution = value->u_int; break;
+	case SCAN_SETTING_BRIGHTNESS:	settings->brightness = value->s_int; break;
+	case SCAN_SETTING_CONTRAST:		settings->contrast = value->s_int; break;
+	case SCAN_SETTING_SCALING:		settings->scaling = value->s_int; break;
+	case SCAN_SETTING_WIDTH:		settings->pixel_width = value->u_int; break;
+	case SCAN_SETTING_HEIGHT:		settings->pixel_height = value->u_int; break;
+	case SCAN_SETTING_ROWBYTES:		settings->row_bytes = value->u_int; break;
+	}
+}
+
 
 static status_t put_settings( scanner_entry *entry,
 								scan_settings *settings,
@@ -730,46 +2504,68 @@ static status_t put_settings( scanner_entry *entry,
 {
 	status_t status = B_OK;
 	scan_value value;
+	scan_settings_mask changed = 0;
+	BAutolock hookLock( entry->hook_lock );
+	
+	if( HAS_EXT_HOOK( entry, put_settings ) ) {
+		bigtime_t start = system_time();
+		status = entry->ext->put_settings( entry->cookie, settings, mask );
+		count_hook( entry, SCAN_HOOK_PUT_SETTINGS, start, status );
+		if( status != B_OK && gDebug )
+			printf( "%s: put_settings hook failed: %ld\n", dbgname, status );
+		return status;
+	}
+	
+	// Each put_setting call only reports its own side effects, so
+	// collect them all for the caller.
+	*mask = 0;
 	
 	value.rect = settings->scan_area;
-	status = entry->hooks->put_setting( entry->cookie,
-					SCAN_SETTING_AREA, &value, mask );
+	status = call_put_setting( entry,
+					SCAN_SETTING_AREA, &value, &changed );
+	*mask |= changed;
 	if( status != B_OK )
 		return status;
 	
 	value.type = settings->image_type;
-	status = entry->hooks->put_setting( entry->cookie,
-					SCAN_SETTING_IMAGETYPE, &value, mask );
+	status = call_put_setting( entry,
+					SCAN_SETTING_IMAGETYPE, &value, &changed );
+	*mask |= changed;
 	if( status != B_OK )
 		return status;
 	
 	value.u_int = settings->pixel_bits;
-	status = entry->hooks->put_setting( entry->cookie,
-					SCAN_SETTING_PIXELBITS, &value, mask );
+	status = call_put_setting( entry,
+					SCAN_SETTING_PIXELBITS, &value, &changed );
+	*mask |= changed;
 	if( status != B_OK )
 		return status;
 	
 	value.s_int = settings->resolution;
-	status = entry->hooks->put_setting( entry->cookie,
-					SCAN_SETTING_RESOLUTION, &value, mask );
+	status = call_put_setting( entry,
+					SCAN_SETTING_RESOLUTION, &value, &changed );
+	*mask |= changed;
 	if( status != B_OK )
 		return status;
 	
 	value.s_int = settings->brightness;
-	status = entry->hooks->put_setting( entry->cookie,
-					SCAN_SETTING_BRIGHTNESS, &value, mask );
+	status = call_put_setting( entry,
+					SCAN_SETTING_BRIGHTNESS, &value, &changed );
+	*mask |= changed;
 	if( status != B_OK )
 		return status;
 	
 	value.s_int = settings->contrast;	
-	status = entry->hooks->put_setting( entry->cookie,
-					SCAN_SETTING_CONTRAST, &value, mask );
+	status = call_put_setting( entry,
+					SCAN_SETTING_CONTRAST, &value, &changed );
+	*mask |= changed;
 	if( status != B_OK )
 		return status;
 	
 	value.s_int = settings->scaling;	
-	status = entry->hooks->put_setting( entry->cookie,
-					SCAN_SETTING_SCALING, &value, mask );
+	status = call_put_setting( entry,
+					SCAN_SETTING_SCALING, &value, &changed );
+	*mask |= changed;
 	if( status != B_OK )
 		return status;
 		
@@ -816,10 +2612,9 @@ static status_t get_addon_dir( BDirectory *dir )
 	size_t size;
 	void *rezStr = rez.FindResource( kStringType, kSubdirNameID,
 										&size );
-	if( ! rezStr )
-		return B_RESOURCE_NOT_FOUND;
-	
-	status = path.Append( (char *) rezStr, true );
+									// built without resources (the
+									// headless bench), use the default
+	status = path.Append( rezStr ? (char *) rezStr : kDefaultAddonSubdir, true );
 	if( status != B_OK )
 		goto errXit;
 	
@@ -885,8 +2680,315 @@ static status_t get_addon_info( const BEntry &entry, CallbackInfo &info )
 }
 
 
+/*	Brings the catalog up to date with the add-on directory. The directory
+	is only listed again if its modification time has changed, or if it
+	was last listed in the second it changed, which could have hidden
+	another change. The files are looked at when it is, or if files is
+	set, for ones replaced without the directory changing. New and changed
+	files are read in parallel. What came and went is added to changes. */
+static status_t refresh_catalog( BList *changes, bool files )
+{
+	BAutolock lock( gCatalogLocker );
+	if( ! gCatalogDir[0] ) {
+		BDirectory dir;
+		BEntry dirEntry;
+		BPath path;
+		status_t status = get_addon_dir( &dir );
+		if( status == B_OK )
+			status = dir.GetEntry( &dirEntry );
+		if( status == B_OK )
+			status = dirEntry.GetPath( &path );
+		if( status != B_OK )
+			return status;
+		strcpy( gCatalogDir, path.Path() );
+	}
+	BEntry dirEntry( gCatalogDir );
+	time_t dirTime;
+	status_t status = dirEntry.GetModificationTime( &dirTime );
+	if( status != B_OK )
+		return status;
+	
+	bool relist = ( dirTime != gCatalogDirTime || gCatalogListed <= dirTime );
+	if( ! relist && ! files )
+		return B_OK;
+	if( relist ) {
+		BDirectory dir( gCatalogDir );
+		BList listed;
+		BEntry entry;
+		while( dir.GetNextEntry( &entry ) == B_OK ) {
+			if( entry.IsSymLink() ) {	// resolve sym-link
+				entry_ref ref;
+				if( entry.GetRef( &ref ) != B_OK || entry.SetTo( &ref, true ) != B_OK )
+					continue;
+			}
+			BPath path;
+			if( ! entry.IsFile() || entry.GetPath( &path ) != B_OK )
+				continue;
+			catalog_entry *e = take_catalog_entry( path.Path() );
+			if( ! e ) {
+				e = new catalog_entry;
+				e->info.path = new char[ strlen( path.Path() ) + 1 ];
+				strcpy( e->info.path, path.Path() );
+				e->info.flags = 0;
+				e->info.info[0] = 0;
+				e->mtime = -1;
+				e->size = -1;
+				e->addon = false;
+			}
+			listed.AddItem( e );
+		}
+									// what's left has gone
+		for( int32 i = 0; i < gCatalog.CountItems(); i++ ) {
+			catalog_entry *e = (catalog_entry *) gCatalog.ItemAt( i );
+			if( e->addon )
+				add_change( changes, SCAN_ADDON_REMOVED, &e->info );
+			delete[] e->info.path;
+			delete e;
+		}
+		gCatalog.MakeEmpty();
+		gCatalog.AddList( &listed );
+		gCatalogDirTime = dirTime;
+		gCatalogListed = time( NULL );
+	}
+	
+	BList fresh;
+	for( int32 i = gCatalog.CountItems() - 1; i >= 0; i-- ) {
+		catalog_entry *e = (catalog_entry *) gCatalog.ItemAt( i );
+		int64 mtime, size;
+		if( stat_addon( e->info.path, &mtime, &size ) != B_OK ) {
+									// a link whose file has gone
+			if( e->addon )
+				add_change( changes, SCAN_ADDON_REMOVED, &e->info );
+			gCatalog.RemoveItem( i );
+			delete[] e->info.path;
+			delete e;
+			continue;
+		}
+		if( mtime == e->mtime && size == e->size )
+			continue;
+		e->mtime = mtime;
+		e->size = size;
+		e->was_addon = e->addon;
+		fresh.AddItem( e );
+	}
+	read_catalog( &fresh );
+	
+	for( int32 i = fresh.CountItems() - 1; i >= 0; i-- ) {
+		catalog_entry *e = (catalog_entry *) fresh.ItemAt( i );
+		if( e->addon && e->was_addon )
+			add_change( changes, SCAN_ADDON_CHANGED, &e->info );
+		else if( e->addon )
+			add_change( changes, SCAN_ADDON_ADDED, &e->info );
+		else if( e->was_addon )
+			add_change( changes, SCAN_ADDON_REMOVED, &e->info );
+	}
+	return B_OK;
+}
+
+/*	Calls callback for each add-on in the catalog as it stands, on a copy
+	so the callback can take as long as it likes. */
+static status_t walk_catalog( ScanAddonProc callback, void *data )
+{
+	status_t status = B_OK;
+	int32 count = 0;
+	size_t pathSize = 0;
+	CallbackInfo *infos;
+	char *paths;
+	{
+		BAutolock lock( gCatalogLocker );
+		for( int32 i = 0; i < gCatalog.CountItems(); i++ ) {
+			catalog_entry *e = (catalog_entry *) gCatalog.ItemAt( i );
+			if( e->addon ) {
+				count++;
+				pathSize += strlen( e->info.path ) + 1;
+			}
+		}
+		infos = new CallbackInfo[ count + 1 ];
+		paths = new char[ pathSize + 1 ];
+		char *dest = paths;
+		CallbackInfo *info = infos;
+		for( int32 i = 0; i < gCatalog.CountItems(); i++ ) {
+			catalog_entry *e = (catalog_entry *) gCatalog.ItemAt( i );
+			if( ! e->addon )
+				continue;
+			*info = e->info;
+			info->path = dest;
+			strcpy( dest, e->info.path );
+			dest += strlen( dest ) + 1;
+			info++;
+		}
+	}
+	
+	for( int32 i = 0; i < count && status == B_OK; i++ )
+		status = callback( &infos[i], data );
+	delete[] infos;
+	delete[] paths;
+	return status;
+}
+
+/* Takes the entry for path out of the catalog, if it's there. */
+static catalog_entry* take_catalog_entry( const char *path )
+{
+	for( int32 i = 0; i < gCatalog.CountItems(); i++ ) {
+		catalog_entry *e = (catalog_entry *) gCatalog.ItemAt( i );
+		if( strcmp( e->info.path, path ) == 0 ) {
+			gCatalog.RemoveItem( i );
+			return e;
+		}
+	}
+	return NULL;
+}
+
+/*	Reads the entries on up to kCatalogReaders threads, this one included,
+	but no more than there are CPUs, so the opens and attribute reads of
+	one file overlap the next's. */
+static void read_catalog( BList *entries )
+{
+	int32 count = entries->CountItems();
+	if( count == 0 )
+		return;
+	catalog_read read;
+	read.entries = entries;
+	read.next = 0;
+	thread_id readers[kCatalogReaders];
+	int32 spawned = 0;
+	int32 threads = ( count + kCatalogPerReader - 1 ) / kCatalogPerReader;
+	if( threads > kCatalogReaders )
+		threads = kCatalogReaders;
+	system_info info;
+	int32 cpus = get_system_info( &info ) == B_OK ? info.cpu_count : 1;
+	if( threads > cpus )
+		threads = cpus;
+	for( int32 i = 1; i < threads; i++ ) {
+		readers[spawned] = spawn_thread( catalog_reader, "scan add-on reader",
+										B_NORMAL_PRIORITY, &read );
+		if( readers[spawned] < B_OK )
+			break;
+		resume_thread( readers[spawned++] );
+	}
+	catalog_reader( &read );
+	for( int32 i = 0; i < spawned; i++ ) {
+		status_t exitValue;
+		wait_for_thread( readers[i], &exitValue );
+	}
+}
+
+static status_t catalog_reader( void *data )
+{
+	catalog_read *read = (catalog_read *) data;
+	for( ;; ) {
+		int32 i = atomic_add( &read->next, 1 );
+		if( i >= read->entries->CountItems() )
+			break;
+		read_catalog_entry( (catalog_entry *) read->entries->ItemAt( i ) );
+	}
+	return B_OK;
+}
+
+/* Checks the file's type, and reads its flags and info if it's an add-on. */
+static void read_catalog_entry( catalog_entry *e )
+{
+	e->addon = false;
+	e->info.flags = 0;
+	e->info.info[0] = 0;
+	BNode node( e->info.path );
+	char buf[256];
+	ssize_t len = node.ReadAttr( kTypeAttr, 0, 0, buf, 255 );
+	if( len <= 0 )
+		return;
+	buf[len] = 0;
+	if( strcmp( buf, kAddonMimeType ) )
+		return;
+	
+	BEntry entry( e->info.path );
+	CallbackInfo info;
+	if( get_addon_info( entry, info ) == B_OK ) {
+		e->info.flags = info.flags;
+		strcpy( e->info.info, info.info );
+		e->addon = true;
+	}
+	delete[] info.path;
+}
+
+static void add_change( BList *changes, scan_addon_change change,
+						const CallbackInfo *info )
+{
+	catalog_change *c = new catalog_change;
+	c->change = change;
+	c->info = *info;
+	c->info.path = new char[ strlen( info->path ) + 1 ];
+	strcpy( c->info.path, info->path );
+	changes->AddItem( c );
+}
+
+/*	Tells the watchers about changes, and frees them. The callbacks are
+	made on a copy of the list, without gWatchLocker, so they can call
+	libscanbe or wait on threads that do. A watcher taken off meanwhile
+	isn't called again, and the last call through it deletes it. */
+static void notify_watchers( BList *changes )
+{
+	if( changes->IsEmpty() )
+		return;
+	BList watchers;
+	{
+		BAutolock lock( gWatchLocker );
+		watchers.AddList( &gWatchers );
+		for( int32 j = 0; j < watchers.CountItems(); j++ )
+			( (addon_watcher *) watchers.ItemAt( j ) )->calls++;
+	}
+	for( int32 i = 0; i < changes->CountItems(); i++ ) {
+		catalog_change *c = (catalog_change *) changes->ItemAt( i );
+		for( int32 j = 0; j < watchers.CountItems(); j++ ) {
+			addon_watcher *w = (addon_watcher *) watchers.ItemAt( j );
+			gWatchLocker.Lock();
+			bool removed = w->removed;
+			gWatchLocker.Unlock();
+			if( ! removed )
+				w->callback( c->change, &c->info, w->data );
+		}
+	}
+	{
+		BAutolock lock( gWatchLocker );
+		for( int32 j = 0; j < watchers.CountItems(); j++ ) {
+			addon_watcher *w = (addon_watcher *) watchers.ItemAt( j );
+			if( --w->calls == 0 && w->removed )
+				delete w;
+		}
+	}
+
+	for( int32 i = 0; i < changes->CountItems(); i++ ) {
+		catalog_change *c = (catalog_change *) changes->ItemAt( i );
+		delete[] c->info.path;
+		delete c;
+	}
+	changes->MakeEmpty();
+}
+
+/*	Looks for changes until scan_unwatch_addons() deletes the semaphore.
+	There's no node monitor without a looper to send it to, and
+	libscanbe runs in apps that might not have one, so it polls; with
+	nothing changed that's a stat of the directory and of each file.
+	It's the only thing that notices a file replaced in place, so
+	scan_get_addons() can go by the directory alone. */
+static status_t watch_thread( void * )
+{
+	sem_id quit;
+	{
+		BAutolock lock( gWatchLocker );
+		quit = gWatchQuit;
+	}
+	while( acquire_sem_etc( quit, 1, B_RELATIVE_TIMEOUT, kWatchInterval ) == B_TIMED_OUT ) {
+		BList changes;
+		refresh_catalog( &changes, true );
+		notify_watchers( &changes );
+	}
+	return B_OK;
+}
+
+
 bool libscanbe_get_scanner( char *name )
 {
+	BAutolock lock( gIndexLocker );
 	if( gPrefs.InitCheck() || gSettings.InitCheck() )
 		return false;
 	uint32 type;
@@ -903,6 +3005,7 @@ bool libscanbe_get_scanner( char *name )
 
 bool libscanbe_save_scanner( const char *name )
 {
+	BAutolock lock( gIndexLocker );
 	if( gPrefs.InitCheck() || gSettings.InitCheck() )
 		return false;
 	status_t status = gSettings.SetData( kPrefScannerName,